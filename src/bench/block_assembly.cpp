@@ -0,0 +1,206 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#include "bench.h"
+#include "block_index_store.h"
+#include "chainparams.h"
+#include "config.h"
+#include "mining/journal.h"
+#include "mining/journal_builder.h"
+#include "mining/journal_change_set.h"
+#include "mining/journaling_block_assembler.h"
+#include "policy/policy.h"
+#include "random.h"
+#include "txmempool.h"
+#include "util.h"
+#include "validation.h"
+
+#include <iostream>
+
+#define LOGSTATS(x) // x
+
+namespace
+{
+    mining::CJournalChangeSetPtr nullChangeSet {nullptr};
+
+    // Pad transactions to a typical size
+    constexpr size_t TX_PADDING {200};
+
+    // Shape of a synthetic mempool
+    struct MempoolShape
+    {
+        // Number of transactions
+        size_t txns {0};
+        // Transactions are arranged in chains of this many, each spending the previous one
+        size_t chainLength {1};
+        // Chains are split into CPFP groups of this many transactions, only the
+        // last transaction of a group pays, for the whole group
+        size_t groupSize {1};
+    };
+
+    std::vector<CTxMemPoolEntry> MakeEntries(const MempoolShape& shape)
+    {
+        const CFeeRate payingFeeRate { 2 * DEFAULT_BLOCK_MIN_TX_FEE };
+
+        std::vector<CTxMemPoolEntry> entries {};
+        entries.reserve(shape.txns);
+        CTransactionRef prev {};
+        size_t unpaidSize {0};
+        for(size_t i = 0; i < shape.txns; ++i)
+        {
+            const size_t chainPos { i % shape.chainLength };
+
+            CMutableTransaction tx {};
+            tx.vin.resize(1);
+            tx.vin[0].prevout = chainPos == 0 ? COutPoint{GetRandHash(), 0} : COutPoint{prev->GetId(), 0};
+            tx.vin[0].scriptSig = CScript() << std::vector<uint8_t>(TX_PADDING);
+            tx.vout.resize(1);
+            tx.vout[0].nValue = COIN;
+            tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+            CTransactionRef txn { MakeTransactionRef(std::move(tx)) };
+
+            unpaidSize += txn->GetTotalSize();
+            Amount fee {0};
+            if(chainPos % shape.groupSize == shape.groupSize - 1 || chainPos == shape.chainLength - 1 || i == shape.txns - 1)
+            {
+                fee = payingFeeRate.GetFee(unpaidSize);
+                unpaidSize = 0;
+            }
+
+            entries.emplace_back(txn, fee, 0, 1, false, LockPoints{});
+            prev = txn;
+        }
+        return entries;
+    }
+
+    void FillMempool(CTxMemPool& pool, const std::vector<CTxMemPoolEntry>& entries)
+    {
+        for(const auto& entry : entries)
+        {
+            pool.AddUnchecked(entry.GetSharedTx()->GetId(), entry, TxStorage::memory, nullChangeSet);
+        }
+    }
+
+    // The assembler builds on the active chain, a tip is all it needs
+    void SetupChainTip()
+    {
+        SelectParams(CBaseChainParams::REGTEST);
+        ConfigInit& config { GlobalConfig::GetModifiableGlobalConfig() };
+        config.SetDefaultBlockSizeParams(Params().GetDefaultBlockSizeParams());
+
+        LOCK(cs_main);
+        chainActive.SetTip(mapBlockIndex.Insert(Params().GenesisBlock()));
+    }
+
+    const CScript scriptPubKey { CScript() << OP_TRUE };
+}
+
+// Build a complete template from a populated mempool with a new assembler
+static void AssembleTemplate(benchmark::State& state, const MempoolShape& shape)
+{
+    SetupChainTip();
+    mempool.Clear();
+    FillMempool(mempool, MakeEntries(shape));
+    LOGSTATS(std::cout << "Mempool memory (bytes): " << mempool.DynamicMemoryUsage() << std::endl);
+
+    gArgs.ForceSetArg("-jbafillafternewblock", "1");
+    while(state.KeepRunning())
+    {
+        mining::JournalingBlockAssembler assembler { GlobalConfig::GetConfig() };
+        CBlockIndex* pindexPrev {nullptr};
+        auto blockTemplate { assembler.CreateNewBlock(scriptPubKey, pindexPrev) };
+        assert(blockTemplate->GetBlockRef()->vtx.size() > 1);
+        LOGSTATS(std::cout << "Template transactions: " << blockTemplate->GetBlockRef()->vtx.size() << std::endl);
+    }
+    gArgs.ClearArg("-jbafillafternewblock");
+
+    mempool.Clear();
+}
+
+static void JournalingAssemblerIndependentTxns(benchmark::State& state)
+{
+    AssembleTemplate(state, {10000, 1, 1});
+}
+
+static void JournalingAssemblerChainedTxns(benchmark::State& state)
+{
+    AssembleTemplate(state, {10000, 25, 1});
+}
+
+static void JournalingAssemblerCPFPGroups(benchmark::State& state)
+{
+    AssembleTemplate(state, {10000, 25, 5});
+}
+
+// Process a single time slot of transactions, as the assembler does periodically
+static void JournalingAssemblerSlot(benchmark::State& state)
+{
+    constexpr size_t SLOT_TXNS {1000};
+
+    SetupChainTip();
+    mempool.Clear();
+    FillMempool(mempool, MakeEntries({10 * SLOT_TXNS, 25, 5}));
+
+    gArgs.ForceSetArg("-jbamaxtxnbatch", std::to_string(SLOT_TXNS));
+    while(state.KeepRunning())
+    {
+        mining::JournalingBlockAssembler assembler { GlobalConfig::GetConfig() };
+        CBlockIndex* pindexPrev {nullptr};
+        auto blockTemplate { assembler.CreateNewBlock(scriptPubKey, pindexPrev) };
+        assert(blockTemplate->GetBlockRef()->vtx.size() > 1);
+    }
+    gArgs.ClearArg("-jbamaxtxnbatch");
+
+    mempool.Clear();
+}
+
+// Add a block worth of transactions to a journal, then remove half of them as if they were mined
+static void JournalBuilderChangeSets(benchmark::State& state)
+{
+    std::vector<mining::CJournalEntry> entries {};
+    for(const auto& entry : MakeEntries({10000, 1, 1}))
+    {
+        entries.emplace_back(entry);
+    }
+
+    while(state.KeepRunning())
+    {
+        mining::CJournalBuilder builder {};
+        auto changeSet { builder.getNewChangeSet(mining::JournalUpdateReason::NEW_TXN) };
+        for(const auto& entry : entries)
+        {
+            changeSet->addOperation(mining::CJournalChangeSet::Operation::ADD, entry);
+        }
+        changeSet->apply();
+
+        changeSet = builder.getNewChangeSet(mining::JournalUpdateReason::NEW_BLOCK);
+        for(size_t i = 0; i < entries.size(); i += 2)
+        {
+            changeSet->addOperation(mining::CJournalChangeSet::Operation::REMOVE, entries[i]);
+        }
+        changeSet->apply();
+        LOGSTATS(std::cout << "Journal size: " << builder.getCurrentJournal()->size() << std::endl);
+    }
+}
+
+// Accept chains of transactions that form CPFP groups into the mempool
+static void MempoolCPFPGroupForming(benchmark::State& state)
+{
+    const std::vector<CTxMemPoolEntry> entries { MakeEntries({5000, 25, 5}) };
+
+    while(state.KeepRunning())
+    {
+        CTxMemPool pool {};
+        FillMempool(pool, entries);
+        LOGSTATS(std::cout << "Mempool memory (bytes): " << pool.DynamicMemoryUsage() << std::endl);
+    }
+}
+
+BENCHMARK(JournalingAssemblerIndependentTxns);
+BENCHMARK(JournalingAssemblerChainedTxns);
+BENCHMARK(JournalingAssemblerCPFPGroups);
+BENCHMARK(JournalingAssemblerSlot);
+BENCHMARK(JournalBuilderChangeSets);
+BENCHMARK(MempoolCPFPGroupForming);
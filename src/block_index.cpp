@@ -9,6 +9,7 @@
 #include "block_file_access.h"
 #include "async_file_reader.h"
 #include "blockfileinfostore.h"
+#include "file_region_stream.h"
 #include "blockstreams.h"
 #include "config.h"
 #include "clientversion.h"
@@ -384,6 +385,16 @@ auto CBlockIndex::StreamBlockFromDisk(
     // We expect that block data on disk is in same format as data sent over the
     // network. If this would change in the future then CBlockStream would need
     // to be used to change the resulting fromat.
+#ifdef USE_SENDFILE
+    // Where we can, let the kernel send the data straight from the file
+    return
+        {
+            std::make_unique<CFileRegionStream>(
+                std::move(file),
+                mDiskBlockMetaData.diskDataSize),
+            mDiskBlockMetaData
+        };
+#else
     return
         {
             std::make_unique<CFixedSizeStream<CAsyncFileReader>>(
@@ -391,6 +402,7 @@ auto CBlockIndex::StreamBlockFromDisk(
                 CAsyncFileReader{std::move(file)}),
             mDiskBlockMetaData
         };
+#endif
 }
 
 std::unique_ptr<CForwardReadonlyStream> CBlockIndex::StreamSyncBlockFromDisk() const
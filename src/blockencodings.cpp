@@ -9,13 +9,60 @@
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
 #include "hash.h"
+#include "parallel_batches.h"
 #include "random.h"
 #include "streams.h"
 #include "txmempool.h"
 #include "validation.h"
 
+#include <atomic>
 #include <unordered_map>
 
+namespace
+{
+    // Minimal number of mempool transactions scanned by one batch in
+    // PartiallyDownloadedBlock::InitData. Smaller mempools are scanned on the
+    // calling thread.
+    constexpr size_t MEMPOOL_SCAN_MIN_BATCH_SIZE = 0x4000;
+
+    // Mempool transactions matching a short ID, and the block position of that ID
+    using ShortIdMatches = std::vector<std::pair<uint32_t, CTransactionRef>>;
+
+    // Short IDs are keyed per compact block, so there's no index we could keep
+    // for them. Instead, scan a flat snapshot of the mempool, splitting it into
+    // contiguous batches that are hashed in parallel. Matches are returned in
+    // snapshot order.
+    ShortIdMatches FindShortIdMatches(
+        const CBlockHeaderAndShortTxIDs& cmpctblock,
+        const std::unordered_map<uint64_t, uint32_t>& shorttxids,
+        const std::vector<CTransactionRef>& txns)
+    {
+        // Though ideally we'd scan everything for the two-txn-match-shortid
+        // case, the performance win of an early exit is too good to pass up
+        // and worth the extra risk.
+        std::atomic<size_t> numMatches {0};
+        auto scan = [&](size_t begin, size_t end) {
+            ShortIdMatches matches;
+            for (size_t i = begin; i < end && numMatches.load(std::memory_order_relaxed) < shorttxids.size(); ++i) {
+                const auto idit = shorttxids.find(cmpctblock.GetShortID(txns[i]->GetHash()));
+                if (idit != shorttxids.end()) {
+                    matches.emplace_back(idit->second, txns[i]);
+                    numMatches.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            return matches;
+        };
+
+        ShortIdMatches matches;
+        for (auto& batchMatches : ProcessBatchesInParallel<ShortIdMatches>(txns.size(), MEMPOOL_SCAN_MIN_BATCH_SIZE, scan)) {
+            matches.insert(matches.end(),
+                std::make_move_iterator(batchMatches.begin()),
+                std::make_move_iterator(batchMatches.end()));
+        }
+        return matches;
+    }
+}
+
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock &block)
     : nonce(GetRand(std::numeric_limits<uint64_t>::max())),
       shorttxids(block.vtx.size() - 1), prefilledtxn(1), header(block) {
@@ -158,31 +205,19 @@ ReadStatus PartiallyDownloadedBlock::InitData(
     }
 
     std::vector<bool> have_txn(txns_available.size());
-    {
-        for (const auto& tx : pool->GetTransactions()) {
-            const auto shortid = cmpctblock.GetShortID(tx->GetHash());
-            const auto idit = shorttxids.find(shortid);
-            if (idit != shorttxids.end()) {
-                if (!have_txn[idit->second]) {
-                    txns_available[idit->second] = tx;
-                    have_txn[idit->second] = true;
-                    mempool_count++;
-                } else {
-                    // If we find two mempool txn that match the short id, just
-                    // request it. This should be rare enough that the extra
-                    // bandwidth doesn't matter, but eating a round-trip due to
-                    // FillBlock failure would be annoying.
-                    if (txns_available[idit->second]) {
-                        txns_available[idit->second].reset();
-                        mempool_count--;
-                    }
-                }
-            }
-            // Though ideally we'd continue scanning for the
-            // two-txn-match-shortid case, the performance win of an early exit
-            // here is too good to pass up and worth the extra risk.
-            if (mempool_count == shorttxids.size()) {
-                break;
+    for (auto& [index, tx] : FindShortIdMatches(cmpctblock, shorttxids, pool->GetTransactions())) {
+        if (!have_txn[index]) {
+            txns_available[index] = std::move(tx);
+            have_txn[index] = true;
+            mempool_count++;
+        } else {
+            // If we find two mempool txn that match the short id, just
+            // request it. This should be rare enough that the extra
+            // bandwidth doesn't matter, but eating a round-trip due to
+            // FillBlock failure would be annoying.
+            if (txns_available[index]) {
+                txns_available[index].reset();
+                mempool_count--;
             }
         }
     }
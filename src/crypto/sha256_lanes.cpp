@@ -0,0 +1,131 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/sha256_lanes.h"
+#include "crypto/common.h"
+
+namespace sha256_lanes {
+
+namespace {
+    const uint32_t K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+        0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+        0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+        0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+        0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+        0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+        0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+        0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+        0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+    inline uint32_t Ch(uint32_t x, uint32_t y, uint32_t z) {
+        return z ^ (x & (y ^ z));
+    }
+    inline uint32_t Maj(uint32_t x, uint32_t y, uint32_t z) {
+        return (x & y) | (z & (x | y));
+    }
+    inline uint32_t Sigma0(uint32_t x) {
+        return (x >> 2 | x << 30) ^ (x >> 13 | x << 19) ^ (x >> 22 | x << 10);
+    }
+    inline uint32_t Sigma1(uint32_t x) {
+        return (x >> 6 | x << 26) ^ (x >> 11 | x << 21) ^ (x >> 25 | x << 7);
+    }
+    inline uint32_t sigma0(uint32_t x) {
+        return (x >> 7 | x << 25) ^ (x >> 18 | x << 14) ^ (x >> 3);
+    }
+    inline uint32_t sigma1(uint32_t x) {
+        return (x >> 17 | x << 15) ^ (x >> 19 | x << 13) ^ (x >> 10);
+    }
+} // anonymous namespace
+
+void Initialize(uint32_t state[8]) {
+    state[0] = 0x6a09e667ul;
+    state[1] = 0xbb67ae85ul;
+    state[2] = 0x3c6ef372ul;
+    state[3] = 0xa54ff53aul;
+    state[4] = 0x510e527ful;
+    state[5] = 0x9b05688cul;
+    state[6] = 0x1f83d9abul;
+    state[7] = 0x5be0cd19ul;
+}
+
+void Transform(uint32_t state[8], const unsigned char block[64]) {
+    // Run the same block in every lane, this is not meant to be fast.
+    uint32_t s[8][LANES];
+    uint32_t w[16][LANES];
+    for (size_t i = 0; i < 8; ++i) {
+        for (size_t l = 0; l < LANES; ++l) {
+            s[i][l] = state[i];
+        }
+    }
+    for (size_t i = 0; i < 16; ++i) {
+        const uint32_t word = ReadBE32(block + 4 * i);
+        for (size_t l = 0; l < LANES; ++l) {
+            w[i][l] = word;
+        }
+    }
+    TransformLanes(s, w);
+    for (size_t i = 0; i < 8; ++i) {
+        state[i] = s[i][0];
+    }
+}
+
+void TransformLanes(uint32_t state[8][LANES], const uint32_t block[16][LANES]) {
+    uint32_t w[64][LANES];
+    for (size_t i = 0; i < 16; ++i) {
+        for (size_t l = 0; l < LANES; ++l) {
+            w[i][l] = block[i][l];
+        }
+    }
+    for (size_t i = 16; i < 64; ++i) {
+        for (size_t l = 0; l < LANES; ++l) {
+            w[i][l] = sigma1(w[i - 2][l]) + w[i - 7][l] +
+                      sigma0(w[i - 15][l]) + w[i - 16][l];
+        }
+    }
+
+    uint32_t a[LANES], b[LANES], c[LANES], d[LANES];
+    uint32_t e[LANES], f[LANES], g[LANES], h[LANES];
+    for (size_t l = 0; l < LANES; ++l) {
+        a[l] = state[0][l];
+        b[l] = state[1][l];
+        c[l] = state[2][l];
+        d[l] = state[3][l];
+        e[l] = state[4][l];
+        f[l] = state[5][l];
+        g[l] = state[6][l];
+        h[l] = state[7][l];
+    }
+
+    for (size_t i = 0; i < 64; ++i) {
+        for (size_t l = 0; l < LANES; ++l) {
+            const uint32_t t1 =
+                h[l] + Sigma1(e[l]) + Ch(e[l], f[l], g[l]) + K[i] + w[i][l];
+            const uint32_t t2 = Sigma0(a[l]) + Maj(a[l], b[l], c[l]);
+            h[l] = g[l];
+            g[l] = f[l];
+            f[l] = e[l];
+            e[l] = d[l] + t1;
+            d[l] = c[l];
+            c[l] = b[l];
+            b[l] = a[l];
+            a[l] = t1 + t2;
+        }
+    }
+
+    for (size_t l = 0; l < LANES; ++l) {
+        state[0][l] += a[l];
+        state[1][l] += b[l];
+        state[2][l] += c[l];
+        state[3][l] += d[l];
+        state[4][l] += e[l];
+        state[5][l] += f[l];
+        state[6][l] += g[l];
+        state[7][l] += h[l];
+    }
+}
+
+} // namespace sha256_lanes
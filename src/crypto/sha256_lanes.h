@@ -0,0 +1,38 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_SHA256_LANES_H
+#define BITCOIN_CRYPTO_SHA256_LANES_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * SHA-256 compression of several independent messages at once.
+ *
+ * The state and the message words are stored word by word with one column
+ * per lane (structure of arrays), so every step of the compression is a loop
+ * over the lanes that the compiler can turn into vector instructions. This is
+ * meant for brute force searches like mining, where many messages that differ
+ * only in a few words are hashed from the same midstate.
+ */
+namespace sha256_lanes {
+
+static constexpr size_t LANES = 8;
+
+/** Set the state to the SHA-256 initial value. */
+void Initialize(uint32_t state[8]);
+
+/** Compress one 64-byte block into a single state. */
+void Transform(uint32_t state[8], const unsigned char block[64]);
+
+/**
+ * Compress one block into each of LANES states. Word i of the state or of
+ * the (already decoded, big-endian) message block of lane l is at [i][l].
+ */
+void TransformLanes(uint32_t state[8][LANES], const uint32_t block[16][LANES]);
+
+} // namespace sha256_lanes
+
+#endif // BITCOIN_CRYPTO_SHA256_LANES_H
@@ -0,0 +1,79 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#include <file_region_stream.h>
+
+#include <cassert>
+#include <ios>
+
+#ifdef USE_SENDFILE
+#include <sys/sendfile.h>
+#endif
+
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+CFileRegionStream::CFileRegionStream(UniqueCFile file, size_t size)
+: mFile{std::move(file)}, mSize{size}
+{
+    assert(mFile);
+    mFileId = fileno(mFile.get());
+    assert(mFileId != -1);
+    mOffset = ftell(mFile.get());
+    assert(mOffset >= 0);
+}
+
+CSpan CFileRegionStream::ReadAsync(size_t maxSize)
+{
+    size_t toRead { std::min(mSize - mConsumed, maxSize) };
+    if(toRead == 0)
+    {
+        return {};
+    }
+
+    mBuffer.resize(toRead);
+#ifdef WIN32
+    // No pread, but nothing else moves the position of our file
+    size_t numBytes { fread(mBuffer.data(), 1, toRead, mFile.get()) };
+    if(numBytes != toRead)
+#else
+    ssize_t numBytes { pread(mFileId, mBuffer.data(), toRead, mOffset + static_cast<off_t>(mConsumed)) };
+    if(numBytes <= 0)
+#endif
+    {
+        throw std::ios_base::failure("CFileRegionStream::ReadAsync: read failed");
+    }
+
+    mConsumed += static_cast<size_t>(numBytes);
+    return { mBuffer.data(), static_cast<size_t>(numBytes) };
+}
+
+#ifdef USE_SENDFILE
+ssize_t CFileRegionStream::SendTo(SOCKET socket, size_t maxSize)
+{
+    size_t toSend { std::min(mSize - mConsumed, maxSize) };
+    if(toSend == 0)
+    {
+        return 0;
+    }
+
+    // Sendfile updates the offset for us, but keep our own count so we
+    // can mix it freely with ReadAsync
+    off_t offset { mOffset + static_cast<off_t>(mConsumed) };
+    ssize_t numBytes { sendfile(socket, mFileId, &offset, toSend) };
+    if(numBytes > 0)
+    {
+        mConsumed += static_cast<size_t>(numBytes);
+    }
+    else if(numBytes == 0)
+    {
+        // File is shorter than we were told
+        throw std::ios_base::failure("CFileRegionStream::SendTo: unexpected end of file");
+    }
+
+    return numBytes;
+}
+#endif
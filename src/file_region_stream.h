@@ -0,0 +1,57 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#pragma once
+
+#include <cfile_util.h>
+#include <compat.h>
+#include <streams.h>
+
+#include <vector>
+
+#if defined(__linux__)
+#define USE_SENDFILE
+#endif
+
+/**
+ * Stream over a region of an open file, that can be sent from the file
+ * straight to a socket by the kernel without the data being copied through
+ * user space.
+ *
+ * Blocks on disk are stored in the same format we send them over the network,
+ * so this is how we serve them to peers. Where the data can't be sent directly
+ * (data that needs combining with a message header, or rate limited sending)
+ * it can still be read with ReadAsync, which reads synchronously.
+ */
+class CFileRegionStream : public CForwardAsyncReadonlyStream
+{
+  public:
+    // Stream the given number of bytes from the files current position
+    CFileRegionStream(UniqueCFile file, size_t size);
+
+    bool EndOfStream() const override { return mConsumed == mSize; }
+    CSpan ReadAsync(size_t maxSize) override;
+
+#ifdef USE_SENDFILE
+    /**
+     * Send up to maxSize bytes of the remaining data directly to the socket.
+     * Returns the number of bytes sent, or -1 on error with the reason
+     * available from WSAGetLastError().
+     */
+    ssize_t SendTo(SOCKET socket, size_t maxSize);
+#endif
+
+  private:
+    UniqueCFile mFile {};
+    int mFileId {-1};
+
+    // Offset of the region in the file, and how much of it we have consumed
+    off_t mOffset {0};
+    size_t mSize {0};
+    size_t mConsumed {0};
+
+    // Buffer for ReadAsync
+    std::vector<uint8_t> mBuffer {};
+};
@@ -26,6 +26,7 @@
 #include "httpserver.h"
 #include "invalid_txn_publisher.h"
 #include "key.h"
+#include "mining/candidates.h"
 #include "mining/journaling_block_assembler.h"
 #include "net/net.h"
 #include "net/net_processing.h"
@@ -609,6 +610,12 @@ std::string HelpMessage(HelpMessageMode mode, const Config& config) {
                     "perspective of time may be influenced by peers forward or "
                     "backward by this amount. (default: %u seconds)"),
                   DEFAULT_MAX_TIME_ADJUSTMENT));
+    strUsage += HelpMessageOpt(
+        "-msghandlerthreads=<n>",
+        strprintf(_("Number of threads processing messages from peers. Each "
+                    "thread handles its own share of peers, and helps with the "
+                    "others when it has nothing to do (1 to %u, default: %u)"),
+                  MAX_MSG_HANDLER_THREADS, DEFAULT_MSG_HANDLER_THREADS));
 
     /** Multi-streaming */
     strUsage += HelpMessageOpt("-multistreams",
@@ -722,6 +729,8 @@ std::string HelpMessage(HelpMessageMode mode, const Config& config) {
                                _("Enable publish removal of transaction (txid and the reason in json format) in <address>"));
     strUsage += HelpMessageOpt("-zmqpubremovedfrommempoolblock=<address>",
                                _("Enable publish removal of transaction (txid and the reason in json format) in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubtemplatedelta=<address>",
+                               _("Enable publish block template updates (added transactions and merkle proof in json format) in <address>"));
 #endif
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
@@ -749,6 +758,12 @@ std::string HelpMessage(HelpMessageMode mode, const Config& config) {
             "-checkmempool=<n>",
             strprintf("Run checks every <n> transactions (default: %u)",
                       defaultChainParams->DefaultConsistencyChecks()));
+        strUsage += HelpMessageOpt(
+            "-mempoolmemoryaudit",
+            strprintf("Check the mempool memory usage estimates reported by "
+                      "getmempoolinfo against the actual allocations of "
+                      "copies of the mempool indexes. Slow. (default: %u)",
+                      false));
         strUsage += HelpMessageOpt(
             "-checkpoints", strprintf("Only accept block chain matching "
                                       "built-in checkpoints (default: %d)",
@@ -1061,6 +1076,12 @@ std::string HelpMessage(HelpMessageMode mode, const Config& config) {
         strprintf(_("Set the maximum number of transactions processed in a batch by the journaling block assembler "
                 "(default: %d)"), mining::JournalingBlockAssembler::DEFAULT_MAX_SLOT_TRANSACTIONS)
     );
+    strUsage += HelpMessageOpt(
+        "-jbafeebuckets",
+        strprintf(_("Have the journaling block assembler fill the block template in approximate order of fee rate, "
+                    "rather than in the order transactions were accepted, while keeping parents ahead of their "
+                    "children (default: %d)"), mining::JournalingBlockAssembler::DEFAULT_FEE_BUCKETS)
+    );
     if (showDebug) {
         strUsage += HelpMessageOpt(
             "-jbafillafternewblock",
@@ -1073,6 +1094,12 @@ std::string HelpMessage(HelpMessageMode mode, const Config& config) {
                 mining::JournalingBlockAssembler::DEFAULT_NEW_BLOCK_FILL)
         );
     }
+    strUsage += HelpMessageOpt(
+        "-maxminingcandidatesmemory=<n>",
+        strprintf(_("Keep the memory used by mining candidates below <n> megabytes, the least recently used "
+                    "candidates are dropped when it is exceeded (default: %u)"),
+            CMiningCandidateManager::DEFAULT_MAX_CANDIDATES_MEMORY)
+    );
 
     strUsage += HelpMessageGroup(_("RPC server options:"));
     strUsage += HelpMessageOpt("-server",
@@ -1765,6 +1792,7 @@ bool AppInitParameterInteraction(ConfigInit &config) {
     if (ratio != 0) {
         mempool.SetSanityCheck(1.0 / ratio);
     }
+    mempool.SetMemoryAudit(gArgs.GetBoolArg("-mempoolmemoryaudit", false));
     fCheckBlockIndex = gArgs.GetBoolArg("-checkblockindex",
                                         chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled =
@@ -3092,6 +3120,14 @@ bool AppInitMain(ConfigInit &config, boost::thread_group &threadGroup,
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
     connOptions.nMaxOutboundLimit = nMaxOutboundLimit;
 
+    int64_t nMessageHandlerThreads {
+        gArgs.GetArg("-msghandlerthreads", DEFAULT_MSG_HANDLER_THREADS) };
+    if (nMessageHandlerThreads < 1 || nMessageHandlerThreads > MAX_MSG_HANDLER_THREADS) {
+        return InitError(strprintf(
+            _("-msghandlerthreads must be between 1 and %u"), MAX_MSG_HANDLER_THREADS));
+    }
+    connOptions.nMessageHandlerThreads = static_cast<unsigned int>(nMessageHandlerThreads);
+
     if (!connman.Start(scheduler, strNodeError, connOptions)) {
         return InitError(strNodeError);
     }
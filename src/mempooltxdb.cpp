@@ -23,105 +23,86 @@ CMempoolTxDB::CMempoolTxDB(const fs::path& dbPath_, size_t nCacheSize_, bool fMe
       fMemory{fMemory_},
       wrapper{std::make_unique<CDBWrapper>(dbPath, nCacheSize, fMemory, fWipe)}
 {
-    uint64_t storedValue;
-    if (wrapper->Read(DB_DISK_USAGE, storedValue))
-    {
-        diskUsage.store(storedValue);
-    }
-    if (wrapper->Read(DB_TX_COUNT, storedValue))
-    {
-        txCount.store(storedValue);
+    // Transactions written by older versions were stored in LevelDB. They
+    // are not worth migrating, the database is only a cache of the mempool.
+    std::unique_ptr<CDBIterator> iter {wrapper->NewIterator()};
+    const auto initialKey = std::make_pair(DB_TRANSACTIONS, uint256{});
+    iter->Seek(initialKey);
+    auto key = decltype(initialKey){};
+    const bool legacy = iter->Valid() && iter->GetKey(key) && key.first == DB_TRANSACTIONS;
+    iter.reset();
+    if (legacy)
+    {
+        LogPrintf("Wiping mempool transaction database in the old format\n");
+        wrapper.reset();
+        wrapper = std::make_unique<CDBWrapper>(dbPath, nCacheSize, fMemory, true);
     }
+
+    xrefSet = wrapper->Exists(DB_MEMPOOL_XREF);
+    txlog = std::make_unique<CMempoolTxLog>(dbPath / "txlog", fMemory, fWipe || legacy);
+    UpdateUsage();
 }
 
 void CMempoolTxDB::ClearDatabase()
 {
     diskUsage.store(0);
+    logSize.store(0);
     txCount.store(0);
     dbWriteCount.store(0);
+    txlog->Clear();
     wrapper.reset();   // Release the old environment before creating a new one.
     wrapper = std::make_unique<CDBWrapper>(dbPath, nCacheSize, fMemory, true);
+    xrefSet = false;
 }
 
-bool CMempoolTxDB::AddTransactions(const std::vector<CTransactionRef>& txs)
+bool CMempoolTxDB::InvalidateXrefKey()
 {
-    const uint64_t txCountAdded = txs.size();
-    const uint64_t diskUsageAdded = [&txs]() {
-        auto accumulator = decltype(txs[0]->GetTotalSize()){0};
-        for (const auto& tx : txs)
-        {
-            accumulator += tx->GetTotalSize();
-        }
-        return accumulator;
-    }();
+    return !xrefSet || RemoveXrefKey();
+}
 
-    auto batch = CDBBatch{*wrapper};
-    for (const auto& tx : txs)
+bool CMempoolTxDB::WriteLog(const std::vector<CTransactionRef>& adds, const std::vector<TxId>& removes)
+{
+    if (!InvalidateXrefKey())
     {
-        batch.Write(std::make_pair(DB_TRANSACTIONS, tx->GetId()), tx);
+        return false;
     }
-    batch.Write(DB_DISK_USAGE, diskUsage.load() + diskUsageAdded);
-    batch.Write(DB_TX_COUNT, txCount.load() + txCountAdded);
-    batch.Erase(DB_MEMPOOL_XREF);
-
     ++dbWriteCount;
-    if (wrapper->WriteBatch(batch, true))
-    {
-        diskUsage.fetch_add(diskUsageAdded);
-        txCount.fetch_add(txCountAdded);
-        return true;
-    }
-    return false;
+    const bool success = txlog->Write(adds, removes);
+    UpdateUsage();
+    return success;
+}
+
+void CMempoolTxDB::UpdateUsage()
+{
+    diskUsage.store(txlog->GetLiveSize());
+    logSize.store(txlog->GetLogSize());
+    txCount.store(txlog->GetTxCount());
+}
+
+bool CMempoolTxDB::AddTransactions(const std::vector<CTransactionRef>& txs)
+{
+    return WriteLog(txs, {});
 }
 
 bool CMempoolTxDB::GetTransaction(const uint256 &txid, CTransactionRef &tx)
 {
-    const auto key = std::make_pair(DB_TRANSACTIONS, txid);
-    if (wrapper->Exists(key))
-    {
-        CMutableTransaction txm;
-        if (wrapper->Read(key, txm))
-        {
-            tx = MakeTransactionRef(std::move(txm));
-            return true;
-        }
-    }
-    return false;
+    return txlog->Read(TxId{txid}, tx);
 }
 
 bool CMempoolTxDB::TransactionExists(const uint256 &txid)
 {
-    return wrapper->Exists(std::make_pair(DB_TRANSACTIONS, txid));
+    return txlog->Exists(TxId{txid});
 }
 
 
 bool CMempoolTxDB::RemoveTransactions(const std::vector<TxData>& txData)
 {
-    const uint64_t txCountRemoved = txData.size();
-    const uint64_t diskUsageRemoved = [&txData]() {
-        auto accumulator = decltype(txData[0].size){0};
-        for (const auto& td : txData) {
-            accumulator += td.size;
-        }
-        return accumulator;
-    }();
-
-    auto batch = CDBBatch{*wrapper};
+    std::vector<TxId> txids;
+    txids.reserve(txData.size());
     for (const auto& td : txData) {
-        batch.Erase(std::make_pair(DB_TRANSACTIONS, td.txid));
+        txids.emplace_back(td.txid);
     }
-    batch.Write(DB_DISK_USAGE, diskUsage.load() - diskUsageRemoved);
-    batch.Write(DB_TX_COUNT, txCount.load() - txCountRemoved);
-    batch.Erase(DB_MEMPOOL_XREF);
-
-    ++dbWriteCount;
-    if (wrapper->WriteBatch(batch, true))
-    {
-        diskUsage.fetch_sub(diskUsageRemoved);
-        txCount.fetch_sub(txCountRemoved);
-        return true;
-    }
-    return false;
+    return WriteLog({}, txids);
 }
 
 uint64_t CMempoolTxDB::GetDiskUsage()
@@ -129,6 +110,11 @@ uint64_t CMempoolTxDB::GetDiskUsage()
     return diskUsage.load();
 }
 
+uint64_t CMempoolTxDB::GetLogSize()
+{
+    return logSize.load();
+}
+
 uint64_t CMempoolTxDB::GetTxCount()
 {
     return txCount.load();
@@ -136,19 +122,7 @@ uint64_t CMempoolTxDB::GetTxCount()
 
 CMempoolTxDB::TxIdSet CMempoolTxDB::GetKeys()
 {
-    static const auto initialKey = std::make_pair(DB_TRANSACTIONS, uint256{});
-
-    std::unique_ptr<CDBIterator> iter {wrapper->NewIterator()};
-    iter->Seek(initialKey);
-
-    TxIdSet result;
-    for (; iter->Valid(); iter->Next())
-    {
-        auto key = decltype(initialKey){};
-        iter->GetKey(key);
-        result.emplace(key.second);
-    }
-    return result;
+    return txlog->GetTxIds();
 }
 
 bool CMempoolTxDB::SetXrefKey(const XrefKey& xrefKey)
@@ -156,6 +130,7 @@ bool CMempoolTxDB::SetXrefKey(const XrefKey& xrefKey)
     auto batch = CDBBatch{*wrapper};
     batch.Write(DB_MEMPOOL_XREF, xrefKey);
     ++dbWriteCount;
+    xrefSet = true;
     return wrapper->WriteBatch(batch, true);
 }
 
@@ -176,7 +151,12 @@ bool CMempoolTxDB::RemoveXrefKey()
     auto batch = CDBBatch{*wrapper};
     batch.Erase(DB_MEMPOOL_XREF);
     ++dbWriteCount;
-    return wrapper->WriteBatch(batch, true);
+    if (wrapper->WriteBatch(batch, true))
+    {
+        xrefSet = false;
+        return true;
+    }
+    return false;
 }
 
 // The coalescing batch operations assume that the transaction database is
@@ -215,41 +195,21 @@ bool CMempoolTxDB::Commit(const Batch& batch)
         return true;
     }
 
-    const uint64_t txCountDiff = batch.adds.size() - batch.removes.size();
-    const uint64_t diskUsageDiff = [&batch]() {
-        uint64_t accumulator = 0;
-        for (const auto& e : batch.adds)
-        {
-            accumulator += e.second.tx->GetTotalSize();
-        }
-        for (const auto& e : batch.removes)
-        {
-            accumulator -= e.second.size;
-        }
-        return accumulator;
-    }();
-
-    const auto prevDiskUsage = diskUsage.fetch_add(diskUsageDiff);
-    const auto prevTxCount = txCount.fetch_add(txCountDiff);
-
-    auto coalesced = CDBBatch{*wrapper};
+    std::vector<CTransactionRef> adds;
+    adds.reserve(batch.adds.size());
     for (const auto& e : batch.adds)
     {
-        coalesced.Write(std::make_pair(DB_TRANSACTIONS, e.first), e.second.tx);
+        adds.emplace_back(e.second.tx);
     }
+    std::vector<TxId> removes;
+    removes.reserve(batch.removes.size());
     for (const auto& e : batch.removes)
     {
-        coalesced.Erase(std::make_pair(DB_TRANSACTIONS, e.first));
+        removes.emplace_back(e.first);
     }
-    coalesced.Write(DB_DISK_USAGE, prevDiskUsage + diskUsageDiff);
-    coalesced.Write(DB_TX_COUNT, prevTxCount + txCountDiff);
-    coalesced.Erase(DB_MEMPOOL_XREF);
 
-    ++dbWriteCount;
-    if (!wrapper->WriteBatch(coalesced, true))
+    if (!WriteLog(adds, removes))
     {
-        diskUsage.fetch_sub(diskUsageDiff);
-        txCount.fetch_sub(txCountDiff);
         return false;
     }
 
@@ -275,6 +235,23 @@ uint64_t CMempoolTxDB::GetWriteCount()
     return dbWriteCount.load();
 }
 
+size_t CMempoolTxDB::CollectGarbage()
+{
+    // Removed transactions may take up half as much space again as the live
+    // ones, and at least a segment's worth, before the log is compacted.
+    const uint64_t maxDeadSize =
+        std::max(CMempoolTxLog::DEFAULT_SEGMENT_SIZE, txlog->GetLiveSize() / 2);
+    const auto removed = txlog->CollectGarbage(maxDeadSize);
+    if (removed > 0)
+    {
+        UpdateUsage();
+        LogPrint(BCLog::MEMPOOL,
+                 "Removed %zu mempool transaction log segments, %zu remaining.\n",
+                 removed, txlog->GetSegmentCount());
+    }
+    return removed;
+}
+
 
 // Task queue managment for CAsyncMempoolTxDB
 namespace {
@@ -300,7 +277,12 @@ namespace {
         CMempoolTxDB::TxData transaction;
     };
 
-    using Task = std::variant<ClearTask, SyncTask, InvokeTask, AddTask, RemoveTask>;
+    struct PrefetchTask
+    {
+        std::vector<CTransactionWrapperRef> transactions;
+    };
+
+    using Task = std::variant<ClearTask, SyncTask, InvokeTask, AddTask, RemoveTask, PrefetchTask>;
 
     // Estimate the maximum size of the task queue based on the
     // ancestor limit parameters.
@@ -352,6 +334,7 @@ public:
 
     using CThreadSafeQueue<Task>::Close;
     using CThreadSafeQueue<Task>::MaximalSize;
+    using CThreadSafeQueue<Task>::PushNoWait;
     using CThreadSafeQueue<Task>::PushWait;
     using CThreadSafeQueue<Task>::PopAllWait;
 
@@ -425,6 +408,35 @@ void CAsyncMempoolTxDB::Remove(CMempoolTxDB::TxData&& transactionToRemove)
     assert(success && "Push to task queue failed");
 }
 
+void CAsyncMempoolTxDB::Prefetch(std::vector<CTransactionWrapperRef>&& transactionsToPrefetch)
+{
+    if (transactionsToPrefetch.empty())
+    {
+        return;
+    }
+    // Prefetching is only a hint, so don't wait for space in the queue; our
+    // callers may be holding locks that the queue's consumers need.
+    if (!queue->PushNoWait(Task{PrefetchTask{std::move(transactionsToPrefetch)}}))
+    {
+        LogPrint(BCLog::MEMPOOL, "Mempool txdb queue is full, not prefetching transactions\n");
+    }
+}
+
+void CAsyncMempoolTxDB::CollectGarbage()
+{
+    const auto function = [](CMempoolTxDB& txdb)
+    {
+        txdb.CollectGarbage();
+    };
+
+    // This runs on block connect, when the mempool is locked, so don't wait
+    // for space in the queue; the next block will try again.
+    if (!queue->PushNoWait(Task{InvokeTask{function}}))
+    {
+        LogPrint(BCLog::MEMPOOL, "Mempool txdb queue is full, not collecting garbage\n");
+    }
+}
+
 std::shared_ptr<CMempoolTxDBReader> CAsyncMempoolTxDB::GetDatabase()
 {
     return txdb;
@@ -555,7 +567,18 @@ void CAsyncMempoolTxDB::Work()
         batch.Remove(task.transaction.txid, task.transaction.size);
     };
 
-    const auto dispatcher {dispatch{sync, clear, invoke, add, remove}};
+    // Read transactions back from the database ahead of use. Transactions
+    // whose add is still pending in the current batch are in memory and
+    // will be skipped.
+    const auto prefetch = [](const PrefetchTask& task)
+    {
+        for (const auto& wrapper : task.transactions)
+        {
+            wrapper->Prefetch();
+        }
+    };
+
+    const auto dispatcher {dispatch{sync, clear, invoke, add, remove, prefetch}};
     for (;;)
     {
         try
@@ -9,6 +9,7 @@
 #define BITCOIN_MEMPOOLTXDB_H
 
 #include "dbwrapper.h"
+#include "mempooltxlog.h"
 #include "txhasher.h"
 #include "tx_mempool_info.h"
 
@@ -33,26 +34,34 @@ public:
     virtual ~CMempoolTxDBReader() = default;
     virtual bool GetTransaction(const uint256 &txid, CTransactionRef &tx) = 0;
     virtual bool TransactionExists(const uint256 &txid) = 0;
+
+    // Memory used by transactions that were read back ahead of use and are
+    // held by their wrappers (see CTransactionWrapper::Prefetch()).
+    size_t GetPrefetchedUsage() const noexcept { return prefetchedUsage; }
+
+private:
+    friend class CTransactionWrapper;
+    std::atomic<size_t> prefetchedUsage {0};
 };
 
 /**
  * Access to the mempool transaction database (mempoolTxDB).
  *
+ * Transactions are kept in an append-only log (see @ref CMempoolTxLog) in the
+ * "txlog" subdirectory of the database; the LevelDB database only stores the
+ * mempool.dat cross-reference key.
+ *
  * Objects of this class should be used in a single-threaded context, otherwise
  * internal accounting will not be consistent. The exceptions to this rule are:
  * <ul>
  *  <li>Methods from the base @ref CMempoolTxDBReader that are implemented here;</li>
- *  <li>GetDiskUsage(), GetTxCount() and GetWriteCount().</li>
+ *  <li>GetDiskUsage(), GetLogSize(), GetTxCount() and GetWriteCount().</li>
  * </ul>
  */
 class CMempoolTxDB : public CMempoolTxDBReader {
 private:
-    // Prefix to store map of Transaction values with txid as a key
+    // Prefix of transactions stored by older versions, before the log
     static constexpr char DB_TRANSACTIONS = 'T';
-    // Prefix to store disk usage
-    static constexpr char DB_DISK_USAGE = 'D';
-    // Prefix to store transaaction count
-    static constexpr char DB_TX_COUNT = 'C';
     // Prefix to store the mempool.dat cross-reference key
     static constexpr char DB_MEMPOOL_XREF = 'X';
 
@@ -62,11 +71,22 @@ private:
     const bool fMemory;
 
     std::unique_ptr<CDBWrapper> wrapper;
+    std::unique_ptr<CMempoolTxLog> txlog;
+    // Whether the cross-reference key may be in the database
+    bool xrefSet {false};
 
     std::atomic_uint64_t diskUsage {0};
+    std::atomic_uint64_t logSize {0};
     std::atomic_uint64_t txCount {0};
     std::atomic_uint64_t dbWriteCount {0};
 
+    // Remove the cross-reference key before the log is changed.
+    bool InvalidateXrefKey();
+    // Write to the log and update the accounting.
+    bool WriteLog(const std::vector<CTransactionRef>& adds, const std::vector<TxId>& removes);
+    // Refresh the accounting from the log.
+    void UpdateUsage();
+
 public:
     /**
      * Initializes mempool transaction database. nCacheSize is leveldb cache size
@@ -116,6 +136,12 @@ public:
      */
     uint64_t GetDiskUsage();
 
+    /**
+     * Return the size of the transaction log on disk, including records
+     * that have not been reclaimed yet.
+     */
+    uint64_t GetLogSize();
+
     /*
      * Return the number of transactions moved to disk.
      */
@@ -172,6 +198,12 @@ public:
 
     // Get the number of batch writes performed on the database.
     uint64_t GetWriteCount();
+
+    /*
+     * Reclaim disk space taken by removed transactions, if there's enough of
+     * it to be worth the copying. Returns the number of removed log segments.
+     */
+    size_t CollectGarbage();
 };
 
 
@@ -196,12 +228,27 @@ public:
     // Asynchronously remove a transaction from the database.
     void Remove(CMempoolTxDB::TxData&& transactionToRemove);
 
+    // Asynchronously read on-disk transactions back into their wrappers so
+    // that the next GetTx() on them does not have to wait for the disk.
+    // Never blocks; the request is dropped if the queue is full.
+    void Prefetch(std::vector<CTransactionWrapperRef>&& transactionsToPrefetch);
+
+    // Asynchronously reclaim disk space taken by removed transactions.
+    // Never blocks; the request is dropped if the queue is full.
+    void CollectGarbage();
+
     // Get the size of the data in the database.
     uint64_t GetDiskUsage()
     {
         return txdb->GetDiskUsage();
     }
 
+    // Get the size of the transaction log on disk.
+    uint64_t GetLogSize()
+    {
+        return txdb->GetLogSize();
+    }
+
     // Get the number of transactions in the database.
     uint64_t GetTxCount()
     {
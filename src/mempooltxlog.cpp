@@ -0,0 +1,548 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mempooltxlog.h"
+
+#include "clientversion.h"
+#include "crypto/common.h"
+#include "logging.h"
+#include "streams.h"
+#include "util.h"
+#include "utilstrencodings.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    // Segment file names are the segment id in hex with this extension.
+    constexpr const char* SEGMENT_EXTENSION = ".seg";
+}
+
+CMempoolTxLog::CMempoolTxLog(const fs::path& path_, bool inMemory_, bool wipe,
+                             uint64_t segmentSize_)
+    : path{path_},
+      inMemory{inMemory_},
+      segmentSize{segmentSize_}
+{
+    std::lock_guard lock{mtx};
+    if (inMemory)
+    {
+        return;
+    }
+
+    TryCreateDirectories(path);
+    OpenNL(wipe);
+}
+
+fs::path CMempoolTxLog::SegmentPath(uint32_t id) const
+{
+    return path / strprintf("%08x%s", id, SEGMENT_EXTENSION);
+}
+
+void CMempoolTxLog::OpenNL(bool wipe)
+{
+    for (fs::directory_iterator it{path}; it != fs::directory_iterator{}; ++it)
+    {
+        const auto& file = it->path();
+        if (!fs::is_regular_file(file) || file.extension() != SEGMENT_EXTENSION)
+        {
+            continue;
+        }
+        const auto stem = file.stem().string();
+        if (stem.size() != 8 || !IsHex(stem))
+        {
+            continue;
+        }
+        const auto id = static_cast<uint32_t>(std::stoul(stem, nullptr, 16));
+        if (wipe)
+        {
+            fs::remove(file);
+            continue;
+        }
+        segments.emplace(id, Segment{});
+    }
+
+    // Replay the segments in the order they were written.
+    for (auto& [id, segment] : segments)
+    {
+        segment.file.reset(fsbridge::fopen(SegmentPath(id), "rb+"));
+        if (!segment.file)
+        {
+            throw std::runtime_error(
+                strprintf("Cannot open mempool transaction log segment %s",
+                          SegmentPath(id).string()));
+        }
+        ReplayNL(id, segment);
+    }
+
+    LogPrint(BCLog::MEMPOOL,
+             "Opened mempool transaction log with %zu segments and %zu transactions\n",
+             segments.size(), index.size());
+}
+
+void CMempoolTxLog::ReplayNL(uint32_t id, Segment& segment)
+{
+    FILE* file = segment.file.get();
+    std::fseek(file, 0, SEEK_END);
+    const auto fileSize = static_cast<uint64_t>(std::ftell(file));
+    std::fseek(file, 0, SEEK_SET);
+
+    uint64_t offset = 0;
+    unsigned char header[HEADER_SIZE];
+    while (offset + HEADER_SIZE <= fileSize)
+    {
+        if (std::fread(header, 1, HEADER_SIZE, file) != HEADER_SIZE)
+        {
+            break;
+        }
+        const uint8_t type = header[0];
+        TxId txid {uint256{std::vector<unsigned char>(header + 1, header + 33)}};
+        const uint32_t size = ReadLE32(header + 33);
+        if ((type != RECORD_ADD && type != RECORD_REMOVE)
+            || offset + HEADER_SIZE + size > fileSize)
+        {
+            break;
+        }
+
+        if (auto it = index.find(txid); it != index.end())
+        {
+            EraseLocationNL(txid, it->second);
+            index.erase(it);
+        }
+        if (type == RECORD_ADD)
+        {
+            const Location location {id, offset + HEADER_SIZE, size};
+            index.emplace(txid, location);
+            segment.liveSize += size;
+            segment.live.insert(txid);
+            liveSize += size;
+        }
+        else
+        {
+            segment.tombstones.push_back(txid);
+        }
+
+        offset += HEADER_SIZE + size;
+        std::fseek(file, static_cast<long>(offset), SEEK_SET);
+    }
+
+    if (offset != fileSize)
+    {
+        LogPrintf("Truncating mempool transaction log segment %s from %u to %u bytes\n",
+                  SegmentPath(id).string(), fileSize, offset);
+        TruncateFile(file, offset);
+    }
+    segment.size = offset;
+    logSize += offset;
+}
+
+std::pair<const uint32_t, CMempoolTxLog::Segment>& CMempoolTxLog::HeadNL(uint64_t recordSize)
+{
+    if (!segments.empty())
+    {
+        auto& head = *segments.rbegin();
+        if (head.second.size == 0 || head.second.size + recordSize <= segmentSize)
+        {
+            return head;
+        }
+    }
+    return NewSegmentNL();
+}
+
+std::pair<const uint32_t, CMempoolTxLog::Segment>& CMempoolTxLog::NewSegmentNL()
+{
+    if (!segments.empty())
+    {
+        // Make sure the old head is on disk before moving on.
+        auto& head = *segments.rbegin();
+        if (head.second.file)
+        {
+            std::fflush(head.second.file.get());
+            FileCommit(head.second.file.get());
+        }
+    }
+
+    const uint32_t id = segments.empty() ? 0 : segments.rbegin()->first + 1;
+    Segment segment;
+    if (!inMemory)
+    {
+        segment.file.reset(fsbridge::fopen(SegmentPath(id), "wb+"));
+        if (!segment.file)
+        {
+            throw std::runtime_error(
+                strprintf("Cannot create mempool transaction log segment %s",
+                          SegmentPath(id).string()));
+        }
+    }
+    return *segments.emplace(id, std::move(segment)).first;
+}
+
+bool CMempoolTxLog::AppendNL(uint8_t type, const TxId& txid,
+                             const char* payload, uint32_t payloadSize)
+{
+    unsigned char header[HEADER_SIZE];
+    header[0] = type;
+    std::memcpy(header + 1, txid.begin(), 32);
+    WriteLE32(header + 33, payloadSize);
+
+    auto& [id, segment] = HeadNL(HEADER_SIZE + payloadSize);
+    if (inMemory)
+    {
+        segment.data.insert(segment.data.end(), header, header + HEADER_SIZE);
+        segment.data.insert(segment.data.end(), payload, payload + payloadSize);
+    }
+    else
+    {
+        FILE* file = segment.file.get();
+        if (std::fseek(file, static_cast<long>(segment.size), SEEK_SET) != 0
+            || std::fwrite(header, 1, HEADER_SIZE, file) != HEADER_SIZE
+            || std::fwrite(payload, 1, payloadSize, file) != payloadSize)
+        {
+            // Don't leave a partial record in front of the next one.
+            LogPrintf("Failed to write to mempool transaction log segment %s\n",
+                      SegmentPath(id).string());
+            std::fflush(file);
+            TruncateFile(file, segment.size);
+            return false;
+        }
+    }
+    segment.size += HEADER_SIZE + payloadSize;
+    logSize += HEADER_SIZE + payloadSize;
+    return true;
+}
+
+bool CMempoolTxLog::ReadNL(const Segment& segment, uint64_t offset, char* buffer, uint64_t size) const
+{
+    if (offset + size > segment.size)
+    {
+        return false;
+    }
+    if (inMemory)
+    {
+        std::memcpy(buffer, segment.data.data() + offset, size);
+        return true;
+    }
+    FILE* file = segment.file.get();
+    return std::fseek(file, static_cast<long>(offset), SEEK_SET) == 0
+        && std::fread(buffer, 1, size, file) == size;
+}
+
+bool CMempoolTxLog::FlushNL()
+{
+    if (inMemory || segments.empty())
+    {
+        return true;
+    }
+    FILE* file = segments.rbegin()->second.file.get();
+    if (std::fflush(file) != 0)
+    {
+        return false;
+    }
+    FileCommit(file);
+    return true;
+}
+
+void CMempoolTxLog::EraseLocationNL(const TxId& txid, const Location& location)
+{
+    auto& segment = segments.at(location.segment);
+    segment.liveSize -= location.size;
+    segment.live.erase(txid);
+    segment.dead.insert(txid);
+    liveSize -= location.size;
+}
+
+bool CMempoolTxLog::TombstoneNeededNL(uint32_t id, const TxId& txid) const
+{
+    // A later record of a live transaction overrides the older ones anyway.
+    if (index.count(txid) != 0)
+    {
+        return false;
+    }
+    for (auto it = segments.begin(); it != segments.end() && it->first < id; ++it)
+    {
+        if (it->second.dead.count(txid) != 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CMempoolTxLog::MoveRecordsNL(uint32_t id, Segment& segment)
+{
+    // Copy the live transactions to the end of the log in their original order.
+    std::vector<std::pair<TxId, Location>> live;
+    live.reserve(segment.live.size());
+    for (const auto& txid : segment.live)
+    {
+        live.emplace_back(txid, index.at(txid));
+    }
+    std::sort(live.begin(), live.end(),
+              [](const auto& a, const auto& b) { return a.second.offset < b.second.offset; });
+
+    std::vector<char> buffer;
+    for (const auto& [txid, location] : live)
+    {
+        buffer.resize(location.size);
+        if (!ReadNL(segment, location.offset, buffer.data(), location.size)
+            || !AppendNL(RECORD_ADD, txid, buffer.data(), location.size))
+        {
+            LogPrintf("Failed to compact mempool transaction log segment %s\n",
+                      SegmentPath(id).string());
+            FlushNL();
+            return false;
+        }
+        // The copy is live now, the original is dead.
+        auto& [headId, head] = *segments.rbegin();
+        EraseLocationNL(txid, location);
+        const Location moved {headId, head.size - location.size, location.size};
+        index[txid] = moved;
+        head.liveSize += moved.size;
+        head.live.insert(txid);
+        liveSize += moved.size;
+    }
+
+    // Keep the tombstones that would otherwise bring older records back.
+    for (const auto& txid : segment.tombstones)
+    {
+        if (!TombstoneNeededNL(id, txid))
+        {
+            continue;
+        }
+        if (!AppendNL(RECORD_REMOVE, txid, nullptr, 0))
+        {
+            LogPrintf("Failed to compact mempool transaction log segment %s\n",
+                      SegmentPath(id).string());
+            FlushNL();
+            return false;
+        }
+        segments.rbegin()->second.tombstones.push_back(txid);
+    }
+
+    // The copies must be on disk before the originals are removed.
+    return FlushNL();
+}
+
+bool CMempoolTxLog::Write(const std::vector<CTransactionRef>& adds, const std::vector<TxId>& removes)
+{
+    std::lock_guard lock{mtx};
+    bool success = true;
+
+    CDataStream stream {SER_DISK, CLIENT_VERSION};
+    for (const auto& tx : adds)
+    {
+        const auto& txid = tx->GetId();
+        if (index.count(txid) != 0)
+        {
+            continue;
+        }
+        stream.clear();
+        stream << *tx;
+        const auto size = static_cast<uint32_t>(stream.size());
+        if (!AppendNL(RECORD_ADD, txid, stream.data(), size))
+        {
+            success = false;
+            break;
+        }
+        auto& [id, segment] = *segments.rbegin();
+        index.emplace(txid, Location{id, segment.size - size, size});
+        segment.liveSize += size;
+        segment.live.insert(txid);
+        liveSize += size;
+    }
+
+    for (const auto& txid : removes)
+    {
+        if (!success)
+        {
+            break;
+        }
+        const auto it = index.find(txid);
+        if (it == index.end())
+        {
+            continue;
+        }
+        if (!AppendNL(RECORD_REMOVE, txid, nullptr, 0))
+        {
+            success = false;
+            break;
+        }
+        segments.rbegin()->second.tombstones.push_back(txid);
+        EraseLocationNL(txid, it->second);
+        index.erase(it);
+    }
+
+    return FlushNL() && success;
+}
+
+bool CMempoolTxLog::Read(const TxId& txid, CTransactionRef& tx) const
+{
+    std::vector<char> buffer;
+    {
+        // Records are never changed in place, so readers only exclude writers
+        // and garbage collection. Reads through the same file take turns.
+        std::shared_lock lock{mtx};
+        const auto it = index.find(txid);
+        if (it == index.end())
+        {
+            return false;
+        }
+        const auto& location = it->second;
+        const auto& segment = segments.at(location.segment);
+        buffer.resize(location.size);
+        std::lock_guard readLock{*segment.readMtx};
+        if (!ReadNL(segment, location.offset, buffer.data(), location.size))
+        {
+            return false;
+        }
+    }
+
+    try
+    {
+        CDataStream stream {buffer.data(), buffer.data() + buffer.size(), SER_DISK, CLIENT_VERSION};
+        CMutableTransaction txm;
+        stream >> txm;
+        tx = MakeTransactionRef(std::move(txm));
+        return true;
+    }
+    catch (const std::exception& e)
+    {
+        LogPrintf("Corrupt transaction %s in mempool transaction log: %s\n",
+                  txid.ToString(), e.what());
+        return false;
+    }
+}
+
+bool CMempoolTxLog::Exists(const TxId& txid) const
+{
+    std::shared_lock lock{mtx};
+    return index.count(txid) != 0;
+}
+
+CMempoolTxLog::TxIdSet CMempoolTxLog::GetTxIds() const
+{
+    std::shared_lock lock{mtx};
+    TxIdSet result;
+    result.reserve(index.size());
+    for (const auto& entry : index)
+    {
+        result.emplace(entry.first);
+    }
+    return result;
+}
+
+uint64_t CMempoolTxLog::GetLiveSize() const
+{
+    std::shared_lock lock{mtx};
+    return liveSize;
+}
+
+uint64_t CMempoolTxLog::GetTxCount() const
+{
+    std::shared_lock lock{mtx};
+    return index.size();
+}
+
+size_t CMempoolTxLog::GetSegmentCount() const
+{
+    std::shared_lock lock{mtx};
+    return segments.size();
+}
+
+uint64_t CMempoolTxLog::GetLogSize() const
+{
+    std::shared_lock lock{mtx};
+    return logSize;
+}
+
+uint64_t CMempoolTxLog::GetDeadSize() const
+{
+    std::shared_lock lock{mtx};
+    return DeadSizeNL();
+}
+
+uint64_t CMempoolTxLog::DeadSizeNL() const
+{
+    return logSize - liveSize - HEADER_SIZE * index.size();
+}
+
+uint64_t CMempoolTxLog::DeadSizeNL(const Segment& segment)
+{
+    return segment.size - segment.liveSize - HEADER_SIZE * segment.live.size();
+}
+
+void CMempoolTxLog::Clear()
+{
+    std::lock_guard lock{mtx};
+    for (auto& [id, segment] : segments)
+    {
+        if (segment.file)
+        {
+            segment.file.reset();
+            fs::remove(SegmentPath(id));
+        }
+    }
+    segments.clear();
+    index.clear();
+    liveSize = 0;
+    logSize = 0;
+}
+
+size_t CMempoolTxLog::CollectGarbage(uint64_t maxDeadSize)
+{
+    std::lock_guard lock{mtx};
+    size_t removed = 0;
+    if (DeadSizeNL() <= maxDeadSize)
+    {
+        return removed;
+    }
+
+    // Compact the segments with the most dead bytes first, and go on until
+    // there's room for as much again, so that this doesn't run every time a
+    // few more transactions are removed. Each segment is judged on its own,
+    // so a few long lived transactions in an old segment don't hold back the
+    // newer ones.
+    std::vector<std::pair<uint64_t, uint32_t>> candidates;
+    for (const auto& [id, segment] : segments)
+    {
+        if (const uint64_t deadSize = DeadSizeNL(segment); deadSize > 0)
+        {
+            candidates.emplace_back(deadSize, id);
+        }
+    }
+    std::sort(candidates.rbegin(), candidates.rend());
+
+    for (const auto& candidate : candidates)
+    {
+        if (DeadSizeNL() <= maxDeadSize / 2)
+        {
+            break;
+        }
+
+        // The head is retired first, so that what it keeps goes to a new one.
+        const uint32_t id = candidate.second;
+        if (id == segments.rbegin()->first)
+        {
+            NewSegmentNL();
+        }
+        auto& segment = segments.at(id);
+        if (!MoveRecordsNL(id, segment))
+        {
+            return removed;
+        }
+
+        LogPrint(BCLog::MEMPOOL,
+                 "Removing mempool transaction log segment %08x (%u bytes)\n",
+                 id, segment.size);
+        if (segment.file)
+        {
+            segment.file.reset();
+            fs::remove(SegmentPath(id));
+        }
+        logSize -= segment.size;
+        segments.erase(id);
+        ++removed;
+    }
+    return removed;
+}
@@ -0,0 +1,156 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include "cfile_util.h"
+#include "consensus/consensus.h"
+#include "fs.h"
+#include "primitives/transaction.h"
+#include "txhasher.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * Append-only storage for mempool transactions that were moved to disk.
+ *
+ * Transactions are appended to segment files and found through an in-memory
+ * index of their offsets. Removing a transaction appends a small tombstone
+ * record and drops it from the index; no data is rewritten in place.
+ *
+ * Space is reclaimed a whole segment at a time, once the dead records add up
+ * to more than the caller allows: a segment is deleted after its live
+ * transactions have been copied to the end of the log. Tombstones in a
+ * deleted segment that still hide a record in an older segment are copied to
+ * the end of the log as well.
+ *
+ * Opening an existing log rebuilds the index by replaying the segments in
+ * order. A partially written record at the end of the last segment is cut
+ * off.
+ *
+ * All methods are safe to use from multiple threads. Reads only take a shared
+ * lock, so they don't wait for each other.
+ */
+class CMempoolTxLog
+{
+public:
+    static constexpr uint64_t DEFAULT_SEGMENT_SIZE {64 * ONE_MEBIBYTE};
+
+    /**
+     * Opens the log in directory @a path. If @a inMemory is true, segments
+     * are kept in memory and nothing is written to disk. If @a wipe is true,
+     * existing segments are removed.
+     */
+    CMempoolTxLog(const fs::path& path, bool inMemory, bool wipe,
+                  uint64_t segmentSize = DEFAULT_SEGMENT_SIZE);
+
+    CMempoolTxLog(const CMempoolTxLog&) = delete;
+    CMempoolTxLog& operator=(const CMempoolTxLog&) = delete;
+
+    /**
+     * Append @a adds and tombstones for @a removes to the log and flush it
+     * to disk. Transactions that are already in the log are not added again
+     * and removes of unknown transactions are ignored.
+     */
+    bool Write(const std::vector<CTransactionRef>& adds, const std::vector<TxId>& removes);
+
+    bool Read(const TxId& txid, CTransactionRef& tx) const;
+    bool Exists(const TxId& txid) const;
+
+    using TxIdSet = std::unordered_set<uint256, SaltedTxidHasher>;
+    TxIdSet GetTxIds() const;
+
+    // Total serialized size and number of live transactions.
+    uint64_t GetLiveSize() const;
+    uint64_t GetTxCount() const;
+
+    // Number of segments and their total size on disk, including dead records.
+    size_t GetSegmentCount() const;
+    uint64_t GetLogSize() const;
+
+    // Total size of the records that don't belong to live transactions.
+    uint64_t GetDeadSize() const;
+
+    // Remove all segments.
+    void Clear();
+
+    /**
+     * Reclaim space if more than @a maxDeadSize bytes of the log are dead.
+     * Segments are compacted starting with the one with the most dead bytes,
+     * the one being appended to included, until at most half of that is left.
+     * Returns the number of removed segments.
+     */
+    size_t CollectGarbage(uint64_t maxDeadSize = 0);
+
+private:
+    // Record types.
+    static constexpr uint8_t RECORD_ADD = 'T';
+    static constexpr uint8_t RECORD_REMOVE = 'R';
+    // Record header: type, txid, payload size.
+    static constexpr uint64_t HEADER_SIZE {1 + 32 + 4};
+
+    struct Segment
+    {
+        // Backing file, or empty for in-memory logs
+        UniqueCFile file {};
+        // Serialises concurrent reads through the file
+        std::unique_ptr<std::mutex> readMtx {std::make_unique<std::mutex>()};
+        std::vector<char> data {};
+        uint64_t size {0};
+        uint64_t liveSize {0};
+        // Transactions with live and dead records in this segment
+        std::unordered_set<TxId, SaltedTxidHasher> live {};
+        std::unordered_set<TxId, SaltedTxidHasher> dead {};
+        // Transactions removed by tombstones in this segment
+        std::vector<TxId> tombstones {};
+    };
+
+    struct Location
+    {
+        uint32_t segment;
+        // Offset of the record payload within the segment
+        uint64_t offset;
+        uint32_t size;
+    };
+
+    const fs::path path;
+    const bool inMemory;
+    const uint64_t segmentSize;
+
+    mutable std::shared_mutex mtx {};
+    std::map<uint32_t, Segment> segments {};
+    std::unordered_map<TxId, Location, SaltedTxidHasher> index {};
+    uint64_t liveSize {0};
+    uint64_t logSize {0};
+
+    fs::path SegmentPath(uint32_t id) const;
+    void OpenNL(bool wipe);
+    void ReplayNL(uint32_t id, Segment& segment);
+
+    // Segment that new records are appended to, a new one is started when
+    // the current one is full.
+    std::pair<const uint32_t, Segment>& HeadNL(uint64_t recordSize);
+    // Flush the current head and start a new segment.
+    std::pair<const uint32_t, Segment>& NewSegmentNL();
+    bool AppendNL(uint8_t type, const TxId& txid, const char* payload, uint32_t payloadSize);
+    bool ReadNL(const Segment& segment, uint64_t offset, char* buffer, uint64_t size) const;
+    bool FlushNL();
+
+    // Mark the record of a transaction at @a location dead.
+    void EraseLocationNL(const TxId& txid, const Location& location);
+    // Size of the records that don't belong to live transactions.
+    uint64_t DeadSizeNL() const;
+    static uint64_t DeadSizeNL(const Segment& segment);
+    // Whether a tombstone in segment @a id still hides a record in an older one.
+    bool TombstoneNeededNL(uint32_t id, const TxId& txid) const;
+    // Copy what must survive the removal of a segment to the end of the log.
+    bool MoveRecordsNL(uint32_t id, Segment& segment);
+};
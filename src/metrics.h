@@ -10,7 +10,10 @@
 #include <vector>
 #include <string>
 #include <chrono>
+#include <condition_variable>
+#include <functional>
 #include <mutex>
+#include <sstream>
 #include <thread>
 
 #include "util.h"
@@ -66,6 +69,19 @@ public:
         LogPrintf("%s", stat.str());
     }
 
+    // Current count for each value below the histogram size
+    std::vector<size_t> getCounts() const {
+        std::vector<size_t> counts {};
+        counts.reserve(mCounts.size());
+        for (auto& count: mCounts) {
+            counts.push_back(count);
+        }
+        return counts;
+    }
+    // Number of values too big for the histogram, and the largest of them
+    size_t getOverCount() const { return mOverCount; }
+    size_t getOverMax() const { return mOverMax; }
+
 private:
     std::string mWhat;
     std::vector<std::atomic_size_t> mCounts;
@@ -5,6 +5,8 @@
 
 
 #include "candidates.h"
+#include "hash.h"
+#include "memusage.h"
 #include "utiltime.h"
 #include "validation.h"
 
@@ -16,21 +18,53 @@ namespace
 /**
  * CMiningCandidate constructor.
  */
-CMiningCandidate::CMiningCandidate(MiningCandidateId id, const CBlockRef& block)
-    : mId{id}, mBlock{block}
+CMiningCandidate::CMiningCandidate(MiningCandidateId id, const CBlockRef& body, const CBlock& block, std::vector<uint256> merkleProof)
+    : mId{id}, mBlock{body}, mMerkleProof{std::move(merkleProof)}
 {
-    if(!block || block->vtx.empty())
+    if(!body || block.vtx.empty())
     {
         throw std::runtime_error("Null or empty block in MiningCandidate creation");
     }
 
     // Copy out fields from block that are unique to this candidate
-    mBlockTime = block->nTime;
-    mBlockBits = block->nBits;
-    mBlockVersion = block->nVersion;
-    mBlockCoinbase = block->vtx[0];
+    mBlockTime = block.nTime;
+    mBlockBits = block.nBits;
+    mBlockVersion = block.nVersion;
+    mBlockCoinbase = block.vtx[0];
+}
+
+size_t CMiningCandidate::DynamicMemoryUsage() const
+{
+    return memusage::MallocUsage(sizeof(CMiningCandidate)) +
+           memusage::MallocUsage(mBlockCoinbase->GetTotalSize()) +
+           memusage::DynamicUsage(mMerkleProof);
 }
 
+namespace
+{
+    // Whether the candidates of a block can share the given block instead
+    bool HaveSameTransactions(const CBlock& block, const CBlock& shared)
+    {
+        if(block.hashPrevBlock != shared.hashPrevBlock || block.vtx.size() != shared.vtx.size())
+        {
+            return false;
+        }
+        // Transactions are shared with the mempool, so unchanged ones are the same objects
+        for(size_t i = 1; i < block.vtx.size(); ++i)
+        {
+            if(block.vtx[i] != shared.vtx[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    size_t BlockMemoryUsage(const CBlock& block)
+    {
+        return memusage::MallocUsage(sizeof(CBlock)) + memusage::DynamicUsage(block.vtx);
+    }
+}
 
 /**
  * Create a new Mining Candidate. This is then ready for use by the BlockConstructor to construct a Candidate Block.
@@ -40,12 +74,53 @@ CMiningCandidate::CMiningCandidate(MiningCandidateId id, const CBlockRef& block)
  */
 CMiningCandidateRef CMiningCandidateManager::Create(const CBlockRef& block)
 {
+    if(!block || block->vtx.empty())
+    {
+        throw std::runtime_error("Null or empty block in MiningCandidate creation");
+    }
+
     // Create UUID for next candidate
     MiningCandidateId nextId { mIdGenerator() };
 
-    auto candidate = std::make_shared<CMiningCandidate>(CMiningCandidate(nextId, block));
+    // Many candidates are usually created from the same block, or from a block that
+    // only has some more transactions than the previous one.
+    std::vector<uint256> merkleProof {};
+    CBlockRef sharedBlock {};
+    {
+        std::lock_guard<std::mutex> lock {mMerkleMutex};
+        if(block != mMerkleBlock)
+        {
+            mMerkleBranch.Update(block->vtx);
+            mMerkleBlock = block;
+            if(!mSharedBlock || !HaveSameTransactions(*block, *mSharedBlock))
+            {
+                mSharedBlock = block;
+            }
+        }
+        merkleProof = mMerkleBranch.GetBranch();
+        sharedBlock = mSharedBlock;
+    }
+
+    auto candidate = std::make_shared<CMiningCandidate>(CMiningCandidate(nextId, sharedBlock, *block, std::move(merkleProof)));
+
     std::lock_guard<std::mutex> lock {mMutex};
-    mCandidates[nextId] = candidate;
+    mLru.push_front(nextId);
+    mCandidates[nextId] = Entry{candidate, mLru.begin()};
+    mMemory += candidate->DynamicMemoryUsage();
+    SharedBlock& shared { mBlocks[sharedBlock.get()] };
+    if(shared.candidates++ == 0)
+    {
+        shared.memory = BlockMemoryUsage(*sharedBlock);
+        mMemory += shared.memory;
+    }
+
+    // Make room by evicting the least recently used candidates, but never the new one
+    while(mMemory > mMaxMemory && mLru.size() > 1)
+    {
+        EraseNL(mCandidates.find(mLru.back()));
+        ++mEvicted;
+    }
+
     return candidate;
 }
 
@@ -62,12 +137,37 @@ CMiningCandidateRef CMiningCandidateManager::Get(const MiningCandidateId& candid
     auto candidateIt { mCandidates.find(candidateId) };
     if(candidateIt != mCandidates.end())
     {
-        res = candidateIt->second;
+        res = candidateIt->second.candidate;
+        mLru.splice(mLru.begin(), mLru, candidateIt->second.lruPos);
     }
 
     return res;
 }
 
+void CMiningCandidateManager::Remove(MiningCandidateId candidateId)
+{
+    std::lock_guard<std::mutex> lock {mMutex};
+    auto candidateIt { mCandidates.find(candidateId) };
+    if(candidateIt != mCandidates.end())
+    {
+        EraseNL(candidateIt);
+    }
+}
+
+CMiningCandidateManager::CandidateMap::iterator CMiningCandidateManager::EraseNL(CandidateMap::iterator it)
+{
+    const CMiningCandidateRef& candidate { it->second.candidate };
+    mMemory -= candidate->DynamicMemoryUsage();
+    auto sharedIt { mBlocks.find(candidate->mBlock.get()) };
+    if(--sharedIt->second.candidates == 0)
+    {
+        mMemory -= sharedIt->second.memory;
+        mBlocks.erase(sharedIt);
+    }
+    mLru.erase(it->second.lruPos);
+    return mCandidates.erase(it);
+}
+
 /**
  * Remove old candidate blocks. This frees up space.
  *
@@ -96,11 +196,11 @@ void CMiningCandidateManager::RemoveOldCandidates()
     {
         // Clean out mining candidates that are older than the discovered block.
         std::lock_guard<std::mutex> lock {mMutex};
-        for(auto it = mCandidates.cbegin(); it != mCandidates.cend();)
+        for(auto it = mCandidates.begin(); it != mCandidates.end();)
         {
-            if(it->second->mBlock->GetHeightFromCoinbase() <= mPrevHeight)
+            if(it->second.candidate->mBlock->GetHeightFromCoinbase() <= mPrevHeight)
             {
-                it = mCandidates.erase(it);
+                it = EraseNL(it);
             }
             else
             {
@@ -110,3 +210,79 @@ void CMiningCandidateManager::RemoveOldCandidates()
         mPrevHeight = height;
     }
 }
+
+size_t CMiningCandidateManager::GetBlockCount() const
+{
+    std::lock_guard<std::mutex> lock {mMutex};
+    return mBlocks.size();
+}
+
+uint64_t CMiningCandidateManager::GetMemoryUsage() const
+{
+    std::lock_guard<std::mutex> lock {mMutex};
+    return mMemory;
+}
+
+/**
+ * Rehash the nodes that depend on transactions that were added or replaced since the last update.
+ */
+const std::vector<uint256>& CCoinbaseMerkleBranch::Update(const std::vector<CTransactionRef>& vtx)
+{
+    if(mLevels.empty())
+    {
+        mLevels.emplace_back();
+    }
+    std::vector<uint256>& leaves { mLevels[0] };
+
+    // Find the first transaction that differs from the previous update, skipping the coinbase
+    size_t first {1};
+    size_t common { std::min(leaves.size(), vtx.size()) };
+    while(first < common && leaves[first] == vtx[first]->GetHash())
+    {
+        ++first;
+    }
+    if(first == leaves.size() && first == vtx.size())
+    {
+        return mBranch;
+    }
+
+    leaves.resize(vtx.size());
+    for(size_t i = first; i < vtx.size(); ++i)
+    {
+        leaves[i] = vtx[i]->GetHash();
+    }
+
+    // Recompute the parents of the changed nodes level by level, the last
+    // node of a level with an odd number of nodes is paired with itself.
+    size_t level {0};
+    for(; mLevels[level].size() > 1; ++level)
+    {
+        if(mLevels.size() == level + 1)
+        {
+            mLevels.emplace_back();
+        }
+        const std::vector<uint256>& children { mLevels[level] };
+        std::vector<uint256>& parents { mLevels[level + 1] };
+        parents.resize((children.size() + 1) / 2);
+
+        first /= 2;
+        for(size_t i = std::max<size_t>(first, 1); i < parents.size(); ++i)
+        {
+            const uint256& left { children[2 * i] };
+            const uint256& right { 2 * i + 1 < children.size() ? children[2 * i + 1] : left };
+            CHash256().Write(left.begin(), left.size())
+                      .Write(right.begin(), right.size())
+                      .Finalize(parents[i].begin());
+        }
+    }
+    mLevels.resize(level + 1);
+
+    // The branch of the coinbase is the second node of every level below the root
+    mBranch.clear();
+    for(size_t i = 0; i < level; ++i)
+    {
+        mBranch.push_back(mLevels[i][1]);
+    }
+
+    return mBranch;
+}
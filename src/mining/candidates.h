@@ -7,10 +7,14 @@
 #ifndef BITCOIN_CANDIDATES_H
 #define BITCOIN_CANDIDATES_H
 
+#include "consensus/consensus.h"
 #include "primitives/block.h"
 
 #include <atomic>
+#include <list>
+#include <map>
 #include <mutex>
+#include <vector>
 
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_generators.hpp>
@@ -33,19 +37,26 @@ class CMiningCandidate {
 public:
     // Accessors
     MiningCandidateId GetId() const { return mId; };
+    // The block holding the transactions of this candidate. The block may be shared with other
+    // candidates, so apart from the previous block hash its header fields and coinbase are not
+    // necessarily this candidate's; use the accessors below for those.
     CBlockRef GetBlock() const { return mBlock; };
     uint32_t GetBlockTime() const { return mBlockTime; }
     uint32_t GetBlockBits() const { return mBlockBits; }
     int32_t GetBlockVersion() const { return mBlockVersion; }
     CTransactionRef GetBlockCoinbase() const { return mBlockCoinbase; }
+    const std::vector<uint256>& GetMerkleProof() const { return mMerkleProof; }
 
 private:
-    CMiningCandidate(MiningCandidateId id, const CBlockRef& block);
+    CMiningCandidate(MiningCandidateId id, const CBlockRef& body, const CBlock& block, std::vector<uint256> merkleProof);
+
+    // Memory held by this candidate itself, excluding the shared block
+    size_t DynamicMemoryUsage() const;
 
     // This candidate ID
     MiningCandidateId mId {};
 
-    // The block this candidate is based off
+    // The block this candidate is based off, shared by the candidates with the same transactions
     CBlockRef mBlock { nullptr };
 
     // Fields from the block that are unique to this candidate
@@ -53,22 +64,61 @@ private:
     uint32_t mBlockBits {};
     int32_t mBlockVersion {};
     CTransactionRef mBlockCoinbase {};
+
+    // Merkle branch of the coinbase, the same for any coinbase the miner uses
+    std::vector<uint256> mMerkleProof {};
 };
 using CMiningCandidateRef = std::shared_ptr<CMiningCandidate>;
 
 
+/**
+ * Maintains the merkle branch of the coinbase for a sequence of blocks.
+ *
+ * Block templates grow by having transactions appended to them, so the tree of
+ * the previous block is kept and only the nodes that depend on transactions
+ * which differ from the previous block are rehashed. Appending k transactions
+ * to a block of n transactions costs O(k + log n) hashes rather than O(n).
+ *
+ * The coinbase itself never contributes to its own branch, so it is not hashed.
+ */
+class CCoinbaseMerkleBranch {
+public:
+    // Update the tree to the transactions of the given block and return the
+    // branch of the coinbase
+    const std::vector<uint256>& Update(const std::vector<CTransactionRef>& vtx);
+
+    const std::vector<uint256>& GetBranch() const { return mBranch; }
+
+private:
+    // Hashes of the tree, level 0 are the transaction hashes and are used to
+    // recognise unchanged leaves. Entries that depend on the coinbase are not
+    // maintained.
+    std::vector<std::vector<uint256>> mLevels {};
+    std::vector<uint256> mBranch {};
+};
+
+
 /**
  * The mining candidate manager owns a collection of mining candidates.
+ *
+ * Candidates created from blocks with the same previous block and the same transactions (other
+ * than the coinbase) share a single block, so a new template generation only costs memory once
+ * however many candidates miners request from it. The memory held by the candidates is bounded,
+ * when it grows over the limit the least recently used candidates are evicted.
  */
 class CMiningCandidateManager {
 public:
+    // Default limit on the memory used by candidates, in megabytes
+    static constexpr uint64_t DEFAULT_MAX_CANDIDATES_MEMORY {256};
+
+    explicit CMiningCandidateManager(uint64_t maxMemory = DEFAULT_MAX_CANDIDATES_MEMORY * ONE_MEGABYTE)
+    : mMaxMemory{maxMemory}
+    {}
+
     CMiningCandidateRef Create(const CBlockRef& block);
     CMiningCandidateRef Get(const MiningCandidateId& candidateId) const;
 
-    void Remove(MiningCandidateId candidateId) {
-        std::lock_guard<std::mutex> lock(mMutex);
-        mCandidates.erase(candidateId);
-    };
+    void Remove(MiningCandidateId candidateId);
     size_t Size() const {
         std::lock_guard<std::mutex> lock(mMutex);
         return mCandidates.size();
@@ -76,14 +126,50 @@ public:
 
     void RemoveOldCandidates();
 
+    // Metrics
+    size_t GetBlockCount() const;
+    uint64_t GetMemoryUsage() const;
+    uint64_t GetEvictedCount() const { return mEvicted; }
+    uint64_t GetMaxMemory() const { return mMaxMemory; }
+
 private:
+    using LruList = std::list<MiningCandidateId>;
+    struct Entry {
+        CMiningCandidateRef candidate {};
+        // Position in the LRU list
+        LruList::iterator lruPos {};
+    };
+    // A block shared by candidates
+    struct SharedBlock {
+        size_t candidates {0};
+        size_t memory {0};
+    };
+
+    using CandidateMap = std::map<MiningCandidateId, Entry>;
+
+    // Remove a candidate, the caller holds mMutex
+    CandidateMap::iterator EraseNL(CandidateMap::iterator it);
+
     mutable std::mutex mMutex {};   // we don't expect much concurrency, a simple exclusive mutex is sufficient
 
-    using CandidateMap = std::map<MiningCandidateId, CMiningCandidateRef>;
     CandidateMap mCandidates {};
+    // Candidate IDs, most recently used first
+    mutable LruList mLru {};
+    std::map<const CBlock*, SharedBlock> mBlocks {};
+
+    const uint64_t mMaxMemory {};
+    uint64_t mMemory {0};
+    std::atomic_uint64_t mEvicted {0};
 
     std::atomic_int32_t mPrevHeight {0};
     boost::uuids::random_generator mIdGenerator {};
+
+    // Coinbase merkle branch of the most recent block candidates were created from,
+    // and the block its candidates share
+    std::mutex mMerkleMutex {};
+    CBlockRef mMerkleBlock { nullptr };
+    CBlockRef mSharedBlock { nullptr };
+    CCoinbaseMerkleBranch mMerkleBranch {};
 };
 
 
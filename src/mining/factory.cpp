@@ -7,6 +7,7 @@
 #include <config.h>
 #include <mining/factory.h>
 #include <mining/journaling_block_assembler.h>
+#include <util.h>
 #include <stdexcept>
 
 namespace mining
@@ -40,10 +41,20 @@ BlockAssemblerRef CMiningFactory::GetAssembler() const
 // Get a reference to the mining candidate manager
 CMiningCandidateManager& CMiningFactory::GetCandidateManager()
 {
-    static CMiningCandidateManager manager {};
+    static CMiningCandidateManager manager {
+        static_cast<uint64_t>(gArgs.GetArg("-maxminingcandidatesmemory",
+            CMiningCandidateManager::DEFAULT_MAX_CANDIDATES_MEMORY)) * ONE_MEGABYTE
+    };
     return manager;
 }
 
+// Get a reference to the stream of block template updates
+CTemplateDeltaStream& CMiningFactory::GetTemplateDeltaStream()
+{
+    static CTemplateDeltaStream stream {};
+    return stream;
+}
+
 // Enable enum_cast for BlockAssemblerType
 const enumTableT<CMiningFactory::BlockAssemblerType>& enumTable(CMiningFactory::BlockAssemblerType)
 {
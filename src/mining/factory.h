@@ -9,6 +9,7 @@
 #include <enum_cast.h>
 #include <mining/candidates.h>
 #include <mining/assembler.h>
+#include <mining/template_stream.h>
 
 #include <memory>
 
@@ -37,6 +38,9 @@ class CMiningFactory
     // Get a reference to the mining candidate manager
     static CMiningCandidateManager& GetCandidateManager();
 
+    // Get a reference to the stream of block template updates
+    static CTemplateDeltaStream& GetTemplateDeltaStream();
+
   private:
 
     // Keep reference to the global config
@@ -6,9 +6,12 @@
 
 #include <mining/journal.h>
 #include <mining/journal_change_set.h>
+#include <memusage.h>
 #include <utiltime.h>
 #include <logging.h>
 
+#include <algorithm>
+
 using mining::CJournal;
 using mining::CJournalTester;
 using mining::CJournalChangeSet;
@@ -18,16 +21,34 @@ using mining::CJournalPtr;
 // Copy constructor, only required by journal builder
 CJournal::CJournal(const CJournal& that)
 {
-    // Lock journal we are copying from, and copy its contents
+    // Lock journal we are copying from, and copy its contents. Empty slots
+    // are left behind, so the copy starts out compacted.
     std::shared_lock lock { that.mMtx };
-    mTransactions = that.mTransactions;
+    mNextSequence = that.mNextSequence;
+    mFrontSequence = that.mFrontSequence;
+    mSequences.reserve(that.mSequences.size());
+    for(const Slot& slot : that.mSlots)
+    {
+        if(!slot.removed())
+        {
+            mSlots.push_back(slot);
+            mSequences.emplace(TxIdKey{&slot.entry.getTxn()->GetId()}, slot.sequence);
+        }
+    }
 }
 
 // Get size of journal
 size_t CJournal::size() const
 {
     std::shared_lock lock { mMtx };
-    return mTransactions.size();
+    return mSequences.size();
+}
+
+// Estimate the memory used by the journal
+size_t CJournal::DynamicMemoryUsage() const
+{
+    std::shared_lock lock { mMtx };
+    return mSlots.size() * sizeof(Slot) + memusage::DynamicUsage(mSequences);
 }
 
 // Apply changes to the journal
@@ -35,60 +56,67 @@ void CJournal::applyChanges(const CJournalChangeSet& changeSet)
 {
     std::unique_lock lock { mMtx };
 
-    using TransactionListByName = TransactionList::nth_index<0>::type;
-    using TransactionListByPosition = TransactionList::nth_index<1>::type;
-    TransactionListByName& index0 { mTransactions.get<0>() };
-    TransactionListByPosition& index1 { mTransactions.get<1>() };
-
-    // For REORGs we need to remember the current start position
-    TransactionListByPosition::const_iterator begin1 {};
-    TransactionListByName::const_iterator begin0 {};
+    // Reorgs add to the start of the journal, ahead of what is already there
+    // but in the order given by the change set. Collect them up and add them
+    // once we're done.
     bool isReorg { changeSet.getUpdateReason() == JournalUpdateReason::REORG };
-    if(isReorg)
-    {
-        begin1 = index1.begin();
-        begin0 = mTransactions.project<0>(begin1);
-    }
+    std::vector<CJournalEntry> reorgAdds {};
 
     for(const auto& [ op, txn ] : changeSet.getChangeSet())
     {
         if(op == CJournalChangeSet::Operation::ADD)
         {
-            // Reorgs need to be added to the start of the journal, other reasons add to the end
+            if(mSequences.count(TxIdKey{&txn.getTxn()->GetId()}))
+            {
+                // Already have it
+                continue;
+            }
+
             if(isReorg)
             {
-                index1.emplace(begin1, txn);
+                reorgAdds.push_back(txn);
             }
             else
             {
-                index1.emplace_back(txn);
+                append(txn);
             }
         }
         else if(op == CJournalChangeSet::Operation::REMOVE)
         {
-            // Lookup txn
-            auto txnit { index0.find(txn) };
-            if(txnit != index0.end())
+            if(!remove(txn))
             {
-                // If this is a REORG and if we're erasing the first transaction in the journal
-                // then we need to update our saved iterator to the start of the list.
-                if(isReorg && txnit == begin0)
+                // Could be one of the reorg additions we haven't added yet
+                const TxId& txid { txn.getTxn()->GetId() };
+                auto it { std::find_if(reorgAdds.begin(), reorgAdds.end(),
+                    [&txid](const CJournalEntry& entry) { return entry.getTxn()->GetId() == txid; }) };
+                if(it != reorgAdds.end())
                 {
-                    ++begin1;
-                    begin0 = mTransactions.project<0>(begin1);
+                    reorgAdds.erase(it);
+                }
+                else
+                {
+                    LogPrint(BCLog::JOURNAL, "ERROR: Failed to find and remove txn %s from journal\n",
+                        txid.ToString().c_str());
                 }
-
-                // Remove txn
-                index0.erase(txnit);
-            }
-            else
-            {
-                LogPrint(BCLog::JOURNAL, "ERROR: Failed to find and remove txn %s from journal\n",
-                    txn.getTxn()->GetId().ToString().c_str());
             }
         }
     }
 
+    if(!reorgAdds.empty())
+    {
+        prepend(reorgAdds);
+    }
+
+    // Compact once there are enough empty slots to be worth it. Readers find
+    // their place again by sequence number, so this doesn't invalidate them.
+    // Leave it to changes that only append, so that large removals (such as
+    // for a new block) aren't held up by it.
+    if(changeSet.getTailAppendOnly() &&
+       mRemovedSlots >= MIN_SLOTS_TO_COMPACT && mRemovedSlots * 2 >= mSlots.size())
+    {
+        compact();
+    }
+
     // Do we need to invalidate any observers after this change?
     if(!changeSet.getTailAppendOnly())
     {
@@ -96,50 +124,100 @@ void CJournal::applyChanges(const CJournalChangeSet& changeSet)
     }
 }
 
-// Get start index for our underlying sequence
-CJournal::Index CJournal::ReadLock::begin() const
+// Find the position of the slot with the given sequence number, or of the
+// first one after it
+size_t CJournal::position(int64_t sequence) const
 {
-    return Index { mJournal.get(), mJournal->index<1>().begin() };
+    auto it { std::lower_bound(mSlots.begin(), mSlots.end(), sequence,
+        [](const Slot& slot, int64_t seq) { return slot.sequence < seq; }) };
+    return static_cast<size_t>(std::distance(mSlots.begin(), it));
 }
 
-// Get end index for our underlying sequence
-CJournal::Index CJournal::ReadLock::end() const
+// Find the position of the first entry at or after the given position
+size_t CJournal::nextEntry(size_t pos) const
 {
-    return Index { mJournal.get(), mJournal->index<1>().end() };
+    while(pos < mSlots.size() && mSlots[pos].removed())
+    {
+        ++pos;
+    }
+    return pos;
 }
 
+// Add an entry at the end
+void CJournal::append(const CJournalEntry& entry)
+{
+    mSlots.push_back({ mNextSequence, entry });
+    mSequences.emplace(TxIdKey{&entry.getTxn()->GetId()}, mNextSequence);
+    ++mNextSequence;
+}
 
-/** Journal Index **/
+// Add entries at the front, in the given order
+void CJournal::prepend(const std::vector<CJournalEntry>& entries)
+{
+    for(auto it = entries.rbegin(); it != entries.rend(); ++it)
+    {
+        --mFrontSequence;
+        mSlots.push_front({ mFrontSequence, *it });
+        mSequences.emplace(TxIdKey{&it->getTxn()->GetId()}, mFrontSequence);
+    }
+    ++mLayout;
+}
 
-// Constructor
-CJournal::Index::Index(const CJournal* journal, const Underlying& begin)
-: mJournal{journal}, mValidTime{GetTimeMicros()}, mCurrItem{begin}
+// Empty the slot for the given transaction
+bool CJournal::remove(const CJournalEntry& entry)
 {
-    // Work out what to do for previous item pointer
-    if(mCurrItem == mJournal->index<1>().begin())
+    auto it { mSequences.find(TxIdKey{&entry.getTxn()->GetId()}) };
+    if(it == mSequences.end())
     {
-        // Can't point before the start
-        mPrevItem = mJournal->index<1>().end();
+        return false;
     }
-    else if(mCurrItem == mJournal->index<1>().end())
+
+    Slot& slot { mSlots[position(it->second)] };
+    mSequences.erase(it);
+    slot.entry = CJournalEntry { nullptr, 0, Amount{0}, std::nullopt, false };
+    ++mRemovedSlots;
+    return true;
+}
+
+// Drop all empty slots
+void CJournal::compact()
+{
+    LogPrint(BCLog::JOURNAL, "Compacting journal, dropping %d of %d slots\n",
+        mRemovedSlots, mSlots.size());
+
+    std::deque<Slot> slots {};
+    for(Slot& slot : mSlots)
     {
-        if(!mJournal->index<1>().empty())
-        {
-            // Point 1 before the end
-            mPrevItem = mJournal->index<1>().end();
-            --mPrevItem;
-        }
-        else
+        if(!slot.removed())
         {
-            mPrevItem = mJournal->index<1>().end();
+            slots.push_back(std::move(slot));
         }
     }
-    else
-    {
-        // Point 1 before current position
-        mPrevItem = mCurrItem;
-        --mPrevItem;
-    }
+    mSlots = std::move(slots);
+    mRemovedSlots = 0;
+    ++mLayout;
+}
+
+// Get start index for our underlying sequence
+CJournal::Index CJournal::ReadLock::begin() const
+{
+    return Index { mJournal.get(), 0 };
+}
+
+// Get end index for our underlying sequence
+CJournal::Index CJournal::ReadLock::end() const
+{
+    return Index { mJournal.get(), mJournal->mSlots.size() };
+}
+
+
+/** Journal Index **/
+
+// Constructor
+CJournal::Index::Index(const CJournal* journal, size_t pos)
+: mJournal{journal}, mValidTime{GetTimeMicros()}, mLayout{journal->mLayout}
+{
+    moveTo(pos);
 }
 
 // Are we still valid?
@@ -149,11 +227,16 @@ bool CJournal::Index::valid() const
     return ( mJournal && mValidTime > mJournal->getLastInvalidatingTime() );
 }
 
+// Get the entry we point to
+const CJournalEntry& CJournal::Index::at() const
+{
+    return mJournal->mSlots[position()].entry;
+}
+
 // Increment
 CJournal::Index& CJournal::Index::operator++()
 {
-    // Set previous to current, and move on current
-    mPrevItem = mCurrItem++;
+    moveTo(position() + 1);
     return *this;
 }
 
@@ -168,24 +251,33 @@ void CJournal::Index::reset()
         throw std::runtime_error("Can't reset invalidated index");
     }
 
-    if(mCurrItem == mJournal->index<1>().end())
+    moveTo(position());
+}
+
+// Our position in the journal
+size_t CJournal::Index::position() const
+{
+    if(mLayout != mJournal->mLayout)
     {
-        if(mPrevItem != mJournal->index<1>().end())
-        {
-            Underlying prevNext { mPrevItem };
-            ++prevNext;
-            if(prevNext != mJournal->index<1>().end())
-            {
-                // New items have arrived, reset current pointer
-                mCurrItem = prevNext;
-            }
-        }
-        else if(!mJournal->index<1>().empty())
-        {
-            // Previously the journal must have been empty, but now items have
-            // arrived. Reset current pointer.
-            mCurrItem = mJournal->index<1>().begin();
-        }
+        // Slots have moved, find our place again
+        mPos = mJournal->position(mSequence);
+        mLayout = mJournal->mLayout;
+    }
+    return mPos;
+}
+
+// Move to the first entry at or after the given position
+void CJournal::Index::moveTo(size_t pos)
+{
+    mPos = mJournal->nextEntry(pos);
+    if(mPos < mJournal->mSlots.size())
+    {
+        mSequence = mJournal->mSlots[mPos].sequence;
+    }
+    else
+    {
+        // At the end, the next entry appended will be ours
+        mSequence = mJournal->mNextSequence;
     }
 }
 
@@ -230,10 +322,12 @@ CJournalTester::CJournalTester(const CJournalPtr& journal)
     std::shared_lock lock { journal->mMtx };
 
     // Rebuild the journal in our faster iterating (but slower updating) format.
-    const auto& journalIndex { journal->index<1>() };
-    for(auto it = journalIndex.begin(); it != journalIndex.end(); ++it)
+    for(const auto& slot : journal->mSlots)
     {
-        index1.emplace_back(*it);
+        if(!slot.removed())
+        {
+            index1.emplace_back(slot.entry);
+        }
     }
 }
 
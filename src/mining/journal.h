@@ -8,17 +8,19 @@
 
 #include <enum_cast.h>
 #include <mining/journal_entry.h>
+#include <txhasher.h>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/identity.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/random_access_index.hpp>
-#include <boost/multi_index/sequenced_index.hpp>
 
 #include <atomic>
+#include <deque>
 #include <memory>
 #include <ostream>
 #include <shared_mutex>
+#include <unordered_map>
 
 namespace mining
 {
@@ -53,6 +55,9 @@ class CJournal final
     // Get size of journal
     size_t size() const;
 
+    // Estimate the memory used by the journal
+    size_t DynamicMemoryUsage() const;
+
     // Get time we were last updated by an invalidating change
     int64_t getLastInvalidatingTime() const { return mInvalidatingTime; }
 
@@ -77,28 +82,68 @@ class CJournal final
         }
     };
 
-    // The journal itself is a multi-index of transactions and the order they
-    // should be read/replayed from the journal.
-    using TransactionList = boost::multi_index_container<
-        CJournalEntry,
-        boost::multi_index::indexed_by<
-            // Unique transaction
-            boost::multi_index::ordered_unique<
-                boost::multi_index::identity<CJournalEntry>,
-                EntrySorter
-            >,
-            // Order of replay
-            boost::multi_index::sequenced<>
-        >
-    >;
-    TransactionList mTransactions {};
+    // The journal itself is a chunked array of entries in the order they
+    // should be read/replayed from the journal. Each entry has a sequence
+    // number that never changes, so readers can find their place again after
+    // the array has been rearranged.
+    //
+    // Removed entries release their transaction and leave an empty slot
+    // behind, which keeps removal cheap and the positions of other entries
+    // unchanged. Empty slots are dropped by compacting the journal once they
+    // make up a large enough part of it.
+    struct Slot
+    {
+        int64_t sequence;
+        CJournalEntry entry;
+
+        bool removed() const { return !entry.getTxn(); }
+    };
+    std::deque<Slot> mSlots {};
+
+    // Sequence numbers for the next entry added to the end or the front
+    int64_t mNextSequence {0};
+    int64_t mFrontSequence {0};
+
+    // Number of empty slots
+    size_t mRemovedSlots {0};
 
-    // Convenience accessor to fetch the given multi-index index
-    template<unsigned I>
-    const typename TransactionList::nth_index<I>::type& index() const
+    // Changed whenever the positions of the slots change
+    uint64_t mLayout {0};
+
+    // Lookup from transaction to the sequence number of its entry. The key
+    // refers to the id held by the entry's transaction wrapper, so the id
+    // isn't stored twice.
+    struct TxIdKey
+    {
+        const TxId* id;
+        bool operator==(const TxIdKey& that) const { return *id == *that.id; }
+    };
+    struct TxIdKeyHasher
     {
-        return mTransactions.get<I>();
-    }
+        size_t operator()(const TxIdKey& key) const noexcept { return SaltedTxidHasher{}(*key.id); }
+    };
+    std::unordered_map<TxIdKey, int64_t, TxIdKeyHasher> mSequences {};
+
+    // Don't compact until there are at least this many empty slots, and they
+    // make up at least half of the journal
+    static constexpr size_t MIN_SLOTS_TO_COMPACT {1024};
+
+    // Find the position of the slot with the given sequence number, or of the
+    // first one after it
+    size_t position(int64_t sequence) const;
+
+    // Find the position of the first entry at or after the given position
+    size_t nextEntry(size_t pos) const;
+
+    // Add entries at the end or the front
+    void append(const CJournalEntry& entry);
+    void prepend(const std::vector<CJournalEntry>& entries);
+
+    // Empty the slot for the given transaction, returns false if not found
+    bool remove(const CJournalEntry& entry);
+
+    // Drop all empty slots
+    void compact();
 
     // Time of last invalidating change
     std::atomic_int64_t mInvalidatingTime {0};
@@ -118,26 +163,36 @@ class CJournal final
     // it came from is locked by holding a ReadLock (see below).
     class Index
     {
-        using Underlying = TransactionList::nth_index<1>::type::const_iterator;
-
       public:
         Index() = default;
-        Index(const CJournal* journal, const Underlying& begin);
+        Index(const CJournal* journal, size_t pos);
 
         bool valid() const;
-        const CJournalEntry& at() const { return *mCurrItem; }
+        const CJournalEntry& at() const;
         void reset();
 
         Index& operator++();
-        bool operator==(const Index& that) { return (mCurrItem == that.mCurrItem); }
-        bool operator!=(const Index& that) { return !(*this == that); }
+        bool operator==(const Index& that) const { return (mSequence == that.mSequence); }
+        bool operator!=(const Index& that) const { return !(*this == that); }
 
       private:
 
+        // Our position in the journal, looked up again if the journal has
+        // been compacted since we last checked
+        size_t position() const;
+
+        // Move to the first entry at or after the given position
+        void moveTo(size_t pos);
+
         const CJournal* mJournal {nullptr};
         int64_t mValidTime       {-1};
-        Underlying mCurrItem     {};
-        Underlying mPrevItem     {};
+
+        // Sequence number of our entry, or of the next entry to be appended
+        // if we are at the end
+        int64_t mSequence        {0};
+
+        mutable size_t mPos      {0};
+        mutable uint64_t mLayout {0};
     };
 
     // An RAII wrapper for holding a read lock on the journal
@@ -9,16 +9,22 @@
 #include <config.h>
 #include <consensus/validation.h>
 #include <logging.h>
+#include <mining/factory.h>
 #include <mining/journal_builder.h>
+#include <parallel_batches.h>
 #include <timedata.h>
 #include <txmempool.h>
 #include <util.h>
 #include <validation.h>
 
+#include <algorithm>
+#include <future>
 #include <limits>
 
 using mining::CJournal;
 using mining::CBlockTemplate;
+using mining::CMiningFactory;
+using mining::CTemplateDelta;
 using mining::JournalingBlockAssembler;
 
 namespace
@@ -32,11 +38,143 @@ namespace
     {
         return gArgs.GetBoolArg("-jbafillafternewblock", JournalingBlockAssembler::DEFAULT_NEW_BLOCK_FILL);
     }
+    bool GetFeeBuckets()
+    {
+        return gArgs.GetBoolArg("-jbafeebuckets", JournalingBlockAssembler::DEFAULT_FEE_BUCKETS);
+    }
 }
 
+// Reads transactions from the journal ahead of the block assembly, and
+// fetches them and checks their lock times on other threads. The block
+// assembly consumes the results in journal order while later batches are
+// still being checked. Must not outlive the journal lock it was created under.
+class JournalingBlockAssembler::TxnCheckPipeline
+{
+  public:
+
+    struct CheckedTxn
+    {
+        CTransactionRef txn {nullptr};
+        bool final {false};
+    };
+
+    TxnCheckPipeline(const Config& config, const CBlockIndex* pindex, int64_t lockTimeCutoff,
+                     CJournal::Index pos, const CJournal::Index& journalEnd, uint64_t maxTxns,
+                     uint64_t blockSize, uint64_t maxBlockSize)
+    : mConfig{config}, mIndex{pindex}, mLockTimeCutoff{lockTimeCutoff}
+    {
+        // Transactions are only ever added in journal order, so there's no need
+        // to read ahead past the point where the block would be full
+        for(uint64_t i = 0; i < maxTxns && pos != journalEnd; ++i, ++pos)
+        {
+            blockSize += pos.at().getTxnSize();
+            if(blockSize >= maxBlockSize)
+            {
+                break;
+            }
+            mEntries.push_back(&pos.at());
+        }
+        mResults.resize(mEntries.size());
+
+        // Keep one batch per pool thread in flight, small reads are checked right here
+        mNumThreads = GetBatchThreadPool().getPoolSize();
+        mBatchSize = std::max(MIN_BATCH_SIZE, (mEntries.size() + 4 * mNumThreads - 1) / (4 * mNumThreads));
+        mFutures.resize((mEntries.size() + mBatchSize - 1) / mBatchSize);
+        if(mFutures.size() == 1)
+        {
+            checkBatch(0);
+        }
+        else
+        {
+            for(size_t batch = 0; batch < std::min(mNumThreads, mFutures.size()); ++batch)
+            {
+                launch(batch);
+            }
+        }
+    }
+
+    ~TxnCheckPipeline()
+    {
+        mCancelled = true;
+        for(auto& future : mFutures)
+        {
+            if(future.valid())
+            {
+                future.wait();
+            }
+        }
+    }
+
+    TxnCheckPipeline(const TxnCheckPipeline&) = delete;
+    TxnCheckPipeline& operator=(const TxnCheckPipeline&) = delete;
+
+    // The checked transaction at the current journal position, or nullptr if
+    // that is past the read ahead window
+    const CheckedTxn* peek()
+    {
+        if(mNext >= mResults.size())
+        {
+            return nullptr;
+        }
+
+        size_t batch { mNext / mBatchSize };
+        if(mFutures[batch].valid())
+        {
+            mFutures[batch].get();
+            if(batch + mNumThreads < mFutures.size())
+            {
+                launch(batch + mNumThreads);
+            }
+        }
+        return &mResults[mNext];
+    }
+
+    // Move past the current journal position
+    void pop() { ++mNext; }
+
+  private:
+
+    static constexpr size_t MIN_BATCH_SIZE {256};
+
+    void launch(size_t batch)
+    {
+        mFutures[batch] = make_task(GetBatchThreadPool(), [this, batch]{ checkBatch(batch); });
+    }
+
+    void checkBatch(size_t batch)
+    {
+        size_t end { std::min((batch + 1) * mBatchSize, mEntries.size()) };
+        for(size_t i = batch * mBatchSize; i < end && !mCancelled; ++i)
+        {
+            CheckedTxn& result { mResults[i] };
+            result.txn = mEntries[i]->getTxn()->GetTx();
+            result.final = (result.txn != nullptr);
+            if(result.final && mIndex)
+            {
+                CValidationState state {};
+                result.final = ContextualCheckTransaction(mConfig, *result.txn, state, mIndex->GetHeight() + 1,
+                                                          mLockTimeCutoff, false);
+            }
+        }
+    }
+
+    const Config& mConfig;
+    const CBlockIndex* mIndex {nullptr};
+    int64_t mLockTimeCutoff {0};
+
+    std::vector<const CJournalEntry*> mEntries {};
+    std::vector<CheckedTxn> mResults {};
+    std::vector<std::future<void>> mFutures {};
+    size_t mNumThreads {1};
+    size_t mBatchSize {MIN_BATCH_SIZE};
+    size_t mNext {0};
+    std::atomic_bool mCancelled {false};
+};
+
 // Construction
 JournalingBlockAssembler::JournalingBlockAssembler(const Config& config)
-: BlockAssembler{config}, mMaxSlotTransactions{GetMaxTxnBatch()}, mNewBlockFill{GetFillAfterNewBlock()}
+: BlockAssembler{config}, mMaxSlotTransactions{GetMaxTxnBatch()}, mNewBlockFill{GetFillAfterNewBlock()},
+  mFeeBucketSelection{GetFeeBuckets()}
 {
     // Create a new starting block
     newBlock();
@@ -62,6 +200,16 @@ void JournalingBlockAssembler::ReadConfigParameters()
     // Get config values
     mMaxSlotTransactions = GetMaxTxnBatch();
     mNewBlockFill = GetFillAfterNewBlock();
+
+    // Changing how transactions are selected means starting over
+    std::unique_lock<std::mutex> lock { mMtx };
+    bool feeBuckets { GetFeeBuckets() };
+    if(feeBuckets != mFeeBucketSelection)
+    {
+        mFeeBucketSelection = feeBuckets;
+        newBlock();
+        mState.mJournalPos = CJournal::ReadLock{mJournal}.begin();
+    }
 }
 
 
@@ -78,10 +226,11 @@ std::unique_ptr<CBlockTemplate> JournalingBlockAssembler::CreateNewBlock(const C
         std::unique_lock<std::mutex> lock { mMtx };
 
         // Get our best block even if the background thread hasn't run for a while
-        updateBlock(pindexPrevNew, mNewBlockFill? std::numeric_limits<uint64_t>::max() : mMaxSlotTransactions.load());
+        updateBlock(pindexPrevNew, mNewBlockFill? std::numeric_limits<uint64_t>::max() : mMaxSlotTransactions.load(), false);
         // Copy our current transactions into the block
         block->vtx = mBlockTxns;
     }
+    CMiningFactory::GetTemplateDeltaStream().SignalPublished();
 
     // Fill in the block header fields
     FillBlockHeader(block, pindexPrevNew, scriptPubKeyIn, mState.mBlockFees);
@@ -143,8 +292,11 @@ void JournalingBlockAssembler::threadBlockUpdate() noexcept
             if(status == std::future_status::timeout)
             {
                 // Update block template
-                std::unique_lock<std::mutex> lock { mMtx };
-                updateBlock(chainActive.Tip(), mMaxSlotTransactions);
+                {
+                    std::unique_lock<std::mutex> lock { mMtx };
+                    updateBlock(chainActive.Tip(), mMaxSlotTransactions, true);
+                }
+                CMiningFactory::GetTemplateDeltaStream().SignalPublished();
             }
             else if(status == std::future_status::ready)
                 break;
@@ -159,10 +311,14 @@ void JournalingBlockAssembler::threadBlockUpdate() noexcept
 }
 
 // Update our block template with some new transactions - Caller holds mutex
-void JournalingBlockAssembler::updateBlock(const CBlockIndex* pindex, uint64_t maxTxns)
+void JournalingBlockAssembler::updateBlock(const CBlockIndex* pindex, uint64_t maxTxns, bool deferDiskReads)
 {
     uint64_t txnNum {0};
 
+    // Track what changes so it can be published
+    bool reset {false};
+    size_t firstNew { mBlockTxns.size() };
+
     try
     {
         // Update chain state
@@ -180,6 +336,8 @@ void JournalingBlockAssembler::updateBlock(const CBlockIndex* pindex, uint64_t m
             // Release old lock, update journal/block, take new lock
             journalLock = CJournal::ReadLock {};
             newBlock();
+            reset = true;
+            firstNew = mBlockTxns.size();
             journalLock = CJournal::ReadLock { mJournal };
 
             // Reset our position to the start of the journal
@@ -203,29 +361,60 @@ void JournalingBlockAssembler::updateBlock(const CBlockIndex* pindex, uint64_t m
         // maxBlockSizeComputed is stored here to keep the same value throughout
         // the whole execution and to avoid locking/unlocking mutex too many times.
         uint64_t maxBlockSizeComputed = ComputeMaxGeneratedBlockSize();
-        while(!finished)
-        {
-            // Try to add another txn or a whole group of txns to the block
-            // mMaxTransactions is an internal limit used to reduce lock contention
-            // When we're adding a group we may add more transactions and that's OK
-            size_t nAdded = addTransactionOrGroup(pindex, journalEnd, maxBlockSizeComputed);
-            if(nAdded)
-            {
-                txnNum += nAdded;
-
-                // Set updated flag
-                mRecentlyUpdated = true;
 
-                // We're finished if we've reached the end of the journal, or we've added
-                // as many transactions this iteration as we're allowed.
-                finished = (mState.mJournalPos == journalEnd  || txnNum >= maxTxns);
-            }
-            else
+        if(mFeeBucketSelection)
+        {
+            // Everything new in the journal is sorted into buckets, which only needs the
+            // journal entries, and then the best of them are added to the block
+            readIntoFeeBuckets(journalEnd);
+            txnNum = addFromFeeBuckets(pindex, maxBlockSizeComputed, maxTxns);
+        }
+        else if(deferDiskReads && !mSlotPrefetched && prefetchTransactions(journalEnd, maxTxns, maxBlockSizeComputed) > 0)
+        {
+            // Nothing was read ahead for this slot (it's the first since a reset, or
+            // since we caught up with the journal) and some of it is on disk, so
+            // leave it until it's been read back rather than wait for the disk here.
+            LogPrint(BCLog::JOURNAL, "BlockAssembler waiting for transactions to be read from disk\n");
+        }
+        else
+        {
+            // Whatever was prefetched is used up by this slot
+            mSlotPrefetched = false;
+
+            // Fetch and check the transactions we're going to look at in parallel,
+            // while they're committed to the block in journal order here.
+            TxnCheckPipeline pipeline { mConfig, pindex, mLockTimeCutoff, mState.mJournalPos, journalEnd, maxTxns,
+                                        mState.mBlockSize, maxBlockSizeComputed };
+            while(!finished)
             {
-                // We're also finished once we can't add any more transactions.
-                finished = true;
+                // Try to add another txn or a whole group of txns to the block
+                // mMaxTransactions is an internal limit used to reduce lock contention
+                // When we're adding a group we may add more transactions and that's OK
+                size_t nAdded = addTransactionOrGroup(pindex, journalEnd, maxBlockSizeComputed, pipeline);
+                if(nAdded)
+                {
+                    txnNum += nAdded;
+
+                    // Set updated flag
+                    mRecentlyUpdated = true;
+
+                    // We're finished if we've reached the end of the journal, or we've added
+                    // as many transactions this iteration as we're allowed.
+                    finished = (mState.mJournalPos == journalEnd  || txnNum >= maxTxns);
+                }
+                else
+                {
+                    // We're also finished once we can't add any more transactions.
+                    finished = true;
+                }
             }
         }
+
+        // If we stopped because of the slot limit, the next slot continues from here
+        if(txnNum >= mMaxSlotTransactions && mState.mJournalPos != journalEnd)
+        {
+            prefetchTransactions(journalEnd, mMaxSlotTransactions, maxBlockSizeComputed);
+        }
     }
     catch(std::exception& e)
     {
@@ -236,6 +425,83 @@ void JournalingBlockAssembler::updateBlock(const CBlockIndex* pindex, uint64_t m
     {
         LogPrint(BCLog::JOURNAL, "BlockAssembler processed %llu transactions from the journal\n", txnNum);
     }
+
+    if(reset || mBlockTxns.size() > firstNew)
+    {
+        publishDelta(pindex, reset, firstNew);
+    }
+}
+
+// Publish what changed in the block template; the validation interface is
+// signalled once the caller has released the mutex - Caller holds mutex
+void JournalingBlockAssembler::publishDelta(const CBlockIndex* pindex, bool reset, size_t firstNew)
+{
+    CTemplateDelta delta {};
+    delta.reset = reset;
+    if(pindex)
+    {
+        delta.prevHash = pindex->GetBlockHash();
+    }
+    delta.added.reserve(mBlockTxns.size() - firstNew);
+    for(size_t i = firstNew; i < mBlockTxns.size(); ++i)
+    {
+        delta.added.emplace_back(mBlockTxns[i]->GetId(), mTxFees[i]);
+    }
+    delta.txCount = mBlockTxns.size() - 1;
+    delta.fees = mState.mBlockFees;
+    delta.merkleProof = mMerkleBranch.Update(mBlockTxns);
+
+    CMiningFactory::GetTemplateDeltaStream().Publish(std::move(delta));
+}
+
+// Have the transactions the next slot will read from the journal loaded back
+// from disk in the background - Caller holds mutex and journal lock
+size_t JournalingBlockAssembler::prefetchTransactions(const CJournal::Index& journalEnd, uint64_t maxTxns,
+                                                      uint64_t maxBlockSizeComputed)
+{
+    dropPrefetched();
+    mSlotPrefetched = true;
+
+    std::vector<CTransactionWrapperRef> onDisk {};
+    CJournal::Index pos { mState.mJournalPos };
+    uint64_t blockSize { mState.mBlockSize };
+    for(uint64_t i = 0; i < maxTxns && pos != journalEnd; ++i, ++pos)
+    {
+        // Nothing past the point where the block is full will be needed
+        blockSize += pos.at().getTxnSize();
+        if(blockSize >= maxBlockSizeComputed)
+        {
+            break;
+        }
+
+        const CTransactionWrapperRef& txn { pos.at().getTxn() };
+        if(!txn->IsInMemory())
+        {
+            onDisk.push_back(txn);
+            mPrefetched.push_back(txn);
+        }
+    }
+
+    const size_t numOnDisk { onDisk.size() };
+    if(numOnDisk > 0)
+    {
+        LogPrint(BCLog::JOURNAL, "BlockAssembler prefetching %llu transactions from disk\n", numOnDisk);
+        mempool.PrefetchTxsFromDisk(std::move(onDisk));
+    }
+    return numOnDisk;
+}
+
+// Release prefetched transactions nobody asked for - Caller holds mutex
+void JournalingBlockAssembler::dropPrefetched()
+{
+    for(const auto& prefetched : mPrefetched)
+    {
+        if(const CTransactionWrapperRef txn { prefetched.lock() })
+        {
+            txn->DropPrefetched();
+        }
+    }
+    mPrefetched.clear();
 }
 
 // Get (and reset) whether we might produce an updated template
@@ -253,6 +519,10 @@ void JournalingBlockAssembler::newBlock()
     // Get new current journal
     mJournal = mempool.getJournalBuilder().getCurrentJournal();
 
+    // Anything read ahead from the old journal is of no use to us now
+    dropPrefetched();
+    mSlotPrefetched = false;
+
     // Reset transaction list
     mBlockTxns.clear();
     mTxFees.clear();
@@ -266,23 +536,32 @@ void JournalingBlockAssembler::newBlock()
     mBlockTxns.emplace_back();
     mTxFees.emplace_back(Amount{-1});
 
+    // Nothing read from the journal yet
+    for(auto& bucket : mFeeBuckets)
+    {
+        bucket.clear();
+    }
+    mPendingTxns.clear();
+    mWaitingUnits.clear();
+
     // Set updated flag
     mRecentlyUpdated = true;
 }
 
-size_t JournalingBlockAssembler::addTransactionOrGroup(const CBlockIndex* pindex, const CJournal::Index& journalEnd, uint64_t maxBlockSizeComputed)
+size_t JournalingBlockAssembler::addTransactionOrGroup(const CBlockIndex* pindex, const CJournal::Index& journalEnd, uint64_t maxBlockSizeComputed,
+                                                       TxnCheckPipeline& pipeline)
 {
     auto& groupId { mState.mJournalPos.at().getGroupId() };
     if (!groupId)
     {
-        return addTransaction(pindex, maxBlockSizeComputed);
+        return addTransaction(pindex, maxBlockSizeComputed, pipeline);
     }
     else
     {
         GroupCheckpoint checkpoint {*this};
         size_t nAddedTotal {0};
         while (mState.mJournalPos != journalEnd && groupId == mState.mJournalPos.at().getGroupId()) {
-            size_t nAdded = addTransaction(pindex, maxBlockSizeComputed);
+            size_t nAdded = addTransaction(pindex, maxBlockSizeComputed, pipeline);
             if (!nAdded) {
                 checkpoint.rollback();
                 return 0;
@@ -315,7 +594,7 @@ void JournalingBlockAssembler::GroupCheckpoint::rollback()
 
 // Test whether we can add another transaction to the next block, and if
 // so do it - Caller holds mutex
-size_t JournalingBlockAssembler::addTransaction(const CBlockIndex* pindex, uint64_t maxBlockSizeComputed)
+size_t JournalingBlockAssembler::addTransaction(const CBlockIndex* pindex, uint64_t maxBlockSizeComputed, TxnCheckPipeline& pipeline)
 {
     const CJournalEntry& entry { mState.mJournalPos.at() };
 
@@ -327,22 +606,34 @@ size_t JournalingBlockAssembler::addTransaction(const CBlockIndex* pindex, uint6
         return 0;
     }
 
-    // FIXME: We may read the transaction from disk and then throw
-    //        it away if the contextual check fails.
-    const auto txn = entry.getTxn()->GetTx();
+    // Transactions within the read ahead window have already been fetched and
+    // checked, others (the tail of a group) are done here.
+    CTransactionRef txn {nullptr};
+    bool final {true};
+    if(const auto* checked = pipeline.peek())
+    {
+        txn = checked->txn;
+        final = checked->final;
+    }
+    else
+    {
+        txn = entry.getTxn()->GetTx();
+        if(txn && pindex)
+        {
+            CValidationState state {};
+            final = ContextualCheckTransaction(mConfig, *txn, state, pindex->GetHeight() + 1, mLockTimeCutoff, false);
+        }
+    }
+
     if (txn == nullptr) {
         LogPrint(BCLog::JOURNAL, "BlockAssembler found stale wrapper in the journal. need to start over.\n");
         return 0;
     }
 
     // Must check that lock times are still valid
-    if(pindex)
+    if(!final)
     {
-        CValidationState state {};
-        if(!ContextualCheckTransaction(mConfig, *txn, state, pindex->GetHeight() + 1, mLockTimeCutoff, false))
-        {
-            return 0;
-        }
+        return 0;
     }
 
     // Append next txn to the block template
@@ -355,6 +646,144 @@ size_t JournalingBlockAssembler::addTransaction(const CBlockIndex* pindex, uint6
 
     // Move to the next item in the journal
     ++mState.mJournalPos;
+    pipeline.pop();
 
     return 1;
 }
+
+// Bucket for the fee rate of a unit. Buckets double in fee rate, bucket 0 is for units
+// that pay nothing.
+size_t JournalingBlockAssembler::FeeBucketUnit::bucket() const
+{
+    int64_t feePerK { CFeeRate{fee, static_cast<size_t>(size)}.GetFeePerK().GetSatoshis() };
+    size_t bucket {0};
+    for(; feePerK > 0 && bucket < NUM_FEE_BUCKETS - 1; feePerK >>= 1)
+    {
+        ++bucket;
+    }
+    return bucket;
+}
+
+// Sort the entries added to the journal since the last time into fee buckets,
+// CPFP groups are kept together - Caller holds mutex and journal lock
+void JournalingBlockAssembler::readIntoFeeBuckets(const CJournal::Index& journalEnd)
+{
+    while(mState.mJournalPos != journalEnd)
+    {
+        FeeBucketUnit unit { mState.mJournalPos };
+        const GroupID groupId { mState.mJournalPos.at().getGroupId() };
+        do
+        {
+            const CJournalEntry& entry { mState.mJournalPos.at() };
+            unit.fee += entry.getFee();
+            unit.size += entry.getTxnSize();
+            ++unit.count;
+            mPendingTxns.insert(entry.getTxn()->GetId());
+            ++mState.mJournalPos;
+        }
+        while(groupId && mState.mJournalPos != journalEnd && groupId == mState.mJournalPos.at().getGroupId());
+
+        mFeeBuckets[unit.bucket()].push_back(std::move(unit));
+    }
+}
+
+// Take units from the fullest paying bucket until we have looked at maxTxns
+// transactions - Caller holds mutex and journal lock
+uint64_t JournalingBlockAssembler::addFromFeeBuckets(const CBlockIndex* pindex, uint64_t maxBlockSizeComputed, uint64_t maxTxns)
+{
+    uint64_t txnNum {0};
+    uint64_t examined {0};
+    while(examined < maxTxns)
+    {
+        // Units released by a parent may have gone back into a higher bucket
+        size_t bucket { NUM_FEE_BUCKETS };
+        while(bucket > 0 && mFeeBuckets[bucket - 1].empty())
+        {
+            --bucket;
+        }
+        if(bucket == 0)
+        {
+            break;
+        }
+
+        FeeBucketUnit unit { std::move(mFeeBuckets[bucket - 1].front()) };
+        mFeeBuckets[bucket - 1].pop_front();
+        examined += unit.count;
+        if(addFeeBucketUnit(pindex, maxBlockSizeComputed, unit) == UnitResult::ADDED)
+        {
+            txnNum += unit.count;
+            mRecentlyUpdated = true;
+        }
+    }
+    return txnNum;
+}
+
+// Add all transactions of a unit to the block template. A unit that doesn't fit, or that
+// isn't final, is dropped until the template is started over, as are its descendants
+// which wait for it forever - Caller holds mutex and journal lock
+JournalingBlockAssembler::UnitResult JournalingBlockAssembler::addFeeBucketUnit(const CBlockIndex* pindex,
+    uint64_t maxBlockSizeComputed, const FeeBucketUnit& unit)
+{
+    GroupCheckpoint checkpoint {*this};
+    std::vector<TxId> added {};
+    CJournal::Index pos { unit.first };
+    for(size_t i = 0; i < unit.count; ++i, ++pos)
+    {
+        const CJournalEntry& entry { pos.at() };
+        uint64_t blockSizeWithTx { mState.mBlockSize + entry.getTxnSize() };
+        if(blockSizeWithTx >= maxBlockSizeComputed)
+        {
+            return UnitResult::DROPPED;
+        }
+
+        CTransactionRef txn { entry.getTxn()->GetTx() };
+        if(txn == nullptr)
+        {
+            return UnitResult::DROPPED;
+        }
+
+        // Parents that were read from the journal have to be in the block first
+        for(const CTxIn& input : txn->vin)
+        {
+            const TxId& parent { input.prevout.GetTxId() };
+            if(mPendingTxns.count(parent) && std::find(added.begin(), added.end(), parent) == added.end())
+            {
+                mWaitingUnits[parent].push_back(unit);
+                return UnitResult::BLOCKED;
+            }
+        }
+
+        if(pindex)
+        {
+            CValidationState state {};
+            if(!ContextualCheckTransaction(mConfig, *txn, state, pindex->GetHeight() + 1, mLockTimeCutoff, false))
+            {
+                return UnitResult::DROPPED;
+            }
+        }
+
+        mBlockTxns.emplace_back(txn);
+        mTxFees.emplace_back(entry.getFee());
+        mState.mBlockSize = blockSizeWithTx;
+        mState.mBlockFees += entry.getFee();
+        added.push_back(txn->GetId());
+    }
+    checkpoint.commit();
+
+    // Release the units that were waiting for these transactions
+    for(const TxId& txid : added)
+    {
+        mPendingTxns.erase(txid);
+        auto waiting { mWaitingUnits.find(txid) };
+        if(waiting != mWaitingUnits.end())
+        {
+            for(FeeBucketUnit& child : waiting->second)
+            {
+                mFeeBuckets[child.bucket()].push_front(std::move(child));
+            }
+            mWaitingUnits.erase(waiting);
+        }
+    }
+
+    return UnitResult::ADDED;
+}
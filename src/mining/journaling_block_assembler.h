@@ -7,10 +7,16 @@
 #pragma once
 
 #include <mining/assembler.h>
+#include <mining/candidates.h>
 #include <mining/journal.h>
+#include <txhasher.h>
 
+#include <array>
+#include <deque>
 #include <future>
 #include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace mining
 {
@@ -25,6 +31,7 @@ class JournalingBlockAssembler : public BlockAssembler
     // Default config values
     static constexpr uint64_t DEFAULT_MAX_SLOT_TRANSACTIONS {20000};
     static constexpr bool DEFAULT_NEW_BLOCK_FILL {false};
+    static constexpr bool DEFAULT_FEE_BUCKETS {false};
 
     // Construction/destruction
     JournalingBlockAssembler(const Config& config);
@@ -49,16 +56,52 @@ class JournalingBlockAssembler : public BlockAssembler
     // Thread entry point for block update processing
     void threadBlockUpdate() noexcept;
 
-    // Update our block template with some new transactions
-    void updateBlock(const CBlockIndex* pindex, uint64_t maxTxns);
+    // Update our block template with some new transactions. Unless we're
+    // asked for a block straight away, transactions on disk that weren't
+    // prefetched are left for the next time slot.
+    void updateBlock(const CBlockIndex* pindex, uint64_t maxTxns, bool deferDiskReads);
 
     // Create a new block for us to start working on
     void newBlock();
 
+    // Publish the transactions added to the block template from position firstNew on
+    void publishDelta(const CBlockIndex* pindex, bool reset, size_t firstNew);
+
+    // Reads and checks transactions from the journal ahead of the block assembly
+    class TxnCheckPipeline;
+
     // Test whether we can add another transaction to the next block and
     // return the number of transactions actually added
-    size_t addTransactionOrGroup(const CBlockIndex* pindex, const CJournal::Index& journalEnd, uint64_t maxBlockSizeComputed);
-    size_t addTransaction(const CBlockIndex* pindex, uint64_t maxBlockSizeComputed);
+    size_t addTransactionOrGroup(const CBlockIndex* pindex, const CJournal::Index& journalEnd, uint64_t maxBlockSizeComputed,
+                                 TxnCheckPipeline& pipeline);
+    size_t addTransaction(const CBlockIndex* pindex, uint64_t maxBlockSizeComputed, TxnCheckPipeline& pipeline);
+
+    // Start reading transactions for the next time slot that fit in the block
+    // back from disk, and return how many were on disk
+    size_t prefetchTransactions(const CJournal::Index& journalEnd, uint64_t maxTxns, uint64_t maxBlockSizeComputed);
+    // Release whatever we prefetched that hasn't been used
+    void dropPrefetched();
+
+    // A transaction, or a whole group of transactions, waiting in a fee bucket
+    struct FeeBucketUnit
+    {
+        // Journal position of the first transaction, and number of transactions
+        CJournal::Index first {};
+        size_t count {0};
+        Amount fee {0};
+        uint64_t size {0};
+
+        size_t bucket() const;
+    };
+    enum class UnitResult { ADDED, BLOCKED, DROPPED };
+
+    // Sort the journal entries up to journalEnd into fee buckets
+    void readIntoFeeBuckets(const CJournal::Index& journalEnd);
+
+    // Add up to maxTxns transactions from the fee buckets to the block template,
+    // highest fee rate first, and return the number added
+    uint64_t addFromFeeBuckets(const CBlockIndex* pindex, uint64_t maxBlockSizeComputed, uint64_t maxTxns);
+    UnitResult addFeeBucketUnit(const CBlockIndex* pindex, uint64_t maxBlockSizeComputed, const FeeBucketUnit& unit);
 
     // Our internal mutex
     mutable std::mutex mMtx {};
@@ -83,10 +126,17 @@ class JournalingBlockAssembler : public BlockAssembler
     // Whether every call to CreateNewBlock returns all txns from the journal,
     // or whether sometimes only a subset may be returned.
     std::atomic_bool mNewBlockFill {DEFAULT_NEW_BLOCK_FILL};
+    // Whether transactions are taken in order of fee rate rather than in journal order
+    bool mFeeBucketSelection {DEFAULT_FEE_BUCKETS};
 
     // The journal we're reading from and our current position in that journal
     CJournalPtr mJournal {nullptr};
 
+    // Transactions we last asked to be read back from disk, and whether they
+    // cover the next time slot
+    std::vector<std::weak_ptr<CTransactionWrapper>> mPrefetched {};
+    bool mSlotPrefetched {false};
+
     // Variables used for mining statistics
     BlockStats mLastBlockStats{};
 
@@ -106,6 +156,17 @@ class JournalingBlockAssembler : public BlockAssembler
     std::vector<CTransactionRef> mBlockTxns {};
     std::vector<Amount> mTxFees {};
 
+    // Coinbase merkle branch of the block template, for publishing template updates
+    CCoinbaseMerkleBranch mMerkleBranch {};
+
+    // Fee bucket selection state. Transactions read from the journal wait in a bucket for
+    // their fee rate, each bucket in journal order. Units that have a parent which was read
+    // but is not in the block template yet wait for that parent instead.
+    static constexpr size_t NUM_FEE_BUCKETS {48};
+    std::array<std::deque<FeeBucketUnit>, NUM_FEE_BUCKETS> mFeeBuckets {};
+    std::unordered_set<TxId, SaltedTxidHasher> mPendingTxns {};
+    std::unordered_map<TxId, std::vector<FeeBucketUnit>, SaltedTxidHasher> mWaitingUnits {};
+
     BlockAssemblyState mState {};
     // When adding transaction group we optimize for the happy case
     // and do serious extra work only when we need to rollback() when
@@ -0,0 +1,110 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <mining/template_stream.h>
+#include <rpc/jsonwriter.h>
+#include <validationinterface.h>
+
+using mining::CTemplateDelta;
+using mining::CTemplateDeltaRef;
+using mining::CTemplateDeltaStream;
+
+void CTemplateDelta::ToJSON(CJSONWriter& writer) const
+{
+    writer.writeBeginObject();
+    writer.pushKV("sequence", sequence);
+    writer.pushKV("reset", reset);
+    writer.pushKV("prevhash", prevHash.GetHex());
+    writer.pushKV("num_tx", txCount);
+    writer.pushKV("fees", fees.GetSatoshis());
+
+    writer.writeBeginArray("added");
+    for(const auto& [txid, fee] : added)
+    {
+        writer.writeBeginObject();
+        writer.pushKV("txid", txid.GetHex());
+        writer.pushKV("fee", fee.GetSatoshis());
+        writer.writeEndObject();
+    }
+    writer.writeEndArray();
+
+    writer.writeBeginArray("merkleProof");
+    for(const auto& branch : merkleProof)
+    {
+        writer.pushV(branch.GetHex());
+    }
+    writer.writeEndArray();
+    writer.writeEndObject();
+}
+
+CTemplateDeltaRef CTemplateDeltaStream::Publish(CTemplateDelta&& delta)
+{
+    CTemplateDeltaRef published {};
+    {
+        std::lock_guard lock { mMtx };
+        delta.sequence = ++mSequence;
+        published = std::make_shared<const CTemplateDelta>(std::move(delta));
+        mDeltas.push_back(published);
+        while(mDeltas.size() > mMaxDeltas)
+        {
+            mDeltas.pop_front();
+        }
+        mUnsignalled.push_back(published);
+    }
+    mPublished.notify_all();
+
+    return published;
+}
+
+void CTemplateDeltaStream::SignalPublished()
+{
+    std::lock_guard signalLock { mSignalMtx };
+    while(true)
+    {
+        CTemplateDeltaRef delta {};
+        {
+            std::lock_guard lock { mMtx };
+            if(mUnsignalled.empty())
+            {
+                break;
+            }
+            delta = std::move(mUnsignalled.front());
+            mUnsignalled.pop_front();
+        }
+        GetMainSignals().TemplateDeltaPublished(delta);
+    }
+}
+
+std::optional<std::vector<CTemplateDeltaRef>> CTemplateDeltaStream::GetSince(uint64_t sequence, std::chrono::milliseconds timeout) const
+{
+    std::unique_lock lock { mMtx };
+    if(sequence > mSequence || (!mDeltas.empty() && sequence + 1 < mDeltas.front()->sequence))
+    {
+        return std::nullopt;
+    }
+
+    mPublished.wait_for(lock, timeout, [this, sequence]{ return mSequence > sequence; });
+
+    // We may have waited long enough for the deltas to be dropped
+    if(!mDeltas.empty() && sequence + 1 < mDeltas.front()->sequence)
+    {
+        return std::nullopt;
+    }
+
+    std::vector<CTemplateDeltaRef> deltas {};
+    for(const auto& delta : mDeltas)
+    {
+        if(delta->sequence > sequence)
+        {
+            deltas.push_back(delta);
+        }
+    }
+    return deltas;
+}
+
+uint64_t CTemplateDeltaStream::GetSequence() const
+{
+    std::lock_guard lock { mMtx };
+    return mSequence;
+}
@@ -0,0 +1,107 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#pragma once
+
+#include <amount.h>
+#include <primitives/transaction.h>
+#include <uint256.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+class CJSONWriter;
+
+namespace mining
+{
+
+/**
+* The change to the block template made by one update of the block assembler.
+*
+* Transactions are only ever appended to a template, until the assembler starts
+* over with a new one (after a new block, or when the journal is replaced).
+* Such an update is flagged as a reset and lists the whole new template.
+*/
+struct CTemplateDelta
+{
+    // Position of this delta in the stream
+    uint64_t sequence {0};
+
+    // Whether the template was started over, earlier deltas no longer apply
+    bool reset {false};
+
+    // Tip the template builds on
+    uint256 prevHash {};
+
+    // Transactions appended to the template, in template order, with their fees
+    std::vector<std::pair<TxId, Amount>> added {};
+
+    // Template totals after this update, excluding the coinbase
+    uint64_t txCount {0};
+    Amount fees {0};
+
+    // Merkle branch of the coinbase for the updated template
+    std::vector<uint256> merkleProof {};
+
+    void ToJSON(CJSONWriter& writer) const;
+};
+using CTemplateDeltaRef = std::shared_ptr<const CTemplateDelta>;
+
+/**
+* The most recent template deltas, for clients that follow the template by
+* sequence number instead of polling for complete templates.
+*
+* Deltas are also published to the validation interface (and from there to ZMQ)
+* as they are added.
+*/
+class CTemplateDeltaStream
+{
+  public:
+
+    // How many deltas are kept for clients to catch up from
+    static constexpr size_t DEFAULT_MAX_DELTAS {100};
+
+    explicit CTemplateDeltaStream(size_t maxDeltas = DEFAULT_MAX_DELTAS)
+    : mMaxDeltas{maxDeltas}
+    {}
+
+    // Assign the next sequence number to a delta and keep it for clients. The
+    // validation interface isn't told until SignalPublished(), so this can be
+    // called while the publisher holds its own locks.
+    CTemplateDeltaRef Publish(CTemplateDelta&& delta);
+
+    // Signal the validation interface with the deltas published since the last
+    // call, in sequence order. Call without holding any locks.
+    void SignalPublished();
+
+    // The deltas following the given sequence number, waiting up to timeout for
+    // the first one. Returns nothing if the client has to resync because the
+    // deltas it missed are no longer kept or the sequence number is unknown.
+    std::optional<std::vector<CTemplateDeltaRef>> GetSince(uint64_t sequence, std::chrono::milliseconds timeout) const;
+
+    // Sequence number of the latest delta (0 if there is none)
+    uint64_t GetSequence() const;
+
+  private:
+
+    mutable std::mutex mMtx {};
+    mutable std::condition_variable mPublished {};
+
+    size_t mMaxDeltas {DEFAULT_MAX_DELTAS};
+    std::deque<CTemplateDeltaRef> mDeltas {};
+    uint64_t mSequence {0};
+
+    // Published deltas the validation interface hasn't been told about yet. The
+    // signal mutex keeps the signals in order when there are several publishers.
+    std::mutex mSignalMtx {};
+    std::deque<CTemplateDeltaRef> mUnsignalled {};
+};
+
+}
@@ -0,0 +1,107 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * A lock free multiple producer, single consumer queue.
+ *
+ * Producers push items onto a linked list with a single compare and swap, so
+ * they never block each other or the consumer. The consumer takes everything
+ * queued so far in one go, and gets it back in the order it was pushed.
+ *
+ * Because the consumer only ever takes the whole list with an atomic
+ * exchange, it is also safe to have several consumers, as long as none of
+ * them relies on seeing items in order across separate calls to PopAll.
+ */
+template<typename T>
+class MPSCQueue
+{
+  public:
+    MPSCQueue() = default;
+    ~MPSCQueue() { Free(mHead.exchange(nullptr)); }
+
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+    MPSCQueue(MPSCQueue&&) = delete;
+    MPSCQueue& operator=(MPSCQueue&&) = delete;
+
+    // Add an item; returns true if the queue was empty before
+    template<typename U>
+    bool Push(U&& item)
+    {
+        // Count it first, so the size can't drop below zero if it's popped
+        // before we get to count it
+        ++mSize;
+        Node* node { new Node { std::forward<U>(item), nullptr } };
+
+        // Once it's pushed the consumer may take it at any time, so don't
+        // touch the node again after that
+        Node* head { mHead.load(std::memory_order_relaxed) };
+        do
+        {
+            node->next = head;
+        } while(!mHead.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+        return head == nullptr;
+    }
+
+    // Take all queued items, oldest first, appending them to the given vector
+    void PopAll(std::vector<T>& items)
+    {
+        Node* head { mHead.exchange(nullptr, std::memory_order_acquire) };
+
+        // Reverse the list to get back to the order items were pushed in
+        Node* oldest {nullptr};
+        size_t count {0};
+        while(head)
+        {
+            Node* next { head->next };
+            head->next = oldest;
+            oldest = head;
+            head = next;
+            ++count;
+        }
+
+        items.reserve(items.size() + count);
+        for(Node* node = oldest; node; node = node->next)
+        {
+            items.push_back(std::move(node->item));
+        }
+        Free(oldest);
+        mSize -= count;
+    }
+
+    // Whether there's anything queued
+    bool Empty() const { return mHead.load(std::memory_order_relaxed) == nullptr; }
+
+    // Number of items queued. Only approximate while items are being pushed.
+    size_t Size() const { return mSize; }
+
+  private:
+
+    struct Node
+    {
+        T item;
+        Node* next {nullptr};
+    };
+
+    static void Free(Node* node)
+    {
+        while(node)
+        {
+            Node* next { node->next };
+            delete node;
+            node = next;
+        }
+    }
+
+    std::atomic<Node*> mHead {nullptr};
+    std::atomic<size_t> mSize {0};
+};
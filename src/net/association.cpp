@@ -357,19 +357,11 @@ bool Association::GetPausedForReceiving(PausedFor anyAll) const
     }
 }
 
-bool Association::SetSocketsForSelect(fd_set& setRecv, fd_set& setSend, fd_set& setError,
-                                      SOCKET& socketMax) const
+bool Association::HasCompleteMessages() const
 {
-    bool havefds {false};
-
-    // Get all sockets from each stream
     LOCK(cs_mStreams);
-    for(const auto& stream : mStreams)
-    {
-        havefds |= stream.second->SetSocketForSelect(setRecv, setSend, setError, socketMax);
-    }
-
-    return havefds;
+    return std::any_of(mStreams.begin(), mStreams.end(),
+        [](const auto& stream){ return stream.second->HasCompleteMessages(); });
 }
 
 std::pair<Stream::QueuedNetMessage, bool> Association::GetNextMessage()
@@ -378,23 +370,9 @@ std::pair<Stream::QueuedNetMessage, bool> Association::GetNextMessage()
     return mStreamPolicy->GetNextMessage(mStreams);
 }
 
-void Association::ServiceSockets(fd_set& setRecv, fd_set& setSend, fd_set& setError,
-                                  CConnman& connman, const Config& config, bool& gotNewMsgs,
-                                  uint64_t& bytesRecv, uint64_t& bytesSent)
+std::vector<StreamPtr> Association::GetStreams() const
 {
-    bytesRecv = bytesSent = 0;
-
-    // Service each stream socket
-    try
-    {
-        LOCK(cs_mStreams);
-        mStreamPolicy->ServiceSockets(mStreams, setRecv, setSend, setError, config,
-            gotNewMsgs, bytesRecv, bytesSent);
-    }
-    catch(BanStream& ban)
-    {
-        connman.Ban(GetPeerAddr(), BanReasonNodeMisbehaving);
-    }
+    return ForEachStream([](const StreamPtr& stream){ return stream; });
 }
 
 void Association::AvgBandwithCalc()
@@ -407,7 +385,7 @@ uint64_t Association::GetTotalSendQueueSize() const
 {
     // Get total of all stream send queue sizes
     LOCK(cs_mStreams);
-    return std::accumulate(mStreams.begin(), mStreams.end(), 0,
+    return std::accumulate(mStreams.begin(), mStreams.end(), uint64_t{0},
         [](const uint64_t& tot, const auto& stream) {
             return tot + stream.second->GetSendQueueSize();
         }
@@ -20,7 +20,6 @@
 class AssociationStats;
 class CConnman;
 class CNode;
-class Config;
 class CSerializedNetMsg;
 
 /**
@@ -73,15 +72,14 @@ class Association
     // Copy out current statistics
     void CopyStats(AssociationStats& stats) const;
 
-    // Add our sockets to the sets for reading and writing
-    bool SetSocketsForSelect(fd_set& setRecv, fd_set& setSend, fd_set& setError, SOCKET& socketMax) const;
-
     // Fetch the next message for processing
     std::pair<Stream::QueuedNetMessage, bool> GetNextMessage();
 
-    // Service all sockets that are ready
-    void ServiceSockets(fd_set& setRecv, fd_set& setSend, fd_set& setError, CConnman& connman,
-                        const Config& config, bool& gotNewMsgs, uint64_t& bytesRecv, uint64_t& bytesSent);
+    // Get whether ANY of our streams has completed messages waiting
+    bool HasCompleteMessages() const;
+
+    // Get all our streams
+    std::vector<StreamPtr> GetStreams() const;
 
     // Get current total send queue size
     uint64_t GetTotalSendQueueSize() const;
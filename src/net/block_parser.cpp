@@ -0,0 +1,238 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#include <net/block_parser.h>
+#include <serialize.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace
+{
+    // Thrown when we need more data than has arrived so far
+    struct NeedMoreData {};
+
+    // Minimal stream for deserialising from the received part of a payload
+    class PayloadReader
+    {
+      public:
+        PayloadReader(int type, int version, const char* data, size_t base, size_t size, size_t pos)
+        : mType{type}, mVersion{version}, mData{data}, mBase{base}, mSize{size}, mPos{pos}
+        {}
+
+        void read(char* pch, size_t nSize)
+        {
+            if(nSize > mSize - mPos)
+            {
+                throw NeedMoreData{};
+            }
+            memcpy(pch, mData + (mPos - mBase), nSize);
+            mPos += nSize;
+        }
+
+        template<typename T>
+        PayloadReader& operator>>(T& obj)
+        {
+            ::Unserialize(*this, obj);
+            return *this;
+        }
+
+        int GetType() const { return mType; }
+        int GetVersion() const { return mVersion; }
+        size_t GetPos() const { return mPos; }
+
+      private:
+        int mType {0};
+        int mVersion {0};
+        const char* mData {nullptr};
+        // Payload offset of mData
+        size_t mBase {0};
+        size_t mSize {0};
+        size_t mPos {0};
+    };
+}
+
+IncrementalBlockParser::IncrementalBlockParser(int type, int version, size_t payloadSize)
+: mType{type}, mVersion{version}, mPayloadSize{payloadSize}, mBlock{std::make_shared<CBlock>()}
+{}
+
+void IncrementalBlockParser::Parse(const char* data, size_t size)
+{
+    Parse(data, 0, size);
+}
+
+void IncrementalBlockParser::Parse(const char* data, size_t base, size_t size)
+{
+    if(mFailed || !mBlock || size < mRetrySize)
+    {
+        return;
+    }
+    assert(base <= mPos);
+
+    PayloadReader reader { mType, mVersion, data, base, size, mPos };
+    try
+    {
+        if(!mHeaderParsed)
+        {
+            reader >> *static_cast<CBlockHeader*>(mBlock.get());
+            mNumTxns = ReadCompactSize(reader);
+            mHeaderParsed = true;
+            mPos = reader.GetPos();
+        }
+
+        while(mBlock->vtx.size() < mNumTxns)
+        {
+            CTransactionRef txn {};
+            reader >> txn;
+            mPos = reader.GetPos();
+
+            if(!mBlock->vtx.empty())
+            {
+                for(const CTxIn& input : txn->vin)
+                {
+                    mOutpoints.push_back(input.prevout);
+                }
+            }
+            mBlock->vtx.emplace_back(std::move(txn));
+        }
+    }
+    catch(const NeedMoreData&)
+    {
+        // Wait until there's twice as much available for what we're stuck on,
+        // but always try again once we have the whole payload
+        mRetrySize = std::min(mPos + std::max<size_t>(2 * (size - mPos), 1), mPayloadSize);
+    }
+    catch(const std::exception&)
+    {
+        // Malformed; leave it to normal message processing to report
+        mFailed = true;
+        mBlock.reset();
+        mOutpoints.clear();
+    }
+}
+
+bool IncrementalBlockParser::Complete(size_t size) const
+{
+    return mBlock && mHeaderParsed && mBlock->vtx.size() == mNumTxns && mPos == size;
+}
+
+std::shared_ptr<CBlock> IncrementalBlockParser::TakeBlock()
+{
+    if(!mBlock || mFailed || !mHeaderParsed || mBlock->vtx.size() != mNumTxns)
+    {
+        return nullptr;
+    }
+    return std::move(mBlock);
+}
+
+std::vector<COutPoint> IncrementalBlockParser::TakeOutpoints()
+{
+    std::vector<COutPoint> outpoints {};
+    outpoints.swap(mOutpoints);
+    return outpoints;
+}
+
+AsyncBlockParser::AsyncBlockParser(int type, int version, size_t payloadSize)
+: mPayloadSize{payloadSize}, mParser{type, version, payloadSize}
+{}
+
+void AsyncBlockParser::Append(const char* data, size_t size)
+{
+    if(mFailed || size == 0)
+    {
+        return;
+    }
+    std::lock_guard lock { mChunksMtx };
+    mChunks.emplace_back(data, data + size);
+}
+
+bool AsyncBlockParser::ClaimRun()
+{
+    std::lock_guard lock { mChunksMtx };
+    if(mRunClaimed || mChunks.empty())
+    {
+        return false;
+    }
+    mRunClaimed = true;
+    return true;
+}
+
+void AsyncBlockParser::Run(const HeaderCheck& checkHeader, const Prefetch& prefetch)
+{
+    std::lock_guard parseLock { mParseMtx };
+    for(;;)
+    {
+        ParseAppendedNL();
+
+        // Outpoints are only worth fetching for a block we might accept
+        if(!mPrefetch && mParser.GetHeader())
+        {
+            mPrefetch = checkHeader(*mParser.GetHeader());
+        }
+        if(!mPrefetch.value_or(false))
+        {
+            mParser.TakeOutpoints();
+        }
+        else if(mParser.GetNumOutpoints() >= IncrementalBlockParser::OUTPOINT_BATCH_SIZE ||
+                (mReceived == mPayloadSize && mParser.GetNumOutpoints() > 0))
+        {
+            prefetch(mParser.TakeOutpoints());
+        }
+
+        std::lock_guard lock { mChunksMtx };
+        if(mChunks.empty())
+        {
+            mRunClaimed = false;
+            return;
+        }
+    }
+}
+
+std::shared_ptr<CBlock> AsyncBlockParser::TakeBlock()
+{
+    std::lock_guard parseLock { mParseMtx };
+    ParseAppendedNL();
+    if(mReceived != mPayloadSize || !mParser.Complete(mPayloadSize))
+    {
+        return nullptr;
+    }
+    return mParser.TakeBlock();
+}
+
+void AsyncBlockParser::ParseAppendedNL()
+{
+    std::vector<std::vector<char>> chunks {};
+    {
+        std::lock_guard lock { mChunksMtx };
+        chunks.swap(mChunks);
+    }
+    if(chunks.empty() || mFailed)
+    {
+        return;
+    }
+
+    for(const std::vector<char>& chunk : chunks)
+    {
+        mBuffer.insert(mBuffer.end(), chunk.begin(), chunk.end());
+        mReceived += chunk.size();
+    }
+    mParser.Parse(mBuffer.data(), mBufferBase, mReceived);
+
+    if(mParser.Failed())
+    {
+        // Don't keep anything more for a block we can't parse
+        mFailed = true;
+        mBuffer = {};
+        std::lock_guard lock { mChunksMtx };
+        mChunks.clear();
+        return;
+    }
+
+    // Only keep what we haven't parsed yet
+    const size_t parsed { mParser.GetPos() - mBufferBase };
+    mBuffer.erase(mBuffer.begin(), mBuffer.begin() + static_cast<std::ptrdiff_t>(parsed));
+    mBufferBase += parsed;
+}
@@ -0,0 +1,144 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#pragma once
+
+#include <primitives/block.h>
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+/**
+ * Parses a block message while it is still being received.
+ *
+ * Each time more of the payload arrives, the block header and as many
+ * complete transactions as are available are deserialised. Transaction IDs
+ * (the merkle leaves) are calculated as each transaction is deserialised, and
+ * the outpoints they spend are collected so they can be fetched ahead of
+ * validation. Once the whole message has arrived the block is ready to hand
+ * to validation, without having to deserialise it from the message first.
+ *
+ * A transaction split across what has arrived so far is tried again once the
+ * amount of data available for it has doubled (or the whole payload has
+ * arrived), so large transactions are parsed a bounded number of times.
+ */
+class IncrementalBlockParser
+{
+  public:
+    // Smallest block message worth parsing as it arrives
+    static constexpr size_t MIN_PAYLOAD_SIZE {1024 * 1024};
+    // Number of spent outpoints worth fetching together
+    static constexpr size_t OUTPOINT_BATCH_SIZE {4096};
+
+    IncrementalBlockParser(int type, int version, size_t payloadSize);
+
+    // Parse what we can from the payload received so far
+    void Parse(const char* data, size_t size);
+    // As above, but data only holds the payload from offset base, which
+    // must not be past what we have already parsed
+    void Parse(const char* data, size_t base, size_t size);
+
+    // How much of the payload we have parsed
+    size_t GetPos() const { return mPos; }
+
+    // The block header, once parsed
+    const CBlockHeader* GetHeader() const { return mHeaderParsed ? mBlock.get() : nullptr; }
+
+    // Whether we have parsed the whole block, using exactly size bytes
+    bool Complete(size_t size) const;
+
+    // Whether we gave up because the block is malformed
+    bool Failed() const { return mFailed; }
+
+    // Take the parsed block, if complete
+    std::shared_ptr<CBlock> TakeBlock();
+
+    // Take the outpoints spent by transactions parsed since we last asked
+    std::vector<COutPoint> TakeOutpoints();
+    size_t GetNumOutpoints() const { return mOutpoints.size(); }
+
+  private:
+
+    int mType {0};
+    int mVersion {0};
+    size_t mPayloadSize {0};
+
+    std::shared_ptr<CBlock> mBlock {};
+    bool mHeaderParsed {false};
+    uint64_t mNumTxns {0};
+
+    // How much of the payload we have parsed
+    size_t mPos {0};
+    // Don't try parsing again until at least this much has arrived
+    size_t mRetrySize {0};
+    bool mFailed {false};
+
+    std::vector<COutPoint> mOutpoints {};
+};
+
+/**
+ * Runs an IncrementalBlockParser away from the thread receiving the block, so
+ * that deserialising a large block doesn't hold up the other peers' network
+ * I/O.
+ *
+ * The receiving thread appends a copy of each chunk of payload as it arrives.
+ * A worker thread runs the parser over the chunks appended so far, and the
+ * message handler finishes off whatever is left once the whole message has
+ * arrived. Only the unparsed tail of the payload is kept, so as long as the
+ * worker keeps up the copies stay small.
+ */
+class AsyncBlockParser
+{
+  public:
+    AsyncBlockParser(int type, int version, size_t payloadSize);
+
+    AsyncBlockParser(const AsyncBlockParser&) = delete;
+    AsyncBlockParser& operator=(const AsyncBlockParser&) = delete;
+
+    // Add a chunk of received payload
+    void Append(const char* data, size_t size);
+
+    // Whether the caller should arrange for Run to be called; only true once
+    // until Run has caught up with what was appended
+    bool ClaimRun();
+
+    // Check the header before any outpoints are handed to prefetch
+    using HeaderCheck = std::function<bool(const CBlockHeader&)>;
+    using Prefetch = std::function<void(std::vector<COutPoint>&&)>;
+
+    // Parse the chunks appended so far, and any appended while we do
+    void Run(const HeaderCheck& checkHeader, const Prefetch& prefetch);
+
+    // Finish parsing, and take the block if the whole payload has been
+    // appended and parsed as exactly one block
+    std::shared_ptr<CBlock> TakeBlock();
+
+  private:
+
+    // Parse the chunks appended since last time; call with mParseMtx held
+    void ParseAppendedNL();
+
+    const size_t mPayloadSize {0};
+    std::atomic<bool> mFailed {false};
+
+    std::mutex mChunksMtx {};
+    std::vector<std::vector<char>> mChunks {};
+    bool mRunClaimed {false};
+
+    std::mutex mParseMtx {};
+    IncrementalBlockParser mParser;
+    // Payload we haven't parsed yet, starting at offset mBufferBase
+    std::vector<char> mBuffer {};
+    size_t mBufferBase {0};
+    // How much payload has been moved into mBuffer
+    size_t mReceived {0};
+    // Whether the header passed the check, once it's been checked
+    std::optional<bool> mPrefetch {};
+};
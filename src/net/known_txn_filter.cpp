@@ -0,0 +1,136 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#include <net/known_txn_filter.h>
+
+#include <algorithm>
+#include <numeric>
+
+KnownTxnFilter::Shard::Shard(size_t maxSize)
+: mMaxSize{maxSize}
+{
+    mTxids.reserve(maxSize);
+}
+
+bool KnownTxnFilter::Shard::Contains(const uint256& txid) const
+{
+    return mTxids.count(txid) > 0;
+}
+
+void KnownTxnFilter::Shard::Insert(const uint256& txid)
+{
+    if(!mTxids.insert(txid).second)
+    {
+        return;
+    }
+    mInsertOrder.push_back(txid);
+
+    // Forget the oldest once we're full
+    if(mInsertOrder.size() > mMaxSize)
+    {
+        mTxids.erase(mInsertOrder.front());
+        mInsertOrder.pop_front();
+    }
+}
+
+KnownTxnFilter::KnownTxnFilter(size_t maxPerShard)
+{
+    for(auto& shard : mShards)
+    {
+        shard = std::make_unique<Shard>(std::max<size_t>(maxPerShard, 1));
+    }
+}
+
+bool KnownTxnFilter::Contains(const uint256& txid) const
+{
+    const Shard& shard { *mShards[ShardIndex(txid)] };
+    std::lock_guard lock { shard.mMtx };
+    return shard.Contains(txid);
+}
+
+std::vector<bool> KnownTxnFilter::Contains(const std::vector<uint256>& txids) const
+{
+    std::vector<bool> known(txids.size(), false);
+
+    const ShardBuckets buckets { Bucket(txids) };
+    for(size_t i = 0; i < NUM_SHARDS; ++i)
+    {
+        if(!buckets[i].empty())
+        {
+            const Shard& shard { *mShards[i] };
+            std::lock_guard lock { shard.mMtx };
+            for(size_t pos : buckets[i])
+            {
+                known[pos] = shard.Contains(txids[pos]);
+            }
+        }
+    }
+
+    return known;
+}
+
+// The generation is checked under the shard lock. A clear that starts after
+// the check clears the shard after we release it.
+void KnownTxnFilter::Insert(const uint256& txid, uint64_t generation)
+{
+    Shard& shard { *mShards[ShardIndex(txid)] };
+    std::lock_guard lock { shard.mMtx };
+    if(generation == mGeneration)
+    {
+        shard.Insert(txid);
+    }
+}
+
+void KnownTxnFilter::Insert(const std::vector<uint256>& txids, uint64_t generation)
+{
+    const ShardBuckets buckets { Bucket(txids) };
+    for(size_t i = 0; i < NUM_SHARDS; ++i)
+    {
+        if(!buckets[i].empty())
+        {
+            Shard& shard { *mShards[i] };
+            std::lock_guard lock { shard.mMtx };
+            if(generation != mGeneration)
+            {
+                return;
+            }
+            for(size_t pos : buckets[i])
+            {
+                shard.Insert(txids[pos]);
+            }
+        }
+    }
+}
+
+void KnownTxnFilter::Clear()
+{
+    ++mGeneration;
+    for(auto& shard : mShards)
+    {
+        std::lock_guard lock { shard->mMtx };
+        shard->mTxids.clear();
+        shard->mInsertOrder.clear();
+    }
+}
+
+size_t KnownTxnFilter::Size() const
+{
+    return std::accumulate(mShards.begin(), mShards.end(), size_t{0},
+        [](size_t tot, const auto& shard) {
+            std::lock_guard lock { shard->mMtx };
+            return tot + shard->mTxids.size();
+        }
+    );
+}
+
+KnownTxnFilter::ShardBuckets KnownTxnFilter::Bucket(const std::vector<uint256>& txids) const
+{
+    ShardBuckets buckets {};
+    for(size_t pos = 0; pos < txids.size(); ++pos)
+    {
+        buckets[ShardIndex(txids[pos])].push_back(pos);
+    }
+    return buckets;
+}
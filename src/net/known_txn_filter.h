@@ -0,0 +1,94 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#pragma once
+
+#include <txhasher.h>
+#include <uint256.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * Concurrent filter of transaction IDs we already know about.
+ *
+ * Working out whether we already have an announced transaction means
+ * checking the recent rejects, the mempool, the non-final pool and the coins
+ * cache, each under its own lock. When many peers announce the same
+ * transactions, remembering the answer here lets later announcements be
+ * checked with a single lock per batch.
+ *
+ * The filter is split into shards by transaction ID, each with its own lock,
+ * so it can be used from many message handler threads at once. Each shard
+ * holds a bounded exact set, so we never wrongly report a transaction as
+ * known.
+ *
+ * What we know only holds until the filter is cleared on a new tip. Each
+ * clear starts a new generation, and IDs are only inserted if the caller
+ * worked out that they're known during the current generation, so that a
+ * caller racing with a clear can't put back what it learnt about the old tip.
+ */
+class KnownTxnFilter
+{
+  public:
+    static constexpr size_t NUM_SHARDS {16};
+    // Default number of IDs remembered per shard
+    static constexpr size_t DEFAULT_MAX_PER_SHARD {8192};
+
+    explicit KnownTxnFilter(size_t maxPerShard = DEFAULT_MAX_PER_SHARD);
+
+    // Check whether a single ID is known
+    bool Contains(const uint256& txid) const;
+    // Check a batch of IDs, taking each shard lock at most once
+    std::vector<bool> Contains(const std::vector<uint256>& txids) const;
+
+    // The current generation; get it before checking whether IDs are known
+    uint64_t GetGeneration() const { return mGeneration; }
+
+    // Remember IDs as known, unless the filter was cleared since the given generation
+    void Insert(const uint256& txid, uint64_t generation);
+    void Insert(const std::vector<uint256>& txids, uint64_t generation);
+
+    // Forget everything and start a new generation
+    void Clear();
+
+    // Number of IDs remembered
+    size_t Size() const;
+
+  private:
+
+    struct Shard
+    {
+        explicit Shard(size_t maxSize);
+
+        bool Contains(const uint256& txid) const;
+        void Insert(const uint256& txid);
+
+        const size_t mMaxSize {0};
+        std::unordered_set<uint256, SaltedTxidHasher> mTxids {};
+        std::deque<uint256> mInsertOrder {};
+        mutable std::mutex mMtx {};
+    };
+
+    // Pick the shard for an ID, using different hash bits to the shard sets
+    size_t ShardIndex(const uint256& txid) const
+    {
+        return (static_cast<uint64_t>(mHasher(txid)) >> 32) % NUM_SHARDS;
+    }
+
+    // Group the positions of a batch of IDs by shard
+    using ShardBuckets = std::array<std::vector<size_t>, NUM_SHARDS>;
+    ShardBuckets Bucket(const std::vector<uint256>& txids) const;
+
+    std::array<std::unique_ptr<Shard>, NUM_SHARDS> mShards {};
+    SaltedTxidHasher mHasher {};
+    std::atomic<uint64_t> mGeneration {0};
+};
@@ -21,13 +21,17 @@
 #include "crypto/sha256.h"
 #include "hash.h"
 #include "net/netbase.h"
+#include "net/net_processing.h"
+#include "pow.h"
 #include "primitives/transaction.h"
 #include "scheduler.h"
 #include "taskcancellation.h"
+#include "txdb.h"
 #include "txn_propagator.h"
 #include "txn_validator.h"
 #include "ui_interface.h"
 #include "utilstrencodings.h"
+#include "validation.h"
 #include "invalid_txn_publisher.h"
 
 #include "invalid_txn_sinks/file_sink.h"
@@ -643,11 +647,17 @@ CConnman::CAsyncTaskPool::CAsyncTaskPool(const Config& config)
 
 CConnman::CAsyncTaskPool::~CAsyncTaskPool()
 {
-    for(auto& task : mRunningTasks)
+    std::vector<CRunningTask> runningTasks {};
+    {
+        std::lock_guard lock { mRunningTasksMtx };
+        runningTasks.swap(mRunningTasks);
+    }
+
+    for(auto& task : runningTasks)
     {
         task.mCancellationSource->Cancel();
     }
-    for(auto& task : mRunningTasks)
+    for(auto& task : runningTasks)
     {
         task.mFuture.wait();
     }
@@ -658,6 +668,7 @@ void CConnman::CAsyncTaskPool::AddToPool(
     std::function<void(std::weak_ptr<CNode>)> function,
     std::shared_ptr<task::CCancellationSource> source)
 {
+    std::lock_guard lock { mRunningTasksMtx };
     mRunningTasks.emplace_back(
         node->GetId(),
         make_task(
@@ -671,9 +682,11 @@ void CConnman::CAsyncTaskPool::HandleCompletedAsyncProcessing()
 {
     using namespace std::literals::chrono_literals;
 
+    // Don't wait for tasks while other threads may want to add some
+    std::lock_guard lock { mRunningTasksMtx };
     for(size_t i=0; i<mRunningTasks.size();)
     {
-        if(mRunningTasks[i].mFuture.wait_for(1ms) == std::future_status::ready)
+        if(mRunningTasks[i].mFuture.wait_for(0ms) == std::future_status::ready)
         {
             try
             {
@@ -722,6 +735,7 @@ void CNode::RunAsyncProcessing(
 void CNode::copyStats(NodeStats &stats)
 {
     mAssociation.CopyStats(stats.associationStats);
+    stats.netMsgStats = mNetMsgStats.GetSnapshot();
 
     stats.nodeid = this->GetId();
     stats.nServices = nServices;
@@ -866,6 +880,13 @@ std::vector<CTxnSendingDetails> CNode::FetchNInventory(size_t n)
     return results;
 }
 
+/** Get the number of items in our inventory */
+size_t CNode::GetInventorySize()
+{
+    LOCK(cs_mInvList);
+    return mInvList.size();
+}
+
 /** Set peers known stream policies */
 void CNode::SetSupportedStreamPolicies(const std::string& policies)
 {
@@ -1004,26 +1025,8 @@ int CNode::GetSendVersion() const {
     return nSendVersion;
 }
 
-bool CNode::SetSocketsForSelect(fd_set& setRecv, fd_set& setSend, fd_set& setError, SOCKET& socketMax) const
-{
-    // Get all sockets from our association
-    return mAssociation.SetSocketsForSelect(setRecv, setSend, setError, socketMax);
-}
-
-void CNode::ServiceSockets(fd_set& setRecv, fd_set& setSend, fd_set& setError, CConnman& connman,
-                           const Config& config, uint64_t& bytesRecv, uint64_t& bytesSent)
+void CNode::InactivityCheck(const Config& config)
 {
-    // Let association service its sockets
-    bool newMsgs {false};
-    mAssociation.ServiceSockets(setRecv, setSend, setError, connman, config, newMsgs, bytesRecv, bytesSent);
-    if(newMsgs)
-    {
-        connman.WakeMessageHandler();
-    }
-
-    //
-    // Inactivity checking
-    //
     int64_t nLastSend { mAssociation.GetLastSendTime() };
     int64_t nLastRecv { mAssociation.GetLastRecvTime() };
 
@@ -1348,6 +1351,7 @@ void CConnman::AcceptConnection(const ListenSocket &hListenSocket) {
 
     LogPrint(BCLog::NETCONN, "connection from %s accepted\n", addr.ToString());
 
+    RegisterStreamSockets(pnode);
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
@@ -1355,7 +1359,17 @@ void CConnman::AcceptConnection(const ListenSocket &hListenSocket) {
 }
 
 void CConnman::ThreadSocketHandler() {
+    // Sockets stay registered with the reactor for as long as they are open,
+    // so we only have to look at those that are ready
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        if (!mSocketReactor.AddListening(hListenSocket.socket)) {
+            LogPrintf("failed to register listening socket with %s\n", SocketReactor::GetMechanism());
+        }
+    }
+
     unsigned int nPrevNodeCount = 0;
+    int64_t nLastInactivityCheck {0};
+    std::vector<SocketReactor::Event> events {};
     while (!interruptNet) {
         //
         // Disconnect nodes
@@ -1424,103 +1438,185 @@ void CConnman::ThreadSocketHandler() {
         }
 
         //
-        // Find which sockets have data to receive
+        // Wait for sockets to become ready
         //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        // Frequency to poll pnode->vSend
-        timeout.tv_usec = 50000;
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        for (const ListenSocket &hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
+        // Frequency to check for disconnected nodes and inactivity
+        constexpr std::chrono::milliseconds timeout {50};
 
-        {
-            LOCK(cs_vNodes);
-            for (const CNodePtr& pnode : vNodes) {
-                // Get sockets to select on
-                have_fds |= pnode->SetSocketsForSelect(fdsetRecv, fdsetSend, fdsetError, hSocketMax);
+        if (!mSocketReactor.Wait(timeout, events)) {
+            int nErr = WSAGetLastError();
+            LogPrint(BCLog::NETCONN, "socket %s error %s\n", SocketReactor::GetMechanism(), NetworkErrorString(nErr));
+            if (!interruptNet.sleep_for(timeout)) {
+                return;
             }
         }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0, &fdsetRecv,
-                             &fdsetSend, &fdsetError, &timeout);
         if (interruptNet) {
             return;
         }
 
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                LogPrint(BCLog::NETCONN, "socket select error %s\n", NetworkErrorString(nErr));
-                for (SOCKET i = 0; i <= hSocketMax; i++) {
-                    FD_SET(i, &fdsetRecv);
-                }
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(
-                    std::chrono::milliseconds(timeout.tv_usec / 1000))) {
+        //
+        // Accept new connections and service each ready socket
+        //
+        for (const SocketReactor::Event& event : events) {
+            if (interruptNet) {
                 return;
             }
-        }
 
-        //
-        // Accept new connections
-        //
-        for (const ListenSocket &hListenSocket : vhListenSocket) {
-            if (hListenSocket.socket != INVALID_SOCKET &&
-                FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
-                AcceptConnection(hListenSocket);
+            auto listenSocket { std::find_if(vhListenSocket.begin(), vhListenSocket.end(),
+                [&event](const ListenSocket& hListenSocket) { return hListenSocket.socket == event.socket; }) };
+            if (listenSocket != vhListenSocket.end()) {
+                AcceptConnection(*listenSocket);
+            }
+            else {
+                ServiceStreamSocket(event);
             }
         }
 
         //
-        // Service each socket
+        // Inactivity checking
         //
-        std::vector<CNodePtr> vNodesCopy;
-        {
-            LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-        }
-        for (const CNodePtr& pnode : vNodesCopy) {
-            if (interruptNet) {
-                return;
+        int64_t nTime { GetSystemTimeInSeconds() };
+        if (nTime != nLastInactivityCheck) {
+            nLastInactivityCheck = nTime;
+
+            std::vector<CNodePtr> vNodesCopy;
+            {
+                LOCK(cs_vNodes);
+                vNodesCopy = vNodes;
+            }
+            for (const CNodePtr& pnode : vNodesCopy) {
+                pnode->InactivityCheck(*config);
             }
 
-            uint64_t bytesRecv {0};
-            uint64_t bytesSent {0};
-            pnode->ServiceSockets(fdsetRecv, fdsetSend, fdsetError, *this, *config, bytesRecv, bytesSent);
+            // Forget streams that have gone
+            LOCK(cs_mReactorStreams);
+            for (auto it = mReactorStreams.begin(); it != mReactorStreams.end(); ) {
+                if (it->second.expired()) {
+                    it = mReactorStreams.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+        }
+    }
+}
 
-            if(bytesRecv > 0) {
-                RecordBytesRecv(bytesRecv);
+void CConnman::RegisterStreamSockets(const CNodePtr& pnode) {
+    for (const StreamPtr& stream : pnode->GetAssociation().GetStreams()) {
+        SOCKET socket { stream->GetSocket() };
+        if (socket != INVALID_SOCKET) {
+            // Make the stream known before the reactor can report its socket.
+            // Socket numbers are reused, so replace anything we had for it.
+            {
+                LOCK(cs_mReactorStreams);
+                mReactorStreams[socket] = stream;
             }
-            if(bytesSent > 0) {
-                RecordBytesSent(bytesSent);
+            if (!stream->SetReactor(mSocketReactor)) {
+                LogPrint(BCLog::NETCONN, "failed to register stream socket with %s\n", SocketReactor::GetMechanism());
             }
         }
     }
 }
 
+void CConnman::ServiceStreamSocket(const SocketReactor::Event& event) {
+    StreamPtr stream {};
+    {
+        LOCK(cs_mReactorStreams);
+        auto it { mReactorStreams.find(event.socket) };
+        if (it == mReactorStreams.end()) {
+            return;
+        }
+        stream = it->second.lock();
+        if (!stream) {
+            mReactorStreams.erase(it);
+            return;
+        }
+    }
+
+    bool gotNewMsgs {false};
+    uint64_t bytesRecv {0};
+    uint64_t bytesSent {0};
+    try {
+        stream->ServiceSocket(event.recv, event.send, event.error, *config, gotNewMsgs, bytesRecv, bytesSent);
+    }
+    catch (BanStream& ban) {
+        Ban(stream->GetPeerAddr(), BanReasonNodeMisbehaving);
+    }
+
+    if (gotNewMsgs) {
+        WakeMessageHandler();
+    }
+    if (bytesRecv > 0) {
+        RecordBytesRecv(bytesRecv);
+    }
+    if (bytesSent > 0) {
+        RecordBytesSent(bytesSent);
+    }
+}
+
 void CConnman::WakeMessageHandler() {
     {
         std::lock_guard<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = true;
+        ++nMsgProcWakeSeq;
     }
     condMsgProc.notify_one();
 }
 
+void CConnman::WakeAllMessageHandlers() {
+    {
+        std::lock_guard<std::mutex> lock(mutexMsgProc);
+        ++nMsgProcWakeSeq;
+    }
+    condMsgProc.notify_all();
+}
+
+void CConnman::ParseBlockInBackground(const std::shared_ptr<AsyncBlockParser>& parser, NodeId node)
+{
+    make_task(
+        mThreadPool,
+        CTask::Priority::Low,
+        [this, node](const std::shared_ptr<AsyncBlockParser>& parser)
+        {
+            parser->Run(
+                [node](const CBlockHeader& header)
+                {
+                    // Only read coins for a block we asked this peer for,
+                    // and which is backed by real work, so that unsolicited
+                    // messages can't make us read from disk for free
+                    const uint256 hash { header.GetHash() };
+                    return CheckProofOfWork(hash, header.nBits, GlobalConfig::GetConfig()) &&
+                           IsBlockInFlight(hash, node);
+                },
+                [this](std::vector<COutPoint>&& outpoints)
+                {
+                    PrefetchCoins(std::move(outpoints));
+                });
+        },
+        parser);
+}
+
+void CConnman::PrefetchCoins(std::vector<COutPoint>&& outpoints)
+{
+    // Coins being loaded into the cache are fetched from disk outside of any
+    // locks that validation needs, so this doesn't hold up anything else
+    make_task(
+        mThreadPool,
+        CTask::Priority::Low,
+        [](const std::vector<COutPoint>& outpoints)
+        {
+            if(pcoinsTip)
+            {
+                CoinsDBView view { *pcoinsTip };
+                for(const COutPoint& outpoint : outpoints)
+                {
+                    view.GetCoin(outpoint);
+                }
+            }
+        },
+        std::move(outpoints));
+}
+
 #ifdef USE_UPNP
 void ThreadMapPort() {
     std::string port = strprintf("%u", GetListenPort());
@@ -2122,6 +2218,7 @@ bool CConnman::OpenNetworkConnection(NodeConnectInfo& connectInfo,
     }
 
     GetNodeSignals().InitializeNode(pnode, *this, &connectInfo);
+    RegisterStreamSockets(pnode);
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
@@ -2130,9 +2227,10 @@ bool CConnman::OpenNetworkConnection(NodeConnectInfo& connectInfo,
     return true;
 }
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(unsigned int shard)
 {
     std::vector<CNodePtr> vNodesCopy;
+    uint64_t nWakeSeq {0};
 
     while (!flagInterruptMsgProc)
     {
@@ -2145,35 +2243,40 @@ void CConnman::ThreadMessageHandler()
 
         bool fMoreWork = false;
 
-        mAsyncTaskPool.HandleCompletedAsyncProcessing();
+        if (shard == 0) {
+            mAsyncTaskPool.HandleCompletedAsyncProcessing();
+        }
 
+        // Process the peers in our shard
         for (const CNodePtr& pnode : vNodesCopy)
         {
-            if (pnode->fDisconnect ||
-                mAsyncTaskPool.HasReachedSoftAsyncTaskLimit(pnode->GetId()))
-            {
+            if (pnode->GetId() % nMessageHandlerThreads != shard) {
                 continue;
             }
 
-            // Receive messages
-            bool fMoreNodeWork = GetNodeSignals().ProcessMessages(
-                *config, pnode, *this, flagInterruptMsgProc,
-                mDebugP2PTheadStallsThreshold);
-            fMoreWork |= (fMoreNodeWork && !pnode->GetPausedForSending());
-
+            fMoreWork |= ProcessNodeMessages(pnode);
             if (flagInterruptMsgProc) {
                 return;
             }
+        }
 
-            // Send messages
+        // If we have nothing left to do, help out with peers from other
+        // shards that have received messages their own thread hasn't got
+        // round to yet. Only one thread is woken for new messages, so this
+        // is also how they reach a busy peer's shard.
+        if (!fMoreWork && nMessageHandlerThreads > 1)
+        {
+            for (const CNodePtr& pnode : vNodesCopy)
             {
-                LOCK(pnode->cs_sendProcessing);
-                GetNodeSignals().SendMessages(*config, pnode, *this,
-                                              flagInterruptMsgProc);
-            }
+                if (pnode->GetId() % nMessageHandlerThreads == shard ||
+                    !pnode->GetAssociation().HasCompleteMessages()) {
+                    continue;
+                }
 
-            if (flagInterruptMsgProc) {
-                return;
+                fMoreWork |= ProcessNodeMessages(pnode);
+                if (flagInterruptMsgProc) {
+                    return;
+                }
             }
         }
 
@@ -2182,12 +2285,46 @@ void CConnman::ThreadMessageHandler()
             condMsgProc.wait_until(lock,
                                    std::chrono::steady_clock::now() +
                                        std::chrono::milliseconds(100),
-                                   [this] { return fMsgProcWake; });
+                                   [this, nWakeSeq] { return nMsgProcWakeSeq != nWakeSeq; });
         }
-        fMsgProcWake = false;
+        nWakeSeq = nMsgProcWakeSeq;
     }
 }
 
+bool CConnman::ProcessNodeMessages(const CNodePtr& pnode)
+{
+    if (pnode->fDisconnect ||
+        mAsyncTaskPool.HasReachedSoftAsyncTaskLimit(pnode->GetId()))
+    {
+        return false;
+    }
+
+    // Skip the peer if another thread is already processing it
+    TRY_LOCK(pnode->cs_messageProcessing, lockProcessing);
+    if (!lockProcessing) {
+        return false;
+    }
+
+    // Receive messages
+    bool fMoreNodeWork = GetNodeSignals().ProcessMessages(
+        *config, pnode, *this, flagInterruptMsgProc,
+        mDebugP2PTheadStallsThreshold);
+    fMoreNodeWork &= !pnode->GetPausedForSending();
+
+    if (flagInterruptMsgProc) {
+        return fMoreNodeWork;
+    }
+
+    // Send messages
+    {
+        LOCK(pnode->cs_sendProcessing);
+        GetNodeSignals().SendMessages(*config, pnode, *this,
+                                      flagInterruptMsgProc);
+    }
+
+    return fMoreNodeWork;
+}
+
 bool CConnman::BindListenPort(const CService &addrBind, std::string &strError,
                               bool fWhitelisted) {
     strError = "";
@@ -2462,6 +2599,8 @@ bool CConnman::Start(CScheduler &scheduler, std::string &strNodeError,
     nMaxOutboundLimit = connOptions.nMaxOutboundLimit;
     nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
 
+    nMessageHandlerThreads = std::clamp(connOptions.nMessageHandlerThreads, 1u, MAX_MSG_HANDLER_THREADS);
+
     SetBestHeight(connOptions.nBestHeight);
 
     clientInterface = connOptions.uiInterface;
@@ -2529,7 +2668,7 @@ bool CConnman::Start(CScheduler &scheduler, std::string &strNodeError,
 
     {
         std::unique_lock<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = false;
+        nMsgProcWakeSeq = 0;
     }
 
     // Send and receive from sockets, accept connections
@@ -2573,10 +2712,14 @@ bool CConnman::Start(CScheduler &scheduler, std::string &strNodeError,
     }
 
     // Process messages
-    threadMessageHandler =
-        std::thread(&TraceThread<std::function<void()>>, "msghand",
-                    std::function<void()>(
-                        std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (unsigned int shard = 0; shard < nMessageHandlerThreads; ++shard) {
+        std::string name { shard == 0 ? std::string{"msghand"} : strprintf("msghand%u", shard) };
+        threadMessageHandlers.emplace_back(
+            [this, shard, name = std::move(name)] {
+                TraceThread(name.c_str(), std::function<void()>(
+                    std::bind(&CConnman::ThreadMessageHandler, this, shard)));
+            });
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery(std::bind(&CConnman::DumpData, this),
@@ -2625,9 +2768,12 @@ void CConnman::Interrupt() {
 }
 
 void CConnman::Stop() {
-    if (threadMessageHandler.joinable()) {
-        threadMessageHandler.join();
+    for (std::thread& threadMessageHandler : threadMessageHandlers) {
+        if (threadMessageHandler.joinable()) {
+            threadMessageHandler.join();
+        }
     }
+    threadMessageHandlers.clear();
     if (threadOpenConnections.joinable()) {
         threadOpenConnections.join();
     }
@@ -2960,10 +3106,26 @@ CNode::~CNode()
 }
 
 void CNode::AskFor(const CInv &inv, const Config &config) {
+    const size_t mapAskForMaxSize { CInv::estimateMaxInvElements(config.GetMaxProtocolRecvPayloadLength() * config.GetRecvInvQueueFactor()) };
     LOCK(cs_invQueries);
+    AskForLocked(inv, mapAskForMaxSize);
+}
+
+void CNode::AskFor(const std::vector<CInv> &invs, const Config &config) {
+    if (invs.empty()) {
+        return;
+    }
+    const size_t mapAskForMaxSize { CInv::estimateMaxInvElements(config.GetMaxProtocolRecvPayloadLength() * config.GetRecvInvQueueFactor()) };
+    LOCK(cs_invQueries);
+    for (const CInv &inv : invs) {
+        AskForLocked(inv, mapAskForMaxSize);
+    }
+}
+
+void CNode::AskForLocked(const CInv &inv, size_t mapAskForMaxSize) {
+    AssertLockHeld(cs_invQueries);
     // if mapAskFor is too large, we will never ask for it (it becomes lost)
     constexpr unsigned IDINDEXSIZE_FACTOR {4};
-    const size_t mapAskForMaxSize { CInv::estimateMaxInvElements(config.GetMaxProtocolRecvPayloadLength() * config.GetRecvInvQueueFactor()) };
     const size_t idIndexMaxSize { mapAskForMaxSize * IDINDEXSIZE_FACTOR };
     auto& idIndex { indexAskFor.get<TagTxnID>() };
     if(mapAskFor.size() > mapAskForMaxSize || idIndex.size() > idIndexMaxSize) {
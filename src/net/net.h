@@ -20,9 +20,12 @@
 #include "invalid_txn_publisher.h"
 #include "limitedmap.h"
 #include "net/association.h"
+#include "net/known_txn_filter.h"
 #include "net/net_message.h"
+#include "net/net_msg_stats.h"
 #include "net/net_types.h"
 #include "net/node_stats.h"
+#include "net/socket_reactor.h"
 #include "net/stream_policy_factory.h"
 #include "netaddress.h"
 #include "protocol.h"
@@ -43,6 +46,7 @@
 #include <memory>
 #include <optional>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 #include <functional>
 
@@ -142,6 +146,10 @@ static const std::string DEFAULT_STREAM_POLICY_LIST =
     std::string{BlockPriorityStreamPolicy::POLICY_NAME} + "," +
     std::string{DefaultStreamPolicy::POLICY_NAME};
 
+// Number of threads processing messages, each handling its own share of peers
+static const unsigned int DEFAULT_MSG_HANDLER_THREADS = 1;
+static const unsigned int MAX_MSG_HANDLER_THREADS = 64;
+
 // Parallel block fetch timeout for slow peers (in seconds)
 static const unsigned int DEFAULT_BLOCK_DOWNLOAD_SLOW_FETCH_TIMEOUT = 30;
 // Parralel block fetch maximum number of requests for a single block to different peers
@@ -283,6 +291,7 @@ public:
         unsigned int nReceiveFloodSize = 0;
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
+        unsigned int nMessageHandlerThreads = DEFAULT_MSG_HANDLER_THREADS;
     };
     CConnman(
         const Config &configIn,
@@ -440,6 +449,8 @@ public:
     bool CheckTxnInRecentRejects(const uint256& txHash) const;
     /* Reset recent rejects */
     void ResetRecentRejects();
+    /* Get the filter of transactions we already know about */
+    KnownTxnFilter& GetKnownTxnFilter() { return mKnownTxnFilter; }
     /* Get extra txns for block reconstruction */
     std::vector<std::pair<uint256, CTransactionRef>> GetCompactExtraTxns() const;
 
@@ -525,7 +536,16 @@ public:
 
     unsigned int GetReceiveFloodSize() const;
 
+    /** Wake one message handler thread to process newly received messages */
     void WakeMessageHandler();
+    /** Wake all message handler threads, e.g. when every peer has something to send */
+    void WakeAllMessageHandlers();
+
+    /** Parse a block we're still receiving from the given peer on the task pool */
+    void ParseBlockInBackground(const std::shared_ptr<AsyncBlockParser>& parser, NodeId node);
+
+    /** Load the coins spent by a block we're still receiving, ahead of validation */
+    void PrefetchCoins(std::vector<COutPoint>&& outpoints);
 
     // Task pool for executing async node tasks. Task queue size is implicitly
     // limited by maximum allowed connections (DEFAULT_MAX_PEER_CONNECTIONS)
@@ -544,6 +564,7 @@ public:
 
         bool HasReachedSoftAsyncTaskLimit(NodeId id)
         {
+            std::lock_guard lock { mRunningTasksMtx };
             return
                 std::count_if(
                     mRunningTasks.begin(),
@@ -578,7 +599,9 @@ public:
         };
 
         CThreadPool<CQueueAdaptor> mPool;
+        // Tasks are added by all message handler threads
         std::vector<CRunningTask> mRunningTasks;
+        std::mutex mRunningTasksMtx;
         int mPerInstanceSoftAsyncTaskLimit;
     };
 
@@ -595,9 +618,12 @@ private:
     void ThreadOpenNewStreamConnections();
     void ProcessOneShot();
     void ThreadOpenConnections();
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(unsigned int shard);
+    bool ProcessNodeMessages(const CNodePtr& pnode);
     void AcceptConnection(const ListenSocket &hListenSocket);
     void ThreadSocketHandler();
+    void RegisterStreamSockets(const CNodePtr& pnode);
+    void ServiceStreamSocket(const SocketReactor::Event& event);
     void ThreadDNSAddressSeed();
 
     uint64_t CalculateKeyedNetGroup(const CAddress &ad) const;
@@ -658,6 +684,12 @@ private:
     unsigned int nReceiveFloodSize;
 
     std::vector<ListenSocket> vhListenSocket;
+
+    /** Tells the socket handler which sockets are ready, and the streams they belong to */
+    SocketReactor mSocketReactor {};
+    std::unordered_map<SOCKET, std::weak_ptr<Stream>> mReactorStreams {};
+    CCriticalSection cs_mReactorStreams {};
+
     std::atomic<bool> fNetworkActive;
     banmap_t setBanned;
     CCriticalSection cs_setBanned;
@@ -698,8 +730,11 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake;
+    /** Number of message handler threads, peers are shared out between them by ID */
+    unsigned int nMessageHandlerThreads {DEFAULT_MSG_HANDLER_THREADS};
+
+    /** Incremented for waking the message processors. */
+    uint64_t nMsgProcWakeSeq {0};
 
     std::condition_variable condMsgProc;
     std::mutex mutexMsgProc;
@@ -708,6 +743,9 @@ private:
     /** TxIdTracker */
     TxIdTrackerSPtr mTxIdTracker {nullptr};
 
+    /** Transactions we already know about, shared by all peers */
+    KnownTxnFilter mKnownTxnFilter {};
+
     /** Transaction tracker/propagator */
     std::shared_ptr<CTxnPropagator> mTxnPropagator {};
 
@@ -724,7 +762,7 @@ private:
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
     std::thread threadOpenNewStreamConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
 
     std::chrono::milliseconds mDebugP2PTheadStallsThreshold;
 
@@ -827,6 +865,10 @@ public:
 
     CCriticalSection cs_sendProcessing {};
 
+    // Held by whichever message handler thread is processing this peer, so
+    // the peer's messages are only ever handled one at a time and in order
+    CCriticalSection cs_messageProcessing {};
+
     std::optional<CGetBlockMessageRequest> mGetBlockMessageRequest;
     std::deque<CInv> vRecvGetData {};
     std::atomic<int> nRecvVersion {INIT_PROTO_VERSION};
@@ -1000,6 +1042,9 @@ private:
     // Peer association details
     Association mAssociation;
 
+    // Processing stats for messages from this peer
+    NetMsgStats mNetMsgStats {};
+
     // Peer known stream policy names and common policy names
     mutable CCriticalSection cs_supportedStreamPolicies {};
     std::set<std::string> mSupportedStreamPolicies {};
@@ -1008,6 +1053,9 @@ private:
     // Flag to indicate if we have just become paused for sending and receiving (to control logging)
     bool mEnteredPauseSendRecv {false};
 
+    // Queue an inventory item to ask for, with cs_invQueries held
+    void AskForLocked(const CInv &inv, size_t mapAskForMaxSize);
+
 public:
 
     /** Add some new transactions to our pending inventory list */
@@ -1016,6 +1064,8 @@ public:
     void RemoveTxnsFromInventory(const std::set<CInv>& toRemove);
     /** Fetch the next N items from our inventory */
     std::vector<CTxnSendingDetails> FetchNInventory(size_t n);
+    /** Get the number of items in our inventory */
+    size_t GetInventorySize();
 
     NodeId GetId() const { return id; }
 
@@ -1023,6 +1073,9 @@ public:
     const Association& GetAssociation() const { return mAssociation; }
     Association& GetAssociation() { return mAssociation; }
 
+    // Fetch processing stats for messages from this peer
+    NetMsgStats& GetNetMsgStats() { return mNetMsgStats; }
+
     // Set peers known stream policies
     void SetSupportedStreamPolicies(const std::string& policies);
     // Get stream polices in common with this peer as a string formatted list
@@ -1034,9 +1087,8 @@ public:
 
     int32_t GetMyStartingHeight() const { return nMyStartingHeight; }
 
-    bool SetSocketsForSelect(fd_set& setRecv, fd_set& setSend, fd_set& setError, SOCKET& socketMax) const;
-    void ServiceSockets(fd_set& setRecv, fd_set& setSend, fd_set& setError, CConnman& connman,
-                        const Config& config, uint64_t& bytesRecv, uint64_t& bytesSent);
+    // Disconnect if the peer has gone quiet or failed to complete the handshake
+    void InactivityCheck(const Config& config);
 
     bool GetDisconnect() const { return fDisconnect; }
     bool GetPausedForSending(bool checkPauseRecv = false);
@@ -1071,6 +1123,13 @@ public:
         filterInventoryKnown.insert(inv.hash);
     }
 
+    void AddInventoryKnown(const std::vector<CInv> &invs) {
+        LOCK(cs_inventory);
+        for (const CInv &inv : invs) {
+            filterInventoryKnown.insert(inv.hash);
+        }
+    }
+
     void PushInventory(const CInv &inv) {
         LOCK(cs_inventory);
         if (inv.type == MSG_TX) {
@@ -1088,6 +1147,7 @@ public:
     }
 
     void AskFor(const CInv &inv, const Config &config);
+    void AskFor(const std::vector<CInv> &invs, const Config &config);
 
     void CloseSocketDisconnect();
 
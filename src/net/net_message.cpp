@@ -7,29 +7,57 @@
 
 
 #include <net/net_message.h>
+#include <net/recv_buffer_pool.h>
 #include <logging.h>
 
+namespace {
+    // Most we allocate ahead of the data actually received, so a peer can't
+    // make us allocate lots of memory just by sending a header.
+    constexpr uint32_t MAX_ALLOC_AHEAD = 256 * 1024;
+}
+
+CNetMessage::CNetMessage(const CMessageHeader::MessageMagic &pchMessageStartIn,
+                         int nTypeIn, int nVersionIn)
+    : hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
+    RecvBufferPool::Buffer buffer =
+        RecvBufferPool::Instance().Get(CMessageHeader::HEADER_SIZE);
+    vRecv.SwapBuffer(buffer);
+    vRecv.resize(CMessageHeader::HEADER_SIZE);
+    in_data = false;
+    nHdrPos = 0;
+    nDataPos = 0;
+    nTime = 0;
+}
+
+CNetMessage::~CNetMessage() {
+    RecvBufferPool::Buffer buffer;
+    vRecv.SwapBuffer(buffer);
+    RecvBufferPool::Instance().Release(std::move(buffer));
+}
+
 int CNetMessage::readHeader(const Config &config, const char *pch,
                             uint32_t nBytes, uint64_t maxBlockSize) {
     // copy data to temporary parsing buffer
-    uint32_t nRemaining = 24 - nHdrPos;
+    uint32_t nRemaining = CMessageHeader::HEADER_SIZE - nHdrPos;
     uint32_t nCopy = std::min(nRemaining, nBytes);
 
-    memcpy(&hdrbuf[nHdrPos], pch, nCopy);
+    memcpy(&vRecv[nHdrPos], pch, nCopy);
     nHdrPos += nCopy;
 
     // if header incomplete, exit
-    if (nHdrPos < 24) {
+    if (nHdrPos < CMessageHeader::HEADER_SIZE) {
         return nCopy;
     }
 
-    // deserialize to CMessageHeader
+    // deserialize to CMessageHeader, which leaves the buffer empty for the
+    // payload
     try {
-        hdrbuf >> hdr;
+        vRecv >> hdr;
     } catch (const std::exception &) {
         LogPrint(BCLog::NETMSG, "Bad header format\n");
         return -1;
     }
+    assert(vRecv.empty());
 
     // Reject oversized messages
     if (hdr.IsOversized(config, maxBlockSize)) {
@@ -37,6 +65,13 @@ int CNetMessage::readHeader(const Config &config, const char *pch,
         return -1;
     }
 
+    // Large blocks are parsed as they arrive
+    if (hdr.nPayloadLength >= IncrementalBlockParser::MIN_PAYLOAD_SIZE &&
+        hdr.GetCommand() == NetMsgType::BLOCK) {
+        blockParser = std::make_shared<AsyncBlockParser>(
+            vRecv.GetType(), vRecv.GetVersion(), hdr.nPayloadLength);
+    }
+
     // switch state to reading message data
     in_data = true;
 
@@ -44,20 +79,56 @@ int CNetMessage::readHeader(const Config &config, const char *pch,
 }
 
 int CNetMessage::readData(const char *pch, uint32_t nBytes) {
-    unsigned int nRemaining = hdr.nPayloadLength - nDataPos;
-    unsigned int nCopy = std::min(nRemaining, nBytes);
+    auto [space, nCopy] = getDataSpace(nBytes);
+    memcpy(space, pch, nCopy);
+    dataReceived(nCopy);
+
+    return nCopy;
+}
 
-    if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message
-        // size.
-        vRecv.resize(std::min(hdr.nPayloadLength, nDataPos + nCopy + 256 * 1024));
+std::pair<char *, uint32_t> CNetMessage::getDataSpace(uint32_t nBytes) {
+    assert(in_data);
+    uint32_t nRemaining = hdr.nPayloadLength - nDataPos;
+    uint32_t nSpace = std::min(nRemaining, nBytes);
+
+    reserveData(nDataPos + nSpace);
+    vRecv.resize(nDataPos + nSpace);
+    return {&vRecv[nDataPos], nSpace};
+}
+
+void CNetMessage::dataReceived(uint32_t nBytes) {
+    assert(nDataPos + nBytes <= vRecv.size());
+    hasher.Write(reinterpret_cast<const uint8_t *>(&vRecv[nDataPos]), nBytes);
+    if (blockParser) {
+        blockParser->Append(&vRecv[nDataPos], nBytes);
+    }
+    nDataPos += nBytes;
+    vRecv.resize(nDataPos);
+}
+
+std::shared_ptr<CBlock> CNetMessage::takeParsedBlock() {
+    if (!complete() || !blockParser) {
+        return nullptr;
     }
+    return blockParser->TakeBlock();
+}
 
-    hasher.Write((const uint8_t *)pch, nCopy);
-    memcpy(&vRecv[nDataPos], pch, nCopy);
-    nDataPos += nCopy;
+void CNetMessage::reserveData(uint32_t nSize) {
+    if (vRecv.capacity() >= nSize) {
+        return;
+    }
 
-    return nCopy;
+    // Grow geometrically, so large messages are only moved a few times, but
+    // never beyond the total message size; for multi-GB blocks the usual
+    // vector growth could allocate up to twice what we need.
+    uint64_t nCapacity = std::max<uint64_t>(
+        static_cast<uint64_t>(nSize) + MAX_ALLOC_AHEAD, 2 * vRecv.capacity());
+    nCapacity = std::min<uint64_t>(nCapacity, hdr.nPayloadLength);
+
+    RecvBufferPool::Buffer buffer = RecvBufferPool::Instance().Get(nCapacity);
+    buffer.assign(vRecv.begin(), vRecv.end());
+    vRecv.SwapBuffer(buffer);
+    RecvBufferPool::Instance().Release(std::move(buffer));
 }
 
 const uint256 &CNetMessage::GetMessageHash() const {
@@ -9,41 +9,47 @@
 #pragma once
 
 #include <hash.h>
+#include <net/block_parser.h>
 #include <protocol.h>
 #include <streams.h>
 
+#include <memory>
+#include <utility>
+
 class CNetMessage {
 private:
     mutable CHash256 hasher;
     mutable uint256 data_hash;
 
+    // Make sure we have space for at least the given amount of payload data
+    void reserveData(uint32_t nSize);
+
 public:
     // Parsing header (false) or data (true)
     bool in_data;
 
-    // Partially received header.
-    CDataStream hdrbuf;
     // Complete header.
     CMessageHeader hdr;
     uint32_t nHdrPos;
 
-    // Received message data.
+    // Received message data. The header is also read into here, before
+    // being parsed, so each message needs just the one (pooled) buffer.
     CDataStream vRecv;
     uint32_t nDataPos;
 
     // Time (in microseconds) of message receipt.
     int64_t nTime;
 
+    // For large blocks, parses the block as it arrives. Shared with the
+    // worker thread that runs it.
+    std::shared_ptr<AsyncBlockParser> blockParser;
+
     CNetMessage(const CMessageHeader::MessageMagic &pchMessageStartIn,
-                int nTypeIn, int nVersionIn)
-        : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn),
-          vRecv(nTypeIn, nVersionIn) {
-        hdrbuf.resize(24);
-        in_data = false;
-        nHdrPos = 0;
-        nDataPos = 0;
-        nTime = 0;
-    }
+                int nTypeIn, int nVersionIn);
+    ~CNetMessage();
+
+    CNetMessage(const CNetMessage &) = delete;
+    CNetMessage &operator=(const CNetMessage &) = delete;
 
     bool complete() const {
         if (!in_data) {
@@ -56,10 +62,19 @@ public:
     const uint256 &GetMessageHash() const;
 
     void SetVersion(int nVersionIn) {
-        hdrbuf.SetVersion(nVersionIn);
         vRecv.SetVersion(nVersionIn);
     }
 
     int readHeader(const Config &config, const char *pch, uint32_t nBytes, uint64_t maxBlockSize);
     int readData(const char *pch, uint32_t nBytes);
+
+    // Get space for up to nBytes of payload data to be received directly
+    // into, without having to be copied in with readData. Must be followed
+    // by dataReceived with however much was actually written.
+    std::pair<char *, uint32_t> getDataSpace(uint32_t nBytes);
+    void dataReceived(uint32_t nBytes);
+
+    // Take the block, if this is a block message that was completely
+    // parsed while it was being received
+    std::shared_ptr<CBlock> takeParsedBlock();
 };
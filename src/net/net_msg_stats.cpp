@@ -0,0 +1,164 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#include <net/net_msg_stats.h>
+#include <protocol.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+    // Commands we don't know are all counted under this, so peers can't make
+    // us keep unbounded numbers of histograms
+    const std::string NET_MESSAGE_COMMAND_OTHER { "*other*" };
+
+    // Copy a metrics histogram into a set of buckets
+    void CopyBuckets(const metrics::Histogram& histogram, NetMsgStats::Buckets& buckets)
+    {
+        const std::vector<size_t> counts { histogram.getCounts() };
+        for(size_t i = 0; i < counts.size() && i < NetMsgStats::NUM_BUCKETS; ++i)
+        {
+            buckets[i] = counts[i];
+        }
+        buckets[NetMsgStats::NUM_BUCKETS] = histogram.getOverCount();
+    }
+
+    void AddBuckets(NetMsgStats::Buckets& to, const NetMsgStats::Buckets& from)
+    {
+        for(size_t i = 0; i < to.size(); ++i)
+        {
+            to[i] += from[i];
+        }
+    }
+
+    // The stats for all message handler threads
+    std::mutex threadStatsMtx {};
+    std::vector<std::shared_ptr<NetMsgStats>> threadStats {};
+
+    NetMsgStats& GetThreadStats()
+    {
+        thread_local std::shared_ptr<NetMsgStats> stats {
+            []() {
+                auto newStats { std::make_shared<NetMsgStats>() };
+                std::lock_guard lock { threadStatsMtx };
+                threadStats.push_back(newStats);
+                return newStats;
+            }()
+        };
+        return *stats;
+    }
+}
+
+NetMsgStats::CommandStats& NetMsgStats::CommandStats::operator+=(const CommandStats& that)
+{
+    count += that.count;
+    totalQueueWait += that.totalQueueWait;
+    totalProcessTime += that.totalProcessTime;
+    totalBytes += that.totalBytes;
+    AddBuckets(queueWait, that.queueWait);
+    AddBuckets(processTime, that.processTime);
+    AddBuckets(bytes, that.bytes);
+    return *this;
+}
+
+NetMsgStats::Histograms::Histograms(const std::string& command)
+: queueWait{command + " queue wait", NUM_BUCKETS},
+  processTime{command + " process time", NUM_BUCKETS},
+  bytes{command + " bytes", NUM_BUCKETS}
+{
+}
+
+void NetMsgStats::Record(const std::string& command, std::chrono::microseconds queueWait,
+    std::chrono::microseconds processTime, uint64_t bytes)
+{
+    // Queue wait is measured against the wall clock, which can go backwards
+    const uint64_t queueWaitMicros { static_cast<uint64_t>(std::max<int64_t>(queueWait.count(), 0)) };
+    const uint64_t processTimeMicros { static_cast<uint64_t>(std::max<int64_t>(processTime.count(), 0)) };
+
+    Histograms& histograms { GetHistograms(command) };
+    ++histograms.count;
+    histograms.totalQueueWait += queueWaitMicros;
+    histograms.totalProcessTime += processTimeMicros;
+    histograms.totalBytes += bytes;
+    histograms.queueWait.count(GetBucket(queueWaitMicros));
+    histograms.processTime.count(GetBucket(processTimeMicros));
+    histograms.bytes.count(GetBucket(bytes));
+}
+
+NetMsgStats::Snapshot NetMsgStats::GetSnapshot() const
+{
+    Snapshot snapshot {};
+
+    std::lock_guard lock { mMtx };
+    for(const auto& [command, histograms] : mHistograms)
+    {
+        CommandStats& stats { snapshot[command] };
+        stats.count = histograms->count;
+        stats.totalQueueWait = histograms->totalQueueWait;
+        stats.totalProcessTime = histograms->totalProcessTime;
+        stats.totalBytes = histograms->totalBytes;
+        CopyBuckets(histograms->queueWait, stats.queueWait);
+        CopyBuckets(histograms->processTime, stats.processTime);
+        CopyBuckets(histograms->bytes, stats.bytes);
+    }
+
+    return snapshot;
+}
+
+size_t NetMsgStats::GetBucket(uint64_t value)
+{
+    size_t bucket {0};
+    while(value)
+    {
+        value >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+NetMsgStats::Histograms& NetMsgStats::GetHistograms(const std::string& command)
+{
+    // Histograms are never removed, so it's safe to use them after unlocking
+    std::lock_guard lock { mMtx };
+    auto it { mHistograms.find(command) };
+    if(it == mHistograms.end())
+    {
+        const std::vector<std::string>& allTypes { getAllNetMessageTypes() };
+        const std::string& key { std::find(allTypes.begin(), allTypes.end(), command) != allTypes.end() ?
+            command : NET_MESSAGE_COMMAND_OTHER };
+        it = mHistograms.find(key);
+        if(it == mHistograms.end())
+        {
+            it = mHistograms.emplace(key, std::make_unique<Histograms>(key)).first;
+        }
+    }
+    return *(it->second);
+}
+
+void GlobalNetMsgStats::Record(const std::string& command, std::chrono::microseconds queueWait,
+    std::chrono::microseconds processTime, uint64_t bytes)
+{
+    GetThreadStats().Record(command, queueWait, processTime, bytes);
+}
+
+NetMsgStats::Snapshot GlobalNetMsgStats::GetSnapshot()
+{
+    std::vector<std::shared_ptr<NetMsgStats>> allStats {};
+    {
+        std::lock_guard lock { threadStatsMtx };
+        allStats = threadStats;
+    }
+
+    NetMsgStats::Snapshot snapshot {};
+    for(const auto& stats : allStats)
+    {
+        for(const auto& [command, commandStats] : stats->GetSnapshot())
+        {
+            snapshot[command] += commandStats;
+        }
+    }
+    return snapshot;
+}
@@ -0,0 +1,94 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#pragma once
+
+#include <metrics.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+ * Histograms of how long received network messages waited to be processed,
+ * how long they took to process, and how big they were, by message command.
+ *
+ * Values are counted in power of 2 buckets; bucket 0 counts zeros and bucket
+ * N counts values in [2^(N-1), 2^N). Times are in microseconds. Commands
+ * that aren't known message types are all counted together as "*other*".
+ */
+class NetMsgStats
+{
+  public:
+    static constexpr size_t NUM_BUCKETS {40};
+    using Buckets = std::array<uint64_t, NUM_BUCKETS + 1>;
+
+    // Copy of the histograms for a single command. The final bucket counts
+    // anything too big for the others.
+    struct CommandStats
+    {
+        uint64_t count {0};
+        uint64_t totalQueueWait {0};
+        uint64_t totalProcessTime {0};
+        uint64_t totalBytes {0};
+        Buckets queueWait {};
+        Buckets processTime {};
+        Buckets bytes {};
+
+        CommandStats& operator+=(const CommandStats& that);
+    };
+    using Snapshot = std::map<std::string, CommandStats>;
+
+    // Record processing of a message
+    void Record(const std::string& command, std::chrono::microseconds queueWait,
+        std::chrono::microseconds processTime, uint64_t bytes);
+
+    // Get a copy of the current histograms
+    Snapshot GetSnapshot() const;
+
+    // Get the histogram bucket for a value
+    static size_t GetBucket(uint64_t value);
+
+  private:
+
+    // Histograms for one command
+    struct Histograms
+    {
+        explicit Histograms(const std::string& command);
+
+        std::atomic<uint64_t> count {0};
+        std::atomic<uint64_t> totalQueueWait {0};
+        std::atomic<uint64_t> totalProcessTime {0};
+        std::atomic<uint64_t> totalBytes {0};
+        metrics::Histogram queueWait;
+        metrics::Histogram processTime;
+        metrics::Histogram bytes;
+    };
+
+    Histograms& GetHistograms(const std::string& command);
+
+    mutable std::mutex mMtx {};
+    std::map<std::string, std::unique_ptr<Histograms>> mHistograms {};
+};
+
+/**
+ * Node wide message stats. Each message handler thread records into its own
+ * NetMsgStats, so recording never contends with other threads; they're only
+ * combined when someone asks for them.
+ */
+namespace GlobalNetMsgStats
+{
+    // Record processing of a message against the calling thread's stats
+    void Record(const std::string& command, std::chrono::microseconds queueWait,
+        std::chrono::microseconds processTime, uint64_t bytes);
+
+    // Get the combined stats from all threads
+    NetMsgStats::Snapshot GetSnapshot();
+}
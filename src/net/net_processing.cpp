@@ -34,6 +34,7 @@
 #include "tinyformat.h"
 #include "txdb.h"
 #include "txmempool.h"
+#include "txn_propagator.h"
 #include "ui_interface.h"
 #include "util.h"
 #include "utilmoneystr.h"
@@ -67,7 +68,9 @@ namespace {
 /** Number of nodes with fSyncStarted. */
 std::atomic<int> nSyncStarted = 0;
 
+/** Chain tip the recent rejects filter was last reset for, and its lock. */
 uint256 hashRecentRejectsChainTip;
+std::mutex hashRecentRejectsChainTipMtx;
 
 /** Track blocks in flight and where they're coming from */
 BlockDownloadTracker blockDownloadTracker {};
@@ -549,8 +552,8 @@ private:
 
 // Forward declarion of ProcessMessage
 static bool ProcessMessage(const Config& config, const CNodePtr& pfrom, const std::string& strCommand,
-    CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CConnman& connman,
-    const std::atomic<bool>& interruptMsgProc);
+    CDataStream& vRecv, const std::shared_ptr<CBlock>& parsedBlock, int64_t nTimeReceived,
+    const CChainParams& chainparams, CConnman& connman, const std::atomic<bool>& interruptMsgProc);
 
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
     // Try to obtain an access to the node's state data.
@@ -859,7 +862,7 @@ void PeerLogicValidation::UpdatedBlockTip(const CBlockIndex *pindexNew,
                 }
             }
         });
-        connman->WakeMessageHandler();
+        connman->WakeAllMessageHandlers();
     }
 
     nTimeBestReceived = GetTime();
@@ -888,38 +891,104 @@ bool AlreadyHave(const CInv &inv) {
     return true;
 }
 
+namespace {
+// If the chain tip has changed previously rejected transactions might be now
+// valid, e.g. due to a nLockTime'd tx becoming valid, or a double-spend. Reset
+// the rejects filter and the known transactions filter and give those txs a
+// second chance.
+void ResetRecentRejectsIfTipChanged() {
+    const uint256& activeTipBlockHash {
+        chainActive.Tip()->GetBlockHash()
+    };
+    std::lock_guard lock { hashRecentRejectsChainTipMtx };
+    if (activeTipBlockHash != hashRecentRejectsChainTip) {
+        hashRecentRejectsChainTip = activeTipBlockHash;
+        g_connman->ResetRecentRejects();
+        g_connman->GetKnownTxnFilter().Clear();
+    }
+}
+
+// Whether we have or have rejected a txn, for reasons that will still hold
+// until the chain tip changes, and so can be remembered in the known txns
+// filter.
+bool IsTxnKnownUntilNewTip(const uint256& txid) {
+    // Use pcoinsTip->HaveCoinInCache as a quick approximation to
+    // exclude requesting or processing some txs which have already been
+    // included in a block. As this is best effort, we only check for
+    // output 0 and 1. This works well enough in practice and we get
+    // diminishing returns with 2 onward.
+    return g_connman->CheckTxnInRecentRejects(txid) ||
+           mempool.Exists(txid) ||
+           mempool.getNonFinalPool().exists(txid) ||
+           mempool.getNonFinalPool().recentlyRemoved(txid) ||
+           // It is safe to refer to pcoinsTip (without holding cs_main) as:
+           // - pcoinsTip is initialized before CConnman object is created
+           // - HaveCoinInCache is protected by an internal mtx
+           pcoinsTip->HaveCoinInCache(COutPoint(txid, 0)) ||
+           pcoinsTip->HaveCoinInCache(COutPoint(txid, 1));
+}
+
+// Whether a txn is currently being validated or kept as an orphan. This can
+// change at any time, so isn't remembered.
+bool IsTxnBeingProcessed(const uint256& txid) {
+    // A call to the TxIdTracker is sufficient to verify, if currently:
+    // - txn is already received from the network and then moved into ptv queues
+    // - txn is already detected as an orphan and it is still being kept
+    //   (until evicted or accepted)
+    return g_connman->GetTxIdTracker()->Contains(TxId(txid));
+}
+
+// Check a batch of txn invs, returning whether each one is known
+std::vector<bool> AreTxnsKnown(const std::vector<CInv>& invs) {
+    ResetRecentRejectsIfTipChanged();
+
+    // Most announcements are for txns other peers have already told us about,
+    // so check them all against the known txns filter in one go first
+    KnownTxnFilter& knownTxns { g_connman->GetKnownTxnFilter() };
+    const uint64_t generation { knownTxns.GetGeneration() };
+    std::vector<uint256> txids {};
+    txids.reserve(invs.size());
+    for (const CInv& inv : invs) {
+        txids.push_back(inv.hash);
+    }
+    std::vector<bool> known { knownTxns.Contains(txids) };
+
+    std::vector<uint256> newlyKnown {};
+    for (size_t i = 0; i < invs.size(); ++i) {
+        if (invs[i].type != MSG_TX) {
+            // Don't know what it is, just say we already got one
+            known[i] = true;
+        }
+        else if (!known[i]) {
+            if (IsTxnKnownUntilNewTip(txids[i])) {
+                known[i] = true;
+                newlyKnown.push_back(txids[i]);
+            }
+            else {
+                known[i] = IsTxnBeingProcessed(txids[i]);
+            }
+        }
+    }
+    knownTxns.Insert(newlyKnown, generation);
+
+    return known;
+}
+}
+
 bool IsTxnKnown(const CInv &inv) {
     if (MSG_TX == inv.type) {
-        const uint256& activeTipBlockHash {
-            chainActive.Tip()->GetBlockHash()
-        };
-        if (activeTipBlockHash != hashRecentRejectsChainTip) {
-            // If the chain tip has changed previously rejected transactions
-            // might be now valid, e.g. due to a nLockTime'd tx becoming
-            // valid, or a double-spend. Reset the rejects filter and give
-            // those txs a second chance.
-            hashRecentRejectsChainTip = activeTipBlockHash;
-            g_connman->ResetRecentRejects();
-        }
-        // Use pcoinsTip->HaveCoinInCache as a quick approximation to
-        // exclude requesting or processing some txs which have already been
-        // included in a block. As this is best effort, we only check for
-        // output 0 and 1. This works well enough in practice and we get
-        // diminishing returns with 2 onward.
-        return g_connman->CheckTxnInRecentRejects(inv.hash) ||
-               mempool.Exists(inv.hash) ||
-               mempool.getNonFinalPool().exists(inv.hash) ||
-               mempool.getNonFinalPool().recentlyRemoved(inv.hash) ||
-               // A call to the TxIdTracker is sufficient to verify, if currently:
-               // - txn is already received from the network and then moved into ptv queues
-               // - txn is already detected as an orphan and it is still being kept
-               //   (until evicted or accepted)
-               g_connman->GetTxIdTracker()->Contains(TxId(inv.hash)) ||
-               // It is safe to refer to pcoinsTip (without holding cs_main) as:
-               // - pcoinsTip is initialized before CConnman object is created
-               // - HaveCoinInCache is protected by an internal mtx
-               pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 0)) ||
-               pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 1));
+        ResetRecentRejectsIfTipChanged();
+
+        KnownTxnFilter& knownTxns { g_connman->GetKnownTxnFilter() };
+        const uint64_t generation { knownTxns.GetGeneration() };
+        if (knownTxns.Contains(inv.hash)) {
+            return true;
+        }
+        if (IsTxnKnownUntilNewTip(inv.hash)) {
+            knownTxns.Insert(inv.hash, generation);
+            return true;
+        }
+        return IsTxnBeingProcessed(inv.hash);
     }
     // Don't know what it is, just say we already got one
     return true;
@@ -933,6 +1002,10 @@ bool IsBlockKnown(const CInv &inv) {
     return true;
 }
 
+bool IsBlockInFlight(const uint256& hash, NodeId node) {
+    return blockDownloadTracker.IsInFlight({ hash, node });
+}
+
 void RelayTransaction(const CTransaction &tx, CConnman &connman) {
     CInv inv { MSG_TX, tx.GetId() };
     TxMempoolInfo txinfo {};
@@ -2057,17 +2130,27 @@ static void ProcessInvMessage(const CNodePtr& pfrom,
         fBlocksOnly = false;
     }
 
-    LOCK(cs_main);
-    for(size_t nInv = 0; nInv < vInv.size(); nInv++) {
-        CInv &inv = vInv[nInv];
-
-        if(interruptMsgProc) {
-            return;
+    // Split into block and txn invs, so that txn invs can be handled as a
+    // batch without holding cs_main
+    std::vector<CInv> vBlockInv {};
+    std::vector<CInv> vTxnInv {};
+    for(const CInv& inv : vInv) {
+        if(inv.type == MSG_BLOCK) {
+            vBlockInv.push_back(inv);
         }
+        else {
+            vTxnInv.push_back(inv);
+        }
+    }
 
-        bool fAlreadyHave = AlreadyHave(inv);
+    if(!vBlockInv.empty()) {
+        LOCK(cs_main);
+        for(const CInv& inv : vBlockInv) {
+            if(interruptMsgProc) {
+                return;
+            }
 
-        if(inv.type == MSG_BLOCK) {
+            bool fAlreadyHave = AlreadyHave(inv);
             LogPrint(BCLog::NETMSG, "got block inv: %s %s peer=%d\n", inv.hash.ToString(),
                 fAlreadyHave ? "have" : "new", pfrom->id);
             UpdateBlockAvailability(inv.hash, GetState(pfrom->GetId()).get());
@@ -2090,20 +2173,36 @@ static void ProcessInvMessage(const CNodePtr& pfrom,
                          pfrom->id);
             }
         }
-        else {
+    }
+
+    if(!vTxnInv.empty()) {
+        if(interruptMsgProc) {
+            return;
+        }
+
+        pfrom->AddInventoryKnown(vTxnInv);
+
+        // Check the whole batch at once, and then ask for all the new ones at once
+        const std::vector<bool> vKnown { AreTxnsKnown(vTxnInv) };
+        bool fAskFor { !fBlocksOnly && !fImporting && !fReindex && !IsInitialBlockDownload() };
+        std::vector<CInv> vAskFor {};
+        for(size_t nInv = 0; nInv < vTxnInv.size(); nInv++) {
+            const CInv& inv = vTxnInv[nInv];
             LogPrint(BCLog::TXNSRC | BCLog::NETMSGVERB, "got txn inv: %s %s txnsrc peer=%d\n",
-                inv.hash.ToString(), fAlreadyHave ? "have" : "new", pfrom->id);
-            pfrom->AddInventoryKnown(inv);
+                inv.hash.ToString(), vKnown[nInv] ? "have" : "new", pfrom->id);
             if(fBlocksOnly) {
                 LogPrint(BCLog::NETMSGVERB, "transaction (%s) inv sent in violation of protocol peer=%d\n",
                          inv.hash.ToString(), pfrom->id);
             }
-            else if(!fAlreadyHave && !fImporting && !fReindex && !IsInitialBlockDownload()) {
-                pfrom->AskFor(inv, config);
+            else if(!vKnown[nInv] && fAskFor) {
+                vAskFor.push_back(inv);
             }
         }
+        pfrom->AskFor(vAskFor, config);
+    }
 
-        // Track requests for our stuff
+    // Track requests for our stuff
+    for(const CInv& inv : vInv) {
         GetMainSignals().Inventory(inv.hash);
     }
 }
@@ -3051,10 +3150,15 @@ static bool ProcessCompactBlockMessage(const Config& config, const CNodePtr& pfr
 * Process block message.
 */
 static void ProcessBlockMessage(const Config& config, const CNodePtr& pfrom, CDataStream& vRecv,
-    CConnman& connman)
+    const std::shared_ptr<CBlock>& parsedBlock, CConnman& connman)
 {
-    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-    vRecv >> *pblock;
+    // Large blocks will have been parsed already while they were arriving
+    std::shared_ptr<CBlock> pblock { parsedBlock };
+    if(!pblock)
+    {
+        pblock = std::make_shared<CBlock>();
+        vRecv >> *pblock;
+    }
 
     LogPrint(BCLog::NETMSG, "received block %s peer=%d\n", pblock->GetHash().ToString(), pfrom->id);
 
@@ -3417,6 +3521,7 @@ static bool ProcessProtoconfMessage(const CNodePtr& pfrom, CDataStream& vRecv, C
 */
 static bool ProcessMessage(const Config& config, const CNodePtr& pfrom,
                            const std::string& strCommand, CDataStream& vRecv,
+                           const std::shared_ptr<CBlock>& parsedBlock,
                            int64_t nTimeReceived,
                            const CChainParams& chainparams, CConnman& connman,
                            const std::atomic<bool>& interruptMsgProc)
@@ -3529,7 +3634,7 @@ static bool ProcessMessage(const Config& config, const CNodePtr& pfrom,
 
     // Ignore blocks received while importing
     else if (strCommand == NetMsgType::BLOCK && !fImporting && !fReindex) {
-        ProcessBlockMessage(config, pfrom, vRecv, connman);
+        ProcessBlockMessage(config, pfrom, vRecv, parsedBlock, connman);
     }
 
     else if (strCommand == NetMsgType::GETADDR) {
@@ -3672,6 +3777,7 @@ bool ProcessMessages(const Config &config, const CNodePtr& pfrom, CConnman &conn
         return false;
     }
     fMoreWork = moreMsgs;
+    const int64_t processStartMicros { GetTimeMicros() };
     CNetMessage& msg { *nextMsg };
     msg.SetVersion(pfrom->GetRecvVersion());
 
@@ -3749,10 +3855,19 @@ bool ProcessMessages(const Config &config, const CNodePtr& pfrom, CConnman &conn
 
     // Process message
     bool fRet = false;
+    const auto processStart = std::chrono::steady_clock::now();
+    const auto recordStats = [&]() {
+        const std::chrono::microseconds queueWait { processStartMicros - msg.nTime };
+        const auto processTime { std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - processStart) };
+        pfrom->GetNetMsgStats().Record(strCommand, queueWait, processTime, nPayloadLength);
+        GlobalNetMsgStats::Record(strCommand, queueWait, processTime, nPayloadLength);
+    };
     try {
-        fRet = ProcessMessage(config, pfrom, strCommand, vRecv, msg.nTime,
-                              chainparams, connman, interruptMsgProc);
+        fRet = ProcessMessage(config, pfrom, strCommand, vRecv, msg.takeParsedBlock(),
+                              msg.nTime, chainparams, connman, interruptMsgProc);
         if (interruptMsgProc) {
+            recordStats();
             return false;
         }
         if (!pfrom->vRecvGetData.empty()) {
@@ -3788,6 +3903,8 @@ bool ProcessMessages(const Config &config, const CNodePtr& pfrom, CConnman &conn
         PrintExceptionContinue(nullptr, "ProcessMessages()");
     }
 
+    recordStats();
+
     if (!fRet) {
         LogPrint(BCLog::NETMSG, "%s(%s, %u bytes) FAILED peer=%d\n", __func__,
                   SanitizeString(strCommand), nPayloadLength, pfrom->id);
@@ -4104,11 +4221,11 @@ void SendBlockHeaders(const Config& config, const CNodePtr& pto, CConnman &connm
     pto->vBlockHashesToAnnounce.clear();
 }
 
-void SendTxnInventory(const Config &config, const CNodePtr& pto, CConnman &connman, const CNetMsgMaker& msgMaker,
-    std::vector<CInv>& vInv)
+void SendTxnInventory(const CNodePtr& pto, CConnman &connman, const CNetMsgMaker& msgMaker,
+    std::vector<CInv>& vInv, size_t maxItems)
 {
     // Get as many TX inventory msgs to send as we can for this peer
-    std::vector<CTxnSendingDetails> vInvTx { pto->FetchNInventory(GetInventoryBroadcastMax(config)) };
+    std::vector<CTxnSendingDetails> vInvTx { pto->FetchNInventory(maxItems) };
 
     int64_t nNow = GetTimeMicros();
 
@@ -4166,11 +4283,16 @@ void SendInventory(const Config &config, const CNodePtr& pto, CConnman &connman,
         vInv.clear();
     }
 
-    // Check whether periodic sends should happen
+    // Check whether periodic sends should happen. If the peer is slow to take
+    // what we're already sending, wait longer so we send fewer, fuller invs.
     bool fSendTrickle = pto->fWhitelisted;
     if (pto->nNextInvSend < nNow) {
         fSendTrickle = true;
-        pto->nNextInvSend = nNow + Fixed_delay_microsecs;
+        const Association& association { pto->GetAssociation() };
+        std::chrono::microseconds interval { CTxnPropagator::getPeerInvInterval(
+            std::chrono::microseconds { Fixed_delay_microsecs },
+            association.GetTotalSendQueueSize(), association.GetAverageBandwidth()) };
+        pto->nNextInvSend = nNow + interval.count();
     }
 
     // Time to send but the peer has requested we not relay transactions.
@@ -4216,9 +4338,13 @@ void SendInventory(const Config &config, const CNodePtr& pto, CConnman &connman,
         pto->timeLastMempoolReq = GetTime();
     }
 
-    // Determine transactions to relay
+    // Determine transactions to relay. There's no point waiting any longer if
+    // we already have enough for a full inv message.
     if (fSendTrickle) {
-        SendTxnInventory(config, pto, connman, msgMaker, vInv);
+        SendTxnInventory(pto, connman, msgMaker, vInv, GetInventoryBroadcastMax(config));
+    }
+    else if (pto->GetInventorySize() >= pto->maxInvElements) {
+        SendTxnInventory(pto, connman, msgMaker, vInv, pto->maxInvElements);
     }
 
     if (!vInv.empty()) {
@@ -4408,7 +4534,8 @@ void SendFeeFilter(const Config &config, const CNodePtr& pto, CConnman& connman,
         if (timeNow > pto->nextSendTimeFeeFilter) {
             static CFeeRate default_feerate =
                 CFeeRate(DEFAULT_MIN_RELAY_TX_FEE);
-            static FeeFilterRounder filterRounder(default_feerate);
+            // Not thread safe, so one for each message handler thread
+            static thread_local FeeFilterRounder filterRounder(default_feerate);
             Amount filterToSend = filterRounder.round(currentFilter);
             // We don't allow free transactions, we always have a fee
             // filter of at least minRelayTxFee
@@ -60,6 +60,8 @@ bool AlreadyHave(const CInv &inv);
 bool IsTxnKnown(const CInv &inv);
 /** Check if block is already known */
 bool IsBlockKnown(const CInv &inv);
+/** Check if a block is in flight from the given peer */
+bool IsBlockInFlight(const uint256& hash, NodeId node);
 
 /** Possibly ban a misbehaving peer */
 void Misbehaving(NodeId pnode, int howmuch, const std::string& reason);
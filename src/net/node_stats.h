@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include <net/net_msg_stats.h>
 #include <net/net_types.h>
 
 class StreamStats
@@ -71,4 +72,5 @@ public:
     size_t nInvQueueSize;
 
     AssociationStats associationStats;
+    NetMsgStats::Snapshot netMsgStats;
 };
@@ -0,0 +1,87 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#include <net/recv_buffer_pool.h>
+
+#include <algorithm>
+
+RecvBufferPool& RecvBufferPool::Instance()
+{
+    static RecvBufferPool pool {};
+    return pool;
+}
+
+size_t RecvBufferPool::ClassIndex(size_t size, bool roundUp)
+{
+    size_t index {0};
+    while(index < NUM_CLASSES - 1 && ClassSize(index) < size)
+    {
+        ++index;
+    }
+
+    if(!roundUp && index > 0 && ClassSize(index) > size)
+    {
+        --index;
+    }
+    return index;
+}
+
+size_t RecvBufferPool::MaxPerClass(size_t index)
+{
+    return std::max(MIN_POOLED_PER_CLASS, MAX_POOLED_BYTES_PER_CLASS / ClassSize(index));
+}
+
+RecvBufferPool::Buffer RecvBufferPool::Get(size_t size)
+{
+    Buffer buffer {};
+
+    if(size <= MAX_POOLED_SIZE)
+    {
+        size_t index { ClassIndex(size, true) };
+        {
+            std::lock_guard lock { mMtx };
+            auto& free { mFree[index] };
+            if(!free.empty())
+            {
+                buffer.swap(free.back());
+                free.pop_back();
+                mPooledBytes -= buffer.capacity();
+                return buffer;
+            }
+        }
+
+        // Allocate the whole class size, so it can go back in the same class
+        size = ClassSize(index);
+    }
+
+    buffer.reserve(size);
+    return buffer;
+}
+
+void RecvBufferPool::Release(Buffer&& buffer)
+{
+    size_t capacity { buffer.capacity() };
+    if(capacity < MIN_POOLED_SIZE || capacity > MAX_POOLED_SIZE)
+    {
+        return;
+    }
+
+    buffer.clear();
+    size_t index { ClassIndex(capacity, false) };
+
+    std::lock_guard lock { mMtx };
+    auto& free { mFree[index] };
+    if(free.size() < MaxPerClass(index))
+    {
+        free.emplace_back(std::move(buffer));
+        mPooledBytes += capacity;
+    }
+}
+
+size_t RecvBufferPool::GetPooledBytes() const
+{
+    std::lock_guard lock { mMtx };
+    return mPooledBytes;
+}
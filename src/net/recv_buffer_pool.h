@@ -0,0 +1,65 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#pragma once
+
+#include <support/allocators/zeroafterfree.h>
+
+#include <array>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+/**
+ * Pool of buffers for receiving network messages into.
+ *
+ * Every message we receive needs a buffer, and under heavy transaction relay
+ * that's a lot of short lived allocations. Instead, buffers are returned here
+ * once a message has been processed, and handed out again for later messages.
+ *
+ * Buffers are kept in power of 2 size classes, and only a limited amount of
+ * memory is kept for each class. Buffers for messages larger than the largest
+ * class aren't pooled.
+ */
+class RecvBufferPool
+{
+  public:
+    using Buffer = CSerializeData;
+
+    // Smallest and largest sizes we pool
+    static constexpr size_t MIN_POOLED_SIZE {1024};
+    static constexpr size_t MAX_POOLED_SIZE {1024 * 1024};
+
+    // Most memory we keep in each size class, although we always keep at
+    // least a couple of buffers
+    static constexpr size_t MAX_POOLED_BYTES_PER_CLASS {2 * 1024 * 1024};
+    static constexpr size_t MIN_POOLED_PER_CLASS {2};
+
+    // The process wide pool
+    static RecvBufferPool& Instance();
+
+    // Get an empty buffer with capacity for at least the given size
+    Buffer Get(size_t size);
+
+    // Return a buffer for reuse
+    void Release(Buffer&& buffer);
+
+    // Total capacity of the buffers we hold
+    size_t GetPooledBytes() const;
+
+  private:
+
+    // Size class index for a size; rounded up for Get or down for Release
+    static size_t ClassIndex(size_t size, bool roundUp);
+    static size_t ClassSize(size_t index) { return MIN_POOLED_SIZE << index; }
+    static size_t MaxPerClass(size_t index);
+
+    static constexpr size_t NUM_CLASSES {11};
+    static_assert(MIN_POOLED_SIZE << (NUM_CLASSES - 1) == MAX_POOLED_SIZE);
+
+    std::array<std::vector<Buffer>, NUM_CLASSES> mFree {};
+    size_t mPooledBytes {0};
+    mutable std::mutex mMtx {};
+};
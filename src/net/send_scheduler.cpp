@@ -0,0 +1,133 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#include <net/send_scheduler.h>
+
+#include <algorithm>
+#include <limits>
+
+// Enable enum_cast for SendPriority, so we can log informatively
+const enumTableT<SendPriority>& enumTable(SendPriority)
+{
+    static enumTableT<SendPriority> table
+    {
+        { SendPriority::CONTROL,    "CONTROL" },
+        { SendPriority::HEADERS,    "HEADERS" },
+        { SendPriority::BLOCK,      "BLOCK" },
+        { SendPriority::TXN,        "TXN" },
+    };
+    return table;
+}
+
+void SendScheduler::Push(SendPriority priority, Item&& data, bool endOfMsg)
+{
+    size_t index { std::min(static_cast<size_t>(priority), NUM_SEND_PRIORITIES - 1) };
+    mQueues[index].push_back({ std::move(data), endOfMsg });
+}
+
+bool SendScheduler::Empty() const
+{
+    return std::all_of(mQueues.begin(), mQueues.end(), [](const auto& queue) { return queue.empty(); });
+}
+
+CForwardAsyncReadonlyStream* SendScheduler::Front()
+{
+    // Anything part way through sending has to be finished first
+    mCurrent = mInProgress ? mInProgress : NextClass();
+    if(!mCurrent)
+    {
+        return nullptr;
+    }
+
+    return mQueues[*mCurrent].front().data.get();
+}
+
+void SendScheduler::Sent(uint64_t bytes, bool complete)
+{
+    if(!mCurrent)
+    {
+        return;
+    }
+
+    size_t index { *mCurrent };
+    auto& queue { mQueues[index] };
+    mDeficits[index] -= static_cast<int64_t>(bytes);
+
+    if(complete)
+    {
+        bool endOfMsg { queue.front().endOfMsg };
+        queue.pop_front();
+        mInProgress = endOfMsg ? std::nullopt : mCurrent;
+        mCurrent = std::nullopt;
+
+        // An idle class doesn't save up credit
+        if(queue.empty())
+        {
+            mDeficits[index] = 0;
+        }
+    }
+    else if(bytes > 0)
+    {
+        // We're committed to the rest of this message now
+        mInProgress = mCurrent;
+    }
+}
+
+bool SendScheduler::Stall()
+{
+    if(mInProgress || !mCurrent)
+    {
+        return false;
+    }
+
+    mStalled[*mCurrent] = true;
+    mCurrent = std::nullopt;
+    return true;
+}
+
+std::optional<size_t> SendScheduler::NextClass()
+{
+    auto waiting = [this](size_t index) { return !mQueues[index].empty() && !mStalled[index]; };
+
+    // Highest priority class that's still in credit
+    for(size_t i = 0; i < NUM_SEND_PRIORITIES; ++i)
+    {
+        if(waiting(i) && mDeficits[i] > 0)
+        {
+            return i;
+        }
+    }
+
+    // Run as many rounds as it takes to put a waiting class back in credit
+    uint64_t rounds { std::numeric_limits<uint64_t>::max() };
+    for(size_t i = 0; i < NUM_SEND_PRIORITIES; ++i)
+    {
+        if(waiting(i))
+        {
+            uint64_t quantum { std::max<uint64_t>(mQuanta[i], 1) };
+            rounds = std::min(rounds, static_cast<uint64_t>(-mDeficits[i]) / quantum + 1);
+        }
+    }
+    if(rounds == std::numeric_limits<uint64_t>::max())
+    {
+        return std::nullopt;
+    }
+
+    std::optional<size_t> next {};
+    for(size_t i = 0; i < NUM_SEND_PRIORITIES; ++i)
+    {
+        if(waiting(i))
+        {
+            uint64_t quantum { std::max<uint64_t>(mQuanta[i], 1) };
+            mDeficits[i] += static_cast<int64_t>(rounds * quantum);
+            if(!next && mDeficits[i] > 0)
+            {
+                next = i;
+            }
+        }
+    }
+
+    return next;
+}
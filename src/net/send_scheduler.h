@@ -0,0 +1,104 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#pragma once
+
+#include <enum_cast.h>
+#include <streams.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+
+/**
+ * Classes of outgoing message, highest priority first.
+ */
+enum class SendPriority : uint8_t
+{
+    CONTROL = 0,    // Connection control and keep alive; pings, pongs, etc
+    HEADERS,        // Headers and announcements; headers, inv, getdata, etc
+    BLOCK,          // Blocks and compact blocks
+    TXN,            // Transactions and anything else
+
+    MAX_SEND_PRIORITY
+};
+// Enable enum_cast for SendPriority, so we can log informatively
+const enumTableT<SendPriority>& enumTable(SendPriority);
+
+constexpr size_t NUM_SEND_PRIORITIES { static_cast<size_t>(SendPriority::MAX_SEND_PRIORITY) };
+
+// Number of bytes each class is allowed to send per round
+using SendQuanta = std::array<uint64_t, NUM_SEND_PRIORITIES>;
+
+/**
+ * Schedules sending queued messages from a stream.
+ *
+ * Messages are queued by priority class, and the classes share the stream
+ * using deficit round-robin; each round every class with something ready to
+ * send is credited with its quantum of bytes, and the bytes it sends are
+ * debited.
+ * The highest priority class still in credit is always sent from first, so
+ * small control messages don't sit behind large blocks, while a steady
+ * stream of high priority traffic can't starve the lower classes completely.
+ *
+ * Once we have started sending a message the rest of it has to follow on the
+ * wire, so a large message is sent in chunks that are all debited from its
+ * class, and other classes get their turn once it completes.
+ */
+class SendScheduler
+{
+  public:
+    using Item = std::unique_ptr<CForwardAsyncReadonlyStream>;
+
+    // Default per round quanta
+    static constexpr SendQuanta DEFAULT_QUANTA { 256 * 1024, 128 * 1024, 128 * 1024, 64 * 1024 };
+
+    SendScheduler() = default;
+
+    // Set the per round quanta
+    void SetQuanta(const SendQuanta& quanta) { mQuanta = quanta; }
+
+    // Queue part of a message; endOfMsg is set for the final part
+    void Push(SendPriority priority, Item&& data, bool endOfMsg);
+
+    // Whether we have nothing queued
+    bool Empty() const;
+
+    // Get the data to send next, or nullptr if there's nothing we can send
+    CForwardAsyncReadonlyStream* Front();
+
+    // Record we sent some bytes from the front item, and whether that's all of it
+    void Sent(uint64_t bytes, bool complete);
+
+    // Record the front item isn't ready to send anything yet, so other classes
+    // can go ahead until ClearStalled() is called. Returns false if they can't
+    // because we're part way through sending a message.
+    bool Stall();
+    void ClearStalled() { mStalled = {}; }
+
+  private:
+
+    // Pick the class to send from next
+    std::optional<size_t> NextClass();
+
+    struct QueuedItem
+    {
+        Item data {};
+        bool endOfMsg {false};
+    };
+
+    std::array<std::deque<QueuedItem>, NUM_SEND_PRIORITIES> mQueues {};
+    std::array<int64_t, NUM_SEND_PRIORITIES> mDeficits {};
+    std::array<bool, NUM_SEND_PRIORITIES> mStalled {};
+    SendQuanta mQuanta { DEFAULT_QUANTA };
+
+    // Class of the message we are part way through sending, if any
+    std::optional<size_t> mInProgress {};
+    // Class of the item returned by Front()
+    std::optional<size_t> mCurrent {};
+};
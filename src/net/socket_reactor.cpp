@@ -0,0 +1,233 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#include <net/netbase.h>
+#include <net/socket_reactor.h>
+#include <tinyformat.h>
+#include <util.h>
+
+#include <array>
+#include <stdexcept>
+
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#elif !defined(WIN32)
+#include <poll.h>
+#endif
+
+namespace
+{
+#ifdef USE_EPOLL
+    // Most events we fetch per wait; any more stay ready for the next wait
+    constexpr int MAX_EPOLL_EVENTS {1024};
+
+    bool EpollAdd(int epollFd, SOCKET socket, uint32_t events)
+    {
+        epoll_event event {};
+        event.events = events;
+        event.data.fd = socket;
+
+        if(epoll_ctl(epollFd, EPOLL_CTL_ADD, socket, &event) == 0)
+        {
+            return true;
+        }
+
+        int nErr { errno };
+        LogPrint(BCLog::NETCONN, "failed to add socket to epoll: %s\n", NetworkErrorString(nErr));
+        return false;
+    }
+#endif
+}
+
+SocketReactor::SocketReactor()
+{
+#ifdef USE_EPOLL
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if(mEpollFd < 0)
+    {
+        throw std::runtime_error(strprintf("Failed to create epoll instance: %s", NetworkErrorString(errno)));
+    }
+#endif
+}
+
+SocketReactor::~SocketReactor()
+{
+#ifdef USE_EPOLL
+    close(mEpollFd);
+#endif
+}
+
+bool SocketReactor::Add(SOCKET socket)
+{
+#ifdef USE_EPOLL
+    return EpollAdd(mEpollFd, socket, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+#else
+    // A socket number can be reused once closed, so just replace anything we had for it
+    std::lock_guard lock { mMtx };
+    mWatched[socket] = { POLLIN | POLLOUT, true };
+    return true;
+#endif
+}
+
+bool SocketReactor::AddListening(SOCKET socket)
+{
+#ifdef USE_EPOLL
+    return EpollAdd(mEpollFd, socket, EPOLLIN);
+#else
+    std::lock_guard lock { mMtx };
+    mWatched[socket] = { POLLIN, false };
+    return true;
+#endif
+}
+
+void SocketReactor::Rearm(SOCKET socket, bool recv, bool send)
+{
+#ifndef USE_EPOLL
+    std::lock_guard lock { mMtx };
+    auto it { mWatched.find(socket) };
+    if(it != mWatched.end())
+    {
+        if(recv)
+        {
+            it->second.events |= POLLIN;
+        }
+        if(send)
+        {
+            it->second.events |= POLLOUT;
+        }
+    }
+#endif
+}
+
+void SocketReactor::Schedule(SOCKET socket)
+{
+    std::lock_guard lock { mMtx };
+    mScheduled.insert(socket);
+}
+
+bool SocketReactor::Wait(std::chrono::milliseconds timeout, std::vector<Event>& events)
+{
+    events.clear();
+
+#ifdef USE_EPOLL
+    std::array<epoll_event, MAX_EPOLL_EVENTS> ready {};
+    int nReady { epoll_wait(mEpollFd, ready.data(), MAX_EPOLL_EVENTS, static_cast<int>(timeout.count())) };
+    if(nReady < 0)
+    {
+        if(errno != EINTR)
+        {
+            return false;
+        }
+        nReady = 0;
+    }
+
+    for(int i = 0; i < nReady; ++i)
+    {
+        uint32_t flags { ready[i].events };
+        events.push_back({ ready[i].data.fd,
+                           (flags & (EPOLLIN | EPOLLRDHUP)) != 0,
+                           (flags & EPOLLOUT) != 0,
+                           (flags & (EPOLLERR | EPOLLHUP)) != 0 });
+    }
+#else
+    std::vector<pollfd> fds {};
+    {
+        std::lock_guard lock { mMtx };
+        fds.reserve(mWatched.size());
+        for(const auto& [socket, watched] : mWatched)
+        {
+            // Skip edge triggered sockets we have already reported in both directions
+            if(watched.events)
+            {
+                pollfd fd {};
+                fd.fd = socket;
+                fd.events = watched.events;
+                fds.push_back(fd);
+            }
+        }
+    }
+
+#ifdef WIN32
+    int nReady { WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), static_cast<INT>(timeout.count())) };
+#else
+    int nReady { poll(fds.data(), fds.size(), static_cast<int>(timeout.count())) };
+#endif
+    if(nReady == SOCKET_ERROR)
+    {
+        if(WSAGetLastError() != WSAEINTR)
+        {
+            return false;
+        }
+        nReady = 0;
+    }
+
+    if(nReady > 0)
+    {
+        std::lock_guard lock { mMtx };
+        for(const pollfd& fd : fds)
+        {
+            if(!fd.revents)
+            {
+                continue;
+            }
+
+            auto it { mWatched.find(fd.fd) };
+            if(it == mWatched.end())
+            {
+                continue;
+            }
+            if(fd.revents & POLLNVAL)
+            {
+                // Socket has been closed
+                mWatched.erase(it);
+                continue;
+            }
+
+            Event event { fd.fd,
+                          (fd.revents & (POLLIN | POLLHUP)) != 0,
+                          (fd.revents & POLLOUT) != 0,
+                          (fd.revents & POLLERR) != 0 };
+
+            // Emulate edge triggering by not watching for what we've just
+            // reported until we're rearmed
+            if(it->second.edgeTriggered)
+            {
+                if(event.recv || event.error)
+                {
+                    it->second.events &= ~POLLIN;
+                }
+                if(event.send)
+                {
+                    it->second.events &= ~POLLOUT;
+                }
+            }
+
+            events.push_back(event);
+        }
+    }
+#endif
+
+    // Add scheduled sockets
+    std::unordered_set<SOCKET> scheduled {};
+    {
+        std::lock_guard lock { mMtx };
+        scheduled.swap(mScheduled);
+    }
+    for(SOCKET socket : scheduled)
+    {
+        events.push_back({ socket, false, false, false });
+    }
+
+    return true;
+}
+
+const char* SocketReactor::GetMechanism()
+{
+#ifdef USE_EPOLL
+    return "epoll";
+#else
+    return "poll";
+#endif
+}
@@ -0,0 +1,88 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#pragma once
+
+#include <compat.h>
+
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#if defined(__linux__)
+#define USE_EPOLL
+#endif
+
+/**
+ * Waits for sockets to become ready for reading or writing.
+ *
+ * Sockets are registered once, when they're opened, rather than being
+ * collected together again for every wait, so the cost of a wait depends
+ * on the number of ready sockets, not on the total number we have.
+ *
+ * Connected sockets are edge triggered; each time a socket becomes ready
+ * it is reported once, and the owner is expected to keep reading or writing
+ * until it would block. Uses epoll where available, otherwise poll.
+ */
+class SocketReactor
+{
+  public:
+
+    // What a socket is ready for
+    struct Event
+    {
+        SOCKET socket {INVALID_SOCKET};
+        bool recv {false};
+        bool send {false};
+        bool error {false};
+    };
+
+    SocketReactor();
+    ~SocketReactor();
+
+    SocketReactor(const SocketReactor&) = delete;
+    SocketReactor& operator=(const SocketReactor&) = delete;
+
+    // Watch a connected socket for reading and writing (edge triggered)
+    bool Add(SOCKET socket);
+
+    // Watch a listening socket for incoming connections (level triggered)
+    bool AddListening(SOCKET socket);
+
+    // Watch again for a socket becoming ready, after reading or writing
+    // it would have blocked. Only needed for poll, epoll rearms itself.
+    void Rearm(SOCKET socket, bool recv, bool send);
+
+    // Report a socket again from the next wait, even if it isn't ready.
+    // For owners that stopped before they would block.
+    void Schedule(SOCKET socket);
+
+    // Wait up to the timeout for sockets to become ready, then add any
+    // scheduled sockets. Returns false on error.
+    bool Wait(std::chrono::milliseconds timeout, std::vector<Event>& events);
+
+    // Name of the mechanism in use
+    static const char* GetMechanism();
+
+  private:
+
+    // Sockets to report from the next wait
+    std::unordered_set<SOCKET> mScheduled {};
+    std::mutex mMtx {};
+
+#ifdef USE_EPOLL
+    int mEpollFd {-1};
+#else
+    // What we're waiting for on each socket
+    struct Watched
+    {
+        short events {0};
+        bool edgeTriggered {true};
+    };
+    std::unordered_map<SOCKET, Watched> mWatched {};
+#endif
+};
@@ -5,11 +5,15 @@
 
 
 #include <config.h>
+#include <file_region_stream.h>
 #include <net/net.h>
 #include <net/netbase.h>
+#include <net/socket_reactor.h>
 #include <net/stream.h>
 #include "config.h"
 
+#include <tuple>
+
 // Enable enum_cast for StreamType, so we can log informatively
 const enumTableT<StreamType>& enumTable(StreamType)
 {
@@ -93,139 +97,162 @@ void Stream::Shutdown()
     }
 }
 
-bool Stream::SetSocketForSelect(fd_set& setRecv, fd_set& setSend, fd_set& setError,
-                                SOCKET& socketMax) const
+SOCKET Stream::GetSocket() const
 {
-    // Implement the following logic:
-    // * If there is data to send select() for sending data.
-    // * If there is space left in the receive buffer select() for receiving data.
-
-    bool select_recv = !mPauseRecv;
-    bool select_send;
-    {
-        LOCK(cs_mSendMsgQueue);
-        select_send = !mSendMsgQueue.empty();
-    }
+    LOCK(cs_mSocket);
+    return mSocket;
+}
 
+bool Stream::SetReactor(SocketReactor& reactor)
+{
+    LOCK(cs_mNode);
     LOCK(cs_mSocket);
-    if(mSocket == INVALID_SOCKET)
+    if(mSocket == INVALID_SOCKET || !reactor.Add(mSocket))
     {
         return false;
     }
 
-    FD_SET(mSocket, &setError);
-    socketMax = std::max(socketMax, mSocket);
-
-    if(select_send)
-    {
-        FD_SET(mSocket, &setSend);
-    }
-    if(select_recv)
-    {
-        FD_SET(mSocket, &setRecv);
-    }
-
+    mReactor = &reactor;
     return true;
 }
 
-void Stream::ServiceSocket(fd_set& setRecv, fd_set& setSend, fd_set& setError, const Config& config,
+void Stream::ServiceSocket(bool recvReady, bool sendReady, bool errorSet, const Config& config,
                            bool& gotNewMsgs, uint64_t& bytesRecv, uint64_t& bytesSent)
 {
+    LOCK(cs_mNode);
+
+    // We won't be told again until we have read or written everything we can
+    mRecvReady |= recvReady || errorSet;
+    mSendReady |= sendReady;
+
     //
-    // Receive
+    // Receive until we would block, until our receive queue is full, or until
+    // we've had our share for this event
     //
-    bool recvSet = false;
-    bool sendSet = false;
-    bool errorSet = false;
-
+    uint64_t bytesRecvThisEvent {0};
+    while(mRecvReady && !mPauseRecv && bytesRecvThisEvent < MAX_RECV_BYTES_PER_EVENT)
     {
-        LOCK(cs_mNode);
+        // typical socket buffer is 8K-64K
+        char pchBuf[0x10000];
+        char* recvBuf { pchBuf };
+        size_t recvSize { sizeof(pchBuf) };
+        ssize_t nBytes = 0;
+
+        // Once we're part way through a large payload, receive the rest of it
+        // straight into the message rather than copying it in from here
+        CNetMessage* payloadMsg { GetPartialPayloadMsg(sizeof(pchBuf)) };
+        if (payloadMsg)
+        {
+            std::tie(recvBuf, recvSize) = payloadMsg->getDataSpace(sizeof(pchBuf));
+        }
+
         {
             LOCK(cs_mSocket);
             if (mSocket == INVALID_SOCKET)
             {
+                if (payloadMsg)
+                {
+                    payloadMsg->dataReceived(0);
+                }
                 return;
             }
-            recvSet = FD_ISSET(mSocket, &setRecv);
-            sendSet = FD_ISSET(mSocket, &setSend);
-            errorSet = FD_ISSET(mSocket, &setError);
+            nBytes = recv(mSocket, recvBuf, recvSize, MSG_DONTWAIT);
         }
-        if (recvSet || errorSet)
+        if (payloadMsg && nBytes <= 0)
         {
-            // typical socket buffer is 8K-64K
-            char pchBuf[0x10000];
-            ssize_t nBytes = 0;
+            payloadMsg->dataReceived(0);
+        }
 
+        if (nBytes > 0)
+        {
+            bytesRecv += static_cast<uint64_t>(nBytes);
+            bytesRecvThisEvent += static_cast<uint64_t>(nBytes);
+            bool complete {false};
+            RECV_STATUS status {RECV_OK};
+            if (payloadMsg)
             {
-                LOCK(cs_mSocket);
-                if (mSocket == INVALID_SOCKET)
-                {
-                    return;
-                }
-                nBytes = recv(mSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+                ReceivePayloadBytes(*payloadMsg, static_cast<uint64_t>(nBytes), complete);
             }
-            if (nBytes > 0)
+            else
             {
-                bytesRecv = static_cast<uint64_t>(nBytes);
-                const RECV_STATUS status = ReceiveMsgBytes(config, pchBuf, bytesRecv, gotNewMsgs);
-                if (status != RECV_OK)
-                {
-                    mNode->CloseSocketDisconnect();
-                    if (status == RECV_BAD_LENGTH)
-                    {
-                        // Ban the peer if try to send messages with bad length
-                        throw BanStream{};
-                    }
-                }
+                status = ReceiveMsgBytes(config, pchBuf, static_cast<uint64_t>(nBytes), complete);
             }
-            else if (nBytes == 0)
+            if (status != RECV_OK)
             {
-                // socket closed gracefully
-                if (!mNode->GetDisconnect())
+                mNode->CloseSocketDisconnect();
+                if (status == RECV_BAD_LENGTH)
                 {
-                    LogPrint(BCLog::NETCONN, "stream socket closed\n");
+                    // Ban the peer if try to send messages with bad length
+                    throw BanStream{};
                 }
-                mNode->CloseSocketDisconnect();
+                return;
             }
-            else if (nBytes < 0)
+
+            // Pull out any completely received msgs, this also tells us
+            // whether our receive queue is now full
+            if (complete)
             {
-                // error
-                int nErr = WSAGetLastError();
-                if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                {
-                    if (!mNode->GetDisconnect())
-                    {
-                        LogPrintf("stream socket recv error %s\n", NetworkErrorString(nErr));
-                    }
-                    mNode->CloseSocketDisconnect();
-                }
+                GetNewMsgs();
+                gotNewMsgs = true;
             }
-        }
 
-        //
-        // Send
-        //
-        if (sendSet)
+            // A short read means the socket buffer is empty
+            if (static_cast<size_t>(nBytes) < recvSize)
+            {
+                mRecvReady = false;
+            }
+        }
+        else if (nBytes == 0)
         {
-            bytesSent = SocketSendData();
+            // socket closed gracefully
+            if (!mNode->GetDisconnect())
+            {
+                LogPrint(BCLog::NETCONN, "stream socket closed\n");
+            }
+            mNode->CloseSocketDisconnect();
+            return;
+        }
+        else
+        {
+            // error
+            int nErr = WSAGetLastError();
+            if (nErr == WSAEINTR)
+            {
+                continue;
+            }
+            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINPROGRESS)
+            {
+                if (!mNode->GetDisconnect())
+                {
+                    LogPrintf("stream socket recv error %s\n", NetworkErrorString(nErr));
+                }
+                mNode->CloseSocketDisconnect();
+                return;
+            }
+            mRecvReady = false;
         }
     }
 
-    // Pull out any completely received msgs
-    if(gotNewMsgs)
+    //
+    // Send
+    //
+    if (mSendReady)
     {
-        GetNewMsgs();
+        bytesSent = SocketSendData();
     }
+
+    UpdateReactor();
 }
 
 uint64_t Stream::PushMessage(std::vector<uint8_t>&& serialisedHeader, CSerializedNetMsg&& msg,
-    uint64_t nPayloadLength, uint64_t nTotalSize)
+    uint64_t nPayloadLength, uint64_t nTotalSize, SendPriority priority, const SendQuanta& quanta)
 {
     uint64_t nBytesSent {0};
 
     LOCK(cs_mNode);
     LOCK(cs_mSendMsgQueue);
-    bool optimisticSend { mSendMsgQueue.empty() };
+    bool optimisticSend { mSendMsgQueue.Empty() };
+    mSendMsgQueue.SetQuanta(quanta);
 
     // Log total amount of bytes per command
     mSendBytesPerMsgCmd[msg.Command()] += nTotalSize;
@@ -247,15 +274,15 @@ uint64_t Stream::PushMessage(std::vector<uint8_t>&& serialisedHeader, CSerialize
         }
 
         // Queue combined header & data
-        mSendMsgQueue.push_back(std::make_unique<CVectorStream>(std::move(serialisedHeader)));
+        mSendMsgQueue.Push(priority, std::make_unique<CVectorStream>(std::move(serialisedHeader)), true);
     }
     else
     {
         // Queue header and payload separately
-        mSendMsgQueue.push_back(std::make_unique<CVectorStream>(std::move(serialisedHeader)));
+        mSendMsgQueue.Push(priority, std::make_unique<CVectorStream>(std::move(serialisedHeader)), !nPayloadLength);
         if(nPayloadLength)
         {
-            mSendMsgQueue.push_back(msg.MoveData());
+            mSendMsgQueue.Push(priority, msg.MoveData(), true);
         }
     }
 
@@ -263,6 +290,7 @@ uint64_t Stream::PushMessage(std::vector<uint8_t>&& serialisedHeader, CSerialize
     if(optimisticSend)
     {
         nBytesSent = SocketSendData();
+        UpdateReactor();
     }
 
     return nBytesSent;
@@ -289,6 +317,12 @@ std::pair<Stream::QueuedNetMessage, bool> Stream::GetNextMessage()
     return { std::move(msg), !mRecvCompleteMsgQueue.empty() };
 }
 
+bool Stream::HasCompleteMessages() const
+{
+    LOCK(cs_mRecvMsgQueue);
+    return !mRecvCompleteMsgQueue.empty();
+}
+
 void Stream::CopyStats(StreamStats& stats) const
 {
     stats.streamType = enum_cast<std::string>(mStreamType);
@@ -371,6 +405,12 @@ void Stream::SetOwningNode(CNode* newNode)
     mNode = newNode;
 }
 
+CAddress Stream::GetPeerAddr() const
+{
+    LOCK(cs_mNode);
+    return mNode->GetAssociation().GetPeerAddr();
+}
+
 Stream::RECV_STATUS Stream::ReceiveMsgBytes(const Config& config, const char* pch, uint64_t nBytes,
     bool& complete)
 {
@@ -408,6 +448,7 @@ Stream::RECV_STATUS Stream::ReceiveMsgBytes(const Config& config, const char* pc
         else
         {
             handled = msg.readData(pch, nBytes);
+            ParseBlockInBackground(msg);
         }
 
         if (handled < 0)
@@ -434,32 +475,82 @@ Stream::RECV_STATUS Stream::ReceiveMsgBytes(const Config& config, const char* pc
     return RECV_OK;
 }
 
+CNetMessage* Stream::GetPartialPayloadMsg(uint64_t minRemaining)
+{
+    AssertLockHeld(cs_mNode);
+
+    // Incomplete messages are only ever touched by us, under cs_mNode, so
+    // the message can be used after we release the queue lock
+    LOCK(cs_mRecvMsgQueue);
+    if (!mRecvMsgQueue.empty())
+    {
+        CNetMessage& msg { *(mRecvMsgQueue.back()) };
+        if (msg.in_data && msg.hdr.nPayloadLength - msg.nDataPos >= minRemaining)
+        {
+            return &msg;
+        }
+    }
+    return nullptr;
+}
+
+void Stream::ReceivePayloadBytes(CNetMessage& msg, uint64_t nBytes, bool& complete)
+{
+    AssertLockHeld(cs_mNode);
+
+    int64_t nTimeMicros = GetTimeMicros();
+
+    LOCK(cs_mRecvMsgQueue);
+    mLastRecvTime = nTimeMicros / MICROS_PER_SECOND;
+    mTotalBytesRecv += nBytes;
+    mBytesRecvThisSpot += nBytes;
+
+    msg.dataReceived(static_cast<uint32_t>(nBytes));
+    ParseBlockInBackground(msg);
+    complete = msg.complete();
+    if (complete)
+    {
+        msg.nTime = nTimeMicros;
+    }
+}
+
+void Stream::ParseBlockInBackground(CNetMessage& msg)
+{
+    if (msg.blockParser && g_connman && msg.blockParser->ClaimRun())
+    {
+        g_connman->ParseBlockInBackground(msg.blockParser, mNode->GetId());
+    }
+}
+
 uint64_t Stream::SocketSendData()
 {
     uint64_t nSentSize = 0;
-    uint64_t nMsgCount = 0;
     uint64_t nSendBufferMaxSize = g_connman->GetSendBufferSize();
 
     AssertLockHeld(cs_mNode);
     LOCK(cs_mSendMsgQueue);
 
-    for(const auto& data : mSendMsgQueue)
+    // Send from each priority class in turn, as the scheduler decides
+    mSendMsgQueue.ClearStalled();
+    while(CForwardAsyncReadonlyStream* data { mSendMsgQueue.Front() })
     {
         auto sent = SendMessage(*data, nSendBufferMaxSize);
         nSentSize += sent.sentSize;
         mSendMsgQueueSize -= sent.sentSize;
+        mSendMsgQueue.Sent(sent.sentSize, sent.sendComplete);
 
         if(sent.sendComplete == false)
         {
+            // If nothing was sent because the data isn't ready yet, and we
+            // hadn't started on this message, let other classes go ahead
+            if(sent.sentSize == 0 && !mSendChunk && mSendReady && mSendMsgQueue.Stall())
+            {
+                continue;
+            }
             break;
         }
-
-        ++nMsgCount;
     }
 
-    mSendMsgQueue.erase(mSendMsgQueue.begin(), mSendMsgQueue.begin() + nMsgCount);
-
-    if (mSendMsgQueue.empty())
+    if (mSendMsgQueue.Empty())
     {
         assert(!mSendChunk);
         assert(mSendMsgQueueSize.getSendQueueBytes() == 0);
@@ -468,6 +559,29 @@ uint64_t Stream::SocketSendData()
     return nSentSize;
 }
 
+void Stream::UpdateReactor()
+{
+    AssertLockHeld(cs_mNode);
+
+    if(mReactor)
+    {
+        SOCKET socket { GetSocket() };
+        if(socket != INVALID_SOCKET)
+        {
+            mReactor->Rearm(socket, !mRecvReady, !mSendReady);
+
+            // If receiving stopped before the socket was empty (paused, or
+            // we used up our budget for the event), or sending stopped for
+            // some other reason than the socket being full (waiting for data
+            // to load, or rate limiting), we have to come back and try again
+            if(mRecvReady || (mSendReady && GetSendQueueSize() > 0))
+            {
+                mReactor->Schedule(socket);
+            }
+        }
+    }
+}
+
 void Stream::GetNewMsgs()
 {
     uint64_t nSizeAdded {0};
@@ -514,6 +628,12 @@ Stream::CSendResult Stream::SendMessage(CForwardAsyncReadonlyStream& data, uint6
     }
     uint64_t sentSize = 0;
 
+#ifdef USE_SENDFILE
+    // Data from disk can be sent by the kernel straight from the file, unless
+    // we're rate limiting or have already read part of it into memory
+    CFileRegionStream* fileData { mSendRateLimit < 0 ? dynamic_cast<CFileRegionStream*>(&data) : nullptr };
+#endif
+
     do
     {
         // See if we need to apply a sending rate limit
@@ -529,7 +649,11 @@ Stream::CSendResult Stream::SendMessage(CForwardAsyncReadonlyStream& data, uint6
         }
 
         ssize_t nBytes = 0;
-        if (!mSendChunk)
+        bool sendFromFile { false };
+#ifdef USE_SENDFILE
+        sendFromFile = fileData && !mSendChunk;
+#endif
+        if (!mSendChunk && !sendFromFile)
         {
             mSendChunk = data.ReadAsync(maxChunkSize);
 
@@ -549,10 +673,19 @@ Stream::CSendResult Stream::SendMessage(CForwardAsyncReadonlyStream& data, uint6
                 return {false, sentSize};
             }
 
-            nBytes = send(mSocket,
-                          reinterpret_cast<const char *>(mSendChunk->Begin()),
-                          mSendChunk->Size(),
-                          MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifdef USE_SENDFILE
+            if (sendFromFile)
+            {
+                nBytes = fileData->SendTo(mSocket, maxChunkSize);
+            }
+            else
+#endif
+            {
+                nBytes = send(mSocket,
+                              reinterpret_cast<const char *>(mSendChunk->Begin()),
+                              mSendChunk->Size(),
+                              MSG_NOSIGNAL | MSG_DONTWAIT);
+            }
         }
 
         if (nBytes == 0)
@@ -569,6 +702,11 @@ Stream::CSendResult Stream::SendMessage(CForwardAsyncReadonlyStream& data, uint6
                 LogPrintf("socket send error %s\n", NetworkErrorString(nErr));
                 mNode->CloseSocketDisconnect();
             }
+            else if (nErr == WSAEWOULDBLOCK)
+            {
+                // Wait to be told there is space again
+                mSendReady = false;
+            }
 
             return {false, sentSize};
         }
@@ -577,9 +715,22 @@ Stream::CSendResult Stream::SendMessage(CForwardAsyncReadonlyStream& data, uint6
         mLastSendTime = GetSystemTimeInSeconds();
         mTotalBytesSent += nBytes;
         sentSize += nBytes;
+        if (sendFromFile)
+        {
+            if (static_cast<uint64_t>(nBytes) != maxChunkSize && !data.EndOfStream())
+            {
+                // could not send full chunk; stop sending more until we're
+                // told there is space again
+                mSendReady = false;
+                return {false, sentSize};
+            }
+            continue;
+        }
         if (static_cast<uint64_t>(nBytes) != mSendChunk->Size())
         {
-            // could not send full message; stop sending more
+            // could not send full message; stop sending more until we're
+            // told there is space again
+            mSendReady = false;
             mSendChunk =
                 CSpan {
                     mSendChunk->Begin() + nBytes,
@@ -11,6 +11,7 @@
 #include <net/net_message.h>
 #include <net/net_types.h>
 #include <net/send_queue_bytes.h>
+#include <net/send_scheduler.h>
 #include <streams.h>
 #include <sync.h>
 #include <utiltime.h>
@@ -26,9 +27,11 @@
 
 class CConnman;
 class CNetAddr;
+class CAddress;
 class CNode;
 class Config;
 class CSerializedNetMsg;
+class SocketReactor;
 class StreamStats;
 
 /**
@@ -86,23 +89,32 @@ class Stream
     // Shutdown the stream
     void Shutdown();
 
-    // Add our socket to the sets for reading and writing
-    bool SetSocketForSelect(fd_set& setRecv, fd_set& setSend, fd_set& setError, SOCKET& socketMax) const;
+    // Get our socket
+    SOCKET GetSocket() const;
 
-    // Service our socket for reading and writing
-    void ServiceSocket(fd_set& setRecv, fd_set& setSend, fd_set& setError, const Config& config,
+    // Register our socket with the reactor that tells us when it is ready
+    bool SetReactor(SocketReactor& reactor);
+
+    // Service our socket for reading and writing, after the reactor has told
+    // us it is ready (or we asked it to come back to us)
+    void ServiceSocket(bool recvReady, bool sendReady, bool errorSet, const Config& config,
                        bool& gotNewMsgs, uint64_t& bytesRecv, uint64_t& bytesSent);
 
 
-    // Add new message to our list for sending
+    // Add new message to our list for sending, in the given priority class
+    // and with the given per class quanta for scheduling sends
     uint64_t PushMessage(std::vector<uint8_t>&& serialisedHeader, CSerializedNetMsg&& msg,
-                         uint64_t nPayloadLength, uint64_t nTotalSize);
+                         uint64_t nPayloadLength, uint64_t nTotalSize,
+                         SendPriority priority, const SendQuanta& quanta);
 
     // Fetch the next message for processing.
     // Also returns a boolean set true if there are more queued messages available, and false if not.
     using QueuedNetMessage = std::unique_ptr<CNetMessage>;
     std::pair<QueuedNetMessage, bool> GetNextMessage();
 
+    // Get whether we have completed messages waiting to be processed
+    bool HasCompleteMessages() const;
+
     // Get last send/receive time
     int64_t GetLastSendTime() const { return mLastSendTime; }
     int64_t GetLastRecvTime() const { return mLastRecvTime; }
@@ -126,6 +138,9 @@ class Stream
     // Set our owning CNode
     void SetOwningNode(CNode* newNode);
 
+    // Get the address of the peer we're connected to
+    CAddress GetPeerAddr() const;
+
     // Get whether we're paused for receiving
     bool GetPausedForReceiving() const { return mPauseRecv; }
 
@@ -136,6 +151,9 @@ class Stream
     static constexpr size_t MIN_MAX_SEGMENT_SIZE { 536 };
     // Maximum TCP maximum segment size
     static constexpr size_t MAX_MAX_SEGMENT_SIZE { 65535 };
+    // Most we receive per socket event before giving other sockets a turn,
+    // so a single fast peer can't hold up the socket handler thread
+    static constexpr uint64_t MAX_RECV_BYTES_PER_EVENT { 0x100000 };
 
     // Node we are for
     CNode* mNode {nullptr};
@@ -148,11 +166,18 @@ class Stream
     SOCKET mSocket {0};
     mutable CCriticalSection cs_mSocket {};
 
+    // Reactor that tells us when our socket is ready, and whether as far as we
+    // know it still is. We are only told when our socket becomes ready, so we
+    // carry on reading/writing until we would block. Protected by cs_mNode.
+    SocketReactor* mReactor {nullptr};
+    bool mRecvReady {false};
+    bool mSendReady {true};
+
     // TCP maximum segment size for our underlying socket
     size_t mMSS { MIN_MAX_SEGMENT_SIZE };
 
     // Send message queue
-    std::deque<std::unique_ptr<CForwardAsyncReadonlyStream>> mSendMsgQueue {};
+    SendScheduler mSendMsgQueue {};
     uint64_t mTotalBytesSent {0};
     CSendQueueBytes mSendMsgQueueSize {};
     mapMsgCmdSize mSendBytesPerMsgCmd {};
@@ -178,9 +203,22 @@ class Stream
     enum RECV_STATUS {RECV_OK, RECV_BAD_LENGTH, RECV_FAIL};
     RECV_STATUS ReceiveMsgBytes(const Config& config, const char* pch, uint64_t nBytes, bool& complete);
 
+    // If we're part way through receiving a payload with at least the given
+    // amount still to come, get the message so we can receive directly into it
+    CNetMessage* GetPartialPayloadMsg(uint64_t minRemaining);
+    // Account for bytes received directly into a partial payload message
+    void ReceivePayloadBytes(CNetMessage& msg, uint64_t nBytes, bool& complete);
+
+    // Have a worker parse what we've received so far of a large block
+    void ParseBlockInBackground(CNetMessage& msg);
+
     // Write the next batch of data to the wire
     uint64_t SocketSendData();
 
+    // Tell the reactor what to watch for next, and to come back to us anyway
+    // if we stopped reading or writing before we would have blocked
+    void UpdateReactor();
+
     /** Average bandwidth measurements */
     // Keep enough spot measurements to cover 1 minute
     boost::circular_buffer<double> mAvgBandwidth {60 / PEER_AVG_BANDWIDTH_CALC_FREQUENCY_SECS};
@@ -22,6 +22,33 @@ namespace
                payloadType == CSerializedNetMsg::PayloadType::BLOCK;
     }
 
+    // Classify connection control and keep alive messages
+    bool IsControlMsg(const std::string& cmd)
+    {
+        return cmd == NetMsgType::PING ||
+               cmd == NetMsgType::PONG ||
+               cmd == NetMsgType::VERSION ||
+               cmd == NetMsgType::VERACK ||
+               cmd == NetMsgType::REJECT ||
+               cmd == NetMsgType::SENDHEADERS ||
+               cmd == NetMsgType::SENDCMPCT ||
+               cmd == NetMsgType::FEEFILTER ||
+               cmd == NetMsgType::PROTOCONF ||
+               cmd == NetMsgType::CREATESTREAM ||
+               cmd == NetMsgType::STREAMACK;
+    }
+
+    // Classify headers and announcement messages
+    bool IsHeadersMsg(const std::string& cmd)
+    {
+        return cmd == NetMsgType::HEADERS ||
+               cmd == NetMsgType::GETHEADERS ||
+               cmd == NetMsgType::INV ||
+               cmd == NetMsgType::GETDATA ||
+               cmd == NetMsgType::NOTFOUND ||
+               cmd == NetMsgType::GETBLOCKS;
+    }
+
     // Classify msgs we consider high priority
     bool IsHighPriorityMsg(const CSerializedNetMsg& msg)
     {
@@ -37,22 +64,6 @@ namespace
 /** A BasicStreamPolicy **/
 /*************************/
 
-void BasicStreamPolicy::ServiceSockets(StreamMap& streams, fd_set& setRecv,
-    fd_set& setSend, fd_set& setError, const Config& config, bool& gotNewMsgs,
-    uint64_t& bytesRecv, uint64_t& bytesSent)
-{
-    // Service each stream socket
-    for(auto& stream : streams)
-    {
-        uint64_t streamBytesRecv {0};
-        uint64_t streamBytesSent {0};
-        stream.second->ServiceSocket(setRecv, setSend, setError, config, gotNewMsgs,
-            streamBytesRecv, streamBytesSent);
-        bytesRecv += streamBytesRecv;
-        bytesSent += streamBytesSent;
-    }
-}
-
 uint64_t BasicStreamPolicy::PushMessageCommon(StreamMap& streams, StreamType streamType,
     bool exactMatch, std::vector<uint8_t>&& serialisedHeader, CSerializedNetMsg&& msg,
     uint64_t nPayloadLength, uint64_t nTotalSize)
@@ -83,7 +94,28 @@ uint64_t BasicStreamPolicy::PushMessageCommon(StreamMap& streams, StreamType str
         throw std::runtime_error(err.str());
     }
 
-    return destStream->PushMessage(std::move(serialisedHeader), std::move(msg), nPayloadLength, nTotalSize);
+    SendPriority priority { GetSendPriority(msg) };
+    return destStream->PushMessage(std::move(serialisedHeader), std::move(msg), nPayloadLength, nTotalSize,
+        priority, GetSendQuanta());
+}
+
+SendPriority BasicStreamPolicy::GetSendPriority(const CSerializedNetMsg& msg) const
+{
+    const std::string& cmd { msg.Command() };
+    if(IsControlMsg(cmd))
+    {
+        return SendPriority::CONTROL;
+    }
+    else if(IsHeadersMsg(cmd))
+    {
+        return SendPriority::HEADERS;
+    }
+    else if(IsBlockMsg(cmd, msg.GetPayloadType()))
+    {
+        return SendPriority::BLOCK;
+    }
+
+    return SendPriority::TXN;
 }
 
 
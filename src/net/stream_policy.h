@@ -16,7 +16,6 @@
 #include <string>
 
 class CConnman;
-class Config;
 
 /**
  * A stream policy defines how a collection of streams to a peer are utilised.
@@ -44,11 +43,6 @@ class StreamPolicy
     // Fetch the next message for processing
     virtual std::pair<Stream::QueuedNetMessage, bool> GetNextMessage(StreamMap& streams) = 0;
 
-    // Service the sockets of the streams
-    virtual void ServiceSockets(StreamMap& streams, fd_set& setRecv, fd_set& setSend,
-                                fd_set& setError, const Config& config, bool& gotNewMsgs,
-                                uint64_t& bytesRecv, uint64_t& bytesSent) = 0;
-
     // Queue an outgoing message on the appropriate stream
     virtual uint64_t PushMessage(StreamMap& streams, StreamType streamType,
                                  std::vector<uint8_t>&& serialisedHeader, CSerializedNetMsg&& msg,
@@ -56,6 +50,12 @@ class StreamPolicy
 
     // Get the stream type the given message category is sent over
     virtual StreamType GetStreamTypeForMessage(MessageType msgType) const = 0;
+
+    // Get the priority class the given message is sent in
+    virtual SendPriority GetSendPriority(const CSerializedNetMsg& msg) const = 0;
+
+    // Get the per round quanta streams use to share sending between priority classes
+    virtual const SendQuanta& GetSendQuanta() const = 0;
 };
 using StreamPolicyPtr = std::shared_ptr<StreamPolicy>;
 
@@ -68,10 +68,11 @@ class BasicStreamPolicy : public StreamPolicy
   public:
     BasicStreamPolicy() = default;
 
-    // Service the sockets of the streams
-    void ServiceSockets(StreamMap& streams, fd_set& setRecv, fd_set& setSend,
-                        fd_set& setError, const Config& config, bool& gotNewMsgs,
-                        uint64_t& bytesRecv, uint64_t& bytesSent) override;
+    // Get the priority class the given message is sent in
+    SendPriority GetSendPriority(const CSerializedNetMsg& msg) const override;
+
+    // Get the per round quanta streams use to share sending between priority classes
+    const SendQuanta& GetSendQuanta() const override { return SendScheduler::DEFAULT_QUANTA; }
 
   protected:
 
@@ -132,7 +133,9 @@ class DefaultStreamPolicy : public BasicStreamPolicy
  * plus pings and pongs. All other messages are lower priority and sent over
  * the GENERAL stream.
  *
- * Gives equal priority to all stream sockets for reading and writing.
+ * Gives equal priority to all stream sockets for reading and writing. Within
+ * each stream, block messages get a larger share of sending than they do by
+ * default, since on the DATA1 stream they only share with pings and headers.
  */
 class BlockPriorityStreamPolicy : public BasicStreamPolicy
 {
@@ -159,4 +162,11 @@ class BlockPriorityStreamPolicy : public BasicStreamPolicy
 
     // Get the stream type the given message category is sent over
     StreamType GetStreamTypeForMessage(MessageType msgType) const override;
+
+    // Get the per round quanta streams use to share sending between priority classes
+    const SendQuanta& GetSendQuanta() const override { return SEND_QUANTA; }
+
+  private:
+
+    static constexpr SendQuanta SEND_QUANTA { 256 * 1024, 128 * 1024, 1024 * 1024, 64 * 1024 };
 };
@@ -10,6 +10,8 @@
 ///////////////////////////////////#include "allowed_args.h"
 #include "arith_uint256.h"
 #include "chainparamsbase.h"
+#include "crypto/common.h"
+#include "crypto/sha256_lanes.h"
 #include "hash.h"
 #include "primitives/block.h"
 #include "rpc/client_utils.h"
@@ -19,8 +21,10 @@
 #include "util.h"
 #include "utilstrencodings.h"
 #include <boost/thread.hpp>
+#include <atomic>
 #include <random>
 #include <limits>
+#include <thread>
 #include <event2/http.h>
 #include <univalue.h>
 
@@ -30,44 +34,110 @@ typedef unsigned int extra_nonce_type;
 
 // Internal miner
 //
-// ScanHash scans nonces looking for a hash with at least some zero bits.
-// The nonce is usually preserved between calls, but periodically or if the
-// nonce is 0xffff0000 or above, the block is rebuilt and nNonce starts over at
-// zero.
-bool static ScanHash(const CBlockHeader *pblock, uint32_t &nNonce, uint256 *phash)
+// The proof of work hash is SHA256(T || T || SHA256(T || T || header)) with
+// T = SHA256("PoW"). T || T fills exactly one SHA-256 block, so both hashes
+// start from the same midstate, and the first 64 bytes of the header only
+// change with the merkle root. HeaderScanner computes these midstates once,
+// after which every nonce costs two compressions that are done for
+// sha256_lanes::LANES nonces at a time.
+class HeaderScanner
 {
-    std::string tag = "PoW";
-    uint256 taghash;
-    CSHA256().Write((const unsigned char*)tag.data(), tag.size()).Finalize((uint8_t *)&taghash);
-    CSHA256 taghasher;
-    taghasher.Write((uint8_t *)&taghash, CSHA256::OUTPUT_SIZE);
-    taghasher.Write((uint8_t *)&taghash, CSHA256::OUTPUT_SIZE);
+public:
+    explicit HeaderScanner(const CBlockHeader &header);
+
+    // ScanHash scans nonces from nNonce + 1 on looking for a hash with at
+    // least some zero bits. Returns true with nNonce and hash set to the
+    // candidate, or false with nNonce set to the last nonce checked after
+    // trying for a while.
+    bool ScanHash(uint32_t &nNonce, uint256 &hash) const;
+
+private:
+    uint32_t tagMidstate[8];
+    uint32_t headerMidstate[8];
+    // Header bytes 64 to 75, the part of the last block before the nonce.
+    uint32_t headerTail[3];
+};
+
+HeaderScanner::HeaderScanner(const CBlockHeader &header)
+{
+    const std::string tag = "PoW";
+    unsigned char taghash[2 * CSHA256::OUTPUT_SIZE];
+    CSHA256().Write((const unsigned char*)tag.data(), tag.size()).Finalize(taghash);
+    memcpy(taghash + CSHA256::OUTPUT_SIZE, taghash, CSHA256::OUTPUT_SIZE);
+    sha256_lanes::Initialize(tagMidstate);
+    sha256_lanes::Transform(tagMidstate, taghash);
 
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << *pblock;
+    ss << header;
     assert(ss.size() == 80);
 
-    // Write the first 76 bytes of the block header to a double-SHA256 state.
-    CSHA256 hasher = taghasher;
-    hasher.Write((unsigned char *)&ss[0], 76);
+    const unsigned char *pheader = (const unsigned char *)&ss[0];
+    memcpy(headerMidstate, tagMidstate, sizeof(headerMidstate));
+    sha256_lanes::Transform(headerMidstate, pheader);
+    for (size_t i = 0; i < 3; i++)
+        headerTail[i] = ReadBE32(pheader + 64 + 4 * i);
+}
 
-    while (true)
+bool HeaderScanner::ScanHash(uint32_t &nNonce, uint256 &hash) const
+{
+    using sha256_lanes::LANES;
+
+    // Last block of the inner hash: header bytes 64 to 79 and the padding of
+    // a 144 byte message. Only the nonce word differs between lanes.
+    uint32_t inner[8][LANES];
+    uint32_t innerBlock[16][LANES] = {};
+    // The outer hash is one block with the inner hash and the padding of a
+    // 96 byte message.
+    uint32_t outer[8][LANES];
+    uint32_t outerBlock[16][LANES] = {};
+    for (size_t l = 0; l < LANES; l++)
     {
-        nNonce++;
-
-        // Write the last 4 bytes of the block header (the nonce) to a copy of
-        // the double-SHA256 state, and compute the result.
-        CSHA256(hasher).Write((unsigned char *)&nNonce, 4).Finalize((unsigned char *)phash);
-        CSHA256(taghasher).Write((uint8_t *)phash, CSHA256::OUTPUT_SIZE).Finalize((unsigned char *)phash);
+        for (size_t i = 0; i < 3; i++)
+            innerBlock[i][l] = headerTail[i];
+        innerBlock[4][l] = 0x80000000;
+        innerBlock[15][l] = (64 + 80) * 8;
+        outerBlock[8][l] = 0x80000000;
+        outerBlock[15][l] = (64 + 32) * 8;
+    }
 
-        // Return the nonce if the hash has at least some zero bits,
-        // caller will check if it has enough to reach the target
-        if (*std::next(phash->begin(), 31) == 0 &&
-            *std::next(phash->begin(), 30) == 0)
-            return true;
+    while (true)
+    {
+        for (size_t l = 0; l < LANES; l++)
+        {
+            // The nonce is serialized little endian, message words are read
+            // big endian.
+            unsigned char nonce[4];
+            WriteLE32(nonce, uint32_t(nNonce + 1 + l));
+            innerBlock[3][l] = ReadBE32(nonce);
+            for (size_t i = 0; i < 8; i++)
+            {
+                inner[i][l] = headerMidstate[i];
+                outer[i][l] = tagMidstate[i];
+            }
+        }
+        sha256_lanes::TransformLanes(inner, innerBlock);
+        for (size_t i = 0; i < 8; i++)
+            for (size_t l = 0; l < LANES; l++)
+                outerBlock[i][l] = inner[i][l];
+        sha256_lanes::TransformLanes(outer, outerBlock);
+
+        // Return the nonce if the hash has at least some zero bits (the last
+        // two bytes of the hash are the low half of its last word), caller
+        // will check if it has enough to reach the target
+        for (size_t l = 0; l < LANES; l++)
+        {
+            if ((outer[7][l] & 0xffff) == 0)
+            {
+                nNonce += l + 1;
+                for (size_t i = 0; i < 8; i++)
+                    WriteBE32(hash.begin() + 4 * i, outer[i][l]);
+                return true;
+            }
+        }
+        nNonce += LANES;
 
         // If nothing found after trying for a while, return -1
-        if ((nNonce & 0xffff) == 0)
+        if ((nNonce & 0xffff) < LANES)
             return false;
     }
 }
@@ -120,7 +190,7 @@ std::string HelpMessage()
     ss << HelpMessageCli();
     ss << HelpMessageGroup(_("Mining options:"));
     ss << HelpMessageOpt( "-blockversion", strprintf(_("Set the block version number. For testing only.  Value must be an integer: %s)"), DEFAULT_NAMED));
-    ss << HelpMessageOpt( "-cpus", strprintf(_("Number of cpus to use for mining (default: 1).  Value must be an integer: %s)"), 1));
+    ss << HelpMessageOpt( "-cpus", strprintf(_("Number of threads that search each block candidate (default: 1).  Value must be an integer: %s)"), 1));
     ss << HelpMessageOpt( "-duration", strprintf(_("Number of seconds to mine a particular block candidate (default: 30). Value must be an integer: %s)"), DEFAULT_NAMED));
     ss << HelpMessageOpt( "-nblock", strprintf(_("Number of blocks to mine (default: mine forever / -1). Value must be an integer: %s)"), DEFAULT_NAMED));
     return ss.str();
@@ -218,22 +288,26 @@ public:
     uint32_t operator ()() { return dist(mt);}
 };
 
-// WARNING: This methods "splits" coinbaseBytes and inserts space for an extra-nonce.
+// Searches the nonces of pblock for extra-nonces nExtraNonce + nExtraNonceStep,
+// nExtraNonce + 2 * nExtraNonceStep, ... until a solution is found, stop is
+// set or some candidates that did not reach the target were checked. Every
+// thread uses a different start and the number of threads as step, so the
+// threads search disjoint parts of the extra-nonce space.
 static bool CpuMineBlockHasher(CBlockHeader *pblock, vector<unsigned char>& coinbaseBytes, const std::vector<uint256> &merkleproof,
                                size_t offset_extra_nonce,
-                               RandomIntGenerator & random_int_func)
+                               extra_nonce_type &nExtraNonce, extra_nonce_type nExtraNonceStep,
+                               const std::atomic<bool> &stop, uint64_t &nHashes)
 {
-    extra_nonce_type nExtraNonce = random_int_func();
     uint32_t nNonce = pblock->nNonce;
     arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
     bool found = false;
     int ntries = 10;
 
-    while (!found)
+    while (!found && !stop)
     {
         // hashMerkleRoot:
         {
-            ++nExtraNonce;
+            nExtraNonce += nExtraNonceStep;
             unsigned char *pbytes = (unsigned char *)coinbaseBytes.data();
             memcpy(pbytes + offset_extra_nonce + 1, &nExtraNonce, sizeof(nExtraNonce));
             uint256 hash;
@@ -245,11 +319,16 @@ static bool CpuMineBlockHasher(CBlockHeader *pblock, vector<unsigned char>& coin
         //
         // Search
         //
+        const HeaderScanner scanner(*pblock);
         uint256 hash;
         while (!found)
         {
+            const uint32_t nFirst = nNonce;
+            const bool candidate = scanner.ScanHash(nNonce, hash);
+            nHashes += uint32_t(nNonce - nFirst);
+
             // Check if something found
-            if (ScanHash(pblock, nNonce, &hash))
+            if (candidate)
             {
                 if (UintToArith256(hash) <= hashTarget)
                 {
@@ -269,6 +348,11 @@ static bool CpuMineBlockHasher(CBlockHeader *pblock, vector<unsigned char>& coin
                     }
                 }
             }
+            else if (stop)
+            {
+                pblock->nNonce = nNonce;
+                return false; // Another thread found a solution or time is up
+            }
         }
     }
 
@@ -328,7 +412,6 @@ static UniValue CpuMineBlock(unsigned int searchDuration, const UniValue &params
         header.nVersion = blockversion;
     }
 
-    uint32_t startNonce = header.nNonce = random_int_func();
     std::string candidateId = params["id"].get_str();
 
     printf("Mining: id: %s parent: %s bits: %x difficulty: %.8e time: %d\n", candidateId.c_str(),
@@ -364,27 +447,72 @@ static UniValue CpuMineBlock(unsigned int searchDuration, const UniValue &params
     //cout << "Expanded coinbase tx is:\n";
     //print_coinbase_transaction(cout, coinbaseBytes);
 
-    int64_t start = GetTime();
-    while ((GetTime() < start + searchDuration) && !found)
+    // Every thread mines its own copy of the header and the coinbase.
+    struct MinerThread
+    {
+        CBlockHeader header;
+        vector<unsigned char> coinbaseBytes;
+        uint64_t nHashes;
+        bool found;
+    };
+    const int64_t nThreads = std::max<int64_t>(1, gArgs.GetArg("-cpus", 1));
+    const extra_nonce_type nExtraNonceStart = random_int_func();
+    std::vector<MinerThread> miners(nThreads, MinerThread{header, coinbaseBytes, 0, false});
+    for (auto &miner : miners)
+        miner.header.nNonce = random_int_func();
+
+    std::atomic<bool> stop {false};
+    std::vector<std::thread> threads;
+    int64_t start = GetTimeMillis();
+    for (int64_t i = 0; i < nThreads; i++)
     {
-        // When mining mainnet, you would normally want to advance the time to keep the block time as close to the
-        // real time as possible.  However, this CPU miner is only useful on testnet and in testnet the block difficulty
-        // resets to 1 after 20 minutes.  This will cause the block's difficulty to mismatch the expected difficulty
-        // and the block will be rejected.  So do not advance time (let it be advanced by novobitcoind every time we
-        // request a new block).
-        // header.nTime = (header.nTime < GetTime()) ? GetTime() : header.nTime;
-
-        found = CpuMineBlockHasher(&header, coinbaseBytes, merkleproof, offset_extra_nonce, random_int_func);
+        threads.emplace_back([&, i]() {
+            MinerThread &miner = miners[i];
+            extra_nonce_type nExtraNonce = nExtraNonceStart + i;
+            while ((GetTimeMillis() < start + searchDuration * 1000) && !stop)
+            {
+                // When mining mainnet, you would normally want to advance the time to keep the block time as close to the
+                // real time as possible.  However, this CPU miner is only useful on testnet and in testnet the block difficulty
+                // resets to 1 after 20 minutes.  This will cause the block's difficulty to mismatch the expected difficulty
+                // and the block will be rejected.  So do not advance time (let it be advanced by novobitcoind every time we
+                // request a new block).
+                // header.nTime = (header.nTime < GetTime()) ? GetTime() : header.nTime;
+
+                if (CpuMineBlockHasher(&miner.header, miner.coinbaseBytes, merkleproof, offset_extra_nonce,
+                                       nExtraNonce, nThreads, stop, miner.nHashes))
+                {
+                    miner.found = true;
+                    stop = true;
+                }
+            }
+        });
     }
+    for (auto &thread : threads)
+        thread.join();
+
+    // Report the hash rate of every thread
+    double elapsed = std::max<int64_t>(GetTimeMillis() - start, 1) / 1000.0;
+    uint64_t nHashes = 0;
+    for (int64_t i = 0; i < nThreads; i++)
+    {
+        printf("Thread %d: %.2f kH/s\n", (int)i, miners[i].nHashes / elapsed / 1000.0);
+        nHashes += miners[i].nHashes;
+    }
+
+    auto solution = std::find_if(miners.begin(), miners.end(), [](const MinerThread &miner) { return miner.found; });
+    found = solution != miners.end();
 
     // Leave if not found:
     if (!found)
     {
-        printf("Checked %d possibilities\n", header.nNonce - startNonce);
+        printf("Checked %llu possibilities, %.2f kH/s\n", (unsigned long long)nHashes, nHashes / elapsed / 1000.0);
         return ret;
     }
 
-    printf("Solution! Checked %d possibilities\n", header.nNonce - startNonce);
+    printf("Solution! Checked %llu possibilities, %.2f kH/s\n", (unsigned long long)nHashes, nHashes / elapsed / 1000.0);
+
+    header = solution->header;
+    coinbaseBytes = solution->coinbaseBytes;
 
     tmpstr = HexStr(coinbaseBytes.begin(), coinbaseBytes.end());
     tmp.push_back(Pair("coinbase", tmpstr));
@@ -612,27 +740,6 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    int64_t nThreads {gArgs.GetArg("-cpus", 1)};
-
-    auto minerThread = []()  {
-        RandomIntGenerator generator;
-        while (1) {
-            try {
-                CpuMiner(generator);
-            }
-            catch (const std::exception &e) {
-                PrintExceptionContinue(&e, "CommandLineRPC()");
-            }
-            catch (...) {
-                PrintExceptionContinue(NULL, "CommandLineRPC()");
-            }
-        }
-    };
-
-    boost::thread_group minerThreads;
-    for (int64_t i = 0; i < nThreads - 1; ++i)
-        minerThreads.create_thread(minerThread);
-
     int ret = EXIT_FAILURE;
     try
     {
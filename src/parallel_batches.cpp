@@ -0,0 +1,14 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#include "parallel_batches.h"
+
+#include <thread>
+
+CThreadPool<CQueueAdaptor>& GetBatchThreadPool()
+{
+    static CThreadPool<CQueueAdaptor> pool { "BatchThreadPool", std::max(std::thread::hardware_concurrency(), 1u) };
+    return pool;
+}
@@ -0,0 +1,72 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#pragma once
+
+#include "task_helpers.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <future>
+#include <vector>
+
+/**
+* Thread pool shared by code that splits a large piece of work into batches
+* handled on all cores. It is started on first use and lives until exit, so
+* that no threads are started while the work is done.
+*/
+CThreadPool<CQueueAdaptor>& GetBatchThreadPool();
+
+/**
+* Splits [0, count) into contiguous batches of at least minBatchSize elements,
+* with no more batches than the batch thread pool has threads, and calls
+* func(begin, end) for each of them. The first batch is processed on the
+* calling thread and the rest on the pool, so that work which fits in a single
+* batch never leaves the calling thread. Results are returned in batch order.
+*
+* Must not be called from the batch thread pool itself.
+*/
+template<typename Result, typename Func>
+std::vector<Result> ProcessBatchesInParallel(size_t count, size_t minBatchSize, const Func& func)
+{
+    auto& pool { GetBatchThreadPool() };
+    size_t batchSize { std::max<size_t>(minBatchSize, 1) };
+    while(batchSize * pool.getPoolSize() < count)
+    {
+        batchSize <<= 1;
+    }
+
+    std::vector<std::future<Result>> futures {};
+    for(size_t begin = batchSize; begin < count; begin += batchSize)
+    {
+        futures.push_back(make_task(pool, func, begin, std::min(begin + batchSize, count)));
+    }
+
+    // The batches use the caller's data, so none of them may still be running
+    // once we return, not even if one of them threw
+    struct WaitForAll
+    {
+        std::vector<std::future<Result>>& futures;
+        ~WaitForAll()
+        {
+            for(auto& future : futures)
+            {
+                if(future.valid())
+                {
+                    future.wait();
+                }
+            }
+        }
+    } waitForAll { futures };
+
+    std::vector<Result> results {};
+    results.reserve(futures.size() + 1);
+    results.push_back(func(0, std::min(batchSize, count)));
+    for(auto& future : futures)
+    {
+        results.push_back(future.get());
+    }
+    return results;
+}
@@ -2304,6 +2304,7 @@ UniValue mempoolInfoToJSON(const Config& config) {
     ret.push_back(Pair("bytes", (int64_t)mempool.GetTotalTxSize()));
     ret.push_back(Pair("usage", (int64_t)mempool.DynamicMemoryUsage()));
     ret.push_back(Pair("usagedisk", (int64_t)mempool.GetDiskUsage()));
+    ret.push_back(Pair("disklogsize", (int64_t)mempool.GetDiskLogSize()));
     ret.push_back(Pair("usagecpfp", (int64_t)mempool.SecondaryMempoolUsage()));
     ret.push_back(
         Pair("nonfinalusage",
@@ -2319,11 +2320,44 @@ UniValue mempoolInfoToJSON(const Config& config) {
     return ret;
 }
 
+static UniValue mempoolUsageToJSON(const CMempoolMemoryUsage& usage) {
+    const auto partToJSON = [](const CMempoolMemoryUsage::Part& part) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("count", (int64_t)part.count));
+        obj.push_back(Pair("usage", (int64_t)part.usage));
+        return obj;
+    };
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("maptx", (int64_t)usage.mapTx));
+    ret.push_back(Pair("mapnexttx", (int64_t)usage.mapNextTx));
+    ret.push_back(Pair("maplinks", (int64_t)usage.mapLinks));
+    ret.push_back(Pair("mapdeltas", (int64_t)usage.mapDeltas));
+    ret.push_back(Pair("txinmemory", partToJSON(usage.txInMemory)));
+    ret.push_back(Pair("txondisk", partToJSON(usage.txOnDisk)));
+    ret.push_back(Pair("prefetched", (int64_t)usage.prefetched));
+    ret.push_back(Pair("cpfpgroups", partToJSON(usage.cpfpGroups)));
+    ret.push_back(Pair("evictiontracker", (int64_t)usage.evictionTracker));
+    ret.push_back(Pair("journal", (int64_t)usage.journal));
+    if (usage.audit) {
+        UniValue audit(UniValue::VOBJ);
+        audit.push_back(Pair("maptx", (int64_t)usage.audit->mapTx));
+        audit.push_back(Pair("mapnexttx", (int64_t)usage.audit->mapNextTx));
+        audit.push_back(Pair("maplinks", (int64_t)usage.audit->mapLinks));
+        audit.push_back(Pair("mapdeltas", (int64_t)usage.audit->mapDeltas));
+        ret.push_back(Pair("audit", audit));
+    }
+    return ret;
+}
+
 UniValue getmempoolinfo(const Config &config, const JSONRPCRequest &request) {
-    if (request.fHelp || request.params.size() != 0) {
+    if (request.fHelp || request.params.size() > 1) {
         throw std::runtime_error(
-            "getmempoolinfo\n"
+            "getmempoolinfo ( verbose )\n"
             "\nReturns details on the active state of the TX memory pool.\n"
+            "\nArguments:\n"
+            "1. verbose (boolean, optional, default=false) True to add a "
+            "breakdown of the memory usage\n"
             "\nResult:\n"
             "{\n"
             "  \"size\": xxxxx,               (numeric) Current tx count\n"
@@ -2334,20 +2368,43 @@ UniValue getmempoolinfo(const Config &config, const JSONRPCRequest &request) {
             "  \"bytes\": xxxxx,              (numeric) Transaction size.\n"
             "  \"usage\": xxxxx,              (numeric) Total memory usage for the mempool\n"
             "  \"usagedisk\": xxxxx,          (numeric) Total disk usage for storing mempool transactions\n"
+            "  \"disklogsize\": xxxxx,        (numeric) Size of the mempool transaction log on disk, including\n"
+            "                                 space not reclaimed yet from removed transactions\n"
             "  \"usagecpfp\": xxxxx,          (numeric) Total memory usage for the low paying transactions\n"
             "  \"nonfinalusage\": xxxxx,      (numeric) Total memory usage for "
             "the non-final mempool\n"
             "  \"maxmempool\": xxxxx,         (numeric) Maximum memory usage for the mempool\n"
             "  \"maxmempoolsizedisk\": xxxxx, (numeric) Maximum disk usage for storing mempool transactions\n"
             "  \"maxmempoolsizecpfp\": xxxxx, (numeric) Maximum memory usage for the low paying transactions\n"
-            "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee (in " + CURRENCY_UNIT + "/kB) for tx to be accepted\n"
+            "  \"mempoolminfee\": xxxxx,      (numeric) Minimum fee (in " + CURRENCY_UNIT + "/kB) for tx to be accepted\n"
+            "  \"usagedetails\": {            (json object, only if verbose) Memory usage by component\n"
+            "    \"maptx\": xxxxx,            (numeric) Transaction index\n"
+            "    \"mapnexttx\": xxxxx,        (numeric) Spent outputs index\n"
+            "    \"maplinks\": xxxxx,         (numeric) Parent and child links\n"
+            "    \"mapdeltas\": xxxxx,        (numeric) Prioritised transactions\n"
+            "    \"txinmemory\": {            (json object) Transactions kept in memory\n"
+            "      \"count\": xxxxx,          (numeric) Number of transactions\n"
+            "      \"usage\": xxxxx           (numeric) Memory usage\n"
+            "    },\n"
+            "    \"txondisk\": { ... },       (json object) Transactions moved to disk, usage as if in memory\n"
+            "    \"prefetched\": xxxxx,       (numeric) Copies of transactions on disk read back ahead of use\n"
+            "    \"cpfpgroups\": { ... },     (json object) CPFP groups, not included in usage\n"
+            "    \"evictiontracker\": xxxxx,  (numeric) Eviction candidates, not included in usage\n"
+            "    \"journal\": xxxxx,          (numeric) Block template journal, not included in usage\n"
+            "    \"audit\": { ... }           (json object, only with -mempoolmemoryaudit) Measured usage of the indexes\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getmempoolinfo", "") +
+            HelpExampleCli("getmempoolinfo", "true") +
             HelpExampleRpc("getmempoolinfo", ""));
     }
 
-    return mempoolInfoToJSON(config);
+    UniValue ret = mempoolInfoToJSON(config);
+    if (request.params.size() > 0 && request.params[0].get_bool()) {
+        ret.push_back(Pair("usagedetails", mempoolUsageToJSON(mempool.GetMemoryUsage())));
+    }
+    return ret;
 }
 
 UniValue getorphaninfo(const Config &config, const JSONRPCRequest &request) {
@@ -3460,7 +3517,7 @@ static const CRPCCommand commands[] = {
     { "blockchain",         "getmempoolancestors",    getmempoolancestors,    true,  {"txid","verbose"} },
     { "blockchain",         "getmempooldescendants",  getmempooldescendants,  true,  {"txid","verbose"} },
     { "blockchain",         "getmempoolentry",        getmempoolentry,        true,  {"txid"} },
-    { "blockchain",         "getmempoolinfo",         getmempoolinfo,         true,  {} },
+    { "blockchain",         "getmempoolinfo",         getmempoolinfo,         true,  {"verbose"} },
     { "blockchain",         "getrawmempool",          getrawmempool,          true,  {"verbose"} },
     { "blockchain",         "getrawnonfinalmempool",  getrawnonfinalmempool,  true,  {} },
     { "blockchain",         "gettxout",               gettxout,               true,  {"txid","n","include_mempool"} },
@@ -117,6 +117,7 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     {"pruneblockchain", 0, "height"},
     {"keypoolrefill", 0, "newsize"},
     {"getrawmempool", 0, "verbose"},
+    {"getmempoolinfo", 0, "verbose"},
     {"prioritisetransaction", 1, "priority_delta"},
     {"prioritisetransaction", 2, "fee_delta"},
     {"setban", 2, "bantime"},
@@ -126,6 +127,8 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     {"getmempooldescendants", 1, "verbose"},
     {"disconnectnode", 1, "nodeid"},
     {"getminingcandidate", 0, "coinbase"},
+    {"gettemplatedelta", 0, "sequence"},
+    {"gettemplatedelta", 1, "timeout"},
     {"getblockbyheight", 0, "height"},
     {"verifymerkleproof", 0, "proof"},
     {"softrejectblock", 1, "numblocks"},
@@ -8,7 +8,6 @@
 #include "mining.h"
 #include "config.h"
 #include "chain.h"
-#include "consensus/merkle.h"
 #include "consensus/params.h"
 #include "core_io.h"
 #include "hash.h"
@@ -16,6 +15,8 @@
 #include "mining/factory.h"
 #include "net/net.h"
 #include "primitives/transaction.h"
+#include "rpc/http_protocol.h"
+#include "rpc/jsonwriter.h"
 #include "rpc/server.h"
 #include "tinyformat.h"
 #include "util.h"
@@ -23,6 +24,8 @@
 #include "validation.h"
 #include "versionbits.h"
 #include "invalid_txn_publisher.h"
+#include <algorithm>
+#include <chrono>
 #include <iomanip>
 #include <limits>
 #include <queue>
@@ -35,6 +38,10 @@ using mining::CBlockTemplate;
 namespace
 {
 
+/// Longest gettemplatedelta waits for an update, in seconds. Like getblocktemplate's
+/// long poll, it stops a client from tying up an RPC thread indefinitely.
+constexpr int64_t MAX_TEMPLATE_DELTA_TIMEOUT {60};
+
 /// mkblocktemplate is a modified/cut down version of the code from the RPC method getblocktemplate.
 /// It is currently only called from getminingcandidate, but getblocktemplate could be
 /// modified to call a generic version of mkblocktemplate.
@@ -115,20 +122,6 @@ CMiningCandidateRef mkblocktemplate(const Config& config, bool coinbaseRequired)
 }
 
 
-std::vector<uint256> GetMerkleProofBranches(CBlockRef pblock)
-{
-    std::vector<uint256> ret;
-    std::vector<uint256> leaves;
-    int len = pblock->vtx.size();
-
-    for (int i = 0; i < len; i++)
-    {
-        leaves.emplace_back(pblock->vtx[i]->GetHash());
-    }
-
-    return ComputeMerkleBranch(leaves, 0);
-}
-
 void CalculateNextMerkleRoot(uint256 &merkle_root, const uint256 &merkle_branch)
 {
     // Append a branch to the root. Double SHA256 the whole thing:
@@ -164,16 +157,17 @@ UniValue MkMiningCandidateJson(bool coinbaseRequired, CMiningCandidateRef &candi
 
     ret.push_back(Pair("prevhash", block->hashPrevBlock.GetHex()));
 
-    const CTransaction* cbtran = block->vtx[0].get();
+    // The block may be shared with other candidates, take the fields unique to this one from the candidate
+    CTransactionRef cbtran = candidate->GetBlockCoinbase();
     if(coinbaseRequired)
     {
         ret.push_back(Pair("coinbase", EncodeHexTx(*cbtran)));
     }
     ret.push_back(Pair("coinbaseValue", cbtran->vout[0].nValue.GetSatoshis()));
 
-    ret.push_back(Pair("version", block->nVersion));
-    ret.push_back(Pair("nBits", strprintf("%08x", block->nBits)));
-    ret.push_back(Pair("time", block->GetBlockTime()));
+    ret.push_back(Pair("version", candidate->GetBlockVersion()));
+    ret.push_back(Pair("nBits", strprintf("%08x", candidate->GetBlockBits())));
+    ret.push_back(Pair("time", static_cast<int64_t>(candidate->GetBlockTime())));
     ret.push_back(Pair("height", block->GetHeightFromCoinbase()));
 
     // number of transactions including coinbase transaction
@@ -181,9 +175,8 @@ UniValue MkMiningCandidateJson(bool coinbaseRequired, CMiningCandidateRef &candi
     ret.push_back(Pair("sizeWithoutCoinbase", static_cast<uint64_t>(block->GetSizeWithoutCoinbase())));
 
     // merkleProof:
-    std::vector<uint256> brancharr = GetMerkleProofBranches(block);
     UniValue merkleProof(UniValue::VARR);
-    for (const auto &i : brancharr)
+    for (const auto &i : candidate->GetMerkleProof())
     {
         merkleProof.push_back(i.GetHex());
     }
@@ -337,9 +330,8 @@ UniValue submitminingsolution(const Config& config, const JSONRPCRequest& reques
 
     // Merkle root
     {
-        std::vector<uint256> merkleProof = GetMerkleProofBranches(block);
         uint256 t = block->vtx[0]->GetHash();
-        block->hashMerkleRoot = CalculateMerkleRoot(t, merkleProof);
+        block->hashMerkleRoot = CalculateMerkleRoot(t, result->GetMerkleProof());
     }
 
     // Submit solution
@@ -348,6 +340,11 @@ UniValue submitminingsolution(const Config& config, const JSONRPCRequest& reques
         // Ensure we run full checks on submitted block
         block->fChecked = false;
 
+        // The merkle root comes from the cached coinbase merkle branch of the
+        // candidate, so it is checked against the transactions like any other
+        // block's. The block is validated in full; only script checks are
+        // saved, for transactions already in the script cache from mempool
+        // acceptance or from the candidate validity test.
         auto submitBlock = [](const Config& config , const std::shared_ptr<CBlock>& blockptr)
         {
             CScopedBlockOriginRegistry reg(blockptr->GetHash(), "submitminingsolution");
@@ -369,6 +366,114 @@ UniValue submitminingsolution(const Config& config, const JSONRPCRequest& reques
     return submitted;
 }
 
+/// RPC - Follow the block template by sequence number.
+/// Pools that keep a copy of the template only need the changes since the last
+/// delta they saw, instead of polling for complete candidates.
+void gettemplatedelta(const Config& config,
+                      const JSONRPCRequest& request,
+                      HTTPRequest* httpReq,
+                      bool processedInBatch)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+    {
+        throw std::runtime_error(
+                "gettemplatedelta sequence ( timeout )\n"
+                "\nReturns the updates of the block template made after the given sequence number.\n"
+                "Waits up to timeout seconds if there are none yet. The same updates are published by -zmqpubtemplatedelta.\n"
+                "\nArguments:\n"
+                "1. sequence    (numeric, required) Sequence number of the last update the client has, 0 to start\n"
+                "2. timeout     (numeric, optional, default=0) Seconds to wait for an update, at most "
+                    + std::to_string(MAX_TEMPLATE_DELTA_TIMEOUT) + "\n"
+                "\nResult:\n"
+                "    {\n"
+                "        \"sequence\": n,      (integer) Sequence number of the latest update\n"
+                "        \"resync\": true|false, (boolean) The updates the client missed are no longer available,\n"
+                "                              it must get a new candidate and follow from the latest sequence number\n"
+                "        \"deltas\": [         (array) Updates after the given sequence number, oldest first\n"
+                "            {\n"
+                "                \"sequence\": n,      (integer) Sequence number of this update\n"
+                "                \"reset\": true|false, (boolean) The template was started over and added lists all of it\n"
+                "                \"prevhash\": \"xxxx\", (hex string) Hash of the block the template builds on\n"
+                "                \"num_tx\": n,        (integer) Number of transactions in the template without the coinbase\n"
+                "                \"fees\": n,          (integer) Total fees of the template in satoshis\n"
+                "                \"added\": [          (array) Transactions appended to the template, in template order\n"
+                "                    { \"txid\": \"xxxx\", \"fee\": n }, ...\n"
+                "                ],\n"
+                "                \"merkleProof\": [    (list of hex strings) Merkle branch of the coinbase\n"
+                "                    xxxx, ...\n"
+                "                ]\n"
+                "            }, ...\n"
+                "        ]\n"
+                "    }\n"
+                "\nExamples:\n" +
+                HelpExampleCli("gettemplatedelta", "0 30") +
+                HelpExampleRpc("gettemplatedelta", "0, 30"));
+    }
+
+    if (httpReq == nullptr)
+        return;
+
+    int64_t sequence { request.params[0].get_int64() };
+    if (sequence < 0)
+    {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative sequence number");
+    }
+    int64_t timeout {0};
+    if (request.params.size() > 1 && !request.params[1].isNull())
+    {
+        timeout = request.params[1].get_int64();
+    }
+
+    // Wait in short slices so we notice a shutdown
+    const auto& stream { mining::CMiningFactory::GetTemplateDeltaStream() };
+    auto deadline { std::chrono::steady_clock::now() + std::chrono::seconds{std::clamp<int64_t>(timeout, 0, MAX_TEMPLATE_DELTA_TIMEOUT)} };
+    auto deltas { stream.GetSince(sequence, std::chrono::milliseconds{0}) };
+    while (deltas && deltas->empty() && IsRPCRunning())
+    {
+        auto remaining { std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()) };
+        if (remaining.count() <= 0)
+        {
+            break;
+        }
+        deltas = stream.GetSince(sequence, std::min(remaining, std::chrono::milliseconds{1000}));
+    }
+
+    if (!processedInBatch)
+    {
+        httpReq->WriteHeader("Content-Type", "application/json");
+        httpReq->StartWritingChunks(HTTP_OK);
+    }
+
+    {
+        CHttpTextWriter httpWriter(*httpReq);
+        CJSONWriter jWriter(httpWriter, false);
+
+        jWriter.writeBeginObject();
+        jWriter.writeBeginObject("result");
+        jWriter.pushKV("sequence", stream.GetSequence());
+        jWriter.pushKV("resync", !deltas.has_value());
+        jWriter.writeBeginArray("deltas");
+        if (deltas)
+        {
+            for (const auto& delta : *deltas)
+            {
+                delta->ToJSON(jWriter);
+            }
+        }
+        jWriter.writeEndArray();
+        jWriter.writeEndObject();
+        jWriter.pushKV("error", nullptr);
+        jWriter.pushKVJSONFormatted("id", request.id.write());
+        jWriter.writeEndObject();
+        jWriter.flush();
+    }
+
+    if (!processedInBatch)
+    {
+        httpReq->StopWritingChunks();
+    }
+}
+
 /** Mining-Candidate end */
 
 const CRPCCommand commands[] =
@@ -377,6 +482,7 @@ const CRPCCommand commands[] =
   //  --------------------- ------------------------  -----------------------  ----------
     { "mining",             "getminingcandidate",     getminingcandidate,     true, {"coinbase"}  },
     { "mining",             "submitminingsolution",   submitminingsolution,   true, {}  },
+    { "mining",             "gettemplatedelta",       gettemplatedelta,       true, {"sequence", "timeout"}  },
 };
 
 } // namespace
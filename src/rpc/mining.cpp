@@ -27,6 +27,7 @@
 #include "rpc/blockchain.h"
 #include "rpc/server.h"
 #include "script/script_num.h"
+#include "txhasher.h"
 #include "txmempool.h"
 #include "util.h"
 #include "utilstrencodings.h"
@@ -37,6 +38,7 @@
 #include <univalue.h>
 #include <cstdint>
 #include <memory>
+#include <unordered_map>
 
 using mining::CBlockTemplate;
 
@@ -281,6 +283,13 @@ static UniValue getmininginfo(const Config &config,
             "  \"pooledtx\": n              (numeric) The size of the mempool\n"
             "  \"chain\": \"xxxx\",           (string) current network name as "
             "defined in BIP70 (main, test, regtest)\n"
+            "  \"miningcandidates\": {      (json object) Mining candidates kept for getminingcandidate\n"
+            "    \"count\": n,              (numeric) Number of candidates\n"
+            "    \"blocks\": n,             (numeric) Number of distinct blocks the candidates share\n"
+            "    \"memory\": n,             (numeric) Memory used by the candidates in bytes\n"
+            "    \"maxmemory\": n,          (numeric) Limit on the memory used by the candidates in bytes\n"
+            "    \"evicted\": n             (numeric) Number of candidates dropped to stay within the limit\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getmininginfo", "") +
@@ -299,6 +308,15 @@ static UniValue getmininginfo(const Config &config,
     obj.push_back(Pair("networkhashps", getnetworkhashps(config, request)));
     obj.push_back(Pair("pooledtx", uint64_t(mempool.Size())));
     obj.push_back(Pair("chain", config.GetChainParams().NetworkIDString()));
+
+    const CMiningCandidateManager& candidates { mining::CMiningFactory::GetCandidateManager() };
+    UniValue candidatesObj(UniValue::VOBJ);
+    candidatesObj.push_back(Pair("count", uint64_t(candidates.Size())));
+    candidatesObj.push_back(Pair("blocks", uint64_t(candidates.GetBlockCount())));
+    candidatesObj.push_back(Pair("memory", candidates.GetMemoryUsage()));
+    candidatesObj.push_back(Pair("maxmemory", candidates.GetMaxMemory()));
+    candidatesObj.push_back(Pair("evicted", candidates.GetEvictedCount()));
+    obj.push_back(Pair("miningcandidates", candidatesObj));
     return obj;
 }
 
@@ -704,12 +722,13 @@ void getblocktemplate(const Config& config,
         jWriter.pushKV("previousblockhash", pblock->hashPrevBlock.GetHex());
         jWriter.writeBeginArray("transactions");
 
-        std::map<uint256, int64_t> setTxIndex;
+        std::unordered_map<uint256, int64_t, SaltedTxidHasher> setTxIndex;
+        setTxIndex.reserve(pblock->vtx.size());
         int i = 0;
         for (const auto &it : pblock->vtx) {
             const CTransaction &tx = *it;
-            uint256 txId = tx.GetId();
-            setTxIndex[txId] = i++;
+            const uint256& txId = tx.GetId();
+            setTxIndex.emplace(txId, i++);
 
             if (tx.IsCoinBase()) {
                 continue;
@@ -717,10 +736,11 @@ void getblocktemplate(const Config& config,
 
             jWriter.writeBeginObject();
 
+            // The transaction is hex encoded straight from the template into
+            // the reply buffer, which is sent in chunks as it fills up. Don't
+            // flush here, that would send a chunk for every transaction.
             jWriter.pushK("data");
             jWriter.pushQuote();
-            jWriter.flush();
-            // EncodeHexTx supports streaming (large transaction's hex should be chunked)
             EncodeHexTx(tx, httpWriter, RPCSerializationFlags());
             jWriter.pushQuote();
 
@@ -729,8 +749,9 @@ void getblocktemplate(const Config& config,
 
             jWriter.writeBeginArray("depends");
             for (const CTxIn &in : tx.vin) {
-                if (setTxIndex.count(in.prevout.GetTxId())) {
-                    jWriter.pushV(setTxIndex[in.prevout.GetTxId()]);
+                const auto parent = setTxIndex.find(in.prevout.GetTxId());
+                if (parent != setTxIndex.end()) {
+                    jWriter.pushV(parent->second);
                 }
             }
             jWriter.writeEndArray();
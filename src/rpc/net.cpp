@@ -66,6 +66,36 @@ static UniValue ping(const Config &config, const JSONRPCRequest &request) {
     return NullUniValue;
 }
 
+// Histogram buckets keyed by their (exclusive) upper bound, skipping empty ones
+static UniValue NetMsgBucketsToJSON(const NetMsgStats::Buckets &buckets) {
+    UniValue obj(UniValue::VOBJ);
+    for (size_t i = 0; i < NetMsgStats::NUM_BUCKETS; i++) {
+        if (buckets[i] > 0) {
+            obj.push_back(Pair(std::to_string(uint64_t{1} << i), buckets[i]));
+        }
+    }
+    if (buckets[NetMsgStats::NUM_BUCKETS] > 0) {
+        obj.push_back(Pair("inf", buckets[NetMsgStats::NUM_BUCKETS]));
+    }
+    return obj;
+}
+
+static UniValue NetMsgStatsToJSON(const NetMsgStats::Snapshot &snapshot) {
+    UniValue obj(UniValue::VOBJ);
+    for (const auto &[command, stats] : snapshot) {
+        UniValue cmdStats(UniValue::VOBJ);
+        cmdStats.push_back(Pair("count", stats.count));
+        cmdStats.push_back(Pair("totalqueuewait", stats.totalQueueWait));
+        cmdStats.push_back(Pair("totalprocesstime", stats.totalProcessTime));
+        cmdStats.push_back(Pair("totalbytes", stats.totalBytes));
+        cmdStats.push_back(Pair("queuewait", NetMsgBucketsToJSON(stats.queueWait)));
+        cmdStats.push_back(Pair("processtime", NetMsgBucketsToJSON(stats.processTime)));
+        cmdStats.push_back(Pair("bytes", NetMsgBucketsToJSON(stats.bytes)));
+        obj.push_back(Pair(command, cmdStats));
+    }
+    return obj;
+}
+
 static UniValue getpeerinfo(const Config &config,
                             const JSONRPCRequest &request) {
     if (request.fHelp || request.params.size() != 0) {
@@ -154,6 +184,11 @@ static UniValue getpeerinfo(const Config &config,
             "       \"addr\": n,              (numeric) The total bytes "
             "received aggregated by message type\n"
             "       ...\n"
+            "    },\n"
+            "    \"msgstats\": {               (json object) Processing stats for "
+            "messages received from this peer, by message type. See "
+            "getnetmsgstats for details\n"
+            "       ...\n"
             "    }\n"
             "  }\n"
             "  ,...\n"
@@ -261,6 +296,7 @@ static UniValue getpeerinfo(const Config &config,
             }
         }
         obj.push_back(Pair("bytesrecv_per_msg", recvPerMsgCmd));
+        obj.push_back(Pair("msgstats", NetMsgStatsToJSON(stats.netMsgStats)));
 
         ret.push_back(obj);
     }
@@ -507,6 +543,44 @@ static UniValue getnettotals(const Config &config,
     return obj;
 }
 
+static UniValue getnetmsgstats(const Config &config,
+                               const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() > 0)
+        throw std::runtime_error(
+            "getnetmsgstats\n"
+            "\nReturns histograms of how long received network messages waited "
+            "to be processed,\nhow long they took to process and how big they "
+            "were, by message type, across all peers.\n"
+            "Times are in microseconds. Each histogram bucket is keyed by its "
+            "upper bound and counts\nvalues below that and at least half of "
+            "it; empty buckets are omitted.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"msgtype\": {                (json object) Stats for this message type\n"
+            "    \"count\": n,               (numeric) Number of messages processed\n"
+            "    \"totalqueuewait\": n,      (numeric) Total time messages waited to be processed\n"
+            "    \"totalprocesstime\": n,    (numeric) Total time spent processing messages\n"
+            "    \"totalbytes\": n,          (numeric) Total message payload bytes\n"
+            "    \"queuewait\": {            (json object) Histogram of queue wait times\n"
+            "      \"bound\": n,             (numeric) Number of messages in this bucket\n"
+            "      ...\n"
+            "    },\n"
+            "    \"processtime\": {...},     (json object) Histogram of processing times\n"
+            "    \"bytes\": {...}            (json object) Histogram of payload sizes\n"
+            "  },\n"
+            "  ...\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getnetmsgstats", "") +
+            HelpExampleRpc("getnetmsgstats", ""));
+    if (!g_connman)
+        throw JSONRPCError(
+            RPC_CLIENT_P2P_DISABLED,
+            "Error: Peer-to-peer functionality missing or disabled");
+
+    return NetMsgStatsToJSON(GlobalNetMsgStats::GetSnapshot());
+}
+
 static UniValue GetNetworksInfo() {
     UniValue networks(UniValue::VARR);
     for (int n = 0; n < NET_MAX; ++n) {
@@ -849,6 +923,7 @@ static const CRPCCommand commands[] = {
     { "network",            "disconnectnode",         disconnectnode,         true,  {"address", "nodeid"} },
     { "network",            "getaddednodeinfo",       getaddednodeinfo,       true,  {"node"} },
     { "network",            "getnettotals",           getnettotals,           true,  {} },
+    { "network",            "getnetmsgstats",         getnetmsgstats,         true,  {} },
     { "network",            "getnetworkinfo",         getnetworkinfo,         true,  {} },
     { "network",            "setban",                 setban,                 true,  {"subnet", "command", "bantime", "absolute"} },
     { "network",            "listbanned",             listbanned,             true,  {} },
@@ -9,6 +9,7 @@
 #include "consensus/consensus.h" // For ONE_MEGABYTE
 #include "httpserver.h" // For HTTPRequest
 #include <string>
+#include <string_view>
 #include <fstream>
 
 class CTextWriter
@@ -17,6 +18,7 @@ public:
     virtual ~CTextWriter() = default;
     virtual void Write(char val) = 0;
     virtual void Write(const std::string& jsonText) = 0;
+    virtual void Write(const char* data, size_t size) = 0;
     virtual void Flush() = 0;
     virtual void ReserveAdditional(size_t size) = 0;
 
@@ -43,6 +45,11 @@ public:
         strBuffer.append(jsonText);
     }
 
+    void Write(const char* data, size_t size) override
+    {
+        strBuffer.append(data, size);
+    }
+
     void Flush() override {}
 
 
@@ -88,6 +95,11 @@ public:
         WriteToBuff(jsonText);
     }
 
+    void Write(const char* data, size_t size) override
+    {
+        WriteToBuff(std::string_view{data, size});
+    }
+
     void Flush() override
     {
         FlushNonVirtual();
@@ -100,7 +112,7 @@ private:
     HTTPRequest& _request;
     std::string strBuffer;
 
-    void WriteToBuff(std::string const & jsonText)
+    void WriteToBuff(std::string_view jsonText)
     {
         if (jsonText.size() > BUFFER_SIZE)
         {
@@ -166,6 +178,15 @@ public:
         }
     }
 
+    void Write(const char* data, size_t size) override
+    {
+        if (error.empty())
+        {
+            file.write(data, size);
+            CheckForError();
+        }
+    }
+
     void Flush() override
     {
         FlushNonVirtual();
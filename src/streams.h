@@ -215,6 +215,7 @@ public:
     bool empty() const { return vch.size() == nReadPos; }
     void resize(size_type n, value_type c = 0) { vch.resize(n + nReadPos, c); }
     void reserve(size_type n) { vch.reserve(n + nReadPos); }
+    size_type capacity() const { return vch.capacity() - nReadPos; }
     const_reference operator[](size_type pos) const {
         return vch[pos + nReadPos];
     }
@@ -294,6 +295,13 @@ public:
             return vch.erase(first, last);
     }
 
+    // Exchange our underlying buffer with another, so that allocated
+    // buffers can be reused
+    void SwapBuffer(vector_type &other) {
+        vch.swap(other);
+        nReadPos = 0;
+    }
+
     inline void Compact() {
         vch.erase(vch.begin(), vch.begin() + nReadPos);
         nReadPos = 0;
@@ -0,0 +1,63 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_COUNTING_H
+#define BITCOIN_SUPPORT_ALLOCATORS_COUNTING_H
+
+#include "memusage.h"
+
+#include <cstddef>
+#include <memory>
+
+// Totals of the memory that is currently allocated through a counting_allocator.
+struct AllocationCounter {
+    // Number of live allocations.
+    size_t allocations = 0;
+    // Heap usage of the live allocations, including malloc overhead as
+    // estimated by memusage::MallocUsage().
+    size_t usage = 0;
+};
+
+// Allocator that keeps track of the memory allocated by a container. Used to
+// check the memusage::DynamicUsage() estimates against actual allocations.
+// All copies and rebinds of an allocator update the same counter.
+template <typename T>
+struct counting_allocator {
+    typedef T value_type;
+    template <typename U> struct rebind {
+        typedef counting_allocator<U> other;
+    };
+
+    explicit counting_allocator(AllocationCounter &counter_) noexcept
+        : counter(&counter_) {}
+    template <typename U>
+    counting_allocator(const counting_allocator<U> &a) noexcept
+        : counter(a.counter) {}
+
+    T *allocate(std::size_t n) {
+        T *p = std::allocator<T>{}.allocate(n);
+        ++counter->allocations;
+        counter->usage += memusage::MallocUsage(sizeof(T) * n);
+        return p;
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept {
+        std::allocator<T>{}.deallocate(p, n);
+        --counter->allocations;
+        counter->usage -= memusage::MallocUsage(sizeof(T) * n);
+    }
+
+    template <typename U>
+    bool operator==(const counting_allocator<U> &a) const noexcept {
+        return counter == a.counter;
+    }
+    template <typename U>
+    bool operator!=(const counting_allocator<U> &a) const noexcept {
+        return counter != a.counter;
+    }
+
+    AllocationCounter *counter;
+};
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_COUNTING_H
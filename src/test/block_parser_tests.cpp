@@ -0,0 +1,247 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#include <config.h>
+#include <consensus/merkle.h>
+#include <net/block_parser.h>
+#include <net/net_message.h>
+#include <test/test_novobitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <thread>
+
+namespace
+{
+    // A block with a coinbase plus the given number of transactions, each
+    // spending inputs outpoints and padded to roughly the given size
+    CBlock MakeBlock(size_t numTxns, size_t inputs, size_t padding)
+    {
+        CBlock block {};
+        block.nVersion = 42;
+        block.hashPrevBlock = InsecureRand256();
+
+        CMutableTransaction coinbase {};
+        coinbase.vin.resize(1);
+        coinbase.vout.resize(1);
+        coinbase.vout[0].nValue = Amount(42);
+        block.vtx.push_back(MakeTransactionRef(coinbase));
+
+        for(size_t i = 0; i < numTxns; ++i)
+        {
+            CMutableTransaction tx {};
+            tx.vin.resize(inputs);
+            for(CTxIn& input : tx.vin)
+            {
+                input.prevout = COutPoint(InsecureRand256(), 0);
+            }
+            tx.vin[0].scriptSig = CScript() << std::vector<uint8_t>(padding);
+            tx.vout.resize(1);
+            tx.vout[0].nValue = Amount(1);
+            block.vtx.push_back(MakeTransactionRef(tx));
+        }
+
+        block.hashMerkleRoot = BlockMerkleRoot(block);
+        return block;
+    }
+
+    std::vector<char> Serialise(const CBlock& block)
+    {
+        CDataStream stream { SER_NETWORK, INIT_PROTO_VERSION };
+        stream << block;
+        return { stream.begin(), stream.end() };
+    }
+
+    void CheckSameBlock(const CBlock& parsed, const CBlock& block)
+    {
+        BOOST_CHECK(parsed.GetHash() == block.GetHash());
+        BOOST_REQUIRE_EQUAL(parsed.vtx.size(), block.vtx.size());
+        for(size_t i = 0; i < block.vtx.size(); ++i)
+        {
+            BOOST_CHECK(parsed.vtx[i]->GetId() == block.vtx[i]->GetId());
+        }
+        BOOST_CHECK(BlockMerkleRoot(parsed) == block.hashMerkleRoot);
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(block_parser_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(parse_in_pieces)
+{
+    const CBlock block { MakeBlock(100, 3, 50) };
+    const std::vector<char> data { Serialise(block) };
+
+    // Also try transactions that are much larger than the pieces they arrive in
+    const CBlock largeTxnBlock { MakeBlock(3, 1, 100000) };
+    const std::vector<char> largeTxnData { Serialise(largeTxnBlock) };
+
+    for(const auto& [expected, bytes] : { std::tie(block, data), std::tie(largeTxnBlock, largeTxnData) })
+    {
+        for(size_t pieceSize : { 1, 7, 1000, 65536 })
+        {
+            IncrementalBlockParser parser { SER_NETWORK, INIT_PROTO_VERSION, bytes.size() };
+            size_t numOutpoints {0};
+            for(size_t size = std::min(pieceSize, bytes.size()); ; size = std::min(size + pieceSize, bytes.size()))
+            {
+                parser.Parse(bytes.data(), size);
+                numOutpoints += parser.TakeOutpoints().size();
+                if(size == bytes.size())
+                {
+                    break;
+                }
+                BOOST_CHECK(!parser.Complete(size));
+            }
+
+            BOOST_CHECK(!parser.Failed());
+            BOOST_CHECK(parser.Complete(bytes.size()));
+            BOOST_CHECK(!parser.Complete(bytes.size() + 1));
+
+            // The coinbase doesn't spend anything
+            size_t expectedOutpoints {0};
+            for(size_t i = 1; i < expected.vtx.size(); ++i)
+            {
+                expectedOutpoints += expected.vtx[i]->vin.size();
+            }
+            BOOST_CHECK_EQUAL(numOutpoints, expectedOutpoints);
+
+            std::shared_ptr<CBlock> parsed { parser.TakeBlock() };
+            BOOST_REQUIRE(parsed);
+            CheckSameBlock(*parsed, expected);
+            BOOST_CHECK(!parser.TakeBlock());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(malformed)
+{
+    const CBlock block { MakeBlock(10, 1, 10) };
+    std::vector<char> data { Serialise(block) };
+
+    // Block with extra data on the end parses, but isn't complete
+    std::vector<char> extra { data };
+    extra.push_back(0);
+    IncrementalBlockParser parser { SER_NETWORK, INIT_PROTO_VERSION, extra.size() };
+    parser.Parse(extra.data(), extra.size());
+    BOOST_CHECK(!parser.Failed());
+    BOOST_CHECK(!parser.Complete(extra.size()));
+
+    // Non-canonical transaction count
+    std::vector<char> bad { data };
+    bad[80] = static_cast<char>(0xfd);
+    bad[81] = 1;
+    bad[82] = 0;
+    IncrementalBlockParser badParser { SER_NETWORK, INIT_PROTO_VERSION, bad.size() };
+    badParser.Parse(bad.data(), bad.size());
+    BOOST_CHECK(badParser.Failed());
+    BOOST_CHECK(!badParser.Complete(bad.size()));
+    BOOST_CHECK(!badParser.TakeBlock());
+}
+
+BOOST_AUTO_TEST_CASE(async_parser)
+{
+    const CBlock block { MakeBlock(1000, 2, 200) };
+    const std::vector<char> data { Serialise(block) };
+    const size_t expectedOutpoints { (block.vtx.size() - 1) * 2 };
+
+    for(bool acceptHeader : { false, true })
+    {
+        AsyncBlockParser parser { SER_NETWORK, INIT_PROTO_VERSION, data.size() };
+        BOOST_CHECK(!parser.ClaimRun());
+
+        size_t numChecks {0};
+        size_t numOutpoints {0};
+        const auto checkHeader = [&](const CBlockHeader& header) {
+            ++numChecks;
+            BOOST_CHECK(header.GetHash() == block.GetHash());
+            return acceptHeader;
+        };
+        const auto prefetch = [&](std::vector<COutPoint>&& outpoints) {
+            numOutpoints += outpoints.size();
+        };
+
+        // Run as the receiving thread would ask us to
+        constexpr size_t pieceSize {10000};
+        for(size_t pos = 0; pos < data.size(); pos += pieceSize)
+        {
+            parser.Append(data.data() + pos, std::min(pieceSize, data.size() - pos));
+            if(parser.ClaimRun())
+            {
+                // Only one run at a time
+                BOOST_CHECK(!parser.ClaimRun());
+                std::thread { [&]() { parser.Run(checkHeader, prefetch); } }.join();
+            }
+        }
+
+        BOOST_CHECK_EQUAL(numChecks, 1U);
+        BOOST_CHECK_EQUAL(numOutpoints, acceptHeader ? expectedOutpoints : 0U);
+
+        std::shared_ptr<CBlock> parsed { parser.TakeBlock() };
+        BOOST_REQUIRE(parsed);
+        CheckSameBlock(*parsed, block);
+    }
+
+    // Whatever hasn't been run yet is parsed when the block is taken
+    AsyncBlockParser parser { SER_NETWORK, INIT_PROTO_VERSION, data.size() };
+    parser.Append(data.data(), data.size() / 2);
+    BOOST_CHECK(!parser.TakeBlock());
+    parser.Append(data.data() + data.size() / 2, data.size() - data.size() / 2);
+    std::shared_ptr<CBlock> parsed { parser.TakeBlock() };
+    BOOST_REQUIRE(parsed);
+    CheckSameBlock(*parsed, block);
+}
+
+BOOST_AUTO_TEST_CASE(net_message)
+{
+    GlobalConfig config {};
+    config.SetDefaultBlockSizeParams(Params().GetDefaultBlockSizeParams());
+
+    for(size_t numTxns : { 10, 5000 })
+    {
+        const CBlock block { MakeBlock(numTxns, 2, 200) };
+        const std::vector<char> payload { Serialise(block) };
+
+        CMessageHeader hdr { Params().NetMagic(), NetMsgType::BLOCK, static_cast<unsigned int>(payload.size()) };
+        CDataStream stream { SER_NETWORK, INIT_PROTO_VERSION };
+        stream << hdr;
+        std::vector<char> bytes { stream.begin(), stream.end() };
+        bytes.insert(bytes.end(), payload.begin(), payload.end());
+
+        CNetMessage msg { Params().NetMagic(), SER_NETWORK, INIT_PROTO_VERSION };
+        size_t pos {0};
+        while(!msg.complete())
+        {
+            int handled {};
+            if(!msg.in_data)
+            {
+                handled = msg.readHeader(config, bytes.data() + pos, bytes.size() - pos, config.GetMaxBlockSize());
+            }
+            else
+            {
+                handled = msg.readData(bytes.data() + pos, std::min<size_t>(bytes.size() - pos, 10000));
+            }
+            BOOST_REQUIRE(handled > 0);
+            pos += handled;
+        }
+
+        // Only large blocks are parsed as they arrive
+        std::shared_ptr<CBlock> parsed { msg.takeParsedBlock() };
+        if(payload.size() < IncrementalBlockParser::MIN_PAYLOAD_SIZE)
+        {
+            BOOST_CHECK(!parsed);
+        }
+        else
+        {
+            BOOST_REQUIRE(parsed);
+            CheckSameBlock(*parsed, block);
+        }
+
+        // The payload is still there too
+        CBlock deserialised {};
+        msg.vRecv >> deserialised;
+        CheckSameBlock(deserialised, block);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
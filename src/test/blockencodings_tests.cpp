@@ -408,6 +408,42 @@ BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(LargeMempoolRoundTripTest) {
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry(DEFAULT_TEST_TX_FEE);
+    CBlock block(BuildBlockTestCase());
+
+    // Enough unrelated transactions that the mempool is scanned in more than
+    // one batch, with the block's transactions added last
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = Amount(42);
+    for (size_t i = 0; i < 20000; i++) {
+        tx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+        const CTransaction filler(tx);
+        pool.AddUnchecked(filler.GetId(), entry.FromTx(filler), TxStorage::memory, nullChangeSet);
+    }
+    pool.AddUnchecked(block.vtx[1]->GetId(), entry.FromTx(*block.vtx[1]), TxStorage::memory, nullChangeSet);
+    pool.AddUnchecked(block.vtx[2]->GetId(), entry.FromTx(*block.vtx[2]), TxStorage::memory, nullChangeSet);
+
+    CBlockHeaderAndShortTxIDs shortIDs(block);
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << shortIDs;
+    CBlockHeaderAndShortTxIDs shortIDs2;
+    stream >> shortIDs2;
+
+    PartiallyDownloadedBlock partialBlock(GlobalConfig::GetConfig(), &pool);
+    BOOST_CHECK(partialBlock.InitData(shortIDs2, extra_txn) == READ_STATUS_OK);
+    BOOST_CHECK(partialBlock.IsTxAvailable(0));
+    BOOST_CHECK(partialBlock.IsTxAvailable(1));
+    BOOST_CHECK(partialBlock.IsTxAvailable(2));
+
+    CBlock block2;
+    BOOST_CHECK(partialBlock.FillBlock(block2, {}, 0) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block.GetHash().ToString(), block2.GetHash().ToString());
+}
+
 BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest) {
     BlockTransactionsRequest req1;
     req1.blockhash = InsecureRand256();
@@ -571,4 +571,50 @@ BOOST_AUTO_TEST_CASE(conflicts)
     BOOST_CHECK(mempool.GetTransactions().size() == 1);
 }
 
+BOOST_AUTO_TEST_CASE(conflicts_in_large_block)
+{
+    mempool.SetSanityCheck(0);
+    CTxMemPoolTestAccess testAccess(mempool);
+    auto journal = testAccess.getJournalBuilder().getCurrentJournal();
+
+    // Enough block transactions for RemoveForBlock to resolve them in more than one batch
+    // on multi-core machines. Every mined transaction has a child which stays in the mempool,
+    // except the last one whose child also spends an output double-spent by the block.
+    constexpr size_t numberOfMined = 0x4001;
+
+    std::vector<CTransactionRef> vtx;
+    std::vector<CTxMemPoolTestAccess::txiter> staying;
+    for(size_t i = 0; i < numberOfMined; i++)
+    {
+        auto entryMined = MakeEntry(DefaultFeeRate(), {std::make_tuple(TxId{InsecureRand256()}, 0, Amount{1000000})}, {}, 1);
+        AddToMempool(entryMined);
+        vtx.push_back(entryMined.GetSharedTx());
+
+        if(i + 1 < numberOfMined)
+        {
+            auto entryChild = MakeEntry(DefaultFeeRate(), {}, {std::make_tuple(entryMined.GetSharedTx(), 0)}, 1);
+            staying.push_back(AddToMempool(entryChild));
+        }
+        else
+        {
+            auto inputForDoubleSpend = std::make_tuple(TxId{InsecureRand256()}, 0, Amount{1000000});
+            auto entryDoubleSpendMempool = MakeEntry(DefaultFeeRate(), {inputForDoubleSpend}, {}, 1);
+            auto entryDoubleSpendBlock = MakeEntry(DefaultFeeRate(), {inputForDoubleSpend}, {}, 2);
+            auto entryDoubleSpendChild = MakeEntry(DefaultFeeRate(), {}, {std::make_tuple(entryDoubleSpendMempool.GetSharedTx(), 0), std::make_tuple(entryMined.GetSharedTx(), 0)}, 1);
+            AddToMempool(entryDoubleSpendMempool);
+            AddToMempool(entryDoubleSpendChild);
+            vtx.push_back(entryDoubleSpendBlock.GetSharedTx());
+        }
+    }
+
+    mempool.RemoveForBlock(vtx, mining::CJournalChangeSetPtr{}, uint256{});
+
+    BOOST_CHECK_EQUAL(mempool.GetTransactions().size(), staying.size());
+    for(auto entryIt: staying)
+    {
+        BOOST_CHECK(entryIt->IsInPrimaryMempool());
+        BOOST_CHECK(JournalTester(journal).checkTxnExists(JournalEntry{*entryIt}));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,11 +4,13 @@
 
 #include "crypto/aes.h"
 #include "crypto/chacha20.h"
+#include "crypto/common.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
+#include "crypto/sha256_lanes.h"
 #include "crypto/sha512.h"
 #include "random.h"
 #include "test/test_novobitcoin.h"
@@ -314,6 +316,60 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
         "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256_lanes_matches_sha256) {
+    using sha256_lanes::LANES;
+
+    // Hash a different 64-byte message in each lane, the second block is
+    // the padding of a 64-byte message.
+    std::vector<unsigned char> messages[LANES];
+    uint32_t state[8][LANES];
+    uint32_t block[16][LANES];
+    uint32_t padding[16][LANES] = {};
+    for (size_t l = 0; l < LANES; ++l) {
+        messages[l].resize(64);
+        for (auto &b : messages[l]) {
+            b = InsecureRandBits(8);
+        }
+        uint32_t init[8];
+        sha256_lanes::Initialize(init);
+        for (size_t i = 0; i < 8; ++i) {
+            state[i][l] = init[i];
+        }
+        for (size_t i = 0; i < 16; ++i) {
+            block[i][l] = ReadBE32(&messages[l][4 * i]);
+        }
+        padding[0][l] = 0x80000000;
+        padding[15][l] = 64 * 8;
+    }
+    sha256_lanes::TransformLanes(state, block);
+    sha256_lanes::TransformLanes(state, padding);
+
+    for (size_t l = 0; l < LANES; ++l) {
+        unsigned char expected[CSHA256::OUTPUT_SIZE];
+        CSHA256().Write(messages[l].data(), messages[l].size()).Finalize(expected);
+        unsigned char hash[CSHA256::OUTPUT_SIZE];
+        for (size_t i = 0; i < 8; ++i) {
+            WriteBE32(hash + 4 * i, state[i][l]);
+        }
+        BOOST_CHECK(std::equal(hash, hash + sizeof(hash), expected));
+    }
+
+    // The single state transform agrees with the first lane.
+    uint32_t single[8];
+    uint32_t lanes[8][LANES];
+    sha256_lanes::Initialize(single);
+    for (size_t i = 0; i < 8; ++i) {
+        for (size_t l = 0; l < LANES; ++l) {
+            lanes[i][l] = single[i];
+        }
+    }
+    sha256_lanes::Transform(single, messages[0].data());
+    sha256_lanes::TransformLanes(lanes, block);
+    for (size_t i = 0; i < 8; ++i) {
+        BOOST_CHECK_EQUAL(single[i], lanes[i][0]);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512(
         "", "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
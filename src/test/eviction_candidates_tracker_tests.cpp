@@ -12,7 +12,9 @@
 #include "txmempoolevictioncandidates.h"
 
 #include <boost/test/unit_test.hpp>
+#include <cmath>
 #include <deque>
+#include <set>
 
 
 
@@ -330,6 +332,66 @@ BOOST_AUTO_TEST_CASE(secondary_mempool_first) {
 
 
 
+BOOST_AUTO_TEST_CASE(wide_and_close_fee_rates) {
+    MempoolMockup mempool;
+    auto confirmedEntry = std::make_tuple<TxId, int, Amount>(TxId(), 0, Amount(100000000000));
+    auto entry = MakeEntry(1,{confirmedEntry}, {}, 200, 0);
+    mempool.AddTx(entry);
+    mempool.InitializeTracker();
+
+    // fee rates spanning several orders of magnitude, with groups of
+    // nearly equal fee rates that land in the same score bucket
+    for(int i = 0; i < 200; i++)
+    {
+        auto feerate = std::pow(10.0, (i * 7) % 40 / 10.0) * (1 + (i % 5) * 0.001);
+        auto newEntry = MakeEntry(feerate, {}, { std::make_tuple<CTransactionRef, int>(entry.GetSharedTx(), std::move(i))}, 1, 0);
+        mempool.AddTx(newEntry);
+    }
+    BOOST_CHECK_EQUAL(mempool.tracker->GetAllCandidates().size(), 200);
+
+    double lastRemovedFeeRate = 0;
+    for(int i = 0; i < 200; i++)
+    {
+        auto txToRemove = mempool.tracker->GetMostWorthless();
+        double feeRate = double(txToRemove->GetFee().GetSatoshis()) / txToRemove->GetTxSize();
+        mempool.RemoveTx(txToRemove);
+        BOOST_CHECK_GE(feeRate, lastRemovedFeeRate);
+        lastRemovedFeeRate = feeRate;
+    }
+
+    // the parent is the only candidate left
+    BOOST_CHECK_EQUAL(mempool.tracker->GetAllCandidates().size(), 1);
+}
+
+
+
+BOOST_AUTO_TEST_CASE(bucket_spread) {
+    // realistic fee rates in satoshis per kilobyte, from 1 sat/kB up to 1 BSV/kB
+    std::set<uint32_t> usedBuckets;
+    uint32_t lastBucket = 0;
+    for(int64_t score = 1; score <= 100000000; score = score * 11 / 10 + 1)
+    {
+        const uint32_t bucket = CEvictionCandidateTracker::BucketIndex(score);
+        BOOST_CHECK_GE(bucket, lastBucket);
+        lastBucket = bucket;
+        usedBuckets.insert(bucket);
+    }
+    BOOST_CHECK_GT(usedBuckets.size(), 100);
+
+    // lower scores never land in higher buckets, across the sign change as well
+    const std::vector<int64_t> scores {
+        std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::min() + 1000,
+        -1000000, -1001, -1000, -2, -1, 0, 1, 2, 1000, 1001, 1000000,
+        std::numeric_limits<int64_t>::max() };
+    for(size_t i = 1; i < scores.size(); i++)
+    {
+        BOOST_CHECK_LE(CEvictionCandidateTracker::BucketIndex(scores[i - 1]),
+                       CEvictionCandidateTracker::BucketIndex(scores[i]));
+    }
+    BOOST_CHECK_LT(CEvictionCandidateTracker::BucketIndex(-1), CEvictionCandidateTracker::BucketIndex(0));
+    BOOST_CHECK_LT(CEvictionCandidateTracker::BucketIndex(-1000000), CEvictionCandidateTracker::BucketIndex(-1000));
+}
+
 BOOST_AUTO_TEST_CASE(group) {
     MempoolMockup mempool;
     std::vector<std::tuple<TxId, int, Amount>> confirmedInputs = {
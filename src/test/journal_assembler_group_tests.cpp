@@ -8,14 +8,19 @@
 #include "mining/journal.h"
 #include "mining/journal_builder.h"
 #include "mining/journal_change_set.h"
+#include "mining/journaling_block_assembler.h"
+#include "mining/template_stream.h"
 #include "random.h"
 #include "txmempool.h"
 #include "config.h"
+#include "validationinterface.h"
 
 #include "test/test_novobitcoin.h"
 
 #include <boost/test/unit_test.hpp>
 
+#include <mutex>
+
 using namespace mining;
 
 namespace
@@ -174,4 +179,152 @@ BOOST_AUTO_TEST_CASE(TestJournalAddGroup)
     BOOST_CHECK_EQUAL(CountBlockUserTxns(block), maxUserTxns);
 }
 
+BOOST_AUTO_TEST_CASE(TestFeeBucketSelection)
+{
+    CJournalBuilder &builder = mempool.getJournalBuilder();
+
+    auto* jba = dynamic_cast<JournalingBlockAssembler*>(mining::g_miningFactory->GetAssembler().get());
+    BOOST_REQUIRE(jba != nullptr);
+    gArgs.ForceSetArg("-jbafeebuckets", "1");
+    jba->ReadConfigParameters();
+
+    // New transaction paying the given fee, spending the parent or some confirmed output
+    auto newTxn = [](Amount fee, const CTransactionRef& parent) {
+        static uint64_t unique {1ULL << 33};
+        CMutableTransaction txn {};
+        txn.vin.resize(1);
+        txn.vin[0].prevout = COutPoint{parent ? parent->GetId() : TxId{InsecureRand256()}, 0};
+        txn.vout.resize(1);
+        std::vector<uint8_t> stuff(txnSize - 32);
+        txn.vout[0].scriptPubKey = CScript() << stuff << OP_DROP << unique++ << OP_DROP;
+        const auto tx = MakeTransactionRef(std::move(txn));
+        return CJournalEntry { std::make_shared<CTransactionWrapper>(tx, nullptr),
+                               tx->GetTotalSize(), fee, std::nullopt, false };
+    };
+
+    std::vector<CJournalEntry> low {};
+    for(size_t i = 0; i < 10; ++i)
+    {
+        low.push_back(newTxn(Amount{500}, nullptr));
+    }
+    std::vector<CJournalEntry> high {};
+    for(size_t i = 0; i < 5; ++i)
+    {
+        high.push_back(newTxn(Amount{50000}, nullptr));
+    }
+    // A child that pays well for a parent that doesn't
+    CJournalEntry parent { newTxn(Amount{1000}, nullptr) };
+    CJournalEntry child { newTxn(Amount{50000}, parent.getTxn()->GetTx()) };
+
+    Config &config = GlobalConfig::GetConfig();
+    const size_t maxUserTxns = 10;
+    config.SetMaxGeneratedBlockSize(1000 + maxUserTxns * low[0].getTxnSize() + 1);
+
+    // Everything arrives at once, the cheap transactions first
+    auto changeSet = builder.getNewChangeSet(JournalUpdateReason::NEW_TXN);
+    for(const auto& entry : low)
+    {
+        changeSet->addOperation(CJournalChangeSet::Operation::ADD, entry);
+    }
+    for(const auto& entry : high)
+    {
+        changeSet->addOperation(CJournalChangeSet::Operation::ADD, entry);
+    }
+    changeSet->addOperation(CJournalChangeSet::Operation::ADD, parent);
+    changeSet->addOperation(CJournalChangeSet::Operation::ADD, child);
+    changeSet->apply();
+
+    std::unique_ptr<CBlockTemplate> block { CreateBlock() };
+    BOOST_CHECK_EQUAL(CountBlockUserTxns(block), maxUserTxns);
+
+    // The well paying transactions all made it, the parent ahead of its child,
+    // and the cheap ones fill up the rest
+    const auto& vtx = block->GetBlockRef()->vtx;
+    auto position = [&vtx](const CJournalEntry& entry) {
+        return std::find(vtx.begin(), vtx.end(), entry.getTxn()->GetTx()) - vtx.begin();
+    };
+    for(const auto& entry : high)
+    {
+        BOOST_CHECK(position(entry) < static_cast<ptrdiff_t>(vtx.size()));
+    }
+    BOOST_CHECK(position(parent) < position(child));
+    BOOST_CHECK(position(child) < static_cast<ptrdiff_t>(vtx.size()));
+    size_t lowIncluded {0};
+    for(const auto& entry : low)
+    {
+        lowIncluded += (position(entry) < static_cast<ptrdiff_t>(vtx.size()));
+    }
+    BOOST_CHECK_EQUAL(lowIncluded, maxUserTxns - high.size() - 2);
+
+    gArgs.ClearArg("-jbafeebuckets");
+    jba->ReadConfigParameters();
+}
+
+BOOST_AUTO_TEST_CASE(TestTemplateDeltas)
+{
+    CJournalBuilder& builder = mempool.getJournalBuilder();
+    const CTemplateDeltaStream& stream = CMiningFactory::GetTemplateDeltaStream();
+    GlobalConfig::GetConfig().SetMaxGeneratedBlockSize(1000 + 10 * txnSize + 1);
+
+    // Records the deltas signalled to the validation interface
+    struct Listener : CValidationInterface
+    {
+        std::mutex mtx {};
+        std::vector<uint64_t> sequences {};
+        void TemplateDeltaPublished(const CTemplateDeltaRef& delta) override
+        {
+            std::lock_guard lock { mtx };
+            sequences.push_back(delta->sequence);
+        }
+    } listener {};
+    RegisterValidationInterface(&listener);
+
+    // New transactions are appended to the template
+    CreateBlock();
+    uint64_t sequence { stream.GetSequence() };
+    NewChangeSet(builder, 3);
+    std::unique_ptr<CBlockTemplate> block { CreateBlock() };
+    const auto appended { stream.GetSince(sequence, std::chrono::milliseconds{0}) };
+    BOOST_REQUIRE(appended && !appended->empty());
+    std::vector<TxId> added {};
+    for(const auto& delta : *appended)
+    {
+        BOOST_CHECK(!delta->reset);
+        for(const auto& [txid, fee] : delta->added)
+        {
+            added.push_back(txid);
+        }
+    }
+    const auto& vtx { block->GetBlockRef()->vtx };
+    BOOST_REQUIRE_EQUAL(added.size(), 3U);
+    BOOST_REQUIRE_EQUAL(vtx.size(), 4U);
+    for(size_t i = 0; i < added.size(); ++i)
+    {
+        BOOST_CHECK(added[i] == vtx[i + 1]->GetId());
+    }
+    BOOST_CHECK_EQUAL(appended->back()->txCount, 3U);
+
+    // Removing a transaction replaces the journal, and the template starts over
+    sequence = stream.GetSequence();
+    PretendTransactionsMinedElsewhere(builder, std::move(block), 1);
+    block = CreateBlock();
+    const auto reset { stream.GetSince(sequence, std::chrono::milliseconds{0}) };
+    BOOST_REQUIRE(reset && !reset->empty());
+    BOOST_CHECK(reset->front()->reset);
+    BOOST_CHECK_EQUAL(reset->back()->txCount, 2U);
+    BOOST_CHECK_EQUAL(CountBlockUserTxns(block), 2U);
+
+    // Everything published was signalled by the time the template was returned, in order
+    UnregisterValidationInterface(&listener);
+    std::lock_guard lock { listener.mtx };
+    BOOST_CHECK(std::is_sorted(listener.sequences.begin(), listener.sequences.end()));
+    for(const auto& deltas : { appended, reset })
+    {
+        for(const auto& delta : *deltas)
+        {
+            BOOST_CHECK(std::count(listener.sequences.begin(), listener.sequences.end(), delta->sequence) == 1);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
@@ -227,6 +227,73 @@ BOOST_AUTO_TEST_CASE(TestJournalReorg)
     BOOST_CHECK_EQUAL(CJournalTester{journal}.checkTxnOrdering(ops2[3].second, ops[1].second), CJournalTester::TxnOrder::BEFORE);
 }
 
+BOOST_AUTO_TEST_CASE(TestJournalCompaction)
+{
+    // Create builder to manage journals
+    CJournalBuilderPtr builder { std::make_unique<CJournalBuilder>() };
+    CJournalPtr journal { builder->getCurrentJournal() };
+
+    // Populate with enough txns that removing most of them is worth compacting
+    std::vector<CJournalEntry> txns {};
+    CJournalChangeSetPtr changeSet { builder->getNewChangeSet(JournalUpdateReason::NEW_TXN) };
+    for(size_t i = 0; i < 3000; ++i)
+    {
+        txns.push_back(NewTxn());
+        changeSet->addOperation(CJournalChangeSet::Operation::ADD, txns.back());
+    }
+    changeSet.reset();
+
+    // Remove every txn apart from every third one
+    changeSet = builder->getNewChangeSet(JournalUpdateReason::REMOVE_TXN);
+    for(size_t i = 0; i < txns.size(); ++i)
+    {
+        if(i % 3 != 0)
+        {
+            changeSet->addOperation(CJournalChangeSet::Operation::REMOVE, txns[i]);
+        }
+    }
+    changeSet.reset();
+    BOOST_CHECK_EQUAL(journal->size(), 1000U);
+    size_t memoryBeforeCompaction { journal->DynamicMemoryUsage() };
+
+    // Removed txns are skipped when reading the journal
+    CJournal::Index index { CJournal::ReadLock{journal}.begin() };
+    BOOST_CHECK(index.at().getTxn()->GetId() == txns[0].getTxn()->GetId());
+    ++index;
+    BOOST_CHECK(index.at().getTxn()->GetId() == txns[3].getTxn()->GetId());
+    for(size_t i = 0; i < 500; ++i)
+    {
+        ++index;
+    }
+    BOOST_CHECK(index.at().getTxn()->GetId() == txns[1503].getTxn()->GetId());
+
+    // Appending compacts the journal without invalidating readers
+    CJournalEntry lastTxn { NewTxn() };
+    changeSet = builder->getNewChangeSet(JournalUpdateReason::NEW_TXN);
+    changeSet->addOperation(CJournalChangeSet::Operation::ADD, lastTxn);
+    BOOST_CHECK(changeSet->getTailAppendOnly());
+    changeSet.reset();
+    BOOST_CHECK_EQUAL(journal->size(), 1001U);
+    BOOST_CHECK(journal->DynamicMemoryUsage() < memoryBeforeCompaction);
+
+    BOOST_CHECK(index.valid());
+    BOOST_CHECK(index.at().getTxn()->GetId() == txns[1503].getTxn()->GetId());
+    size_t remaining {0};
+    {
+        CJournal::ReadLock lock { journal };
+        for(CJournal::Index end { lock.end() }; index != end; ++index)
+        {
+            ++remaining;
+        }
+    }
+    BOOST_CHECK_EQUAL(remaining, 500U);
+
+    // Order is preserved
+    BOOST_CHECK_EQUAL(CJournalTester{journal}.journalSize(), 1001U);
+    BOOST_CHECK_EQUAL(CJournalTester{journal}.checkTxnOrdering(txns[2997], lastTxn), CJournalTester::TxnOrder::BEFORE);
+    BOOST_CHECK_EQUAL(CJournalTester{journal}.checkTxnOrdering(txns[1], lastTxn), CJournalTester::TxnOrder::NOTFOUND);
+}
+
 BOOST_AUTO_TEST_CASE(TestJournalCheckToposort)
 {
     // Create builder to manage journals
@@ -0,0 +1,131 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#include <net/known_txn_filter.h>
+#include <test/test_novobitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <thread>
+
+namespace
+{
+    std::vector<uint256> MakeTxids(size_t num)
+    {
+        std::vector<uint256> txids(num);
+        for(uint256& txid : txids)
+        {
+            txid = InsecureRand256();
+        }
+        return txids;
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(known_txn_filter_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(insert_and_check)
+{
+    KnownTxnFilter filter {};
+    const std::vector<uint256> txids { MakeTxids(1000) };
+    BOOST_CHECK_EQUAL(filter.Size(), 0U);
+
+    // Single items
+    BOOST_CHECK(!filter.Contains(txids[0]));
+    filter.Insert(txids[0], filter.GetGeneration());
+    filter.Insert(txids[0], filter.GetGeneration());
+    BOOST_CHECK(filter.Contains(txids[0]));
+    BOOST_CHECK_EQUAL(filter.Size(), 1U);
+
+    // Batches; insert every other one
+    std::vector<uint256> evens {};
+    for(size_t i = 0; i < txids.size(); i += 2)
+    {
+        evens.push_back(txids[i]);
+    }
+    filter.Insert(evens, filter.GetGeneration());
+    BOOST_CHECK_EQUAL(filter.Size(), evens.size());
+
+    std::vector<bool> known { filter.Contains(txids) };
+    BOOST_REQUIRE_EQUAL(known.size(), txids.size());
+    for(size_t i = 0; i < txids.size(); ++i)
+    {
+        BOOST_CHECK_EQUAL(known[i], i % 2 == 0);
+    }
+    BOOST_CHECK(filter.Contains(std::vector<uint256> {}).empty());
+
+    filter.Clear();
+    BOOST_CHECK_EQUAL(filter.Size(), 0U);
+    known = filter.Contains(txids);
+    BOOST_CHECK(std::none_of(known.begin(), known.end(), [](bool b) { return b; }));
+}
+
+BOOST_AUTO_TEST_CASE(stale_generation)
+{
+    // What was worked out before a clear isn't remembered after it
+    KnownTxnFilter filter {};
+    const std::vector<uint256> txids { MakeTxids(100) };
+    const uint64_t generation { filter.GetGeneration() };
+    filter.Clear();
+    BOOST_CHECK(filter.GetGeneration() != generation);
+    filter.Insert(txids[0], generation);
+    filter.Insert(txids, generation);
+    BOOST_CHECK_EQUAL(filter.Size(), 0U);
+    BOOST_CHECK(!filter.Contains(txids[0]));
+
+    filter.Insert(txids, filter.GetGeneration());
+    BOOST_CHECK_EQUAL(filter.Size(), txids.size());
+}
+
+BOOST_AUTO_TEST_CASE(bounded)
+{
+    // Only the most recent IDs in each shard are kept
+    constexpr size_t maxPerShard {10};
+    KnownTxnFilter filter { maxPerShard };
+    const std::vector<uint256> txids { MakeTxids(1000) };
+    filter.Insert(txids, filter.GetGeneration());
+    BOOST_CHECK_EQUAL(filter.Size(), maxPerShard * KnownTxnFilter::NUM_SHARDS);
+
+    // The newest are definitely still there
+    BOOST_CHECK(filter.Contains(txids.back()));
+    std::vector<bool> known { filter.Contains(txids) };
+    BOOST_CHECK_EQUAL(std::count(known.begin(), known.end(), true), static_cast<long>(filter.Size()));
+}
+
+BOOST_AUTO_TEST_CASE(concurrent)
+{
+    KnownTxnFilter filter {};
+    constexpr size_t numThreads {4};
+    std::vector<std::vector<uint256>> txids {};
+    for(size_t i = 0; i < numThreads; ++i)
+    {
+        txids.push_back(MakeTxids(2000));
+    }
+
+    std::vector<std::thread> threads {};
+    for(size_t i = 0; i < numThreads; ++i)
+    {
+        threads.emplace_back([&filter, &txids, i]() {
+            for(size_t j = 0; j < txids[i].size(); j += 100)
+            {
+                std::vector<uint256> batch { txids[i].begin() + j, txids[i].begin() + j + 100 };
+                filter.Contains(batch);
+                filter.Insert(batch, filter.GetGeneration());
+            }
+        });
+    }
+    for(std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    BOOST_CHECK_EQUAL(filter.Size(), numThreads * 2000);
+    for(const auto& batch : txids)
+    {
+        std::vector<bool> known { filter.Contains(batch) };
+        BOOST_CHECK(std::all_of(known.begin(), known.end(), [](bool b) { return b; }));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 
+#include "consensus/merkle.h"
 #include "mining/candidates.h"
 #include "test/test_novobitcoin.h"
 
@@ -58,4 +59,159 @@ BOOST_AUTO_TEST_CASE(add_remove_candidates) {
     BOOST_CHECK(manager.Get(fiftythird)==nullptr);
 }
 
+BOOST_AUTO_TEST_CASE(incremental_merkle_proof) {
+    // Distinct transactions, the first one is the coinbase
+    std::vector<CTransactionRef> txns {};
+    for(uint32_t i = 0; i < 100; i++) {
+        CMutableTransaction tx {};
+        tx.nLockTime = i;
+        txns.push_back(MakeTransactionRef(std::move(tx)));
+    }
+
+    CMiningCandidateManager manager;
+    auto checkProof = [&manager](const std::vector<CTransactionRef>& vtx) {
+        CBlockRef block { std::make_shared<CBlock>() };
+        block->vtx = vtx;
+        std::vector<uint256> leaves {};
+        for(const auto& tx : vtx) {
+            leaves.push_back(tx->GetHash());
+        }
+        std::vector<uint256> expected { ComputeMerkleBranch(leaves, 0) };
+
+        CMiningCandidateRef candidate { manager.Create(block) };
+        BOOST_CHECK(candidate->GetMerkleProof() == expected);
+        // Another candidate from the same block has the same proof
+        BOOST_CHECK(manager.Create(block)->GetMerkleProof() == expected);
+    };
+
+    // Append transactions one at a time, then in batches
+    std::vector<CTransactionRef> vtx { txns[0] };
+    for(size_t i = 1; i < 20; i++) {
+        checkProof(vtx);
+        vtx.push_back(txns[i]);
+    }
+    for(size_t i = 20; i < 100; i += 7) {
+        checkProof(vtx);
+        vtx.insert(vtx.end(), txns.begin() + i, txns.begin() + std::min<size_t>(i + 7, 100));
+    }
+    checkProof(vtx);
+
+    // A different coinbase does not change the proof
+    CMutableTransaction coinbase {};
+    coinbase.nLockTime = 1000;
+    vtx[0] = MakeTransactionRef(std::move(coinbase));
+    checkProof(vtx);
+
+    // Replace a transaction in the middle, drop some from the end
+    vtx[37] = txns[99];
+    checkProof(vtx);
+    vtx.resize(64);
+    checkProof(vtx);
+    vtx.resize(33);
+    checkProof(vtx);
+
+    // Start over with a new block
+    vtx = { txns[0], txns[5], txns[3] };
+    checkProof(vtx);
+    vtx.resize(1);
+    checkProof(vtx);
+}
+
+BOOST_AUTO_TEST_CASE(shared_blocks) {
+    std::vector<CTransactionRef> txns {};
+    for(uint32_t i = 0; i < 10; i++) {
+        CMutableTransaction tx {};
+        tx.nLockTime = i;
+        txns.push_back(MakeTransactionRef(std::move(tx)));
+    }
+    auto makeBlock = [&txns](uint32_t coinbaseLockTime, size_t numTxns, uint32_t time) {
+        CBlockRef block { std::make_shared<CBlock>() };
+        CMutableTransaction coinbase {};
+        coinbase.nLockTime = 1000 + coinbaseLockTime;
+        coinbase.vout.resize(1);
+        block->vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+        block->vtx.insert(block->vtx.end(), txns.begin(), txns.begin() + numTxns);
+        block->nTime = time;
+        return block;
+    };
+
+    CMiningCandidateManager manager;
+    CBlockRef block1 { makeBlock(1, 5, 100) };
+    CMiningCandidateRef candidate1 { manager.Create(block1) };
+    uint64_t memory { manager.GetMemoryUsage() };
+
+    // A new block with the same transactions shares the first block, but keeps its own coinbase and header fields
+    CBlockRef block2 { makeBlock(2, 5, 200) };
+    CMiningCandidateRef candidate2 { manager.Create(block2) };
+    BOOST_CHECK(candidate2->GetBlock() == block1);
+    BOOST_CHECK(candidate2->GetBlockCoinbase() == block2->vtx[0]);
+    BOOST_CHECK_EQUAL(candidate2->GetBlockTime(), 200U);
+    BOOST_CHECK_EQUAL(candidate1->GetBlockTime(), 100U);
+    BOOST_CHECK_EQUAL(manager.GetBlockCount(), 1U);
+    // Only the candidate itself costs more memory
+    BOOST_CHECK_LT(manager.GetMemoryUsage() - memory, memory);
+
+    // More transactions need a new block
+    CBlockRef block3 { makeBlock(3, 8, 300) };
+    CMiningCandidateRef candidate3 { manager.Create(block3) };
+    BOOST_CHECK(candidate3->GetBlock() == block3);
+    BOOST_CHECK_EQUAL(manager.GetBlockCount(), 2U);
+
+    // Memory is released with the last candidate of a block
+    manager.Remove(candidate1->GetId());
+    BOOST_CHECK_EQUAL(manager.GetBlockCount(), 2U);
+    manager.Remove(candidate2->GetId());
+    BOOST_CHECK_EQUAL(manager.GetBlockCount(), 1U);
+    manager.Remove(candidate3->GetId());
+    BOOST_CHECK_EQUAL(manager.GetBlockCount(), 0U);
+    BOOST_CHECK_EQUAL(manager.GetMemoryUsage(), 0U);
+    BOOST_CHECK_EQUAL(manager.GetEvictedCount(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(evict_least_recently_used) {
+    std::vector<CBlockRef> blocks {};
+    for(uint32_t i = 0; i < 10; i++) {
+        CBlockRef block { std::make_shared<CBlock>() };
+        CMutableTransaction coinbase {};
+        coinbase.nLockTime = i;
+        block->vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+        // A different previous block for each, so no block is shared
+        block->hashPrevBlock = InsecureRand256();
+        blocks.push_back(block);
+    }
+
+    // Find out how much a candidate takes and allow for 4 of them
+    uint64_t candidateMemory {0};
+    {
+        CMiningCandidateManager manager;
+        manager.Create(blocks[0]);
+        candidateMemory = manager.GetMemoryUsage();
+    }
+    CMiningCandidateManager manager { 4 * candidateMemory };
+
+    std::vector<MiningCandidateId> ids {};
+    for(size_t i = 0; i < 4; i++) {
+        ids.push_back(manager.Create(blocks[i])->GetId());
+    }
+    BOOST_CHECK_EQUAL(manager.Size(), 4U);
+    BOOST_CHECK_EQUAL(manager.GetEvictedCount(), 0U);
+
+    // Using the oldest candidate keeps it, the next oldest is evicted instead
+    BOOST_CHECK(manager.Get(ids[0]) != nullptr);
+    ids.push_back(manager.Create(blocks[4])->GetId());
+    BOOST_CHECK_EQUAL(manager.Size(), 4U);
+    BOOST_CHECK_EQUAL(manager.GetEvictedCount(), 1U);
+    BOOST_CHECK(manager.Get(ids[0]) != nullptr);
+    BOOST_CHECK(manager.Get(ids[1]) == nullptr);
+    BOOST_CHECK_LE(manager.GetMemoryUsage(), manager.GetMaxMemory());
+
+    // The newest candidate is kept even if it does not fit on its own
+    CMiningCandidateManager tiny { 1 };
+    MiningCandidateId id1 { tiny.Create(blocks[5])->GetId() };
+    MiningCandidateId id2 { tiny.Create(blocks[6])->GetId() };
+    BOOST_CHECK_EQUAL(tiny.Size(), 1U);
+    BOOST_CHECK(tiny.Get(id1) == nullptr);
+    BOOST_CHECK(tiny.Get(id2) != nullptr);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
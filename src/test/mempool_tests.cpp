@@ -782,4 +782,43 @@ BOOST_AUTO_TEST_CASE(ReorgWithTransactionsOnDisk)
     BOOST_CHECK(testPoolAccess.CheckMempoolTxDB());
 }
 
+BOOST_AUTO_TEST_CASE(MemoryUsageBreakdown)
+{
+    CTxMemPool testPool;
+    CTxMemPoolTestAccess testPoolAccess{testPool};
+
+    const auto entries = GetABunchOfEntries(37, 33000);
+    uint64_t halfSize = 0;
+    for (auto& e : entries)
+    {
+        testPool.AddUnchecked(e.GetTxId(), e, TxStorage::memory, nullChangeSet);
+        if (testPool.Size() <= entries.size() / 2)
+        {
+            halfSize += e.GetTxSize();
+        }
+    }
+    testPool.SaveTxsToDisk(halfSize);
+    testPoolAccess.SyncWithMempoolTxDB();
+
+    // The index and transaction parts add up to the total usage.
+    auto usage = testPool.GetMemoryUsage();
+    BOOST_CHECK_EQUAL(usage.txInMemory.count + usage.txOnDisk.count, entries.size());
+    BOOST_CHECK_EQUAL(usage.txOnDisk.count, testPool.GetDiskTxCount());
+    BOOST_CHECK_EQUAL(usage.mapTx + usage.mapNextTx + usage.mapLinks + usage.mapDeltas
+                      + usage.txInMemory.usage + usage.txOnDisk.usage,
+                      testPool.DynamicMemoryUsage());
+    BOOST_CHECK(!usage.audit.has_value());
+
+    // The audit measures the indexes.
+    testPool.SetMemoryAudit(true);
+    usage = testPool.GetMemoryUsage();
+    BOOST_REQUIRE(usage.audit.has_value());
+    BOOST_CHECK_GT(usage.audit->mapTx, 0);
+    BOOST_CHECK_GT(usage.audit->mapNextTx, 0);
+    BOOST_CHECK_GT(usage.audit->mapLinks, 0);
+    BOOST_TEST_MESSAGE("mapTx estimate " << usage.mapTx << ", audit " << usage.audit->mapTx);
+    BOOST_TEST_MESSAGE("mapNextTx estimate " << usage.mapNextTx << ", audit " << usage.audit->mapNextTx);
+    BOOST_TEST_MESSAGE("mapLinks estimate " << usage.mapLinks << ", audit " << usage.audit->mapLinks);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -254,6 +254,182 @@ BOOST_AUTO_TEST_CASE(GetContentsOfTxDB)
     BOOST_CHECK_EQUAL(keys.size(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(ReopenTxLog)
+{
+    const auto entries = GetABunchOfEntries(31);
+    const auto logPath = GetDataDir() / "test-txlog";
+    std::vector<TxId> removed;
+    for (size_t i = 0; i < entries.size(); i += 3)
+    {
+        removed.emplace_back(entries[i].GetTxId());
+    }
+
+    {
+        // Small segments, so that the log is split across several files.
+        CMempoolTxLog txlog{logPath, false, true, 1000};
+        for (const auto& e : entries)
+        {
+            BOOST_CHECK(txlog.Write({e.GetSharedTx()}, {}));
+        }
+        BOOST_CHECK(txlog.Write({}, removed));
+        BOOST_CHECK_GT(txlog.GetSegmentCount(), 1);
+    }
+
+    // Append a partial record to the last segment.
+    std::vector<fs::path> segmentFiles;
+    for (fs::directory_iterator it{logPath}; it != fs::directory_iterator{}; ++it)
+    {
+        segmentFiles.push_back(it->path());
+    }
+    std::sort(segmentFiles.begin(), segmentFiles.end());
+    {
+        UniqueCFile file {fsbridge::fopen(segmentFiles.back(), "ab")};
+        BOOST_REQUIRE(file);
+        const char garbage[] {'T', 1, 2, 3};
+        BOOST_CHECK_EQUAL(std::fwrite(garbage, 1, sizeof(garbage), file.get()), sizeof(garbage));
+    }
+
+    CMempoolTxLog txlog{logPath, false, false, 1000};
+    BOOST_CHECK_EQUAL(txlog.GetTxCount(), entries.size() - removed.size());
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        CTransactionRef tx;
+        if (i % 3 == 0)
+        {
+            BOOST_CHECK(!txlog.Read(entries[i].GetTxId(), tx));
+        }
+        else
+        {
+            BOOST_CHECK(txlog.Read(entries[i].GetTxId(), tx));
+            BOOST_CHECK(tx && tx->GetId() == entries[i].GetTxId());
+        }
+    }
+
+    // The partial record is gone and new records can be appended.
+    BOOST_CHECK(txlog.Write({entries[0].GetSharedTx()}, {}));
+    BOOST_CHECK(txlog.Exists(entries[0].GetTxId()));
+}
+
+BOOST_AUTO_TEST_CASE(CollectTxLogGarbage)
+{
+    const auto entries = GetABunchOfEntries(40);
+
+    CMempoolTxLog txlog{GetDataDir() / "test-txlog", true, true, 1000};
+    for (const auto& e : entries)
+    {
+        BOOST_CHECK(txlog.Write({e.GetSharedTx()}, {}));
+    }
+    const auto segmentCount = txlog.GetSegmentCount();
+    BOOST_CHECK_GT(segmentCount, 3);
+    BOOST_CHECK_EQUAL(txlog.CollectGarbage(), 0);
+
+    // Remove all but every tenth transaction.
+    std::vector<TxId> removed;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        if (i % 10 != 0)
+        {
+            removed.emplace_back(entries[i].GetTxId());
+        }
+    }
+    BOOST_CHECK(txlog.Write({}, removed));
+    const auto liveSize = txlog.GetLiveSize();
+    const auto logSize = txlog.GetLogSize();
+
+    // Sparse segments are removed and their live transactions are kept.
+    BOOST_CHECK_GT(txlog.CollectGarbage(), 0);
+    BOOST_CHECK_LT(txlog.GetLogSize(), logSize);
+    BOOST_CHECK_EQUAL(txlog.GetLiveSize(), liveSize);
+    BOOST_CHECK_EQUAL(txlog.GetTxCount(), entries.size() - removed.size());
+    for (size_t i = 0; i < entries.size(); i += 10)
+    {
+        CTransactionRef tx;
+        BOOST_CHECK(txlog.Read(entries[i].GetTxId(), tx));
+        BOOST_CHECK(tx && tx->GetId() == entries[i].GetTxId());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CollectTxLogGarbageAboveLimit)
+{
+    const auto entries = GetABunchOfEntries(60);
+    const auto logPath = GetDataDir() / "test-txlog";
+
+    // Transactions that stay in the first segment, except the first one.
+    size_t firstSegmentEnd = 0;
+    {
+        CMempoolTxLog txlog{logPath, false, true, 1000};
+        while (txlog.GetSegmentCount() < 2)
+        {
+            BOOST_CHECK(txlog.Write({entries[firstSegmentEnd++].GetSharedTx()}, {}));
+        }
+        --firstSegmentEnd;
+        BOOST_REQUIRE_GT(firstSegmentEnd, 1);
+
+        // The tombstone lands in a newer segment that is collected below.
+        BOOST_CHECK(txlog.Write({}, {entries[0].GetTxId()}));
+        std::vector<TxId> removed;
+        for (size_t i = firstSegmentEnd; i < entries.size(); ++i)
+        {
+            BOOST_CHECK(txlog.Write({entries[i].GetSharedTx()}, {}));
+            removed.emplace_back(entries[i].GetTxId());
+        }
+        BOOST_CHECK(txlog.Write({}, removed));
+        BOOST_CHECK_GT(txlog.GetSegmentCount(), 3);
+
+        // Nothing is collected until the dead records take more than allowed.
+        const auto logSize = txlog.GetLogSize();
+        const auto deadSize = txlog.GetDeadSize();
+        BOOST_CHECK_GT(deadSize, 0);
+        BOOST_CHECK_EQUAL(txlog.CollectGarbage(deadSize), 0);
+        BOOST_CHECK_EQUAL(txlog.GetLogSize(), logSize);
+
+        // Then segments are compacted until there's room for as much dead
+        // space again. The mostly live old segment doesn't stop the newer
+        // dead ones from being collected.
+        BOOST_CHECK_GT(txlog.CollectGarbage(deadSize - 1), 0);
+        BOOST_CHECK_LT(txlog.GetLogSize(), logSize);
+        BOOST_CHECK_LE(txlog.GetDeadSize(), (deadSize - 1) / 2);
+        BOOST_CHECK_EQUAL(txlog.GetTxCount(), firstSegmentEnd - 1);
+    }
+
+    // The removed transaction stays removed after replaying what is left.
+    CMempoolTxLog txlog{logPath, false, false, 1000};
+    BOOST_CHECK_EQUAL(txlog.GetTxCount(), firstSegmentEnd - 1);
+    CTransactionRef tx;
+    BOOST_CHECK(!txlog.Read(entries[0].GetTxId(), tx));
+    for (size_t i = 1; i < firstSegmentEnd; ++i)
+    {
+        BOOST_CHECK(txlog.Read(entries[i].GetTxId(), tx));
+        BOOST_CHECK(tx && tx->GetId() == entries[i].GetTxId());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(LogSizeIncludesDeadRecords)
+{
+    const auto entries = GetABunchOfEntries(10);
+
+    CMempoolTxDB txdb{GetDataDir() / "test-txdb", 10000, true, true};
+    std::vector<CTransactionRef> txs;
+    std::vector<CMempoolTxDB::TxData> txData;
+    for (const auto& e : entries)
+    {
+        txs.emplace_back(e.GetSharedTx());
+        txData.emplace_back(e.GetTxId(), e.GetTxSize());
+    }
+    BOOST_CHECK(txdb.AddTransactions(txs));
+    BOOST_CHECK_EQUAL(txdb.GetDiskUsage(), totalSize(entries));
+    BOOST_CHECK_GT(txdb.GetLogSize(), totalSize(entries));
+
+    // The removed records still take space until they are collected, and a
+    // few of them aren't worth compacting the log for.
+    const auto logSize = txdb.GetLogSize();
+    BOOST_CHECK(txdb.RemoveTransactions(txData));
+    BOOST_CHECK_EQUAL(txdb.GetDiskUsage(), 0);
+    BOOST_CHECK_GT(txdb.GetLogSize(), logSize);
+    BOOST_CHECK_EQUAL(txdb.CollectGarbage(), 0);
+    BOOST_CHECK_GT(txdb.GetLogSize(), logSize);
+}
+
 BOOST_AUTO_TEST_CASE(GetSetXrefKey)
 {
     boost::uuids::random_generator gen;
@@ -463,6 +639,63 @@ BOOST_AUTO_TEST_CASE(AsyncDeleteFromTxDB)
     }
 }
 
+BOOST_AUTO_TEST_CASE(AsyncPrefetchFromTxDB)
+{
+    const auto entries = GetABunchOfEntries(5);
+
+    CAsyncMempoolTxDB txdb{GetDataDir() / "test-txdb", 10000, true};
+
+    // Write copies of the transactions to the database so that nothing else
+    // holds a reference to them once they are on disk.
+    std::vector<CTransactionWrapperRef> wrappers;
+    for (const auto& e : entries)
+    {
+        const auto tx = std::make_shared<CTransaction>(*e.GetSharedTx());
+        wrappers.push_back(std::make_shared<CTransactionWrapper>(tx, txdb.GetDatabase()));
+        txdb.Add(CTransactionWrapperRef{wrappers.back()});
+    }
+    txdb.Sync();
+    BOOST_CHECK_EQUAL(txdb.GetTxCount(), entries.size());
+
+    // Read the transactions back and then remove them from the database; the
+    // wrappers must still be able to return them.
+    txdb.Prefetch(std::vector<CTransactionWrapperRef>{wrappers});
+    for (const auto& e : entries)
+    {
+        txdb.Remove({e.GetTxId(), e.GetTxSize()});
+    }
+    txdb.Sync();
+    BOOST_CHECK_EQUAL(txdb.GetTxCount(), 0);
+
+    // The copies are accounted for until they are used or dropped.
+    const auto& reader = txdb.GetDatabase();
+    size_t prefetchedUsage = 0;
+    for (const auto& e : entries)
+    {
+        prefetchedUsage += e.DynamicMemoryUsage();
+    }
+    BOOST_CHECK_EQUAL(reader->GetPrefetchedUsage(), prefetchedUsage);
+    const size_t dropped = wrappers.back()->DropPrefetched();
+    BOOST_CHECK_EQUAL(dropped, entries.back().DynamicMemoryUsage());
+    BOOST_CHECK_EQUAL(wrappers.back()->DropPrefetched(), 0U);
+    wrappers.pop_back();
+
+    for (const auto& wrapper : wrappers)
+    {
+        BOOST_CHECK(!wrapper->IsInMemory());
+        const auto tx = wrapper->GetTx();
+        BOOST_REQUIRE(tx != nullptr);
+        BOOST_CHECK(tx->GetId() == wrapper->GetId());
+    }
+
+    // The prefetched copy was handed over to the first caller.
+    for (const auto& wrapper : wrappers)
+    {
+        BOOST_CHECK(wrapper->GetTx() == nullptr);
+    }
+    BOOST_CHECK_EQUAL(reader->GetPrefetchedUsage(), 0U);
+}
+
 BOOST_AUTO_TEST_CASE(AsyncClearDB)
 {
     const auto entries = GetABunchOfEntries(17);
@@ -690,6 +923,54 @@ BOOST_AUTO_TEST_CASE(SaveOnFullMempool)
     BOOST_CHECK(testPoolAccess.CheckMempoolTxDB());
 }
 
+BOOST_AUTO_TEST_CASE(SaveColdTxsToDiskFirst)
+{
+    TestMemPoolEntryHelper entry;
+    std::vector<CTxMemPoolEntry> entries;
+    for (int i = 0; i < 4; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].scriptSig = CScript() << OP_11;
+        mtx.vout.resize(1);
+        mtx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        mtx.vout[0].nValue = Amount{33000LL + i};
+        entries.emplace_back(entry.Fee(Amount{10000}).Time(i).FromTx(mtx));
+    }
+
+    CTxMemPool testPool;
+    CTxMemPoolTestAccess testPoolAccess(testPool);
+    for (auto& e : entries) {
+        testPool.AddUnchecked(e.GetTxId(), e, TxStorage::memory, nullChangeSet);
+    }
+    const auto isInMemory = [&testPoolAccess](const CTxMemPoolEntry& e) {
+        return testPoolAccess.mapTx().find(e.GetTxId())->IsInMemory();
+    };
+
+    // All transactions are new, so the oldest one is written out.
+    testPool.SaveTxsToDisk(entries[0].GetTxSize());
+    testPoolAccess.SyncWithMempoolTxDB();
+    BOOST_CHECK(!isInMemory(entries[0]));
+    BOOST_CHECK(isInMemory(entries[1]));
+
+    // A transaction that has been used since is skipped in favour of a cold one.
+    BOOST_CHECK(testPool.Get(entries[1].GetTxId()) != nullptr);
+    testPool.SaveTxsToDisk(entries[2].GetTxSize());
+    testPoolAccess.SyncWithMempoolTxDB();
+    BOOST_CHECK(isInMemory(entries[1]));
+    BOOST_CHECK(!isInMemory(entries[2]));
+    BOOST_CHECK(isInMemory(entries[3]));
+
+    // Used transactions still go to disk when there is nothing else left.
+    BOOST_CHECK(testPool.Get(entries[3].GetTxId()) != nullptr);
+    testPool.SaveTxsToDisk(totalSize(entries));
+    testPoolAccess.SyncWithMempoolTxDB();
+    for (const auto& e : entries) {
+        BOOST_CHECK(!isInMemory(e));
+    }
+    BOOST_CHECK_EQUAL(testPool.GetDiskTxCount(), entries.size());
+    BOOST_CHECK(testPoolAccess.CheckMempoolTxDB());
+}
+
 BOOST_AUTO_TEST_CASE(RemoveFromDiskOnMempoolTrim)
 {
     const auto entries = GetABunchOfEntries(6);
@@ -827,6 +827,12 @@ void Test_CreateNewBlock_JBA_Config(TestingSetup& testingSetup)
     // CreateNewBlock will finish processing and including everything in the journal
     BOOST_CHECK(pblocktemplate = mining::g_miningFactory->GetAssembler()->CreateNewBlock(scriptPubKey, pindexPrev));
     BOOST_CHECK_EQUAL(pblocktemplate->GetBlockRef()->vtx.size(), NUM_TXNS + 1);
+
+    // Transactions checked in parallel are still added in journal order
+    const auto& vtx = pblocktemplate->GetBlockRef()->vtx;
+    for (size_t i = 2; i < vtx.size(); ++i) {
+        BOOST_CHECK(vtx[i]->vin[0].prevout.GetTxId() == vtx[i - 1]->GetId());
+    }
 }
 
 
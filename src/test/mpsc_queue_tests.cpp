@@ -0,0 +1,95 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#include <mpsc_queue.h>
+#include <test/test_novobitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <memory>
+#include <thread>
+
+BOOST_FIXTURE_TEST_SUITE(mpsc_queue_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(order)
+{
+    MPSCQueue<int> queue {};
+    BOOST_CHECK(queue.Empty());
+    BOOST_CHECK_EQUAL(queue.Size(), 0U);
+
+    // Only the first push is onto an empty queue
+    BOOST_CHECK(queue.Push(1));
+    BOOST_CHECK(!queue.Push(2));
+    BOOST_CHECK(!queue.Push(3));
+    BOOST_CHECK(!queue.Empty());
+    BOOST_CHECK_EQUAL(queue.Size(), 3U);
+
+    // Items come out in the order they went in, after anything already there
+    std::vector<int> items { 0 };
+    queue.PopAll(items);
+    BOOST_CHECK(items == std::vector<int>({ 0, 1, 2, 3 }));
+    BOOST_CHECK(queue.Empty());
+    BOOST_CHECK_EQUAL(queue.Size(), 0U);
+
+    queue.PopAll(items);
+    BOOST_CHECK_EQUAL(items.size(), 4U);
+    BOOST_CHECK(queue.Push(4));
+}
+
+BOOST_AUTO_TEST_CASE(move_only)
+{
+    MPSCQueue<std::unique_ptr<int>> queue {};
+    queue.Push(std::make_unique<int>(1));
+    queue.Push(std::make_unique<int>(2));
+
+    std::vector<std::unique_ptr<int>> items {};
+    queue.PopAll(items);
+    BOOST_REQUIRE_EQUAL(items.size(), 2U);
+    BOOST_CHECK_EQUAL(*items[0], 1);
+    BOOST_CHECK_EQUAL(*items[1], 2);
+
+    // Anything left is freed with the queue
+    queue.Push(std::make_unique<int>(3));
+}
+
+BOOST_AUTO_TEST_CASE(multiple_producers)
+{
+    MPSCQueue<std::pair<size_t, size_t>> queue {};
+    constexpr size_t numProducers {4};
+    constexpr size_t numItems {10000};
+
+    std::vector<std::thread> producers {};
+    for(size_t producer = 0; producer < numProducers; ++producer)
+    {
+        producers.emplace_back([&queue, producer]() {
+            for(size_t i = 0; i < numItems; ++i)
+            {
+                queue.Push(std::make_pair(producer, i));
+            }
+        });
+    }
+
+    // Consume while they're producing
+    std::vector<std::pair<size_t, size_t>> items {};
+    while(items.size() < numProducers * numItems)
+    {
+        queue.PopAll(items);
+    }
+    for(std::thread& producer : producers)
+    {
+        producer.join();
+    }
+    BOOST_CHECK(queue.Empty());
+
+    // Each producer's items arrived in the order it pushed them
+    std::vector<size_t> next(numProducers, 0);
+    for(const auto& [producer, i] : items)
+    {
+        BOOST_CHECK_EQUAL(i, next[producer]);
+        next[producer] = i + 1;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,100 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#include <net/net_msg_stats.h>
+#include <protocol.h>
+#include <test/test_novobitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <thread>
+
+using namespace std::chrono_literals;
+
+BOOST_FIXTURE_TEST_SUITE(net_msg_stats_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(buckets)
+{
+    BOOST_CHECK_EQUAL(NetMsgStats::GetBucket(0), 0U);
+    BOOST_CHECK_EQUAL(NetMsgStats::GetBucket(1), 1U);
+    BOOST_CHECK_EQUAL(NetMsgStats::GetBucket(2), 2U);
+    BOOST_CHECK_EQUAL(NetMsgStats::GetBucket(3), 2U);
+    BOOST_CHECK_EQUAL(NetMsgStats::GetBucket(1023), 10U);
+    BOOST_CHECK_EQUAL(NetMsgStats::GetBucket(1024), 11U);
+}
+
+BOOST_AUTO_TEST_CASE(record)
+{
+    NetMsgStats stats {};
+    BOOST_CHECK(stats.GetSnapshot().empty());
+
+    stats.Record(NetMsgType::PING, 10us, 1us, 8);
+    stats.Record(NetMsgType::PING, 20us, 0us, 8);
+    stats.Record(NetMsgType::TX, 1000us, 500us, 250);
+    // Clock going backwards
+    stats.Record(NetMsgType::TX, -5us, 2us, 250);
+    // Unknown commands are lumped together
+    stats.Record("unknown1", 1us, 1us, 1);
+    stats.Record("unknown2", 1us, 1us, 1);
+    // Too big for the histogram
+    stats.Record(NetMsgType::BLOCK, 0us, 0us, uint64_t{1} << NetMsgStats::NUM_BUCKETS);
+
+    const NetMsgStats::Snapshot snapshot { stats.GetSnapshot() };
+    BOOST_CHECK_EQUAL(snapshot.size(), 4U);
+
+    const NetMsgStats::CommandStats& ping { snapshot.at(NetMsgType::PING) };
+    BOOST_CHECK_EQUAL(ping.count, 2U);
+    BOOST_CHECK_EQUAL(ping.totalQueueWait, 30U);
+    BOOST_CHECK_EQUAL(ping.totalProcessTime, 1U);
+    BOOST_CHECK_EQUAL(ping.totalBytes, 16U);
+    BOOST_CHECK_EQUAL(ping.queueWait[NetMsgStats::GetBucket(10)], 1U);
+    BOOST_CHECK_EQUAL(ping.queueWait[NetMsgStats::GetBucket(20)], 1U);
+    BOOST_CHECK_EQUAL(ping.processTime[0], 1U);
+    BOOST_CHECK_EQUAL(ping.processTime[1], 1U);
+    BOOST_CHECK_EQUAL(ping.bytes[NetMsgStats::GetBucket(8)], 2U);
+
+    const NetMsgStats::CommandStats& tx { snapshot.at(NetMsgType::TX) };
+    BOOST_CHECK_EQUAL(tx.count, 2U);
+    BOOST_CHECK_EQUAL(tx.totalQueueWait, 1000U);
+    BOOST_CHECK_EQUAL(tx.queueWait[0], 1U);
+
+    BOOST_CHECK_EQUAL(snapshot.at("*other*").count, 2U);
+
+    const NetMsgStats::CommandStats& block { snapshot.at(NetMsgType::BLOCK) };
+    BOOST_CHECK_EQUAL(block.bytes[NetMsgStats::NUM_BUCKETS], 1U);
+}
+
+BOOST_AUTO_TEST_CASE(global)
+{
+    // Take what's already there into account, in case other tests added some
+    const auto countPongs = []() {
+        const NetMsgStats::Snapshot snapshot { GlobalNetMsgStats::GetSnapshot() };
+        const auto it { snapshot.find(NetMsgType::PONG) };
+        return it == snapshot.end() ? uint64_t{0} : it->second.count;
+    };
+    const uint64_t initialCount { countPongs() };
+
+    // Stats from several threads are combined, and outlive the threads
+    constexpr size_t numThreads {4};
+    constexpr size_t numMsgs {1000};
+    std::vector<std::thread> threads {};
+    for(size_t i = 0; i < numThreads; ++i)
+    {
+        threads.emplace_back([]() {
+            for(size_t j = 0; j < numMsgs; ++j)
+            {
+                GlobalNetMsgStats::Record(NetMsgType::PONG, 1us, 1us, 8);
+            }
+        });
+    }
+    for(std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    BOOST_CHECK_EQUAL(countPongs(), initialCount + numThreads * numMsgs);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,147 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#include <config.h>
+#include <net/net_message.h>
+#include <net/recv_buffer_pool.h>
+#include <test/test_novobitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+    // Serialised header for a message with the given payload
+    std::vector<char> MakeHeader(const std::vector<char>& payload)
+    {
+        CMessageHeader hdr { Params().NetMagic(), NetMsgType::BLOCK, static_cast<unsigned int>(payload.size()) };
+        uint256 hash { Hash(payload.begin(), payload.end()) };
+        memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+
+        CDataStream stream { SER_NETWORK, INIT_PROTO_VERSION };
+        stream << hdr;
+        return { stream.begin(), stream.end() };
+    }
+
+    std::vector<char> MakePayload(size_t size)
+    {
+        std::vector<char> payload(size);
+        for(size_t i = 0; i < size; ++i)
+        {
+            payload[i] = static_cast<char>(i * 13);
+        }
+        return payload;
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(recv_buffer_pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(size_classes)
+{
+    RecvBufferPool pool {};
+
+    // New buffers get the whole size class
+    RecvBufferPool::Buffer buffer { pool.Get(10) };
+    BOOST_CHECK(buffer.empty());
+    BOOST_CHECK_EQUAL(buffer.capacity(), RecvBufferPool::MIN_POOLED_SIZE);
+    buffer = pool.Get(3000);
+    BOOST_CHECK_EQUAL(buffer.capacity(), 4096U);
+
+    // Released buffers are reused for the same size class
+    buffer.resize(100);
+    const char* data { buffer.data() };
+    pool.Release(std::move(buffer));
+    BOOST_CHECK_EQUAL(pool.GetPooledBytes(), 4096U);
+    buffer = pool.Get(2049);
+    BOOST_CHECK_EQUAL(buffer.data(), data);
+    BOOST_CHECK(buffer.empty());
+    BOOST_CHECK_EQUAL(pool.GetPooledBytes(), 0U);
+
+    // Buffers that grew are pooled in the class they can still satisfy
+    buffer.reserve(6000);
+    pool.Release(std::move(buffer));
+    BOOST_CHECK_EQUAL(pool.Get(4096).capacity(), 6000U);
+    BOOST_CHECK_EQUAL(pool.Get(4097).capacity(), 8192U);
+
+    // Too small or large buffers aren't pooled
+    buffer = {};
+    buffer.reserve(100);
+    pool.Release(std::move(buffer));
+    buffer = pool.Get(RecvBufferPool::MAX_POOLED_SIZE + 1);
+    BOOST_CHECK_EQUAL(buffer.capacity(), RecvBufferPool::MAX_POOLED_SIZE + 1);
+    pool.Release(std::move(buffer));
+    BOOST_CHECK_EQUAL(pool.GetPooledBytes(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(bounded)
+{
+    RecvBufferPool pool {};
+
+    // Only so much memory is kept in each class
+    for(size_t i = 0; i < 10; ++i)
+    {
+        RecvBufferPool::Buffer buffer {};
+        buffer.reserve(RecvBufferPool::MAX_POOLED_SIZE);
+        pool.Release(std::move(buffer));
+    }
+    BOOST_CHECK_EQUAL(pool.GetPooledBytes(), RecvBufferPool::MAX_POOLED_BYTES_PER_CLASS);
+
+    for(size_t i = 0; i < 10000; ++i)
+    {
+        RecvBufferPool::Buffer buffer {};
+        buffer.reserve(RecvBufferPool::MIN_POOLED_SIZE);
+        pool.Release(std::move(buffer));
+    }
+    BOOST_CHECK_EQUAL(pool.GetPooledBytes(), 2 * RecvBufferPool::MAX_POOLED_BYTES_PER_CLASS);
+}
+
+BOOST_AUTO_TEST_CASE(net_message_read)
+{
+    GlobalConfig config {};
+    config.SetDefaultBlockSizeParams(Params().GetDefaultBlockSizeParams());
+
+    for(size_t payloadSize : { 0, 100, 5000, 1000000 })
+    {
+        const std::vector<char> payload { MakePayload(payloadSize) };
+        std::vector<char> bytes { MakeHeader(payload) };
+        bytes.insert(bytes.end(), payload.begin(), payload.end());
+
+        // Feed it in in small pieces, the first half copied in and the second
+        // half received directly into the message
+        CNetMessage msg { Params().NetMagic(), SER_NETWORK, INIT_PROTO_VERSION };
+        size_t pos {0};
+        while(!msg.in_data)
+        {
+            int handled { msg.readHeader(config, bytes.data() + pos, 7, config.GetMaxBlockSize()) };
+            BOOST_REQUIRE(handled > 0);
+            pos += handled;
+        }
+        BOOST_CHECK_EQUAL(pos, static_cast<size_t>(CMessageHeader::HEADER_SIZE));
+        BOOST_CHECK_EQUAL(msg.hdr.nPayloadLength, payloadSize);
+
+        while(pos < bytes.size() / 2)
+        {
+            int handled { msg.readData(bytes.data() + pos, 999) };
+            BOOST_REQUIRE(handled > 0);
+            pos += handled;
+        }
+        while(!msg.complete())
+        {
+            auto [space, size] { msg.getDataSpace(10000) };
+            BOOST_REQUIRE(size > 0);
+            uint32_t received { std::min<uint32_t>(size, 4321) };
+            memcpy(space, bytes.data() + pos, received);
+            msg.dataReceived(received);
+            pos += received;
+        }
+
+        BOOST_CHECK_EQUAL(pos, bytes.size());
+        BOOST_CHECK_EQUAL(msg.vRecv.size(), payloadSize);
+        BOOST_CHECK(std::equal(msg.vRecv.begin(), msg.vRecv.end(), payload.begin(), payload.end()));
+        BOOST_CHECK(msg.GetMessageHash() == Hash(payload.begin(), payload.end()));
+        BOOST_CHECK(msg.vRecv.capacity() <= std::max<size_t>(payloadSize, RecvBufferPool::MAX_POOLED_SIZE));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,140 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#include <net/send_scheduler.h>
+#include <test/test_novobitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+    // Queue a message of the given size, with a marker byte so we can
+    // identify it when it's sent
+    void Push(SendScheduler& scheduler, SendPriority priority, uint8_t marker, size_t size)
+    {
+        std::vector<uint8_t> data(size, marker);
+        scheduler.Push(priority, std::make_unique<CVectorStream>(std::move(data)), true);
+    }
+
+    // Send the next item in full, and return its marker
+    std::optional<uint8_t> SendNext(SendScheduler& scheduler)
+    {
+        CForwardAsyncReadonlyStream* data { scheduler.Front() };
+        if(!data)
+        {
+            return std::nullopt;
+        }
+
+        uint64_t size {0};
+        uint8_t marker {0};
+        while(!data->EndOfStream())
+        {
+            CSpan span { data->ReadAsync(1000) };
+            marker = *span.Begin();
+            size += span.Size();
+        }
+        scheduler.Sent(size, true);
+        return marker;
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(send_scheduler_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(priority_order)
+{
+    SendScheduler scheduler {};
+    BOOST_CHECK(scheduler.Empty());
+    BOOST_CHECK(!scheduler.Front());
+
+    Push(scheduler, SendPriority::TXN, 4, 100);
+    Push(scheduler, SendPriority::BLOCK, 3, 100);
+    Push(scheduler, SendPriority::HEADERS, 2, 100);
+    Push(scheduler, SendPriority::CONTROL, 1, 100);
+    BOOST_CHECK(!scheduler.Empty());
+
+    // Highest priority first
+    for(uint8_t expected : { 1, 2, 3, 4 })
+    {
+        BOOST_CHECK_EQUAL(SendNext(scheduler).value(), expected);
+    }
+    BOOST_CHECK(scheduler.Empty());
+    BOOST_CHECK(!SendNext(scheduler));
+}
+
+BOOST_AUTO_TEST_CASE(message_parts_stay_together)
+{
+    SendScheduler scheduler {};
+
+    // Header then payload for a block
+    scheduler.Push(SendPriority::BLOCK, std::make_unique<CVectorStream>(std::vector<uint8_t>(24, 3)), false);
+    scheduler.Push(SendPriority::BLOCK, std::make_unique<CVectorStream>(std::vector<uint8_t>(5000, 3)), true);
+    BOOST_CHECK_EQUAL(SendNext(scheduler).value(), 3);
+
+    // A ping queued now still has to wait for the rest of the block
+    Push(scheduler, SendPriority::CONTROL, 1, 32);
+    CForwardAsyncReadonlyStream* data { scheduler.Front() };
+    BOOST_REQUIRE(data);
+    data->ReadAsync(1000);
+    scheduler.Sent(1000, false);
+    BOOST_CHECK(!scheduler.Stall());
+    BOOST_CHECK(scheduler.Front() == data);
+    data->ReadAsync(4000);
+    scheduler.Sent(4000, true);
+
+    BOOST_CHECK_EQUAL(SendNext(scheduler).value(), 1);
+    BOOST_CHECK(scheduler.Empty());
+}
+
+BOOST_AUTO_TEST_CASE(deficit_round_robin)
+{
+    SendScheduler scheduler {};
+    scheduler.SetQuanta({ 100, 100, 10, 10 });
+
+    // Equal quanta for equal sized messages take turns, despite priority
+    for(size_t i = 0; i < 3; ++i)
+    {
+        Push(scheduler, SendPriority::CONTROL, 1, 100);
+        Push(scheduler, SendPriority::HEADERS, 2, 100);
+    }
+    for(uint8_t expected : { 1, 2, 1, 2, 1, 2 })
+    {
+        BOOST_CHECK_EQUAL(SendNext(scheduler).value(), expected);
+    }
+
+    // A large block uses up 100 rounds worth of credit, so transactions get
+    // to catch up before the next block
+    Push(scheduler, SendPriority::BLOCK, 3, 1000);
+    Push(scheduler, SendPriority::BLOCK, 3, 1000);
+    for(size_t i = 0; i < 200; ++i)
+    {
+        Push(scheduler, SendPriority::TXN, 4, 10);
+    }
+    BOOST_CHECK_EQUAL(SendNext(scheduler).value(), 3);
+    size_t numTxns {0};
+    while(SendNext(scheduler).value() == 4)
+    {
+        ++numTxns;
+    }
+    BOOST_CHECK_EQUAL(numTxns, 100U);
+}
+
+BOOST_AUTO_TEST_CASE(stalled)
+{
+    SendScheduler scheduler {};
+    Push(scheduler, SendPriority::BLOCK, 3, 100);
+    Push(scheduler, SendPriority::TXN, 4, 100);
+
+    // If the block isn't ready yet, the transaction can go first
+    BOOST_REQUIRE(scheduler.Front());
+    BOOST_CHECK(scheduler.Stall());
+    BOOST_CHECK_EQUAL(SendNext(scheduler).value(), 4);
+    BOOST_CHECK(!scheduler.Front());
+
+    scheduler.ClearStalled();
+    BOOST_CHECK_EQUAL(SendNext(scheduler).value(), 3);
+    BOOST_CHECK(scheduler.Empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
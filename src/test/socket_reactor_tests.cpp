@@ -0,0 +1,153 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#include <net/socket_reactor.h>
+#include <test/test_novobitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <optional>
+
+#ifndef WIN32
+
+namespace
+{
+    const std::chrono::milliseconds noWait {0};
+
+    // Find what (if anything) was reported for the given socket
+    std::optional<SocketReactor::Event> FindEvent(const std::vector<SocketReactor::Event>& events, SOCKET socket)
+    {
+        auto it { std::find_if(events.begin(), events.end(),
+            [socket](const SocketReactor::Event& event){ return event.socket == socket; }) };
+        if(it == events.end())
+        {
+            return std::nullopt;
+        }
+        return *it;
+    }
+
+    // Read until we would block
+    void Drain(SOCKET socket)
+    {
+        char buf[256];
+        while(recv(socket, buf, sizeof(buf), MSG_DONTWAIT) > 0) {}
+    }
+
+    struct SocketPair
+    {
+        SocketPair()
+        {
+            BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+        }
+        ~SocketPair()
+        {
+            close(sockets[0]);
+            close(sockets[1]);
+        }
+
+        int sockets[2] {};
+    };
+}
+
+BOOST_FIXTURE_TEST_SUITE(socket_reactor_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(edge_triggered)
+{
+    SocketReactor reactor {};
+    SocketPair pair {};
+    SOCKET ours { pair.sockets[0] };
+    SOCKET theirs { pair.sockets[1] };
+    BOOST_REQUIRE(reactor.Add(ours));
+
+    // A new socket is ready for writing but not reading
+    std::vector<SocketReactor::Event> events {};
+    BOOST_REQUIRE(reactor.Wait(noWait, events));
+    auto event { FindEvent(events, ours) };
+    BOOST_REQUIRE(event);
+    BOOST_CHECK(event->send);
+    BOOST_CHECK(!event->recv);
+
+    // Reported once when there is something to read
+    BOOST_REQUIRE(send(theirs, "ping", 4, 0) == 4);
+    BOOST_REQUIRE(reactor.Wait(noWait, events));
+    event = FindEvent(events, ours);
+    BOOST_REQUIRE(event);
+    BOOST_CHECK(event->recv);
+    BOOST_REQUIRE(reactor.Wait(noWait, events));
+    BOOST_CHECK(!FindEvent(events, ours));
+
+    // And again once we have read everything and more arrives
+    Drain(ours);
+    reactor.Rearm(ours, true, false);
+    BOOST_REQUIRE(send(theirs, "ping", 4, 0) == 4);
+    BOOST_REQUIRE(reactor.Wait(noWait, events));
+    event = FindEvent(events, ours);
+    BOOST_REQUIRE(event);
+    BOOST_CHECK(event->recv);
+
+    // Closing the other end is reported as ready for reading
+    Drain(ours);
+    reactor.Rearm(ours, true, false);
+    shutdown(theirs, SHUT_RDWR);
+    BOOST_REQUIRE(reactor.Wait(noWait, events));
+    event = FindEvent(events, ours);
+    BOOST_REQUIRE(event);
+    BOOST_CHECK(event->recv || event->error);
+}
+
+BOOST_AUTO_TEST_CASE(scheduled)
+{
+    SocketReactor reactor {};
+    SocketPair pair {};
+    SOCKET ours { pair.sockets[0] };
+    BOOST_REQUIRE(reactor.Add(ours));
+
+    std::vector<SocketReactor::Event> events {};
+    BOOST_REQUIRE(reactor.Wait(noWait, events));
+    BOOST_REQUIRE(reactor.Wait(noWait, events));
+    BOOST_CHECK(!FindEvent(events, ours));
+
+    // Scheduled sockets are reported from the next wait only, and only once
+    reactor.Schedule(ours);
+    reactor.Schedule(ours);
+    BOOST_REQUIRE(reactor.Wait(noWait, events));
+    BOOST_CHECK_EQUAL(std::count_if(events.begin(), events.end(),
+        [ours](const SocketReactor::Event& event){ return event.socket == ours; }), 1);
+    auto event { FindEvent(events, ours) };
+    BOOST_REQUIRE(event);
+    BOOST_CHECK(!event->recv && !event->send && !event->error);
+
+    BOOST_REQUIRE(reactor.Wait(noWait, events));
+    BOOST_CHECK(!FindEvent(events, ours));
+}
+
+BOOST_AUTO_TEST_CASE(listening)
+{
+    SocketReactor reactor {};
+    SocketPair pair {};
+    SOCKET listening { pair.sockets[0] };
+    SOCKET theirs { pair.sockets[1] };
+    BOOST_REQUIRE(reactor.AddListening(listening));
+
+    // Level triggered, so reported for as long as it is ready
+    BOOST_REQUIRE(send(theirs, "ping", 4, 0) == 4);
+    std::vector<SocketReactor::Event> events {};
+    for(int i = 0; i < 2; ++i)
+    {
+        BOOST_REQUIRE(reactor.Wait(noWait, events));
+        auto event { FindEvent(events, listening) };
+        BOOST_REQUIRE(event);
+        BOOST_CHECK(event->recv);
+    }
+
+    Drain(listening);
+    BOOST_REQUIRE(reactor.Wait(noWait, events));
+    BOOST_CHECK(!FindEvent(events, listening));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+#endif
@@ -2,6 +2,8 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "file_region_stream.h"
+#include "fs.h"
 #include "streams.h"
 #include "support/allocators/zeroafterfree.h"
 #include "test/test_novobitcoin.h"
@@ -136,4 +138,64 @@ BOOST_AUTO_TEST_CASE(streams_empty_vector) {
     ds.insert(ds.begin(), &adata[0], &adata[6]);
 }
 
+BOOST_AUTO_TEST_CASE(streams_file_region) {
+    // A file with some data either side of the region we want
+    std::vector<uint8_t> data(10000);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<uint8_t>(i * 7);
+    }
+    fs::path path = pathTemp / "file_region";
+    {
+        UniqueCFile file {fsbridge::fopen(path, "wb")};
+        BOOST_REQUIRE(file);
+        BOOST_REQUIRE_EQUAL(fwrite(data.data(), 1, data.size(), file.get()), data.size());
+    }
+    constexpr size_t regionStart = 100;
+    constexpr size_t regionSize = 9000;
+    auto openRegion = [&]() {
+        UniqueCFile file {fsbridge::fopen(path, "rb")};
+        BOOST_REQUIRE(file);
+        BOOST_REQUIRE_EQUAL(fseek(file.get(), regionStart, SEEK_SET), 0);
+        return CFileRegionStream{std::move(file), regionSize};
+    };
+    const std::vector<uint8_t> expected(data.begin() + regionStart, data.begin() + regionStart + regionSize);
+
+    // Read it back
+    {
+        CFileRegionStream stream = openRegion();
+        std::vector<uint8_t> read;
+        while (!stream.EndOfStream()) {
+            CSpan span = stream.ReadAsync(4096);
+            BOOST_REQUIRE(span.Size() > 0);
+            read.insert(read.end(), span.Begin(), span.Begin() + span.Size());
+        }
+        BOOST_CHECK(read == expected);
+        BOOST_CHECK_EQUAL(stream.ReadAsync(4096).Size(), 0U);
+    }
+
+#ifdef USE_SENDFILE
+    // Send it to a socket, mixed with reading some of it
+    {
+        int sockets[2] {};
+        BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+
+        CFileRegionStream stream = openRegion();
+        CSpan span = stream.ReadAsync(1000);
+        std::vector<uint8_t> received(span.Begin(), span.Begin() + span.Size());
+        while (!stream.EndOfStream()) {
+            ssize_t sent = stream.SendTo(sockets[0], 3000);
+            BOOST_REQUIRE(sent > 0);
+            std::vector<uint8_t> buf(sent);
+            BOOST_REQUIRE_EQUAL(recv(sockets[1], buf.data(), buf.size(), MSG_WAITALL), sent);
+            received.insert(received.end(), buf.begin(), buf.end());
+        }
+        BOOST_CHECK(received == expected);
+        BOOST_CHECK_EQUAL(stream.SendTo(sockets[0], 3000), 0);
+
+        close(sockets[0]);
+        close(sockets[1]);
+    }
+#endif
+}
+
 BOOST_AUTO_TEST_SUITE_END()
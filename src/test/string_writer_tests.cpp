@@ -26,6 +26,14 @@ BOOST_AUTO_TEST_CASE(CStringWriter_writestring)
     BOOST_CHECK_EQUAL(strWriter.MoveOutString(), "string");
 }
 
+BOOST_AUTO_TEST_CASE(CStringWriter_writebuffer)
+{
+    const char buffer[] = "buffer";
+    strWriter.Write(buffer, 3);
+
+    BOOST_CHECK_EQUAL(strWriter.MoveOutString(), "buf");
+}
+
 BOOST_AUTO_TEST_CASE(CStringWriter_writestring_withNL)
 {
     strWriter.ReserveAdditional(100);
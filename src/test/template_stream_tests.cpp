@@ -0,0 +1,113 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#include "mining/template_stream.h"
+#include "rpc/jsonwriter.h"
+
+#include "test/test_novobitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <future>
+#include <univalue.h>
+
+using namespace mining;
+
+namespace
+{
+    CTemplateDelta NewDelta(bool reset, size_t numAdded)
+    {
+        static uint64_t txCount {0};
+        CTemplateDelta delta {};
+        delta.reset = reset;
+        if(reset)
+        {
+            txCount = 0;
+        }
+        for(size_t i = 0; i < numAdded; ++i)
+        {
+            delta.added.emplace_back(TxId{InsecureRand256()}, Amount{static_cast<int64_t>(i)});
+        }
+        txCount += numAdded;
+        delta.txCount = txCount;
+        delta.merkleProof.push_back(InsecureRand256());
+        return delta;
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(template_stream, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(sequence_and_resync)
+{
+    CTemplateDeltaStream stream {3};
+    BOOST_CHECK_EQUAL(stream.GetSequence(), 0U);
+    BOOST_CHECK(stream.GetSince(0, std::chrono::milliseconds{0})->empty());
+    // Unknown sequence numbers need a resync
+    BOOST_CHECK(!stream.GetSince(1, std::chrono::milliseconds{0}));
+
+    BOOST_CHECK_EQUAL(stream.Publish(NewDelta(true, 5))->sequence, 1U);
+    BOOST_CHECK_EQUAL(stream.Publish(NewDelta(false, 2))->sequence, 2U);
+    auto deltas { stream.GetSince(0, std::chrono::milliseconds{0}) };
+    BOOST_REQUIRE(deltas);
+    BOOST_REQUIRE_EQUAL(deltas->size(), 2U);
+    BOOST_CHECK((*deltas)[0]->reset);
+    BOOST_CHECK_EQUAL((*deltas)[1]->txCount, 7U);
+    BOOST_CHECK_EQUAL(stream.GetSince(1, std::chrono::milliseconds{0})->size(), 1U);
+    BOOST_CHECK(stream.GetSince(2, std::chrono::milliseconds{0})->empty());
+
+    // Only the latest deltas are kept
+    stream.Publish(NewDelta(false, 1));
+    stream.Publish(NewDelta(false, 1));
+    stream.Publish(NewDelta(false, 1));
+    BOOST_CHECK_EQUAL(stream.GetSequence(), 5U);
+    BOOST_CHECK(!stream.GetSince(0, std::chrono::milliseconds{0}));
+    BOOST_CHECK(!stream.GetSince(1, std::chrono::milliseconds{0}));
+    deltas = stream.GetSince(2, std::chrono::milliseconds{0});
+    BOOST_REQUIRE(deltas);
+    BOOST_REQUIRE_EQUAL(deltas->size(), 3U);
+    BOOST_CHECK_EQUAL((*deltas)[0]->sequence, 3U);
+    BOOST_CHECK_EQUAL((*deltas)[2]->sequence, 5U);
+}
+
+BOOST_AUTO_TEST_CASE(wait_for_delta)
+{
+    CTemplateDeltaStream stream {};
+    stream.Publish(NewDelta(true, 1));
+
+    auto waiter { std::async(std::launch::async, [&stream]{
+        return stream.GetSince(1, std::chrono::seconds{30});
+    }) };
+    stream.Publish(NewDelta(false, 3));
+
+    auto deltas { waiter.get() };
+    BOOST_REQUIRE(deltas);
+    BOOST_REQUIRE_EQUAL(deltas->size(), 1U);
+    BOOST_CHECK_EQUAL((*deltas)[0]->sequence, 2U);
+    BOOST_CHECK_EQUAL((*deltas)[0]->added.size(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(delta_json)
+{
+    CTemplateDeltaStream stream {};
+    auto delta { stream.Publish(NewDelta(true, 2)) };
+
+    CStringWriter tw {};
+    {
+        CJSONWriter jw {tw, false};
+        delta->ToJSON(jw);
+    }
+    UniValue json {};
+    BOOST_REQUIRE(json.read(tw.MoveOutString()));
+    BOOST_CHECK_EQUAL(json["sequence"].get_int64(), 1);
+    BOOST_CHECK(json["reset"].get_bool());
+    BOOST_CHECK_EQUAL(json["num_tx"].get_int64(), 2);
+    BOOST_REQUIRE_EQUAL(json["added"].size(), 2U);
+    BOOST_CHECK_EQUAL(json["added"][0]["txid"].get_str(), delta->added[0].first.GetHex());
+    BOOST_CHECK_EQUAL(json["added"][1]["fee"].get_int64(), 1);
+    BOOST_REQUIRE_EQUAL(json["merkleProof"].size(), 1U);
+    BOOST_CHECK_EQUAL(json["merkleProof"][0].get_str(), delta->merkleProof[0].GetHex());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
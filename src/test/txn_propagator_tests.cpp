@@ -0,0 +1,106 @@
+// Copyright (c) 2021-2022 The Novo Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+
+#include <net/net.h>
+#include <test/test_novobitcoin.h>
+#include <txn_propagator.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace
+{
+    CTxnSendingDetails NewTxn()
+    {
+        CMutableTransaction txn {};
+        txn.vin.resize(1);
+        txn.vin[0].prevout = COutPoint { InsecureRand256(), 0 };
+        txn.vout.resize(1);
+        const CTransactionRef ref { MakeTransactionRef(std::move(txn)) };
+        return { CInv { MSG_TX, ref->GetId() }, ref };
+    }
+
+    // Wait for the propagator to take everything queued, but no longer than timeout
+    bool WaitForProcessing(const CTxnPropagator& propagator, std::chrono::milliseconds timeout)
+    {
+        const auto deadline { std::chrono::steady_clock::now() + timeout };
+        while(propagator.getNewTxnQueueLength() > 0)
+        {
+            if(std::chrono::steady_clock::now() > deadline)
+            {
+                return false;
+            }
+            std::this_thread::sleep_for(1ms);
+        }
+        return true;
+    }
+}
+
+BOOST_FIXTURE_TEST_SUITE(txn_propagator_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(peer_inv_interval)
+{
+    const std::chrono::microseconds base { 150ms };
+
+    // Nothing queued, or no bandwidth measurement yet
+    BOOST_CHECK(CTxnPropagator::getPeerInvInterval(base, 0, 1000000) == base);
+    BOOST_CHECK(CTxnPropagator::getPeerInvInterval(base, 1000000, 0) == base);
+
+    // Queue that will drain quickly
+    BOOST_CHECK(CTxnPropagator::getPeerInvInterval(base, 1000, 1000000) == base);
+
+    // Queue that will take 300ms to drain
+    BOOST_CHECK(CTxnPropagator::getPeerInvInterval(base, 300000, 1000000) == 300ms);
+
+    // Very backed up queue
+    BOOST_CHECK(CTxnPropagator::getPeerInvInterval(base, 100000000, 1000000) ==
+        base * CTxnPropagator::MAX_PEER_INV_INTERVAL_MULTIPLIER);
+}
+
+BOOST_AUTO_TEST_CASE(early_processing)
+{
+    // Long enough that nothing below happens by the normal schedule
+    constexpr std::chrono::milliseconds runFrequency { 60s };
+    constexpr std::chrono::milliseconds timeout { 30s };
+
+    CTxnPropagator propagator {};
+    propagator.setRunFrequency(runFrequency);
+
+    // We've been idle, so a lone transaction goes straight out
+    propagator.newTransaction(NewTxn());
+    BOOST_CHECK(WaitForProcessing(propagator, timeout));
+
+    // Another one so soon after waits for the next run
+    propagator.newTransaction(NewTxn());
+    std::this_thread::sleep_for(100ms);
+    BOOST_CHECK_EQUAL(propagator.getNewTxnQueueLength(), 1U);
+
+    // Unless the queue fills an inv message, even when it's filled by several threads
+    const size_t toFill { CInv::estimateMaxInvElements(LEGACY_MAX_PROTOCOL_PAYLOAD_LENGTH) - 1 };
+    constexpr size_t numThreads {4};
+    std::vector<std::thread> threads {};
+    for(size_t i = 0; i < numThreads; ++i)
+    {
+        const size_t count { toFill / numThreads + (i < toFill % numThreads) };
+        threads.emplace_back([&propagator, count]() {
+            for(size_t n = 0; n < count; ++n)
+            {
+                propagator.newTransaction(NewTxn());
+            }
+        });
+    }
+    for(auto& thread : threads)
+    {
+        thread.join();
+    }
+    BOOST_CHECK(WaitForProcessing(propagator, timeout));
+
+    propagator.shutdown();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
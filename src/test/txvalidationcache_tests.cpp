@@ -11,8 +11,10 @@
 #include "key.h"
 #include "keystore.h"
 #include "mining/assembler.h"
+#include "mining/factory.h"
 #include "pubkey.h"
 #include "random.h"
+#include "rpc/mining.h"
 #include "script/scriptcache.h"
 #include "script/sighashtype.h"
 #include "script/sign.h"
@@ -428,4 +430,49 @@ BOOST_AUTO_TEST_CASE(checkinputs_test) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(checked_block_caches_scripts) {
+    // Scripts verified while checking a block candidate are remembered, so
+    // they don't run again when the solved block is connected.
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey())
+                                     << OP_CHECKSIG;
+
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbaseTxns[0].GetId(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = COIN;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+    {
+        std::vector<uint8_t> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, CTransaction(spend), 0,
+                                     SigHashType(),
+                                     coinbaseTxns[0].vout[0].nValue);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back(uint8_t(SIGHASH_ALL));
+        spend.vin[0].scriptSig << vchSig;
+    }
+    const CTransaction spendTx(spend);
+
+    const Config& config = GlobalConfig::GetConfig();
+    CBlockIndex* pindexPrev {nullptr};
+    auto pblocktemplate =
+        mining::g_miningFactory->GetAssembler()->CreateNewBlock(scriptPubKey, pindexPrev);
+    CBlock block = *pblocktemplate->GetBlockRef();
+    block.vtx.resize(1);
+    block.vtx.push_back(MakeTransactionRef(spend));
+    unsigned int extraNonce = 0;
+    IncrementExtraNonce(&block, pindexPrev, extraNonce);
+
+    LOCK(cs_main);
+    const uint256 cacheKey =
+        GetScriptCacheKey(spendTx, GetBlockScriptFlags(config, pindexPrev));
+    BOOST_CHECK(!IsKeyInScriptCache(cacheKey, false));
+
+    CValidationState state;
+    BOOST_CHECK(TestBlockValidity(config, state, block, pindexPrev,
+                                  BlockValidationOptions().withCheckPoW(false)));
+    BOOST_CHECK(IsKeyInScriptCache(cacheKey, false));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
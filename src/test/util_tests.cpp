@@ -84,6 +84,17 @@ BOOST_AUTO_TEST_CASE(util_HexStr) {
     std::vector<uint8_t> ParseHex_vec(ParseHex_expected, ParseHex_expected + 5);
 
     BOOST_CHECK_EQUAL(HexStr(ParseHex_vec, true), "04 67 8a fd b0");
+
+    // Inputs longer than the encoding buffer are written in several pieces
+    std::vector<uint8_t> long_vec(2000);
+    std::string long_hex, long_hex_spaces;
+    for (size_t i = 0; i < long_vec.size(); ++i) {
+        long_vec[i] = static_cast<uint8_t>(i * 7);
+        long_hex += strprintf("%02x", int{long_vec[i]});
+        long_hex_spaces += strprintf(i ? " %02x" : "%02x", int{long_vec[i]});
+    }
+    BOOST_CHECK_EQUAL(HexStr(long_vec), long_hex);
+    BOOST_CHECK_EQUAL(HexStr(long_vec, true), long_hex_spaces);
 }
 
 BOOST_AUTO_TEST_CASE(util_DateTimeStrFormat) {
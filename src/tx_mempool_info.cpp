@@ -6,6 +6,7 @@
 
 #include "tx_mempool_info.h"
 
+#include "core_memusage.h"
 #include "txmempool.h"
 #include "mempooltxdb.h"
 
@@ -26,6 +27,11 @@ CTransactionWrapper::CTransactionWrapper(const TxId &_txid,
       txref{WeakPtr{}}
 {}
 
+CTransactionWrapper::~CTransactionWrapper()
+{
+    ReleasePrefetchedNL();
+}
+
 const TxId& CTransactionWrapper::GetId() const noexcept
 {
     return txid;
@@ -69,8 +75,14 @@ const TxId& CTransactionWrapper::GetId() const noexcept
 // removed from the mempool, iff the wrapper is accessible from outside the
 // mempool (e.g., in the block journal's queue) and the call to GetTx() happens
 // before the asynchronous removal of the transaction from the mempool txdb.
+//
+// A prefetched transaction (see Prefetch()) is always referenced by the weak
+// pointer, so the first caller after a prefetch takes over the reference and
+// the wrapper stops pinning the transaction in memory.
 CTransactionRef CTransactionWrapper::GetTx() const
 {
+    accessed.store(true, std::memory_order_relaxed);
+
     std::unique_lock<std::mutex> lock{guard};
     if (std::holds_alternative<OwnedPtr>(txref))
     {
@@ -80,6 +92,7 @@ CTransactionRef CTransactionWrapper::GetTx() const
     {
         assert(std::holds_alternative<WeakPtr>(txref));
         auto ptr = std::get<WeakPtr>(txref).lock();
+        ReleasePrefetchedNL();
         if (!ptr && mempoolTxDB)
         {
             mempoolTxDB->GetTransaction(txid, ptr);
@@ -114,6 +127,46 @@ void CTransactionWrapper::ResetTransaction()
     }
 }
 
+// Called from the CAsyncMempoolTxDB worker thread only. Transactions that are
+// in memory, or still referenced from outside of the wrapper, are not read.
+void CTransactionWrapper::Prefetch()
+{
+    std::unique_lock<std::mutex> lock{guard};
+    if (std::holds_alternative<WeakPtr>(txref) && !prefetched && mempoolTxDB)
+    {
+        auto ptr = std::get<WeakPtr>(txref).lock();
+        if (!ptr && mempoolTxDB->GetTransaction(txid, ptr))
+        {
+            txref.emplace<WeakPtr>(ptr);
+            prefetched = std::move(ptr);
+            mempoolTxDB->prefetchedUsage += RecursiveDynamicUsage(prefetched);
+        }
+    }
+}
+
+size_t CTransactionWrapper::DropPrefetched()
+{
+    std::unique_lock<std::mutex> lock{guard};
+    return ReleasePrefetchedNL();
+}
+
+size_t CTransactionWrapper::ReleasePrefetchedNL() const
+{
+    if (!prefetched)
+    {
+        return 0;
+    }
+    const size_t usage {RecursiveDynamicUsage(prefetched)};
+    mempoolTxDB->prefetchedUsage -= usage;
+    prefetched.reset();
+    return usage;
+}
+
+bool CTransactionWrapper::TestAndClearAccessed() const noexcept
+{
+    return accessed.exchange(false, std::memory_order_relaxed);
+}
+
 // NOTE: We can't avoid locking the mutex here, even if we used a helper
 //       atomic flag, without causing a race with ResetTransaction().
 bool CTransactionWrapper::IsInMemory() const noexcept
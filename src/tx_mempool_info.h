@@ -36,6 +36,7 @@ public:
                         const std::shared_ptr<CMempoolTxDBReader>& txDB);
     CTransactionWrapper(const TxId &txid,
                         const std::shared_ptr<CMempoolTxDBReader>& txDB);
+    ~CTransactionWrapper();
 
     CTransactionRef GetTx() const;
     const TxId& GetId() const noexcept;
@@ -48,6 +49,15 @@ public:
 
     void ResetTransaction();
 
+    // Return whether the transaction was requested through GetTx() since the
+    // previous call, and clear the flag. This is the reference bit of the
+    // CLOCK policy used to pick transactions that are moved to disk.
+    bool TestAndClearAccessed() const noexcept;
+
+    // Release the copy of an on-disk transaction that was read ahead of use
+    // but was not requested since, and return the memory that was freed.
+    size_t DropPrefetched();
+
 private:
     const TxId txid;
     const std::shared_ptr<CMempoolTxDBReader> mempoolTxDB;
@@ -60,9 +70,20 @@ private:
     mutable std::mutex guard;
     mutable std::variant<OwnedPtr, WeakPtr> txref;
 
-    // Accessor for the CAsyncMempoolTxDB worker thread.
+    // An on-disk transaction read back by the CAsyncMempoolTxDB worker thread
+    // before anyone asked for it. It is held until the next GetTx() hands it
+    // over, so that the caller does not have to read from disk.
+    // Its memory is accounted for in the database reader's prefetched usage.
+    mutable CTransactionRef prefetched {nullptr};
+    size_t ReleasePrefetchedNL() const;
+
+    // Set on every GetTx(). New transactions start out as recently used.
+    mutable std::atomic_bool accessed {true};
+
+    // Accessors for the CAsyncMempoolTxDB worker thread.
     friend class CAsyncMempoolTxDB;
     CTransactionRef GetInMemoryTx();
+    void Prefetch();
 };
 
 using CTransactionWrapperRef = std::shared_ptr<CTransactionWrapper>;
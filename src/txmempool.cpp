@@ -12,8 +12,10 @@
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
 #include "mempooltxdb.h"
+#include "parallel_batches.h"
 #include "policy/fees.h"
 #include "policy/policy.h"
+#include "support/allocators/counting.h"
 #include "timedata.h"
 #include "txdb.h"
 #include "util.h"
@@ -1004,6 +1006,74 @@ void CTxMemPool::RemoveForReorg(
     removeStagedNL(setAllRemoves, nonNullChangeSet.Get(), noConflict, MemPoolRemovalReason::REORG);
 }
 
+namespace
+{
+    // Minimal number of block transactions handled by one batch in RemoveForBlock.
+    // Blocks with fewer transactions are resolved on the calling thread.
+    constexpr size_t REMOVE_FOR_BLOCK_MIN_BATCH_SIZE = 0x2000;
+}
+
+CTxMemPool::setEntriesTopoSorted CTxMemPool::removeConflictsForBlockNL(
+    const std::vector<CTransactionRef>& vtx,
+    const std::vector<std::pair<size_t, txiter>>& conflicts,
+    setEntries& toRemove,
+    const uint256& blockhash,
+    mining::CJournalChangeSet& changeSet)
+{
+    // collect all descendants of the txs which made double-spends, attributing every
+    // removed entry to the first block transaction (in reverse block order) it conflicts with
+    setEntries stage;
+    std::vector<std::pair<const CTransaction*, setEntries>> conflictedWith;
+    std::vector<txiter> toVisit;
+    for (auto conflictIt = conflicts.rbegin(); conflictIt != conflicts.rend(); ++conflictIt)
+    {
+        const auto& [blockTxIndex, spentBy] = *conflictIt;
+        if (stage.count(spentBy))
+        {
+            continue;
+        }
+
+        const CTransaction* blockTx = vtx[blockTxIndex].get();
+        if (conflictedWith.empty() || conflictedWith.back().first != blockTx)
+        {
+            conflictedWith.emplace_back(blockTx, setEntries{});
+        }
+        setEntries& descendants = conflictedWith.back().second;
+
+        toVisit.push_back(spentBy);
+        while (!toVisit.empty())
+        {
+            txiter entry = toVisit.back();
+            toVisit.pop_back();
+            if (stage.insert(entry).second)
+            {
+                descendants.insert(entry);
+                for (txiter child : GetMemPoolChildrenNL(entry))
+                {
+                    toVisit.push_back(child);
+                }
+            }
+        }
+    }
+
+    // a descendant of a double-spend can not be part of a valid block, but make sure
+    // we never touch an entry twice
+    for (txiter entry : stage)
+    {
+        toRemove.erase(entry);
+    }
+
+    // remove conflicted txs from the mempool as one staged removal
+    setEntriesTopoSorted toUpdateAfterDeletion = prepareStagedRemovalNL(stage, changeSet);
+    for (const auto& [blockTx, descendants] : conflictedWith)
+    {
+        auto conflict = CTransactionConflict{{blockTx, &blockhash}};
+        removeUncheckedNL(descendants, changeSet, conflict, MemPoolRemovalReason::CONFLICT);
+    }
+
+    return toUpdateAfterDeletion;
+}
+
 void CTxMemPool::RemoveForBlock(
     const std::vector<CTransactionRef> &vtx,
     const CJournalChangeSetPtr& changeSet,
@@ -1016,79 +1086,122 @@ void CTxMemPool::RemoveForBlock(
 
     evictionTracker.reset();
 
-    setEntries toRemove; // entries which should be removed
-    setEntriesTopoSorted childrenOfToRemove; // we must collect all transaction which parents we have removed to update its ancestorCount
-    setEntriesTopoSorted childrenOfToRemoveGroupMembers; // immediate children of entries we will remove that are members of the cpfp group, need to be updated after removal
-    setEntriesTopoSorted childrenOfToRemoveSecondaryMempool; // immediate children of entries we will remove that are in the secondary mempool, need to be updated after removal
-
-    for(auto vtxIter = vtx.rbegin();  vtxIter != vtx.rend();  vtxIter++)
+    // Resolve block transactions against the mempool. This only reads mapTx and
+    // mapNextTx so large blocks are split into batches which are resolved in parallel.
+    struct ResolvedBlockTxs
     {
-        auto& tx = *vtxIter;
-
-        auto found = mapTx.find(tx->GetId()); // see if we have this transaction from block
-
-        if(found != mapTx.end())
+        // block transactions which are in the mempool
+        std::vector<txiter> inMempool;
+        // (index of block transaction, mempool transaction double-spending one of its inputs)
+        std::vector<std::pair<size_t, txiter>> conflicts;
+    };
+    auto resolveBlockTxs =
+        [this, &vtx](size_t begin, size_t end)
         {
-            toRemove.insert(found);
-            for(auto child: GetMemPoolChildrenNL(found))
+            ResolvedBlockTxs resolved;
+            for (size_t i = begin; i < end; ++i)
             {
-                // we are iterating block transactions backwards (we will always first visit child than its parent)
-                // all children that are scheduled for removal are in txToRemove set already
-                if(toRemove.find(child) == toRemove.end())
+                const auto& tx = vtx[i];
+                auto found = mapTx.find(tx->GetId()); // see if we have this transaction from block
+                if (found != mapTx.end())
                 {
-                    // we will not remove this child
-                    // let's see if it need to be updated later on
-                    // it needs to be updated in two cases:
-                    //     1. parent and child are part of the same group (group needs to be disbanded)
-                    //     2. child is in secondary mempool, as well as it's parent (grouping data needs to be updated)
-                    if(found->IsCPFPGroupMember() && child->IsCPFPGroupMember() && (found->GetCPFPGroup() == child->GetCPFPGroup()))
-                    {
-                        childrenOfToRemoveGroupMembers.insert(child);
-                    }
-                    else if(!found->IsInPrimaryMempool() && !child->IsInPrimaryMempool())
+                    resolved.inMempool.push_back(found);
+                    continue;
+                }
+
+                // walk through all inputs by spent tx and see if we already spending them
+                for (const CTxIn &txin : tx->vin)
+                {
+                    auto it = mapNextTx.find(txin.prevout);
+                    if (it != mapNextTx.end())
                     {
-                        childrenOfToRemoveSecondaryMempool.insert(child);
+                        resolved.conflicts.emplace_back(i, it->spentBy);
                     }
-
-                    childrenOfToRemove.insert(child);
                 }
             }
-        }
-        else
+            return resolved;
+        };
+
+    setEntries toRemove; // entries which should be removed
+    std::vector<std::pair<size_t, txiter>> conflicts;
+    for (auto& resolved : ProcessBatchesInParallel<ResolvedBlockTxs>(vtx.size(), REMOVE_FOR_BLOCK_MIN_BATCH_SIZE, resolveBlockTxs))
+    {
+        toRemove.insert(resolved.inMempool.begin(), resolved.inMempool.end());
+        conflicts.insert(conflicts.end(), resolved.conflicts.begin(), resolved.conflicts.end());
+    }
+
+    // remove double-spends (together with all descendants) before looking at children of
+    // removed entries, so that conflicted entries never need to be updated
+    setEntriesTopoSorted removedWithConflicts;
+    if (!conflicts.empty())
+    {
+        removedWithConflicts = removeConflictsForBlockNL(vtx, conflicts, toRemove, blockhash, nonNullChangeSet.Get());
+    }
+
+    // Find children of removed entries that stay in the mempool. toRemove is complete at
+    // this point so the children can also be inspected in parallel.
+    struct ChildrenOfToRemove
+    {
+        // children that stay in the mempool, their ancestorCount must be updated
+        std::vector<txiter> all;
+        // children that are members of the same cpfp group as its removed parent, group needs to be disbanded
+        std::vector<txiter> groupMembers;
+        // children that are in the secondary mempool, as well as its removed parent, grouping data needs to be updated
+        std::vector<txiter> secondaryMempool;
+    };
+    const std::vector<txiter> toRemoveVector(toRemove.begin(), toRemove.end());
+    auto findChildren =
+        [this, &toRemove, &toRemoveVector](size_t begin, size_t end)
         {
-            // walk through all inputs by spent tx
-            for (const CTxIn &txin : tx->vin)
+            ChildrenOfToRemove children;
+            for (size_t i = begin; i < end; ++i)
             {
-                // and see if we already spending them
-                auto it = mapNextTx.find(txin.prevout);
-                if (it != mapNextTx.end())
+                txiter entry = toRemoveVector[i];
+                for (txiter child : GetMemPoolChildrenNL(entry))
                 {
-                    // found double-spend
-
-                    // collect all descendants of the tx which made double-spend
-                    setEntries conflictedWithDescendants;
-                    GetDescendantsNL(mapTx.find(it->spentBy->GetTxId()), conflictedWithDescendants);
-
-                    for(txiter inConflict: conflictedWithDescendants)
+                    if (toRemove.find(child) != toRemove.end())
                     {
-                        // inConflict will be erased so remove it from the sets of txs that needs to be updated
-                        childrenOfToRemove.erase(inConflict);
-                        childrenOfToRemoveGroupMembers.erase(inConflict);
-                        childrenOfToRemoveSecondaryMempool.erase(inConflict);
+                        continue;
                     }
 
-                    // remove conflicted tx from mempool (together with all descendants)
-                    auto conflict = CTransactionConflict{{tx.get(), &blockhash}};
-                    removeStagedNL(conflictedWithDescendants, nonNullChangeSet.Get(), conflict, MemPoolRemovalReason::CONFLICT);
+                    if (entry->IsCPFPGroupMember() && child->IsCPFPGroupMember() && (entry->GetCPFPGroup() == child->GetCPFPGroup()))
+                    {
+                        children.groupMembers.push_back(child);
+                    }
+                    else if (!entry->IsInPrimaryMempool() && !child->IsInPrimaryMempool())
+                    {
+                        children.secondaryMempool.push_back(child);
+                    }
+                    children.all.push_back(child);
                 }
             }
-        }
+            return children;
+        };
+
+    setEntriesTopoSorted childrenOfToRemove; // we must collect all transaction which parents we have removed to update its ancestorCount
+    setEntriesTopoSorted childrenOfToRemoveGroupMembers; // immediate children of entries we will remove that are members of the cpfp group, need to be updated after removal
+    setEntriesTopoSorted childrenOfToRemoveSecondaryMempool; // immediate children of entries we will remove that are in the secondary mempool, need to be updated after removal
+    for (auto& children : ProcessBatchesInParallel<ChildrenOfToRemove>(toRemoveVector.size(), REMOVE_FOR_BLOCK_MIN_BATCH_SIZE, findChildren))
+    {
+        childrenOfToRemove.insert(children.all.begin(), children.all.end());
+        childrenOfToRemoveGroupMembers.insert(children.groupMembers.begin(), children.groupMembers.end());
+        childrenOfToRemoveSecondaryMempool.insert(children.secondaryMempool.begin(), children.secondaryMempool.end());
     }
 
     // remove affected groups from primary mempool
     // we are ignoring members of "toRemove" (we will remove them in the removeUncheckedNL), so that "removedFromPrimary" can not contain transactions that will be removed
     auto removedFromPrimary = RemoveFromPrimaryMempoolNL(std::move(childrenOfToRemoveGroupMembers), nonNullChangeSet.Get(), true, &toRemove);
 
+    // entries moved out of the primary mempool while removing conflicts are revisited
+    // together with the rest, unless they are about to be removed
+    for (txiter entry : removedWithConflicts)
+    {
+        if (toRemove.find(entry) == toRemove.end())
+        {
+            removedFromPrimary.insert(entry);
+        }
+    }
+
     std::vector<txiter> tempEntries;
     // disconnect children from its soon-to-be-removed parents
     for(txiter child: childrenOfToRemove)
@@ -1126,6 +1239,13 @@ void CTxMemPool::RemoveForBlock(
 
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = true;
+
+    // The block's transactions are queued for removal from disk by now, so
+    // that's where the space they leave can be reclaimed.
+    if (mempoolTxDB)
+    {
+        mempoolTxDB->CollectGarbage();
+    }
 }
 
 void CTxMemPool::clearNL(bool skipTransactionDatabase/* = false*/) {
@@ -1564,6 +1684,11 @@ uint64_t CTxMemPool::GetDiskUsage() {
     return mempoolTxDB->GetDiskUsage();
 };
 
+uint64_t CTxMemPool::GetDiskLogSize() {
+    OpenMempoolTxDB();
+    return mempoolTxDB->GetLogSize();
+};
+
 uint64_t CTxMemPool::GetDiskTxCount() {
     OpenMempoolTxDB();
     return mempoolTxDB->GetTxCount();
@@ -1577,16 +1702,40 @@ void CTxMemPool::SaveTxsToDisk(uint64_t requiredSize) {
         // to disk and transaction wrappers, see the comment at
         // CTransactionWrapper::GetTx() in tx_mempool_info.cpp and the 'add'
         // lambda in CAsyncMempoolTxDB::Work() in mempooltxdb.cpp.
+        //
+        // Transactions are picked in entry time order with the CLOCK policy:
+        // the first sweep skips transactions that were used since the previous
+        // sweep, giving them a second chance, and only if that does not free
+        // enough memory are the skipped ones written out too. Cold on-disk
+        // transactions met on the way release any prefetched copy.
         std::shared_lock lock{smtx};
+        std::vector<const CTxMemPoolEntry*> recentlyUsed;
+        const auto saveToDisk = [this, &movedToDiskSize](const CTxMemPoolEntry& entry) {
+            auto tx = entry.tx;
+            mempoolTxDB->Add(std::move(tx));
+            movedToDiskSize += entry.GetTxSize();
+        };
         for (auto mi = mapTx.get<entry_time>().begin();
              mi != mapTx.get<entry_time>().end() && movedToDiskSize < requiredSize;
              ++mi) {
-            if (mi->IsInMemory()) {
-                auto tx = mi->tx;
-                mempoolTxDB->Add(std::move(tx));
-                movedToDiskSize += mi->GetTxSize();
+            const bool accessed = mi->tx->TestAndClearAccessed();
+            if (!mi->IsInMemory()) {
+                if (!accessed) {
+                    movedToDiskSize += mi->tx->DropPrefetched();
+                }
+            }
+            else if (accessed) {
+                recentlyUsed.push_back(&*mi);
+            }
+            else {
+                saveToDisk(*mi);
             }
         }
+        for (auto it = recentlyUsed.begin();
+             it != recentlyUsed.end() && movedToDiskSize < requiredSize;
+             ++it) {
+            saveToDisk(**it);
+        }
     }
 
     if (movedToDiskSize < requiredSize)
@@ -1597,6 +1746,16 @@ void CTxMemPool::SaveTxsToDisk(uint64_t requiredSize) {
     }
 }
 
+void CTxMemPool::PrefetchTxsFromDisk(std::vector<CTransactionWrapperRef>&& wrappers) {
+    OpenMempoolTxDB();
+    mempoolTxDB->Prefetch(std::move(wrappers));
+}
+
+uint64_t CTxMemPool::GetPrefetchedUsage() {
+    OpenMempoolTxDB();
+    return mempoolTxDB->GetDatabase()->GetPrefetchedUsage();
+}
+
 void CTxMemPool::QueryHashes(std::vector<uint256> &vtxid) {
     std::shared_lock lock{smtx};
 
@@ -1844,16 +2003,23 @@ size_t CTxMemPool::DynamicMemoryUsage() const {
     return DynamicMemoryUsageNL();
 }
 
-size_t CTxMemPool::DynamicMemoryIndexUsageNL() const {
+CMempoolMemoryUsage CTxMemPool::IndexMemoryUsageNL() const {
+    CMempoolMemoryUsage usage;
     // Estimate the overhead of mapTx to be 12 pointers + two allocations, as
     // no exact formula for boost::multi_index_container is implemented.
-    return mapTx.size() * memusage::MallocUsage(sizeof(CTxMemPoolEntry) +
-                                                sizeof(CTransactionWrapper) +
-                                                12 * sizeof(void *)) +
-           mapNextTx.size() * memusage::MallocUsage(sizeof(OutpointTxPair) +
-                                                    12 * sizeof(void *)) +
-           memusage::DynamicUsage(mapDeltas) +
-           memusage::DynamicUsage(mapLinks);
+    usage.mapTx = mapTx.size() * memusage::MallocUsage(sizeof(CTxMemPoolEntry) +
+                                                       sizeof(CTransactionWrapper) +
+                                                       12 * sizeof(void *));
+    usage.mapNextTx = mapNextTx.size() * memusage::MallocUsage(sizeof(OutpointTxPair) +
+                                                               12 * sizeof(void *));
+    usage.mapDeltas = memusage::DynamicUsage(mapDeltas);
+    usage.mapLinks = memusage::DynamicUsage(mapLinks);
+    return usage;
+}
+
+size_t CTxMemPool::DynamicMemoryIndexUsageNL() const {
+    const auto usage = IndexMemoryUsageNL();
+    return usage.mapTx + usage.mapNextTx + usage.mapDeltas + usage.mapLinks;
 }
 
 size_t CTxMemPool::DynamicMemoryUsageNL() const {
@@ -1875,11 +2041,122 @@ size_t CTxMemPool::SecondaryMempoolUsageNL() const {
     return indexSize * secondaryMempoolRatio + secondaryMempoolStats.InnerUsage();
 }
 
-void CTxMemPool::removeStagedNL(
-    setEntries& stage,
-    mining::CJournalChangeSet& changeSet,
-    const CTransactionConflict& conflictedWith,
-    MemPoolRemovalReason reason)
+CMempoolMemoryUsage CTxMemPool::GetMemoryUsage() const {
+    std::shared_lock lock{smtx};
+
+    auto usage = IndexMemoryUsageNL();
+    // The parent and child sets are counted in cachedInnerUsage, but belong
+    // with the links index here.
+    for (const auto& [entry, links] : mapLinks) {
+        usage.mapLinks += memusage::DynamicUsage(links.parents) +
+                          memusage::DynamicUsage(links.children);
+    }
+    std::unordered_set<const CPFPGroup*> groups;
+    for (const auto& entry : mapTx) {
+        auto& part = entry.IsInMemory() ? usage.txInMemory : usage.txOnDisk;
+        ++part.count;
+        part.usage += entry.DynamicMemoryUsage();
+
+        if (entry.IsCPFPGroupMember()) {
+            const auto group = entry.GetCPFPGroup();
+            if (groups.insert(group.get()).second) {
+                ++usage.cpfpGroups.count;
+                usage.cpfpGroups.usage +=
+                    memusage::DynamicUsage(group) +
+                    memusage::DynamicUsage(group->Transactions());
+            }
+        }
+    }
+    if (evictionTracker) {
+        usage.evictionTracker = evictionTracker->DynamicMemoryUsage();
+    }
+    usage.journal = mJournalBuilder.getCurrentJournal()->DynamicMemoryUsage();
+    if (mempoolTxDB) {
+        usage.prefetched = mempoolTxDB->GetDatabase()->GetPrefetchedUsage();
+    }
+
+    if (memoryAudit) {
+        usage.audit = AuditMemoryUsageNL();
+    }
+    return usage;
+}
+
+CMempoolMemoryUsage::Audit CTxMemPool::AuditMemoryUsageNL() const {
+    CMempoolMemoryUsage::Audit audit;
+
+    {
+        AllocationCounter counter;
+        using CountedTransactionSet =
+            boost::multi_index_container<CTxMemPoolEntry,
+                                         indexed_transaction_set_indices,
+                                         counting_allocator<CTxMemPoolEntry>>;
+        const CountedTransactionSet copy {
+            mapTx.begin(), mapTx.end(),
+            CountedTransactionSet::ctor_args_list{},
+            counting_allocator<CTxMemPoolEntry>{counter}};
+        // The transaction wrappers are shared with the copy, so they are not
+        // counted by the allocator.
+        size_t wrappers = 0;
+        for (const auto& entry : mapTx) {
+            wrappers += memusage::DynamicUsage(entry.tx);
+        }
+        audit.mapTx = counter.usage + wrappers;
+    }
+
+    {
+        AllocationCounter counter;
+        using CountedMapNextTx =
+            boost::multi_index_container<OutpointTxPair,
+                                         MapNextTxIndices,
+                                         counting_allocator<OutpointTxPair>>;
+        const CountedMapNextTx copy {
+            mapNextTx.begin(), mapNextTx.end(),
+            CountedMapNextTx::ctor_args_list{},
+            counting_allocator<OutpointTxPair>{counter}};
+        audit.mapNextTx = counter.usage;
+    }
+
+    {
+        AllocationCounter counter;
+        using Allocator = counting_allocator<std::pair<const uint256, Amount>>;
+        const std::map<uint256, Amount, std::less<uint256>, Allocator> copy {
+            mapDeltas.begin(), mapDeltas.end(), std::less<uint256>{}, Allocator{counter}};
+        audit.mapDeltas = counter.usage;
+    }
+
+    {
+        AllocationCounter counter;
+        using CountedEntries =
+            std::unordered_set<txiter, SaltedTxiterHasher, std::equal_to<txiter>,
+                               counting_allocator<txiter>>;
+        struct CountedLinks {
+            CountedEntries parents;
+            CountedEntries children;
+        };
+        using Allocator = counting_allocator<std::pair<const txiter, CountedLinks>>;
+        std::unordered_map<txiter, CountedLinks, SaltedTxiterHasher,
+                           std::equal_to<txiter>, Allocator>
+            copy {mapLinks.bucket_count(), SaltedTxiterHasher{},
+                  std::equal_to<txiter>{}, Allocator{counter}};
+        const auto copyEntries = [&counter](const setEntries& entries) {
+            return CountedEntries {entries.begin(), entries.end(),
+                                   entries.bucket_count(), SaltedTxiterHasher{},
+                                   std::equal_to<txiter>{},
+                                   counting_allocator<txiter>{counter}};
+        };
+        for (const auto& [entry, links] : mapLinks) {
+            copy.emplace(entry, CountedLinks{copyEntries(links.parents),
+                                             copyEntries(links.children)});
+        }
+        audit.mapLinks = counter.usage;
+    }
+
+    return audit;
+}
+
+CTxMemPool::setEntriesTopoSorted CTxMemPool::prepareStagedRemovalNL(
+    const setEntries& stage,
+    mining::CJournalChangeSet& changeSet)
 {
     // first remove groups from primary mempool because when we remove groups we might need
     // to remove transactions which are not in the staged for deletion
@@ -1925,6 +2202,17 @@ void CTxMemPool::removeStagedNL(
         }
     }
 
+    return toUpdateAfterDeletion;
+}
+
+void CTxMemPool::removeStagedNL(
+    setEntries& stage,
+    mining::CJournalChangeSet& changeSet,
+    const CTransactionConflict& conflictedWith,
+    MemPoolRemovalReason reason)
+{
+    setEntriesTopoSorted toUpdateAfterDeletion = prepareStagedRemovalNL(stage, changeSet);
+
     // now actually remove transactions
     removeUncheckedNL(stage, changeSet, conflictedWith, reason);
 
@@ -2338,11 +2626,7 @@ std::vector<TxId> CTxMemPool::TrimToSize(
 
     if (!evictionTracker) {
         evictionTracker = std::make_shared<CEvictionCandidateTracker>(
-            mapLinks,
-            [](txiter entry)
-            {
-                return evaluateEvictionCandidateNL(entry);
-            });
+            mapLinks, &evaluateEvictionCandidateNL);
     }
 
     auto getFeeRate = [](txiter entry)
@@ -320,6 +320,51 @@ struct CTransactionConflictData {
 
 using CTransactionConflict = std::optional<CTransactionConflictData>;
 
+/**
+ * Breakdown of the memory used by the mempool, see CTxMemPool::GetMemoryUsage().
+ *
+ * The index and transaction components add up to CTxMemPool::DynamicMemoryUsage().
+ * The remaining components are not counted against -maxmempool.
+ */
+struct CMempoolMemoryUsage
+{
+    struct Part
+    {
+        size_t count {0};
+        size_t usage {0};
+    };
+
+    // Estimated usage of the mempool indexes.
+    size_t mapTx {0};
+    size_t mapNextTx {0};
+    size_t mapLinks {0};
+    size_t mapDeltas {0};
+
+    // Transactions that are in memory and those that were moved to disk. The
+    // latter are still accounted for with their in-memory size.
+    Part txInMemory {};
+    Part txOnDisk {};
+
+    // Copies of on-disk transactions that were read back ahead of use.
+    size_t prefetched {0};
+
+    // Not counted in the mempool usage.
+    Part cpfpGroups {};
+    size_t evictionTracker {0};
+    size_t journal {0};
+
+    // Heap usage of copies of the indexes made with a counting allocator,
+    // filled in only when the memory audit is enabled.
+    struct Audit
+    {
+        size_t mapTx {0};
+        size_t mapNextTx {0};
+        size_t mapLinks {0};
+        size_t mapDeltas {0};
+    };
+    std::optional<Audit> audit {};
+};
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain transactions that
  * may be included in the next block.
@@ -411,6 +456,9 @@ private:
     // Flag to temporarily suspend sanity checking
     std::atomic_bool suspendSanityCheck {false};
 
+    // Cross-check memory usage estimates in GetMemoryUsage()
+    std::atomic_bool memoryAudit {false};
+
     std::atomic_uint nTransactionsUpdated {0};
 
     // fee that a transaction or a group needs to pay to enter the primary mempool
@@ -438,21 +486,24 @@ private:
     friend class CPFPGroup;
 
 public:
+    // Indexes of mapTx, see indexed_transaction_set
+    using indexed_transaction_set_indices =
+        boost::multi_index::indexed_by<
+            // sorted by txid
+            boost::multi_index::hashed_unique<
+                boost::multi_index::tag<transaction_id>,
+                mempoolentry_txid, SaltedTxidHasher>,
+            // sorted by entry time
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<entry_time>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByEntryTime>,
+            // arranged by insertion order
+            boost::multi_index::sequenced<
+                boost::multi_index::tag<insertion_order>>>;
     // FIXME: DEPRECATED - this will become private and ultimately changed or removed
     typedef boost::multi_index_container<
-        CTxMemPoolEntry, boost::multi_index::indexed_by<
-                             // sorted by txid
-                             boost::multi_index::hashed_unique<
-                                 boost::multi_index::tag<transaction_id>,
-                                 mempoolentry_txid, SaltedTxidHasher>,
-                             // sorted by entry time
-                             boost::multi_index::ordered_non_unique<
-                                 boost::multi_index::tag<entry_time>,
-                                 boost::multi_index::identity<CTxMemPoolEntry>,
-                                 CompareTxMemPoolEntryByEntryTime>,
-                             // arranged by insertion order
-                             boost::multi_index::sequenced<
-                                 boost::multi_index::tag<insertion_order>>>>
+        CTxMemPoolEntry, indexed_transaction_set_indices>
         indexed_transaction_set;
 
     // FIXME: DEPRECATED - this will become private and ultimately changed or removed
@@ -513,9 +564,7 @@ private:
         txiter spentBy;
     };
 
-    using MapNextTx =
-    boost::multi_index_container<
-        OutpointTxPair,
+    using MapNextTxIndices =
         boost::multi_index::indexed_by<
             boost::multi_index::hashed_unique<
                 boost::multi_index::tag<by_prevout>,
@@ -535,8 +584,8 @@ private:
                 >,
                 SaltedTxiterHasher
             >
-        >
-    >;
+        >;
+    using MapNextTx = boost::multi_index_container<OutpointTxPair, MapNextTxIndices>;
 
     MapNextTx mapNextTx;
 
@@ -784,9 +833,16 @@ public:
     // cross-reference with mempool.dat.
     void InitMempoolTxDB();
     uint64_t GetDiskUsage();
+    uint64_t GetDiskLogSize();
     uint64_t GetDiskTxCount();
     void SaveTxsToDisk(uint64_t requiredSize);
 
+    // Asynchronously read the given on-disk transactions back into memory
+    // ahead of use (e.g. by the block assembler).
+    void PrefetchTxsFromDisk(std::vector<CTransactionWrapperRef>&& wrappers);
+    // Memory held by prefetched transactions that weren't used yet.
+    uint64_t GetPrefetchedUsage();
+
     // May be called during validation.
     // The transaction must not exist in the mempool.
     void RemoveTxFromDisk(const CTransactionRef& transaction);
@@ -891,6 +947,12 @@ public:
     size_t DynamicMemoryUsage() const;
     size_t SecondaryMempoolUsage() const;
 
+    // Return the memory usage broken down by component. If the memory audit
+    // is enabled, this also copies the mempool indexes to measure their
+    // actual heap usage, which is slow.
+    CMempoolMemoryUsage GetMemoryUsage() const;
+    void SetMemoryAudit(bool enable) { memoryAudit = enable; }
+
     CFeeRate estimateFee() const;
 
     boost::signals2::signal<void(const CTransactionWrapper&)> NotifyEntryAdded;
@@ -1190,6 +1252,30 @@ private:
 
     void trackPackageRemovedNL(const CFeeRate &rate, bool haveSecondaryMempoolTxs);
 
+    /**
+     * First step of removeStagedNL: disbands groups of the staged transactions
+     * and disconnects them from parents which stay in the mempool. Returns
+     * transactions moved out of the primary mempool that should be revisited
+     * after the stage is removed.
+     */
+    setEntriesTopoSorted prepareStagedRemovalNL(
+            const setEntries& stage,
+            mining::CJournalChangeSet& changeSet);
+
+    /**
+     * Removes mempool transactions which double-spend inputs of block
+     * transactions, together with their descendants, as one staged removal.
+     * @a conflicts holds (index in @a vtx, conflicting mempool entry) pairs.
+     * Removed entries are dropped from @a toRemove. Returns transactions
+     * moved out of the primary mempool that should be revisited.
+     */
+    setEntriesTopoSorted removeConflictsForBlockNL(
+            const std::vector<CTransactionRef>& vtx,
+            const std::vector<std::pair<size_t, txiter>>& conflicts,
+            setEntries& toRemove,
+            const uint256& blockhash,
+            mining::CJournalChangeSet& changeSet);
+
     /**
      * Remove a set of transactions from the mempool. If a transaction is in
      * this set, then all in-mempool descendants must also be in the set.
@@ -1218,10 +1304,16 @@ private:
 
     // A non-locking estimate of usage of mempool indexes without actual transactions
     size_t DynamicMemoryIndexUsageNL() const;
+    // The same estimate per index
+    CMempoolMemoryUsage IndexMemoryUsageNL() const;
 
     // A non-locking version of DynamicMemoryUsage.
     size_t DynamicMemoryUsageNL() const;
 
+    // Measure the heap usage of the mempool indexes by copying them with a
+    // counting allocator.
+    CMempoolMemoryUsage::Audit AuditMemoryUsageNL() const;
+
     // A non-locking version of SecondaryMempoolUsage.
     size_t SecondaryMempoolUsageNL() const;
 
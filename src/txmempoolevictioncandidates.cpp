@@ -7,18 +7,108 @@
 
 #include "txmempoolevictioncandidates.h"
 
-bool CEvictionCandidateTracker::CompareResult(const EvalResult& first, const EvalResult& second)
+#include "crypto/common.h"
+
+uint32_t CEvictionCandidateTracker::LogBucket(uint64_t magnitude)
+{
+    const auto bits = static_cast<unsigned>(CountBits(magnitude));
+    if (bits == 0)
+    {
+        return 0;
+    }
+    // the bits following the most significant one
+    constexpr uint64_t mantissaMask = (uint64_t{1} << MANTISSA_BITS) - 1;
+    const uint64_t mantissa =
+        bits > MANTISSA_BITS
+            ? (magnitude >> (bits - 1 - MANTISSA_BITS)) & mantissaMask
+            : (magnitude << (MANTISSA_BITS + 1 - bits)) & mantissaMask;
+    return static_cast<uint32_t>((bits << MANTISSA_BITS) | mantissa);
+}
+
+uint32_t CEvictionCandidateTracker::BucketIndex(int64_t score)
+{
+    if (score < 0)
+    {
+        // negative scores take the lower half, the larger the magnitude the lower the bucket
+        const uint64_t magnitude = static_cast<uint64_t>(-(score + 1)) + 1;
+        return static_cast<uint32_t>(HALF_BUCKET_COUNT - 1 - LogBucket(magnitude));
+    }
+    return static_cast<uint32_t>(HALF_BUCKET_COUNT + LogBucket(static_cast<uint64_t>(score)));
+}
+
+void CEvictionCandidateTracker::SiftUp(std::vector<Candidate*>& bucket, uint32_t position)
+{
+    Candidate* candidate = bucket[position];
+    while (position > 0)
+    {
+        const uint32_t parent = (position - 1) / 2;
+        if (bucket[parent]->score <= candidate->score)
+        {
+            break;
+        }
+        bucket[position] = bucket[parent];
+        bucket[position]->position = position;
+        position = parent;
+    }
+    bucket[position] = candidate;
+    candidate->position = position;
+}
+
+void CEvictionCandidateTracker::SiftDown(std::vector<Candidate*>& bucket, uint32_t position)
+{
+    Candidate* candidate = bucket[position];
+    const auto size = static_cast<uint32_t>(bucket.size());
+    for (;;)
+    {
+        uint32_t child = 2 * position + 1;
+        if (child >= size)
+        {
+            break;
+        }
+        if (child + 1 < size && bucket[child + 1]->score < bucket[child]->score)
+        {
+            ++child;
+        }
+        if (candidate->score <= bucket[child]->score)
+        {
+            break;
+        }
+        bucket[position] = bucket[child];
+        bucket[position]->position = position;
+        position = child;
+    }
+    bucket[position] = candidate;
+    candidate->position = position;
+}
+
+uint32_t CEvictionCandidateTracker::LowestBucket() const
 {
-    return first.Score() > second.Score();
+    for (size_t word = 0; word < occupied.size(); ++word)
+    {
+        if (const uint64_t bits = occupied[word]; bits != 0)
+        {
+            // CountBits of the lowest set bit alone is its index plus one
+            return static_cast<uint32_t>(word * 64 + CountBits(bits & (~bits + 1)) - 1);
+        }
+    }
+    assert(!"no eviction candidates");
+    return 0;
 }
 
 void CEvictionCandidateTracker::InsertEntry(CTxMemPool::txiter entry)
 {
-    auto [iter, success] = entries.insert({entry->GetTxId(), nullptr});
+    const int64_t score = evaluator(entry);
+    const uint32_t index = BucketIndex(score);
+    auto [iter, success] = entries.try_emplace(entry->GetTxId(), Candidate{score, entry, index, 0});
     assert(success); // successful insertion
-    heap.emplace_back(entry, evaluator, iter->second);
 
-    std::push_heap(heap.begin(), heap.end(), CompareResult);
+    auto& bucket = buckets[index];
+    if (bucket.empty())
+    {
+        occupied[index / 64] |= uint64_t{1} << (index % 64);
+    }
+    bucket.push_back(&iter->second);
+    SiftUp(bucket, static_cast<uint32_t>(bucket.size() - 1));
 }
 
 void CEvictionCandidateTracker::ExpireEntry(const TxId& txId)
@@ -28,31 +118,25 @@ void CEvictionCandidateTracker::ExpireEntry(const TxId& txId)
     {
         return;
     }
-    iter->second->MarkExpired();
-    entries.erase(iter);
-}
 
-void CEvictionCandidateTracker::PopExpired()
-{
-    if((entries.size() == 0) ||
-        ((double(heap.size() - entries.size()) / entries.size()) >  MAX_INVALID_TO_VALID_RATIO))
+    const auto& candidate = iter->second;
+    auto& bucket = buckets[candidate.bucket];
+    const uint32_t position = candidate.position;
+    Candidate* last = bucket.back();
+    bucket.pop_back();
+    if (last != &candidate)
     {
-        heap.erase(
-            std::remove_if(heap.begin(),
-                           heap.end(),
-                           [](const EvalResult& x){return x.IsExpired();}),
-            heap.end());
-
-        std::make_heap(heap.begin(), heap.end(), CompareResult);
+        // move the last candidate into the hole and restore the heap from there
+        bucket[position] = last;
+        last->position = position;
+        SiftUp(bucket, position);
+        SiftDown(bucket, last->position);
     }
-    else
+    else if (bucket.empty())
     {
-        while (!heap.empty() && heap.front().IsExpired())
-        {
-            std::pop_heap(heap.begin(), heap.end(), CompareResult);
-            heap.pop_back();
-        }
+        occupied[candidate.bucket / 64] &= ~(uint64_t{1} << (candidate.bucket % 64));
     }
+    entries.erase(iter);
 }
 
 const CTxMemPool::setEntries& CEvictionCandidateTracker::GetParentsNoGroup(CTxMemPool::txiter entry) const
@@ -95,8 +179,8 @@ bool CEvictionCandidateTracker::HasChildren(CTxMemPool::txiter entry) const
 CEvictionCandidateTracker::CEvictionCandidateTracker(CTxMemPool::txlinksMap& _links, Evaluator _evaluator)
     : links{_links}
     , evaluator{_evaluator}
+    , buckets(BUCKET_COUNT)
 {
-    heap.reserve(links.get().size());
     entries.reserve(links.get().size());
     for (const auto& [entry, connections] : links.get())
     {
@@ -110,11 +194,8 @@ CEvictionCandidateTracker::CEvictionCandidateTracker(CTxMemPool::txlinksMap& _li
             continue;
         }
 
-        auto[iter, success] = entries.insert({entry->GetTxId(), nullptr});
-        assert(success);
-        heap.emplace_back(entry, evaluator, iter->second);
+        InsertEntry(entry);
     }
-    std::make_heap(heap.begin(), heap.end(), CompareResult);
 }
 
 
@@ -132,14 +213,12 @@ void CEvictionCandidateTracker::EntryAdded(CTxMemPool::txiter entry)
         }
     }
 
-    PopExpired();
     InsertEntry(entry);
 }
 
 void CEvictionCandidateTracker::EntryRemoved(const TxId& txId, const CTxMemPool::setEntries& immediateParents)
 {
     ExpireEntry(txId);
-    PopExpired();
 
     for (const auto& parent : immediateParents)
     {
@@ -167,14 +246,13 @@ void CEvictionCandidateTracker::EntryModified(CTxMemPool::txiter entry)
         return;
     }
     ExpireEntry(entry->GetTxId());
-    PopExpired();
     InsertEntry(entry);
 }
 
 CTxMemPool::txiter CEvictionCandidateTracker::GetMostWorthless() const
 {
     assert(entries.size() != 0);
-    return heap.front().Entry();
+    return buckets[LowestBucket()].front()->entry;
 }
 
 CTxMemPool::setEntries CEvictionCandidateTracker::GetAllCandidates() const
@@ -182,14 +260,17 @@ CTxMemPool::setEntries CEvictionCandidateTracker::GetAllCandidates() const
     CTxMemPool::setEntries candidates;
     for(const auto& entry: entries)
     {
-        candidates.insert(entry.second->Entry());
+        candidates.insert(entry.second.entry);
     }
     return candidates;
 }
 
 size_t CEvictionCandidateTracker::DynamicMemoryUsage() const
 {
-    return
-        memusage::DynamicUsage(heap) +
-        memusage::DynamicUsage(entries);
+    size_t usage = memusage::DynamicUsage(buckets) + memusage::DynamicUsage(entries);
+    for (const auto& bucket : buckets)
+    {
+        usage += memusage::DynamicUsage(bucket);
+    }
+    return usage;
 }
@@ -9,98 +9,63 @@
 #include "txhasher.h"
 #include "txmempool.h"
 
+#include <array>
+
 // CEvictionCandidateTracker is class that tracks which transaction should be removed. candidates for the removal
-// are childless transactions. they are internally arranged in the heap structure with tx with lowest score on the top.
+// are childless transactions. they are kept in buckets of similar score (a calendar queue), the bucket with the
+// lowest scores is found with a few bit scans and within a bucket candidates are arranged in a small heap.
 // for all calls to this class mempool should be locked
 class CEvictionCandidateTracker
 {
 public:
-    // the function object that assigns the score for the given transaction
+    // the function that assigns the score for the given transaction
     // transactions with lower score will be evicted first
-    using Evaluator = std::function<int64_t(CTxMemPool::txiter)>;
+    using Evaluator = int64_t (*)(CTxMemPool::txiter);
 
 private:
-    // maximal ratio between expired and non-expired transactions
-    static constexpr double MAX_INVALID_TO_VALID_RATIO = 1.0;
+    // scores are quantised logarithmically: every power of two is split into 2^MANTISSA_BITS buckets,
+    // so the scores in a bucket differ by less than 1/16 of their value
+    static constexpr unsigned MANTISSA_BITS = 4;
+    // negative and non-negative scores are bucketed separately by magnitude, each half has one bucket
+    // for zero and 2^MANTISSA_BITS buckets for each of the 64 powers of two
+    static constexpr size_t HALF_BUCKET_COUNT = size_t{65} << MANTISSA_BITS;
+    static constexpr size_t BUCKET_COUNT = 2 * HALF_BUCKET_COUNT;
+
+    // logarithmic bucket of the magnitude of a score, within one half of the buckets
+    static uint32_t LogBucket(uint64_t magnitude);
 
     // mempool's "mapLinks"
     std::reference_wrapper<const CTxMemPool::txlinksMap> links;
     // function calculates transaction worth, tx with lower worth will be evicted first
     Evaluator evaluator;
 
-    // class that represents estimated worth of the transaction
-    class EvalResult
+    // tracked candidate, the score is evaluated when the candidate is inserted and is not changed afterwards
+    struct Candidate
     {
-        // the score of the entry, transactions with lower score will be evicted first.
-        // score should not be modified after it is initialized, if the score needs to be changed, a new EvalResult should be added and this one marked as invalid
-        int64_t score = 0;
-        // the entry for which the score is calculated, should not be modified. this iterator might be invalid if the entry is removed from the mempool
+        int64_t score;
         CTxMemPool::txiter entry;
-        // pointer to pointer to this object in the "entries" map. it tracks our position in the vector (heap).
-        // if the value is nullptr the object is expired (not tracked any more) and not referenced in the map any more
-        EvalResult** ptrToMe;
-    public:
-
-        EvalResult(CTxMemPool::txiter _entry, Evaluator& evaluator, EvalResult*& _ptrToMe )
-            :score{evaluator(_entry)}
-            ,entry{_entry}
-            ,ptrToMe{&_ptrToMe}
-        {
-            *ptrToMe = this;
-        }
-
-        EvalResult(EvalResult&& other)
-            :score{other.score}
-            ,entry{other.entry}
-            ,ptrToMe{other.ptrToMe}
-        {
-            if(ptrToMe != nullptr)
-            {
-                *ptrToMe = this;
-                other.ptrToMe = nullptr;
-            }
-        }
-
-        EvalResult& operator=(EvalResult&& other)
-        {
-            score = other.score;
-            entry = other.entry;
-            ptrToMe = other.ptrToMe;
-            if(ptrToMe != nullptr)
-            {
-                *ptrToMe = this;
-                other.ptrToMe = nullptr;
-            }
-            return *this;
-        }
-
-        EvalResult(const EvalResult&) = delete;
-        EvalResult& operator=(const EvalResult&) = delete;
-
-        CTxMemPool::txiter Entry() const { return entry; }
-        void MarkExpired()               { ptrToMe = nullptr;}
-        bool IsExpired() const           { return ptrToMe == nullptr; }
-        int64_t Score() const            { return score; }
+        uint32_t bucket;
+        // position in the bucket's heap
+        uint32_t position;
     };
 
-    // the comparison function used for the creation of the heap, if the "first" is larger than
-    // the second it returns true. used for the heap creation to make result with lowest score on the top of the heap
-    static bool CompareResult(const EvalResult& first, const EvalResult& second);
+    // map txid to the tracked candidate. nodes of the map are not moved, so buckets can point to them.
+    std::unordered_map<TxId, Candidate, SaltedTxidHasher> entries;
+    // each bucket is a min-heap of candidates ordered by score
+    std::vector<std::vector<Candidate*>> buckets;
+    // bit set of non-empty buckets
+    std::array<uint64_t, (BUCKET_COUNT + 63) / 64> occupied {};
 
-    // vector that represents the heap of the evaluation results, the most worthless entry is on the top
-    std::vector<EvalResult> heap;
-    // map txid to the representing evaluation result. as the evaluation result moves inside heap this ptr will be changed.
-    // when removing a result from this map it should be marked as expired first
-    std::unordered_map<TxId, EvalResult*, SaltedTxidHasher> entries;
+    // moves the candidate up or down the heap of its bucket until the heap is restored
+    void SiftUp(std::vector<Candidate*>& bucket, uint32_t position);
+    void SiftDown(std::vector<Candidate*>& bucket, uint32_t position);
+    // index of the non-empty bucket with lowest scores
+    uint32_t LowestBucket() const;
 
-    // adds entry to the "heap" and "entries"
+    // adds entry to the "buckets" and "entries"
     void InsertEntry(CTxMemPool::txiter entry);
-    // marks the entry as expired
+    // removes the entry from the "buckets" and "entries"
     void ExpireEntry(const TxId& tx);
-    // pops expired transactions from the top of the heap, if the ratio between the size
-    // of the expired and non-expired entries is larger than MAX_INVALID_TO_VALID_RATIO the "heap" will
-    // be filtered for the expired transaction and heap structure will be recreated
-    void PopExpired();
 
     // direct parents of the tx
     const CTxMemPool::setEntries& GetParentsNoGroup(CTxMemPool::txiter entry) const;
@@ -114,8 +79,11 @@ private:
 
 
 public:
+    // maps the score to the bucket, buckets with lower index hold lower scores
+    static uint32_t BucketIndex(int64_t score);
+
     // constructor, Takes reference to the mempool's mapLinks, and evaluator which is the function
-    // that maps transaction iterator to double, where resulting double is worth of the transaction.
+    // that maps transaction iterator to int64_t, where resulting number is worth of the transaction.
     // transaction with lower worth will be evicted sooner
     CEvictionCandidateTracker(CTxMemPool::txlinksMap& _links, Evaluator _evaluator);
 
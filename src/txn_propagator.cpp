@@ -13,6 +13,7 @@ constexpr unsigned CTxnPropagator::DEFAULT_RUN_FREQUENCY_MILLIS;
 
 /** Constructor */
 CTxnPropagator::CTxnPropagator()
+: mFullBatchSize { CInv::estimateMaxInvElements(LEGACY_MAX_PROTOCOL_PAYLOAD_LENGTH) }
 {
     // Configure our running frequency
     auto runFreq { gArgs.GetArg("-txnpropagationfreq", DEFAULT_RUN_FREQUENCY_MILLIS) };
@@ -31,7 +32,6 @@ CTxnPropagator::~CTxnPropagator()
 /** Get the frequency we run */
 std::chrono::milliseconds CTxnPropagator::getRunFrequency() const
 {
-    std::unique_lock<std::mutex> lock { mNewTxnsMtx };
     return mRunFrequency;
 }
 
@@ -49,15 +49,48 @@ void CTxnPropagator::setRunFrequency(const std::chrono::milliseconds& freq)
 size_t CTxnPropagator::getNewTxnQueueLength() const
 {
     std::unique_lock<std::mutex> lock { mNewTxnsMtx };
-    return mNewTxns.size();
+    return mNewTxns.size() + mNewTxnsQueue.Size();
+}
+
+/** Work out how long to wait before next sending transaction invs to a peer */
+std::chrono::microseconds CTxnPropagator::getPeerInvInterval(const std::chrono::microseconds& baseInterval,
+    uint64_t sendQueueBytes, uint64_t avgBandwidth)
+{
+    if(avgBandwidth == 0 || sendQueueBytes == 0)
+    {
+        return baseInterval;
+    }
+
+    // How long it should take to send what's already queued for the peer
+    const std::chrono::microseconds maxInterval { baseInterval * MAX_PEER_INV_INTERVAL_MULTIPLIER };
+    const double drainMicros { static_cast<double>(sendQueueBytes) * 1000000 / avgBandwidth };
+    if(drainMicros >= maxInterval.count())
+    {
+        return maxInterval;
+    }
+
+    return std::max(baseInterval, std::chrono::microseconds { static_cast<int64_t>(drainMicros) });
 }
 
 /** Handle a new transaction */
 void CTxnPropagator::newTransaction(const CTxnSendingDetails& txn)
 {
-    // Add it to the list of new transactions
-    std::unique_lock<std::mutex> lock { mNewTxnsMtx };
-    mNewTxns.push_back(txn);
+    // Add it to the queue of new transactions
+    bool wasEmpty { mNewTxnsQueue.Push(txn) };
+
+    // Wake the processing thread if it might want to run early. We don't take
+    // the mutex to do this, so if the thread misses it, it will still run
+    // after the normal wait. Several threads may push at once, so more than a
+    // full batch can be queued before anyone looks; the flag makes sure just
+    // one of them does the wake up for it.
+    if(wasEmpty && readyToProcess())
+    {
+        mNewTxnsCV.notify_one();
+    }
+    else if(mNewTxnsQueue.Size() >= mFullBatchSize && !mFullBatchNotified.exchange(true))
+    {
+        mNewTxnsCV.notify_one();
+    }
 }
 
 /** Remove some old transactions */
@@ -75,6 +108,8 @@ void CTxnPropagator::removeTransactions(const std::vector<CTransactionRef>& txns
     // Filter list of new transactions
     {
         std::unique_lock<std::mutex> lock { mNewTxnsMtx };
+        mNewTxnsQueue.PopAll(mNewTxns);
+        mFullBatchNotified = false;
 
         mNewTxns.erase(
             std::remove_if(mNewTxns.begin(), mNewTxns.end(),
@@ -120,14 +155,18 @@ void CTxnPropagator::threadNewTxnHandler() noexcept
 
         while(mRunning)
         {
-            // Run every few seconds or until stopping
+            // Run every few seconds, or sooner if we've been idle or have a
+            // full batch, or until stopping
             std::unique_lock<std::mutex> lock { mNewTxnsMtx };
-            mNewTxnsCV.wait_for(lock, mRunFrequency);
+            mNewTxnsCV.wait_for(lock, mRunFrequency.load(), [this]() { return !mRunning || readyToProcess(); });
+            mNewTxnsQueue.PopAll(mNewTxns);
+            mFullBatchNotified = false;
             if(mRunning && !mNewTxns.empty())
             {
                 // Process all new transactions
                 LogPrint(BCLog::TXNPROP, "Got %d new transactions\n", mNewTxns.size());
                 processNewTransactions();
+                mLastRunTime = std::chrono::steady_clock::now();
             }
         }
 
@@ -139,6 +178,22 @@ void CTxnPropagator::threadNewTxnHandler() noexcept
     }
 }
 
+/**
+* Whether we should process new transactions now rather than waiting; either
+* because we have a full batch, or because we've been idle for at least a run
+* period and so can send them straight away.
+*/
+bool CTxnPropagator::readyToProcess() const
+{
+    size_t queued { mNewTxnsQueue.Size() };
+    if(queued >= mFullBatchSize)
+    {
+        return true;
+    }
+
+    return queued > 0 && std::chrono::steady_clock::now() - mLastRunTime.load() >= mRunFrequency.load();
+}
+
 /**
 * Process all new transactions.
 * Already holds mNewTxnsMtx.
@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include "mpsc_queue.h"
 #include "txn_sending_details.h"
 
 #include <atomic>
@@ -18,6 +19,11 @@
 /**
 * A class for tracking new transactions that need propagating out to
 * our peers.
+*
+* New transactions are queued on a lock free queue, so the validator never
+* waits for us. They are handed on to our peers in batches; at most every run
+* period while we're busy, but straight away if we've been idle or if a full
+* inv message worth have built up.
 */
 class CTxnPropagator final
 {
@@ -49,6 +55,18 @@ class CTxnPropagator final
     /** Get the number of queued new transactions awaiting processing */
     size_t getNewTxnQueueLength() const;
 
+    /**
+    * Work out how long to wait before next sending transaction invs to a peer.
+    * If the peer's send queue would take longer than the base interval to
+    * drain at the bandwidth we see from it, wait longer so more invs get
+    * coalesced into each message.
+    */
+    static std::chrono::microseconds getPeerInvInterval(const std::chrono::microseconds& baseInterval,
+        uint64_t sendQueueBytes, uint64_t avgBandwidth);
+
+    /** Most we will stretch a peer's inv interval by */
+    static constexpr unsigned MAX_PEER_INV_INTERVAL_MULTIPLIER {4};
+
   private:
 
     /** Thread entry point for new transaction queue handling */
@@ -57,11 +75,25 @@ class CTxnPropagator final
     /** Process all newly arrived transactions */
     void processNewTransactions();
 
+    /** Whether we should process new transactions now rather than waiting */
+    bool readyToProcess() const;
+
 
-    /** List of new transactions that need processing */
+    /** Queue of new transactions pushed to us */
+    MPSCQueue<CTxnSendingDetails> mNewTxnsQueue {};
+
+    /** List of new transactions taken from the queue that need processing */
     std::vector<CTxnSendingDetails> mNewTxns {};
     mutable std::mutex mNewTxnsMtx {};
 
+    /** When we last processed new transactions */
+    std::atomic<std::chrono::steady_clock::time_point> mLastRunTime {};
+
+    /** Number of new transactions that fill an inv message */
+    const size_t mFullBatchSize;
+    /** Whether the processing thread was woken for the full batch now queued */
+    std::atomic<bool> mFullBatchNotified {false};
+
     /** Our main thread */
     std::thread mNewTxnsThread {};
     std::condition_variable mNewTxnsCV {} ;
@@ -71,6 +103,6 @@ class CTxnPropagator final
 
     /** Frequency we run (defaults to 1 second) */
     static constexpr unsigned DEFAULT_RUN_FREQUENCY_MILLIS {250};
-    std::chrono::milliseconds mRunFrequency {DEFAULT_RUN_FREQUENCY_MILLIS};
+    std::atomic<std::chrono::milliseconds> mRunFrequency {std::chrono::milliseconds{DEFAULT_RUN_FREQUENCY_MILLIS}};
 
 };
@@ -113,18 +113,31 @@ inline constexpr std::array<char, 16> hexmap = {'0', '1', '2', '3', '4', '5', '6
 template <typename T>
 void HexStr(const T itbegin, const T itend, CTextWriter& writer, bool fSpaces = false)
 {
-    std::string rv;
-    writer.ReserveAdditional((itend - itbegin) * 3);
+    // Encode into a small buffer and hand it over in pieces, so that large
+    // inputs (whole transactions) do not cost two virtual calls per byte.
+    std::array<char, 1536> buffer;
+    size_t used {0};
+    writer.ReserveAdditional((itend - itbegin) * (fSpaces ? 3 : 2));
     for (T it = itbegin; it < itend; ++it)
     {
+        if (used + 3 > buffer.size())
+        {
+            writer.Write(buffer.data(), used);
+            used = 0;
+        }
+
         uint8_t val = uint8_t(*it);
         if (fSpaces && it != itbegin)
         {
-            writer.Write(' ');
+            buffer[used++] = ' ';
         }
 
-        writer.Write(hexmap[val >> 4]);
-        writer.Write(hexmap[val & 15]);
+        buffer[used++] = hexmap[val >> 4];
+        buffer[used++] = hexmap[val & 15];
+    }
+    if (used > 0)
+    {
+        writer.Write(buffer.data(), used);
     }
 }
 
@@ -628,8 +628,9 @@ std::vector<TxId> LimitMempoolSize(
 
     // Disk usage is eventually consistent with total usage.
     size_t usageDisk = pool.GetDiskUsage();
-    // Clamp the difference to zero to avoid nasty surprises.
-    size_t usageMemory = std::max(usageTotal, usageDisk) - usageDisk;
+    // Clamp the difference to zero to avoid nasty surprises. Prefetched copies
+    // of on-disk transactions are in memory as well.
+    size_t usageMemory = std::max(usageTotal, usageDisk) - usageDisk + pool.GetPrefetchedUsage();
 
     // Since this is called often we'll track the limit pretty close
     if (usageMemory > limits.Memory()) {
@@ -3079,6 +3080,22 @@ private:
                              "parallel script check failed");
         }
 
+        // A block that is only being checked is usually a mining candidate
+        // that will be connected for real once it is solved, on top of the
+        // same tip and so with the same script flags. The deferred checks
+        // above bypass the script cache, so record the verified transactions
+        // now to spare the solved block from running their scripts again.
+        if (fJustCheck && fScriptChecks)
+        {
+            for (const auto& txRef : block.vtx)
+            {
+                if (!txRef->IsCoinBase())
+                {
+                    AddKeyInScriptCache(GetScriptCacheKey(*txRef, flags));
+                }
+            }
+        }
+
         return true;
     }
 
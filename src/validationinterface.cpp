@@ -26,6 +26,7 @@ void RegisterValidationInterface(CValidationInterface *pwalletIn) {
     g_signals.ScriptForMining.connect(boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1));
     g_signals.NewPoWValidBlock.connect(boost::bind( &CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
     g_signals.InvalidTxMessageZMQ.connect(boost::bind( &CValidationInterface::InvalidTxMessageZMQ, pwalletIn, _1));
+    g_signals.TemplateDeltaPublished.connect(boost::bind( &CValidationInterface::TemplateDeltaPublished, pwalletIn, _1));
 }
 
 void UnregisterValidationInterface(CValidationInterface *pwalletIn) {
@@ -43,6 +44,7 @@ void UnregisterValidationInterface(CValidationInterface *pwalletIn) {
     g_signals.UpdatedBlockTip.disconnect(boost::bind( &CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
     g_signals.NewPoWValidBlock.disconnect(boost::bind( &CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
     g_signals.InvalidTxMessageZMQ.disconnect(boost::bind( &CValidationInterface::InvalidTxMessageZMQ, pwalletIn, _1));
+    g_signals.TemplateDeltaPublished.disconnect(boost::bind( &CValidationInterface::TemplateDeltaPublished, pwalletIn, _1));
 }
 
 void UnregisterAllValidationInterfaces() {
@@ -59,4 +61,5 @@ void UnregisterAllValidationInterfaces() {
     g_signals.UpdatedBlockTip.disconnect_all_slots();
     g_signals.NewPoWValidBlock.disconnect_all_slots();
     g_signals.InvalidTxMessageZMQ.disconnect_all_slots();
+    g_signals.TemplateDeltaPublished.disconnect_all_slots();
 }
@@ -24,6 +24,11 @@ class CValidationInterface;
 class CValidationState;
 class uint256;
 
+namespace mining
+{
+struct CTemplateDelta;
+}
+
 // These functions dispatch to one or all registered wallets
 
 /** Register a wallet to receive updates from core */
@@ -55,6 +60,7 @@ protected:
     virtual void NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock> &block){};
     // This function is called only when there is an active ZMQ subscription of invalid transacion ("-zmqpubinvalidtx")
     virtual void InvalidTxMessageZMQ(std::string_view message) {};
+    virtual void TemplateDeltaPublished(const std::shared_ptr<const mining::CTemplateDelta>& delta) {};
 
     friend void ::RegisterValidationInterface(CValidationInterface *);
     friend void ::UnregisterValidationInterface(CValidationInterface *);
@@ -101,6 +107,8 @@ struct CMainSignals {
     boost::signals2::signal<void(std::shared_ptr<CReserveScript> &)> ScriptForMining;
     /** Notifies listeners that a message part of the invalid transaction dump is ready to send */
     boost::signals2::signal<void(std::string_view)> InvalidTxMessageZMQ;
+    /** Notifies listeners that the block assembler has updated its block template */
+    boost::signals2::signal<void(const std::shared_ptr<const mining::CTemplateDelta>&)> TemplateDeltaPublished;
 
     /**
      * Notifies listeners that a block which builds directly on our current tip
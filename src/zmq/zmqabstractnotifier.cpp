@@ -34,3 +34,8 @@ bool CZMQAbstractNotifier::NotifyRemovedFromMempoolBlock(const uint256& txid, Me
 {
     return true;
 }
+
+bool CZMQAbstractNotifier::NotifyTemplateDelta(const mining::CTemplateDelta& delta)
+{
+    return true;
+}
@@ -12,6 +12,10 @@
 
 class CBlockIndex;
 class CZMQAbstractNotifier;
+namespace mining
+{
+struct CTemplateDelta;
+}
 
 typedef CZMQAbstractNotifier *(*CZMQNotifierFactory)();
 
@@ -38,6 +42,7 @@ public:
     virtual bool NotifyRemovedFromMempool(const uint256& txid, const MemPoolRemovalReason reason,
                                           const CTransactionConflict& conflictedWith);
     virtual bool NotifyRemovedFromMempoolBlock(const uint256& txid, const MemPoolRemovalReason reason);
+    virtual bool NotifyTemplateDelta(const mining::CTemplateDelta& delta);
 
 protected:
     void *psocket;
@@ -47,6 +47,8 @@ CZMQNotificationInterface *CZMQNotificationInterface::Create() {
         CZMQAbstractNotifier::Create<CZMQPublishRemovedFromMempoolNotifier>;
     factories["pubremovedfrommempoolblock"] =
         CZMQAbstractNotifier::Create<CZMQPublishRemovedFromMempoolBlockNotifier>;
+    factories["pubtemplatedelta"] =
+        CZMQAbstractNotifier::Create<CZMQPublishTemplateDeltaNotifier>;
 
 
     for (std::map<std::string, CZMQNotifierFactory>::const_iterator i =
@@ -178,6 +180,23 @@ void CZMQNotificationInterface::InvalidTxMessageZMQ(std::string_view message)
     }
 }
 
+void CZMQNotificationInterface::TemplateDeltaPublished(const std::shared_ptr<const mining::CTemplateDelta>& delta)
+{
+    for (auto i = notifiers.begin(); i != notifiers.end();)
+    {
+        CZMQAbstractNotifier *notifier = *i;
+        if (notifier->NotifyTemplateDelta(*delta))
+        {
+            i++;
+        }
+        else
+        {
+            notifier->Shutdown();
+            i = notifiers.erase(i);
+        }
+    }
+}
+
 void CZMQNotificationInterface::TransactionAddedToMempool(
     const CTransactionRef &ptx) {
     // Used by BlockConnected and BlockDisconnected as well, because they're all
@@ -50,6 +50,8 @@ protected:
 
     void InvalidTxMessageZMQ(std::string_view message) override;
 
+    void TemplateDeltaPublished(const std::shared_ptr<const mining::CTemplateDelta>& delta) override;
+
 private:
     CZMQNotificationInterface();
 
@@ -6,6 +6,7 @@
 
 #include "config.h"
 #include "core_io.h"
+#include "mining/template_stream.h"
 #include "rpc/server.h"
 #include "rpc/jsonwriter.h"
 #include "rpc/text_writer.h"
@@ -28,6 +29,7 @@ static const char *MSG_RAWTX = "rawtx";
 */
 static const char *MSG_DISCARDEDFROMMEMPOOL = "discardedfrommempool";
 static const char *MSG_REMOVEDFROMMEMPOOLBLOCK = "removedfrommempoolblock";
+static const char *MSG_TEMPLATEDELTA = "templatedelta";
 
 
 bool CZMQAbstractPublishNotifier::Initialize(void *pcontext, std::shared_ptr<CZMQPublisher> tspublisher) {
@@ -250,3 +252,17 @@ bool CZMQPublishTextNotifier::NotifyTextMessage(const std::string& topic, std::s
     LogPrint(BCLog::ZMQ, "zmq: Publish text with topic: %s\n", topic.c_str());
     return SendZMQMessage(topic.c_str(), message.data(), message.size());
 }
+
+bool CZMQPublishTemplateDeltaNotifier::NotifyTemplateDelta(const mining::CTemplateDelta& delta)
+{
+    LogPrint(BCLog::ZMQ, "zmq: Publish templatedelta %d\n", delta.sequence);
+
+    CStringWriter tw;
+    {
+        CJSONWriter jw(tw, false);
+        delta.ToJSON(jw);
+    }
+    std::string message = tw.MoveOutString();
+
+    return SendZMQMessage(MSG_TEMPLATEDELTA, message.data(), message.size());
+}
@@ -67,4 +67,10 @@ public:
     bool NotifyTextMessage(const std::string& topic, std::string_view message) override;
 };
 
+class CZMQPublishTemplateDeltaNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyTemplateDelta(const mining::CTemplateDelta& delta) override;
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H